@@ -29,16 +29,46 @@ CONFIG += c++14
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
+        chattab.cpp \
         dialogconf.cpp \
         dialoghelp.cpp \
         sslconn.cpp \
+        reactor.cpp \
+        transport.cpp \
+        qssltransport.cpp \
+        socktune.cpp \
+        connstate.cpp \
+        connector.cpp \
+        admission.cpp \
+        eventlog.cpp \
+        truststore.cpp \
+        mux.cpp \
+        zipcodec.cpp \
+        msgpool.cpp \
+        utf8.cpp \
+        stats.cpp \
         typesimpl.cpp
 
 HEADERS += \
         mainwindow.h \
+        chattab.h \
         dialogconf.h \
         dialoghelp.h \
         sslconn.h \
+        reactor.h \
+        transport.h \
+        qssltransport.h \
+        socktune.h \
+        connstate.h \
+        connector.h \
+        admission.h \
+        eventlog.h \
+        truststore.h \
+        mux.h \
+        zipcodec.h \
+        msgpool.h \
+        utf8.h \
+        stats.h \
         types.h
 
 FORMS += \
@@ -66,6 +96,6 @@ defined(OPENSSL_ALT_PATH, var) {
   }
 }
 
-LIBS += -lssl -lcrypto
+LIBS += -lssl -lcrypto -lz
 
 DISTFILES +=
@@ -0,0 +1,216 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "admission.h"
+
+#include <cstring>
+#include <cstdlib>
+
+#ifndef WINDOWS_OPENSSL
+    #include <netinet/in.h>
+#endif
+
+#include "stats.h"
+#include "eventlog.h"
+
+namespace admission {
+
+    using std::string;
+    using std::to_string;
+    using std::lock_guard;
+    using std::mutex;
+    using std::strtoul;
+
+    using stats::nowUs;
+
+    static bool parseUInt(const string& text, unsigned int& value) noexcept{
+        char           *end { nullptr };
+        unsigned long   val { strtoul(text.c_str(), &end, 10) };
+
+        if(text.empty() || *end != 0 || val > 0xFFFFFFFFUL)
+            return false;
+
+        value = static_cast<unsigned int>(val);
+        return true;
+    }
+
+    static bool parsePair(const string& text, unsigned int& rate, unsigned int& burst) noexcept{
+        size_t  slash { text.find('/') };
+
+        try{
+            return slash != string::npos && parseUInt(text.substr(0, slash), rate) &&
+                   parseUInt(text.substr(slash + 1), burst) && rate > 0 && burst > 0;
+        }catch(...){
+            return false;
+        }
+    }
+
+    bool parseConfig(const string& spec, AdmitConfig& cfg, string& err) noexcept{
+        AdmitConfig  res { ADMIT_IP_RATE, ADMIT_IP_BURST, ADMIT_GLOBAL_RATE, ADMIT_GLOBAL_BURST,
+                           ADMIT_MAX_PENDING, ADMIT_TIMEOUT };
+
+        try{
+            size_t  pos { 0 };
+            while(pos <= spec.size()){
+                size_t  next  { spec.find(',', pos) };
+                if(next == string::npos)
+                    next = spec.size();
+
+                string  item  { spec.substr(pos, next - pos) },
+                        key   { item.substr(0, item.find('=')) },
+                        value { item.find('=') == string::npos ? string() : item.substr(item.find('=') + 1) };
+                bool    ok    { false };
+                pos = next + 1;
+
+                if(item.empty())                continue;
+                else if(key == "ip")            ok = parsePair(value, res.ipRate, res.ipBurst);
+                else if(key == "global")        ok = parsePair(value, res.globalRate, res.globalBurst);
+                else if(key == "pending")       ok = parseUInt(value, res.maxPending) && res.maxPending > 0;
+                else if(key == "timeout")       ok = parseUInt(value, res.timeout) && res.timeout > 0;
+
+                if(!ok){
+                    err = string("Invalid admission setting: ").append(item);
+                    return false;
+                }
+            }
+        }catch(...){
+            err = "Admission settings parse error.";
+            return false;
+        }
+
+        cfg = res;
+        return true;
+    }
+
+    Admission::Admission(void)
+        : config{ ADMIT_IP_RATE, ADMIT_IP_BURST, ADMIT_GLOBAL_RATE, ADMIT_GLOBAL_BURST,
+                  ADMIT_MAX_PENDING, ADMIT_TIMEOUT },
+          sources(ADMIT_TABLE_SIZE, Bucket{ 0, 0.0, 0 }),
+          global{ 0, 0.0, 0 },
+          pending{0},
+          admitted{0},
+          rejectedSource{0},
+          rejectedGlobal{0},
+          rejectedPending{0}
+    {
+        const char  *envconf { getenv(ADMIT_ENV) };
+        string      err;
+        if(envconf != nullptr && !parseConfig(envconf, config, err))
+            eventlog::warn("admission", err.append(": using the defaults."));
+
+        global.tokens = config.globalBurst;
+    }
+
+    bool Admission::take(Bucket& bucket, unsigned int rate, unsigned int burst, long long now) noexcept{
+        bucket.tokens += static_cast<double>(now - bucket.last) * rate / 1000000.0;
+        if(bucket.tokens > burst)
+            bucket.tokens = burst;
+        bucket.last = now;
+
+        if(bucket.tokens < 1.0)
+            return false;
+
+        bucket.tokens -= 1.0;
+        return true;
+    }
+
+    // A source not in the table takes a free slot of the ADMIT_PROBES from
+    // its hashed one, else the one idle the longest: a collision never
+    // refills a source's bucket, and a source is forgotten only once the
+    // others sharing its slots all came after it. The global bucket still applies.
+    Verdict Admission::admit(const struct sockaddr* addr, socklen_t len) noexcept{
+        static const unsigned char  mapped[12] { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };   // ::ffff:0:0/96
+        unsigned long long          key  { 0 };
+        long long                   now  { nowUs() };
+
+        if(addr->sa_family == AF_INET && len >= static_cast<socklen_t>(sizeof(struct sockaddr_in))){
+            const auto  *in4 { reinterpret_cast<const struct sockaddr_in*>(addr) };
+            key = 0x400000000ULL | ntohl(in4->sin_addr.s_addr);
+        }else if(addr->sa_family == AF_INET6 && len >= static_cast<socklen_t>(sizeof(struct sockaddr_in6))){
+            const auto           *in6   { reinterpret_cast<const struct sockaddr_in6*>(addr) };
+            const unsigned char  *bytes { in6->sin6_addr.s6_addr };
+            if(memcmp(bytes, mapped, sizeof(mapped)) == 0)
+                key = 0x400000000ULL | static_cast<unsigned long long>(bytes[12]) << 24 | static_cast<unsigned long long>(bytes[13]) << 16 |
+                                       static_cast<unsigned long long>(bytes[14]) << 8 | bytes[15];
+            else
+                memcpy(&key, bytes, sizeof(key));
+        }
+
+        // Checked and taken under the lock: concurrent workers can't pass the cap together.
+        lock_guard<mutex>  lock(mtx);
+        if(pending >= config.maxPending){
+            rejectedPending++;
+            return REJECTED_PENDING;
+        }
+
+        size_t   home   { static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 52) };
+        Bucket   *source { nullptr },
+                 *oldest { nullptr };
+
+        for(size_t probe = 0; probe < ADMIT_PROBES && source == nullptr; probe++){
+            Bucket&  slot { sources[(home + probe) & (ADMIT_TABLE_SIZE - 1)] };
+            if(slot.last != 0 && slot.key == key)
+                source = &slot;
+            else if(oldest == nullptr || slot.last < oldest->last)
+                oldest = &slot;
+        }
+        if(source == nullptr){
+            source  = oldest;
+            *source = { key, static_cast<double>(config.ipBurst), now };
+        }
+
+        if(!take(*source, config.ipRate, config.ipBurst, now)){
+            rejectedSource++;
+            return REJECTED_SOURCE;
+        }
+        if(!take(global, config.globalRate, config.globalBurst, now)){
+            rejectedGlobal++;
+            return REJECTED_GLOBAL;
+        }
+
+        pending++;
+        admitted++;
+        return ADMITTED;
+    }
+
+    // Paired with an ADMITTED verdict: callers track whether they hold a slot.
+    void Admission::release(void) noexcept{
+        pending--;
+    }
+
+    unsigned int Admission::getTimeout(void) const noexcept{
+        return config.timeout;
+    }
+
+    string Admission::getStats(void) const noexcept{
+        string  res;
+
+        try{
+            res.append("Admission - admitted: ").append(to_string(admitted))
+               .append(" handshakes in progress: ").append(to_string(pending))
+               .append(" rejected per source: ").append(to_string(rejectedSource))
+               .append(" global: ").append(to_string(rejectedGlobal))
+               .append(" pending cap: ").append(to_string(rejectedPending));
+        }catch(...){
+            res = "getStats error.";
+        }
+
+        return res;
+    }
+
+} // End namespace admission
@@ -0,0 +1,99 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef WINDOWS_OPENSSL
+    #include <sys/socket.h>
+#else
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#endif
+
+#define ADMIT_ENV "SCADMIT"           // ip=rate/burst,global=rate/burst,pending=n,timeout=s
+#define ADMIT_IP_RATE 5               // Handshakes per second per source address
+#define ADMIT_IP_BURST 20
+#define ADMIT_GLOBAL_RATE 500         // Handshakes per second for the whole listener
+#define ADMIT_GLOBAL_BURST 1000
+#define ADMIT_MAX_PENDING 256         // Handshakes in progress at once
+#define ADMIT_TIMEOUT 10              // Seconds a handshake may take
+#define ADMIT_TABLE_SIZE 4096         // Per source buckets, hashed
+#define ADMIT_PROBES 4                // Slots a source may take, from its hashed one on
+
+namespace admission {
+
+enum Verdict { ADMITTED, REJECTED_SOURCE, REJECTED_GLOBAL, REJECTED_PENDING };
+
+struct AdmitConfig {
+    unsigned int    ipRate,
+                    ipBurst,
+                    globalRate,
+                    globalBurst,
+                    maxPending,
+                    timeout;
+};
+
+bool  parseConfig(const std::string& spec, AdmitConfig& cfg,
+                  std::string& err)                                          noexcept;
+
+// Token buckets checked right after accept(), before any TLS object is
+// built: one per source address (IPv6 by /64, as a host usually owns the
+// whole prefix, IPv4-mapped IPv6 as the IPv4 address) and one for the
+// listener, plus a cap on handshakes in progress. Each admitted connection
+// must be released once its handshake is over, whatever the outcome.
+
+class Admission {
+    public:
+        Admission(void);
+
+        Admission(const Admission&)                                          = delete;
+        Admission& operator=(const Admission&)                               = delete;
+
+        Verdict             admit(const struct sockaddr* addr,
+                                  socklen_t len)                             noexcept;
+        void                release(void)                                    noexcept;
+        unsigned int        getTimeout(void)                     const       noexcept;
+        std::string         getStats(void)                       const       noexcept;
+
+    private:
+        struct Bucket {
+            unsigned long long  key;
+            double              tokens;
+            long long           last;
+        };
+
+        AdmitConfig                     config;
+        std::vector<Bucket>             sources;
+        Bucket                          global;
+        mutable std::mutex              mtx;
+        std::atomic<unsigned int>       pending;
+        std::atomic<unsigned long long> admitted,
+                                        rejectedSource,
+                                        rejectedGlobal,
+                                        rejectedPending;
+
+        bool                take(Bucket& bucket, unsigned int rate,
+                                 unsigned int burst, long long now)          noexcept;
+};
+
+} // End namespace admission
@@ -0,0 +1,404 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "asyncconn.h"
+
+#include "eventlog.h"
+#include "stats.h"
+
+namespace sslconn {
+
+    using std::string;
+    using std::deque;
+    using std::mutex;
+    using std::lock_guard;
+    using std::unique_lock;
+    using std::thread;
+    using std::shared_ptr;
+    using std::make_shared;
+    using std::atomic;
+
+    using stats::nowUs;
+
+    struct AsyncClient::State {
+        ChatContext             context;
+        SslConn                 conn;
+        mutex                   mtx;          // inbox and waiters: the reactor and the callers.
+        deque<string>           inbox;
+        deque<ReceiveHandler>   waiters;
+        shared_ptr<ReceiveHandler>
+                                stream;       // onReceive(): every message, the inbox stays empty.
+        std::vector<char>       buffer;       // Reactor thread only, as lastBeat and partial.
+        long long               lastBeat;
+        string                  partial;      // A message whose next record is still to come.
+        bool                    discard;      // Over MESSAGE_MAX: its records are dropped up to the last.
+        atomic<bool>            attached,
+                                closed,
+                                ended;        // The stream handler was told.
+        atomic<unsigned long long>
+                                dropped;
+
+        State(void)
+            : conn{context},
+              buffer(RECORD_FULL + 1),
+              lastBeat{0},
+              discard{false},
+              attached{false},
+              closed{false},
+              ended{false},
+              dropped{0}
+        {}
+    };
+
+    namespace {
+
+        using StatePtr = shared_ptr<AsyncClient::State>;
+
+        // Receives waiting fail, the stream handler is told once.
+        void failWaiters(const StatePtr& st) noexcept{
+            deque<ReceiveHandler>       failed;
+            shared_ptr<ReceiveHandler>  stream;
+            {
+                lock_guard<mutex> lock(st->mtx);
+                failed.swap(st->waiters);
+                if(st->stream && !st->ended.exchange(true))
+                    stream = st->stream;
+            }
+
+            for(auto& done : failed)
+                done(false, string());
+            if(stream)
+                (*stream)(false, string());
+        }
+
+        // To the stream handler, or the oldest receive waiting, else to the inbox.
+        void deliver(const StatePtr& st, string&& msg) noexcept{
+            ReceiveHandler              done;
+            shared_ptr<ReceiveHandler>  stream;
+            {
+                lock_guard<mutex> lock(st->mtx);
+                if(st->stream){
+                    stream = st->stream;
+                }else if(st->waiters.empty()){
+                    if(st->inbox.size() >= ASYNC_INBOX){
+                        st->inbox.pop_front();
+                        st->dropped++;
+                    }
+                    st->inbox.push_back(std::move(msg));
+                    return;
+                }else{
+                    done = std::move(st->waiters.front());
+                    st->waiters.pop_front();
+                }
+            }
+
+            if(stream)
+                (*stream)(true, msg);
+            else
+                done(true, msg);
+        }
+
+        // Reactor handler: the records already arrived, or the heartbeat on ticks.
+        void serve(const StatePtr& st, bool ready) noexcept{
+            if(st->context.getStatus() != connected){
+                failWaiters(st);
+                return;
+            }
+
+            if(ready){
+                for(int count = 0; count < REACTOR_BATCH; count++){
+                    int  len { 0 };
+                    if(!st->conn.readIncoming(st->buffer.data(), static_cast<int>(st->buffer.size()), len)){
+                        failWaiters(st);
+                        return;
+                    }
+                    if(len == 0)
+                        return;
+                    if(st->context.isControlMsg())
+                        continue;
+
+                    // The records of a long message are put back together first.
+                    bool  more { st->context.isPartialMsg() };
+                    if(st->discard || st->partial.size() + static_cast<size_t>(len) > MESSAGE_MAX){
+                        st->discard = more;
+                        st->partial.clear();
+                        continue;
+                    }
+                    try{
+                        st->partial.append(st->buffer.data(), static_cast<size_t>(len));
+                    }catch(...){
+                        eventlog::error("async", "Receive allocation failed.");
+                        st->discard = more;
+                        st->partial.clear();
+                        continue;
+                    }
+                    if(!more){
+                        string  msg;
+                        msg.swap(st->partial);
+                        deliver(st, std::move(msg));
+                    }
+                }
+                return;
+            }
+
+            long long  now { nowUs() };
+            if(st->context.getHbInterval() == 0 || now - st->lastBeat < static_cast<long long>(st->context.getHbInterval()) * 1000)
+                return;
+
+            st->lastBeat = now;
+            if(!st->conn.peerAlive()){
+                st->conn.abortConnection();
+                eventlog::warn("async", "Peer not responding.");
+                return;
+            }
+            static_cast<void>(st->conn.sendHeartbeat());
+        }
+
+    } // End anonymous namespace
+
+    AsyncEngine::AsyncEngine(void)
+        : running{false}
+    {}
+
+    AsyncEngine::~AsyncEngine(void){
+        stop();
+    }
+
+    bool AsyncEngine::start(void) noexcept{
+        {
+            lock_guard<mutex> lock(jobMtx);
+            if(running)
+                return true;
+            running = true;
+        }
+
+        if(!reactor.start()){
+            stop();
+            return false;
+        }
+
+        try{
+            for(int idx = 0; idx < ASYNC_CONNECT_THREADS; idx++)
+                workers.emplace_back(&AsyncEngine::work, this);
+        }catch(...){
+            eventlog::error("async", "Can't start the connect threads.");
+            stop();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Connects already queued still complete, then the reactor runs the
+    // completions posted so far. Later requests fail or are dropped.
+    void AsyncEngine::stop(void) noexcept{
+        {
+            lock_guard<mutex> lock(jobMtx);
+            running = false;
+        }
+
+        jobReady.notify_all();
+        for(auto& worker : workers)
+            if(worker.joinable())
+                worker.join();
+        workers.clear();
+
+        reactor.stop();
+    }
+
+    Reactor& AsyncEngine::getReactor(void) noexcept{
+        return reactor;
+    }
+
+    bool AsyncEngine::runJob(AsyncJob&& job) noexcept{
+        try{
+            lock_guard<mutex> lock(jobMtx);
+            if(!running)
+                return false;
+            jobs.push_back(std::move(job));
+        }catch(...){
+            return false;
+        }
+
+        jobReady.notify_one();
+        return true;
+    }
+
+    void AsyncEngine::work(void) noexcept{
+        for(;;){
+            AsyncJob  job;
+            {
+                unique_lock<mutex> lock(jobMtx);
+                jobReady.wait(lock, [this](){ return !running || !jobs.empty(); });
+                if(jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            try{
+                job();
+            }catch(...){
+                eventlog::error("async", "Connect job failed.");
+            }
+        }
+    }
+
+    AsyncClient::AsyncClient(AsyncEngine& eng)
+        : engine{eng},
+          state{make_shared<State>()}
+    {}
+
+    // The session ends on the reactor thread; the state outlives this
+    // object until every completion queued for it has run.
+    AsyncClient::~AsyncClient(void){
+        if(!state->closed)
+            close();
+    }
+
+    // The connect blocks a connect thread; once established the session
+    // is attached to the reactor, unless close() came first.
+    void AsyncClient::connect(const string& host, const string& port, const ConnectHandler& done) noexcept{
+        StatePtr  st      { state };
+        Reactor   &react  { engine.getReactor() };
+
+        bool queued { engine.runJob([st, &react, host, port, done](){
+            st->context.setIp(host);
+            st->context.setPort(port);
+            st->context.setServer(CLIENT);
+            static_cast<void>(st->conn.configure());
+
+            bool  ok { !st->closed && st->context.getStatus() == connected };
+            if(ok){
+                st->attached = react.attach(st->conn, [st](bool ready){ serve(st, ready); });
+                ok           = st->attached;
+            }
+            if(ok && st->closed){
+                react.detach(st->conn);
+                st->conn.disconnect();
+                ok = false;
+            }
+
+            if(!ok && st->context.getStatus() == connected)
+                st->conn.disconnect();
+
+            if(done)
+                done(ok, ok ? string() : st->closed ? string("Closed.") : st->context.getErrMsg());
+        }) };
+
+        if(!queued && done)
+            done(false, "Engine not running.");
+    }
+
+    void AsyncClient::send(string msg, const SendHandler& done) noexcept{
+        StatePtr  st { state };
+
+        bool queued { engine.getReactor().post([st, msg, done](){
+            bool  ok { st->context.getStatus() == connected && st->conn.queueMessage(msg) };
+            if(done)
+                done(ok);
+        }) };
+
+        if(!queued && done)
+            done(false);
+    }
+
+    // Taken from the inbox if a message is already there, else the next one to arrive.
+    void AsyncClient::receive(const ReceiveHandler& done) noexcept{
+        StatePtr  st { state };
+
+        bool queued { engine.getReactor().post([st, done](){
+            string  msg;
+            bool    got { false };
+            {
+                lock_guard<mutex> lock(st->mtx);
+                if(!st->inbox.empty()){
+                    msg = std::move(st->inbox.front());
+                    st->inbox.pop_front();
+                    got = true;
+                }else if(st->context.getStatus() == connected){
+                    st->waiters.push_back(done);
+                    return;
+                }
+            }
+            done(got, msg);
+        }) };
+
+        if(!queued)
+            done(false, string());
+    }
+
+    // Messages already in the inbox go to the handler first.
+    void AsyncClient::onReceive(const ReceiveHandler& handler) noexcept{
+        StatePtr  st { state };
+
+        bool queued { engine.getReactor().post([st, handler](){
+            deque<string>  backlog;
+            {
+                lock_guard<mutex> lock(st->mtx);
+                try{
+                    st->stream = handler ? std::make_shared<ReceiveHandler>(handler) : nullptr;
+                }catch(...){
+                    eventlog::error("async", "Receive handler allocation failed.");
+                    return;
+                }
+                if(st->stream)
+                    backlog.swap(st->inbox);
+            }
+
+            for(const auto& msg : backlog)
+                handler(true, msg);
+        }) };
+
+        if(!queued && handler)
+            handler(false, string());
+    }
+
+    // close_notify, then the session is freed: pending receives fail.
+    // A closed client stays closed.
+    void AsyncClient::close(const CloseHandler& done) noexcept{
+        StatePtr  st     { state };
+        Reactor   &react { engine.getReactor() };
+
+        st->closed = true;
+        bool queued { react.post([st, &react, done](){
+            st->conn.disconnect();
+            if(st->attached)
+                react.detach(st->conn);
+            st->attached = false;
+            failWaiters(st);
+            if(done)
+                done();
+        }) };
+
+        if(!queued){
+            st->conn.disconnect();
+            if(done)
+                done();
+        }
+    }
+
+    bool AsyncClient::isConnected(void) const noexcept{
+        return !state->closed && state->context.getStatus() == connected;
+    }
+
+    unsigned long long AsyncClient::getDropped(void) const noexcept{
+        return state->dropped;
+    }
+
+} // End namespace sslconn
@@ -0,0 +1,184 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+    #include <coroutine>
+    #define SC_ASYNC_COROUTINES
+#endif
+
+#include "reactor.h"
+
+#define ASYNC_CONNECT_THREADS 2       // Blocking connects (the Happy Eyeballs race) run here, not in the reactor
+#define ASYNC_INBOX 1024              // Messages kept for receives not yet requested: older ones are dropped
+
+namespace sslconn {
+
+// Completions run on the engine's threads, never inside the call that
+// requested them: keep them short, they hold back every other session.
+using ConnectHandler = std::function<void(bool ok, const std::string& err)>;
+using SendHandler    = std::function<void(bool ok)>;
+using ReceiveHandler = std::function<void(bool ok, const std::string& msg)>;
+using CloseHandler   = std::function<void(void)>;
+using AsyncJob       = std::function<void(void)>;
+
+// The event loop behind every AsyncClient: one Reactor for the sockets
+// and the completions, and a few threads for the connects.
+
+class AsyncEngine {
+    public:
+        AsyncEngine(void);
+        ~AsyncEngine(void);
+
+        AsyncEngine(const AsyncEngine&)                                      = delete;
+        AsyncEngine& operator=(const AsyncEngine&)                           = delete;
+
+        bool            start(void)                                          noexcept;
+        void            stop(void)                                           noexcept;
+        Reactor&        getReactor(void)                                     noexcept;
+        bool            runJob(AsyncJob&& job)                               noexcept;
+
+    private:
+        Reactor                    reactor;
+        std::mutex                 jobMtx;
+        std::condition_variable    jobReady;
+        std::deque<AsyncJob>       jobs;
+        std::vector<std::thread>   workers;
+        bool                       running;
+
+        void            work(void)                                           noexcept;
+};
+
+// A client session without widgets or threads of its own: connect, send
+// and receive return at once and complete through their handler. Messages
+// are plain, as a peer with SCMUX=0 sends them; one longer than a record
+// is put back together before delivery (SCMSG). Received ones wait in a
+// bounded inbox until a receive() takes them, or go straight to the
+// onReceive() handler, which is cheaper for streams. send() never waits
+// for the socket: the message is queued on the session, up to
+// SEND_BACKLOG bytes, and written as the socket takes it; its handler
+// tells whether it was queued.
+//
+//     client.connect("chat.example", "8866", [&](bool ok, const std::string& err){
+//         if(ok) client.send("disk full on db3");
+//     });
+//
+// With C++20 coroutines the same calls can be awaited:
+//
+//     auto res = co_await client.awaitConnect("chat.example", "8866");
+//     bool sent = co_await client.awaitSend("disk full on db3");
+
+class AsyncClient {
+    public:
+        explicit AsyncClient(AsyncEngine& eng);
+        ~AsyncClient(void);
+
+        AsyncClient(const AsyncClient&)                                      = delete;
+        AsyncClient& operator=(const AsyncClient&)                           = delete;
+
+        void            connect(const std::string& host, const std::string& port,
+                                const ConnectHandler& done)                  noexcept;
+        void            send(std::string msg,
+                             const SendHandler& done=nullptr)                noexcept;
+        void            receive(const ReceiveHandler& done)                  noexcept;
+        void            onReceive(const ReceiveHandler& handler)             noexcept;
+        void            close(const CloseHandler& done=nullptr)              noexcept;
+        bool            isConnected(void)                        const       noexcept;
+        unsigned long long
+                        getDropped(void)                         const       noexcept;
+
+        struct State;
+
+#ifdef SC_ASYNC_COROUTINES
+        struct ConnectResult {
+            bool            ok;
+            std::string     err;
+        };
+
+        struct ReceiveResult {
+            bool            ok;
+            std::string     msg;
+        };
+
+        // Resumes the coroutine on the thread that completes the request.
+        template<typename Result>
+        class Awaitable {
+            public:
+                using Starter = std::function<void(std::function<void(Result)>)>;
+
+                explicit Awaitable(Starter&& st)
+                    : starter{std::move(st)},
+                      result{}
+                {}
+
+                bool  await_ready(void)                                const noexcept{
+                    return false;
+                }
+
+                // The completion may resume, and so destroy, this awaitable
+                // before the starter returns: it runs from a local copy.
+                void  await_suspend(std::coroutine_handle<> handle){
+                    Starter  start { std::move(starter) };
+                    start([this, handle](Result res){ result = std::move(res); handle.resume(); });
+                }
+
+                Result  await_resume(void){
+                    return std::move(result);
+                }
+
+            private:
+                Starter     starter;
+                Result      result;
+        };
+
+        Awaitable<ConnectResult>  awaitConnect(const std::string& host, const std::string& port){
+            return Awaitable<ConnectResult>([this, host, port](std::function<void(ConnectResult)> done){
+                connect(host, port, [done](bool ok, const std::string& err){ done({ ok, err }); });
+            });
+        }
+
+        Awaitable<bool>  awaitSend(std::string msg){
+            return Awaitable<bool>([this, msg](std::function<void(bool)> done){
+                send(msg, [done](bool ok){ done(ok); });
+            });
+        }
+
+        Awaitable<ReceiveResult>  awaitReceive(void){
+            return Awaitable<ReceiveResult>([this](std::function<void(ReceiveResult)> done){
+                receive([done](bool ok, const std::string& msg){ done({ ok, msg }); });
+            });
+        }
+#endif
+
+    private:
+        AsyncEngine                &engine;
+        std::shared_ptr<State>     state;         // Shared with the pending completions.
+};
+
+} // End namespace sslconn
@@ -0,0 +1,274 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "chattab.h"
+
+#include <cstring>
+
+#include <QGridLayout>
+#include <QKeyEvent>
+#include <QScrollBar>
+
+#include "qssltransport.h"
+
+using std::string;
+using std::to_string;
+
+ReturnPress::ReturnPress(QObject *parent)
+    : QObject(parent)
+{}
+
+bool ReturnPress::eventFilter(QObject *obj, QEvent *event){
+    if (event->type() == QEvent::KeyPress) {
+        QKeyEvent *key = static_cast<QKeyEvent *>(event);
+        if((key->key()==Qt::Key_Enter) || (key->key()==Qt::Key_Return) ) {
+             emit returnKeyPressed();
+             return true;
+        }
+    }
+    return QObject::eventFilter(obj, event);
+}
+
+ChatTab::ChatTab(sslconn::Reactor& react, QWidget *parent) :
+    QWidget(parent),
+    received{new QPlainTextEdit(this)},
+    sent{new QTextEdit(this)},
+    returnPress{new ReturnPress(this)},
+    diagConf{new DialogConf(this)},
+    statusText{"Disconnected"},
+    peerPrompt{"peer: "},
+    blankLine{" "},
+    rendered{0}
+{
+    rxText.reserve(MSGPOOL_SLOT_SIZE + UTF8_MAX_PENDING);
+
+    QGridLayout  *layout { new QGridLayout(this) };
+    received->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    received->setReadOnly(true);
+    sent->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+    sent->setMaximumHeight(100);
+    layout->addWidget(received, 0, 0);
+    layout->addWidget(sent, 1, 0);
+
+    qRegisterMetaType<std::string>();
+
+    connect(this, &ChatTab::updateMsgSnd,            this, &ChatTab::appendMsgSnd);
+    connect(this, &ChatTab::updateMsgReady,          this, &ChatTab::appendMsgReady);
+    connect(this, &ChatTab::updateMsgErr,            this, &ChatTab::appendMsgErr);
+    connect(this, &ChatTab::updateLinkStat,          this, &ChatTab::appendLinkStat);
+    connect(this, &ChatTab::updateState,             this, &ChatTab::appendState);
+
+    // Events may come from the reactor thread: the signals queue them to the GUI thread.
+    sslconn::TransportEvents  events;
+    events.state    = [this](sslconn::Status from, sslconn::Status to){
+                          emit updateState(static_cast<int>(from), static_cast<int>(to));
+                          if(to == sslconn::connected)
+                              emit updateMsgStat();
+                      };
+    events.received = [this](const char* data, int len){ deliver(data, len); };
+    events.error    = [this](const std::string& err){ emit updateMsgErr(err); };
+    events.linkStat = [this](){ emit updateLinkStat(); };
+
+    if(sslconn::transportKind() == TRANSPORT_QT)
+        transport.reset(new sslconn::QSslTransport(context, events));
+    else
+        transport.reset(new sslconn::OpenSslTransport(context, react, events));
+
+    sent->installEventFilter(returnPress);
+    connect(returnPress, &ReturnPress::returnKeyPressed, this, &ChatTab::transmit);
+}
+
+// The transport goes first: its last events still find the tab whole.
+ChatTab::~ChatTab(){
+    transport.reset();
+}
+
+// close_notify to the peer. The transport lives on for getStats(), the
+// reactor lets it go when the tab is deleted.
+void ChatTab::shutdown(void) noexcept{
+    transport->close();
+}
+
+bool ChatTab::connectChat(void){
+    context.setPwd(diagConf->getPassword());
+    context.setPort(to_string(diagConf->getPort()));
+    context.setIp(diagConf->getIpAddress());
+    context.setServer(diagConf->getServerMode() ? sslconn::SERVER : sslconn::CLIENT);
+    context.setSockOpts(diagConf->getSockOpts());
+    context.setServers(diagConf->getServers());
+
+    // Failures come back as error events, the status follows the state ones.
+    bool  ret { transport->open() };
+    updateMsgStat();
+
+    return ret;
+}
+
+// close_notify to the peer, then the session is freed: the next connect starts clean.
+void ChatTab::disconnectChat(void){
+    transport->close();
+}
+
+void ChatTab::editConfig(void){
+    diagConf->exec();
+}
+
+void ChatTab::clearHistory(void){
+    received->clear();
+    eventlog::info("gui", "Deleted: History!");
+}
+
+bool ChatTab::isActive(void) const noexcept{
+    return sslconn::ConnState::isActive(transport->getStatus());
+}
+
+QString ChatTab::getTitle(void) const{
+    return QString("%1:%2%3").arg(diagConf->getIpAddress().c_str())
+                             .arg(diagConf->getPort())
+                             .arg(diagConf->getServerMode() ? " (server)" : "");
+}
+
+const QString& ChatTab::getStatusText(void) const noexcept{
+    return statusText;
+}
+
+string ChatTab::getStats(void) const{
+    return msgPool.getStats() + "\n" + transport->getStats();
+}
+
+// Messages join the display queue in slot sized pieces when they are
+// longer than one, as long messages put back together are: the last
+// piece tells appendMsgReady() the message is complete.
+void ChatTab::deliver(const char* data, int len) noexcept{
+    for(int pos = 0; pos < len; pos += MSGPOOL_SLOT_SIZE - 1){
+        int  piece { len - pos < MSGPOOL_SLOT_SIZE - 1 ? len - pos : MSGPOOL_SLOT_SIZE - 1 };
+        if(!replayMessage(data + pos, piece, pos + piece == len)){
+            updateMsgErr("Error Reading Msg");
+            return;
+        }
+    }
+}
+
+// Trace replay (tools/guibench): the same queue and signal as a message from the transport.
+bool ChatTab::replayMessage(const char* msg, int len, bool last) noexcept{
+    msgpool::MsgBuffer  *buf { msgPool.acquire() };
+    if(buf == nullptr)
+        return false;
+
+    if(len > MSGPOOL_SLOT_SIZE - 1)
+        len = MSGPOOL_SLOT_SIZE - 1;
+
+    std::memcpy(buf->data, msg, static_cast<size_t>(len));
+    buf->data[len] = 0;
+    buf->len       = len;
+    buf->last      = last;
+
+    if(msgPool.push(buf))
+        updateMsgReady();
+
+    return true;
+}
+
+unsigned long long ChatTab::getRendered(void) const noexcept{
+    return rendered;
+}
+
+void ChatTab::transmit(void){
+    updateMsgSnd("me:");
+    string  msg { sent->toPlainText().toStdString() };
+    if(transport->send(msg.c_str(), static_cast<int>(msg.size())))
+       sent->clear();
+    else
+       updateMsgErr("Error Sending Msg");
+}
+
+void  ChatTab::appendMsgSnd(const string& prompt){
+        screenMtx.lock();
+        received->appendPlainText(prompt.c_str());
+        received->appendPlainText(sent->toPlainText());
+        received->appendPlainText(" ");
+        received->verticalScrollBar()->setValue(received->verticalScrollBar()->maximum());
+        screenMtx.unlock();
+}
+
+// Renders every queued message and hands the buffers back to the pool.
+void  ChatTab::appendMsgReady(void){
+        msgpool::MsgBuffer  *buf { msgPool.takeAll() };
+
+        screenMtx.lock();
+        while(buf != nullptr){
+            msgpool::MsgBuffer  *next { buf->next };
+            bool                last { buf->last };
+            int                 start { static_cast<int>(rxText.size()) };
+
+            // The pieces of a message add up in rxText, the decoder holding a code
+            // point cut between two: the last piece flushes it and shows the message.
+            rxText.resize(start + buf->len + UTF8_MAX_PENDING);
+            char16_t  *text { reinterpret_cast<char16_t*>(rxText.data()) + start };
+            int        units { decoder.decode(buf->data, buf->len, text) };
+            if(last)
+                units += decoder.finish(text + units);
+            rxText.resize(start + units);
+            msgPool.release(buf);
+
+            if(last){
+                if(!rxText.isEmpty()){
+                    received->appendPlainText(peerPrompt);
+                    received->appendPlainText(rxText);
+                    received->appendPlainText(blankLine);
+                }
+                rxText.resize(0);
+            }
+            rendered++;
+            buf = next;
+        }
+        received->verticalScrollBar()->setValue(received->verticalScrollBar()->maximum());
+        screenMtx.unlock();
+}
+
+void  ChatTab::appendMsgErr(const string& err){
+        screenMtx.lock();
+        statusText = err.c_str();
+        received->appendPlainText(transport->getErrMsg().c_str());
+        received->verticalScrollBar()->setValue(received->verticalScrollBar()->maximum());
+        screenMtx.unlock();
+        emit statusChanged(this);
+}
+
+void  ChatTab::appendState(int from, int to){
+    static_cast<void>(from);
+
+    // A new session doesn't finish a message the last one left open.
+    if(to == sslconn::connected){
+        decoder.reset();
+        rxText.resize(0);
+    }
+
+    statusText = sslconn::ConnState::name(static_cast<sslconn::Status>(to));
+    emit statusChanged(this);
+}
+
+void  ChatTab::appendLinkStat(void){
+    if(transport->getStatus() != sslconn::connected)
+        return;
+
+    statusText = QString("Connected - RTT: %1 ms - Jitter: %2 ms")
+                 .arg(context.getRtt(), 0, 'f', 1)
+                 .arg(context.getJitter(), 0, 'f', 1);
+    emit statusChanged(this);
+}
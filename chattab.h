@@ -0,0 +1,121 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+
+#pragma once
+
+#include "dialogconf.h"
+
+#include "transport.h"
+#include "reactor.h"
+#include "msgpool.h"
+#include "utf8.h"
+#include "eventlog.h"
+
+#include <QWidget>
+#include <QMutex>
+#include <QString>
+#include <QPlainTextEdit>
+#include <QTextEdit>
+#include <QMetaType>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+Q_DECLARE_METATYPE(std::string)
+
+class ReturnPress : public QObject {
+    Q_OBJECT
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event);
+
+public:
+    explicit ReturnPress(QObject *parent=nullptr);
+
+    signals:
+        void returnKeyPressed(void);
+};
+
+// One chat session: its own configuration, transport and panes. With the
+// OpenSSL transport the socket is served by the Reactor of the window,
+// shared by all the tabs, and so is the SSL_CTX of each role (see
+// sslconn.cpp); SCTRANSPORT=qt uses QSslSocket on the GUI thread instead.
+
+class ChatTab : public QWidget {
+    Q_OBJECT
+
+public:
+    ChatTab(sslconn::Reactor& react, QWidget *parent=nullptr);
+    ~ChatTab();
+
+    bool                connectChat(void);
+    void                disconnectChat(void);
+    void                editConfig(void);
+    void                clearHistory(void);
+    void                shutdown(void)                                 noexcept;
+    bool                isActive(void)                         const  noexcept;
+    QString             getTitle(void)                         const;
+    const QString&      getStatusText(void)                    const  noexcept;
+    std::string         getStats(void)                         const;
+
+    bool                replayMessage(const char* msg, int len,
+                                      bool last=true)                 noexcept;
+    unsigned long long  getRendered(void)                      const  noexcept;
+
+private:
+    QPlainTextEdit             *received;
+    QTextEdit                  *sent;
+    ReturnPress                *returnPress;
+    DialogConf                 *diagConf;
+    QMutex                     screenMtx;
+    sslconn::ChatContext       context;
+    msgpool::MsgPool           msgPool;
+    utf8::Decoder              decoder;      // GUI thread only, like rxText
+    QString                    rxText,
+                               statusText;
+    const QString              peerPrompt,
+                               blankLine;
+    std::atomic<unsigned long long>
+                               rendered;
+    std::unique_ptr<sslconn::Transport>
+                               transport;
+
+    void deliver(const char* data, int len)                            noexcept;
+
+private slots:
+    void transmit(void);
+
+    void appendMsgSnd(const std::string& prompt);
+    void appendMsgReady(void);
+    void appendMsgErr(const std::string& err);
+    void appendLinkStat(void);
+    void appendState(int from, int to);
+
+signals:
+
+    void updateMsgSnd(const std::string& prompt);
+    void updateMsgReady(void);
+    void updateMsgStat(void);
+    void updateMsgErr(const std::string& err);
+    void updateLinkStat(void);
+    void updateState(int from, int to);
+    void statusChanged(ChatTab* tab);
+
+};
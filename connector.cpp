@@ -0,0 +1,431 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "connector.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#ifndef WINDOWS_OPENSSL
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <netdb.h>
+    #include <arpa/inet.h>
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <errno.h>
+#else
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #define poll WSAPoll
+#endif
+
+#define HE_RESOLUTION_POLL 10         // ms between checks while resolutions are pending
+
+namespace sslconn {
+
+    using std::string;
+    using std::vector;
+    using std::to_string;
+    using std::shared_ptr;
+    using std::make_shared;
+    using std::mutex;
+    using std::lock_guard;
+    using std::thread;
+
+    namespace {
+
+    struct Candidate {
+        int                     family;
+        struct sockaddr_storage addr;
+        socklen_t               len;
+        string                  text;
+    };
+
+    // Shared with the resolver threads, which may outlive the race.
+    struct Resolution {
+        mutex                       mtx;
+        vector<vector<Candidate>>   candidates;
+        vector<int>                 state;          // 0: pending, 1: resolved, 2: failed
+        vector<size_t>              next;           // First untried candidate
+    };
+
+    struct Attempt {
+        int         fd;
+        SSL         *ssl;
+        size_t      server;
+        string      text;
+        short       events;
+        string      applied;        // Options set before connect()
+    };
+
+    long long elapsedMs(std::chrono::steady_clock::time_point start) noexcept{
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool inProgress(void) noexcept{
+        #ifndef WINDOWS_OPENSSL
+            return errno == EINPROGRESS;
+        #else
+            return WSAGetLastError() == WSAEWOULDBLOCK;
+        #endif
+    }
+
+    // RFC 8305 section 4: alternate the families, the resolver's first one leading.
+    vector<Candidate> interleave(struct addrinfo* addrs){
+        vector<Candidate>  first,
+                           second,
+                           res;
+        int                leading { addrs != nullptr ? addrs->ai_family : AF_UNSPEC };
+
+        for(struct addrinfo *addr = addrs; addr != nullptr; addr = addr->ai_next){
+            Candidate  cand;
+            char       host[NI_MAXHOST] { "?" };
+
+            memset(&cand.addr, 0, sizeof(cand.addr));
+            memcpy(&cand.addr, addr->ai_addr, addr->ai_addrlen);
+            cand.family = addr->ai_family;
+            cand.len    = static_cast<socklen_t>(addr->ai_addrlen);
+            static_cast<void>(getnameinfo(addr->ai_addr, static_cast<socklen_t>(addr->ai_addrlen),
+                                          host, sizeof(host), nullptr, 0, NI_NUMERICHOST));
+            cand.text   = host;
+            (addr->ai_family == leading ? first : second).push_back(cand);
+        }
+
+        for(size_t i = 0; i < first.size() || i < second.size(); i++){
+            if(i < first.size())    res.push_back(first[i]);
+            if(i < second.size())   res.push_back(second[i]);
+        }
+
+        return res;
+    }
+
+    void resolve(shared_ptr<Resolution> res, size_t server, Endpoint endpoint) noexcept{
+        struct addrinfo   hints,
+                          *addrs  { nullptr };
+        vector<Candidate> found;
+
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        bool  ok { getaddrinfo(endpoint.host.c_str(), endpoint.port.c_str(), &hints, &addrs) == 0 };
+        try{
+            if(ok){
+                found = interleave(addrs);
+                for(auto& cand : found)
+                    cand.text = (cand.family == AF_INET6 ? "[" + cand.text + "]" : cand.text) + ":" + endpoint.port;
+            }
+        }catch(...){
+            found.clear();
+        }
+        if(addrs != nullptr)
+            freeaddrinfo(addrs);
+
+        lock_guard<mutex>  lock(res->mtx);
+        res->candidates[server] = found;
+        res->state[server]      = found.empty() ? 2 : 1;
+    }
+
+    // 1: got one, 0: wait for a resolution, -1: nothing left.
+    int nextCandidate(Resolution& res, long long elapsed, Candidate& cand, size_t& server) noexcept{
+        lock_guard<mutex>  lock(res.mtx);
+        bool               pending { false };
+
+        for(size_t idx = 0; idx < res.state.size(); idx++){
+            if(res.state[idx] == 0){
+                if(elapsed < HE_RESOLUTION_DELAY)
+                    return 0;
+                pending = true;
+            }else if(res.state[idx] == 1 && res.next[idx] < res.candidates[idx].size()){
+                cand   = res.candidates[idx][res.next[idx]++];
+                server = idx;
+                return 1;
+            }
+        }
+
+        return pending ? 0 : -1;
+    }
+
+    void dropAttempt(Attempt& att) noexcept{
+        if(att.ssl != nullptr)
+            SSL_free(att.ssl);              // Closes the socket too
+        else if(att.fd >= 0)
+            socktune::closeSocket(att.fd);
+        att.ssl = nullptr;
+        att.fd  = -1;
+    }
+
+    // False when the attempt failed: the handshake is driven as far as the socket allows.
+    bool advance(Attempt& att, SSL_CTX* ctx, const Endpoint& endpoint, short revents) noexcept{
+        if(att.ssl == nullptr){
+            int        soerr { 0 };
+            socklen_t  len   { sizeof(soerr) };
+
+            if((revents & (POLLOUT | POLLERR | POLLHUP)) == 0)
+                return true;
+            if(getsockopt(att.fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&soerr), &len) != 0 || soerr != 0)
+                return false;
+
+            BIO  *sock { BIO_new_socket(att.fd, BIO_CLOSE) };
+            att.ssl = sock == nullptr ? nullptr : SSL_new(ctx);
+            if(att.ssl == nullptr){
+                if(sock != nullptr)
+                    BIO_free(sock);
+                else
+                    socktune::closeSocket(att.fd);
+                att.fd = -1;
+                return false;
+            }
+
+            SSL_set_bio(att.ssl, sock, sock);
+            SSL_set_connect_state(att.ssl);
+
+            // SNI only for names: RFC 6066 forbids literal addresses.
+            unsigned char  probe[sizeof(struct in6_addr)];
+            if(inet_pton(AF_INET, endpoint.host.c_str(), probe) != 1 && inet_pton(AF_INET6, endpoint.host.c_str(), probe) != 1){
+
+                #pragma clang diagnostic push
+                #pragma clang diagnostic ignored "-Wold-style-cast"
+
+                static_cast<void>(SSL_set_tlsext_host_name(att.ssl, endpoint.host.c_str()));
+
+                #pragma clang diagnostic pop
+            }
+        }
+
+        int  rc { SSL_connect(att.ssl) };
+        if(rc == 1){
+            att.events = 0;
+            return true;
+        }
+
+        switch(SSL_get_error(att.ssl, rc)){
+            case SSL_ERROR_WANT_READ:
+                att.events = POLLIN;
+            return true;
+            case SSL_ERROR_WANT_WRITE:
+                att.events = POLLOUT;
+            return true;
+            default:
+            return false;
+        }
+    }
+
+    } // End anonymous namespace
+
+    bool setBlocking(int fd, bool blocking) noexcept{
+        #ifndef WINDOWS_OPENSSL
+            int  flags { fcntl(fd, F_GETFL, 0) };
+            return flags >= 0 && fcntl(fd, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK) == 0;
+        #else
+            u_long  mode { blocking ? 0UL : 1UL };
+            return ioctlsocket(static_cast<SOCKET>(fd), FIONBIO, &mode) == 0;
+        #endif
+    }
+
+    bool parseServers(const string& spec, const string& dfltPort, vector<Endpoint>& servers, string& err) noexcept{
+        vector<Endpoint>  res;
+
+        try{
+            size_t  pos { 0 };
+            while(pos <= spec.size()){
+                size_t  next { spec.find(',', pos) };
+                if(next == string::npos)
+                    next = spec.size();
+
+                string   item { spec.substr(pos, next - pos) };
+                Endpoint endpoint;
+                pos = next + 1;
+
+                item.erase(0, item.find_first_not_of(" \t"));
+                item.erase(item.find_last_not_of(" \t") + 1);
+                if(item.empty())
+                    continue;
+
+                if(item[0] == '['){
+                    size_t  close { item.find(']') };
+                    if(close == string::npos || (close + 1 < item.size() && item[close + 1] != ':')){
+                        err = string("Invalid server: ").append(item);
+                        return false;
+                    }
+                    endpoint.host = item.substr(1, close - 1);
+                    endpoint.port = close + 2 < item.size() ? item.substr(close + 2) : dfltPort;
+                }else if(item.find(':') != item.rfind(':')){
+                    endpoint.host = item;                       // Bare IPv6 literal
+                    endpoint.port = dfltPort;
+                }else{
+                    size_t  colon { item.find(':') };
+                    endpoint.host = item.substr(0, colon);
+                    endpoint.port = colon == string::npos ? dfltPort : item.substr(colon + 1);
+                }
+
+                if(endpoint.host.empty() || (endpoint.port.empty() && !dfltPort.empty()) ||
+                   endpoint.port.find_first_not_of("0123456789") != string::npos){
+                    err = string("Invalid server: ").append(item);
+                    return false;
+                }
+                res.push_back(endpoint);
+            }
+        }catch(...){
+            err = "Server list parse error.";
+            return false;
+        }
+
+        servers = res;
+        return true;
+    }
+
+    SSL* raceConnect(SSL_CTX* ctx, const vector<Endpoint>& servers, const socktune::SockOpts& opts,
+                     string& summary, string& err, ConnState* state,
+                     const std::atomic<bool>* cancel) noexcept{
+        auto             start    { std::chrono::steady_clock::now() };
+        vector<Attempt>  attempts;
+        SSL              *winner  { nullptr };
+        long long        nextAt   { 0 };
+        unsigned int     failures { 0 };
+        string           winText,
+                         winApplied;
+
+        try{
+            auto  res { make_shared<Resolution>() };
+            res->candidates.resize(servers.size());
+            res->state.assign(servers.size(), 0);
+            res->next.assign(servers.size(), 0);
+
+            // getaddrinfo() can't be cancelled: a slow resolver is left behind, not waited for.
+            for(size_t idx = 0; idx < servers.size(); idx++)
+                thread(resolve, res, idx, servers[idx]).detach();
+
+            while(winner == nullptr){
+                long long  now { elapsedMs(start) };
+                if(now >= HE_TIMEOUT){
+                    err = "Connection timeout.";
+                    break;
+                }
+                if(cancel != nullptr && *cancel){
+                    err = "Connection cancelled.";
+                    break;
+                }
+
+                int  avail { 1 };
+                while(now >= nextAt && avail == 1){
+                    Candidate  cand;
+                    size_t     server { 0 };
+
+                    avail = nextCandidate(*res, now, cand, server);
+                    if(avail != 1)
+                        break;
+
+                    int  fd { static_cast<int>(socket(cand.family, SOCK_STREAM, 0)) };
+                    if(fd < 0){
+                        failures++;
+                        continue;
+                    }
+
+                    string  applied;
+                    socktune::tuneBeforeConnect(fd, opts, applied);
+                    if(!setBlocking(fd, false) ||
+                       (connect(fd, reinterpret_cast<struct sockaddr*>(&cand.addr), cand.len) != 0 && !inProgress())){
+                        socktune::closeSocket(fd);
+                        failures++;
+                        continue;
+                    }
+
+                    attempts.push_back({ fd, nullptr, server, cand.text, POLLOUT, applied });
+                    nextAt = now + HE_ATTEMPT_DELAY;
+                    if(state != nullptr)
+                        static_cast<void>(state->moveFrom(resolving, connecting));
+                }
+
+                if(attempts.empty() && avail == -1){
+                    err = "No server reachable.";
+                    break;
+                }
+
+                vector<struct pollfd>  pfds;
+                for(const auto& att : attempts)
+                    pfds.push_back({ att.fd, att.events, 0 });
+
+                long long  wait { HE_TIMEOUT - now };
+                if(avail != -1)
+                    wait = std::min(wait, avail == 0 ? static_cast<long long>(HE_RESOLUTION_POLL) : nextAt - now);
+                if(cancel != nullptr)
+                    wait = std::min(wait, static_cast<long long>(HE_CANCEL_POLL));
+                wait = std::max(wait, 0LL);
+
+                int  rc { pfds.empty() ? 0 : poll(pfds.data(), static_cast<unsigned int>(pfds.size()), static_cast<int>(wait)) };
+                if(pfds.empty())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+                if(rc <= 0)
+                    continue;
+
+                // A failure starts the next attempt at once.
+                for(size_t idx = 0; idx < attempts.size() && winner == nullptr; idx++){
+                    if(pfds[idx].revents == 0)
+                        continue;
+                    bool  ok { advance(attempts[idx], ctx, servers[attempts[idx].server], pfds[idx].revents) };
+                    if(ok && attempts[idx].ssl != nullptr && state != nullptr)
+                        static_cast<void>(state->moveFrom(connecting, handshaking));
+
+                    if(!ok){
+                        dropAttempt(attempts[idx]);
+                        failures++;
+                        nextAt = 0;
+                    }else if(attempts[idx].ssl != nullptr && attempts[idx].events == 0){
+                        winner            = attempts[idx].ssl;
+                        winText           = attempts[idx].text;
+                        winApplied        = attempts[idx].applied;
+                        attempts[idx].ssl = nullptr;
+                        attempts[idx].fd  = SSL_get_fd(winner);
+                    }
+                }
+
+                attempts.erase(std::remove_if(attempts.begin(), attempts.end(),
+                                              [](const Attempt& att){ return att.fd < 0; }),
+                               attempts.end());
+            }
+        }catch(...){
+            err = "Connection race error.";
+        }
+
+        for(auto& att : attempts)
+            if(winner == nullptr || att.ssl != nullptr || att.fd != SSL_get_fd(winner))
+                dropAttempt(att);
+
+        if(winner == nullptr)
+            return nullptr;
+
+        int  fd { SSL_get_fd(winner) };
+        static_cast<void>(setBlocking(fd, true));
+        socktune::tuneConnected(fd, opts, summary);
+        try{
+            summary.append(winApplied)
+                   .append(" - Server: ").append(winText)
+                   .append(" in ").append(to_string(elapsedMs(start))).append(" ms, ")
+                   .append(to_string(failures)).append(" failed attempts");
+        }catch(...){}
+
+        return winner;
+    }
+
+} // End namespace sslconn
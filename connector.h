@@ -0,0 +1,63 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "socktune.h"
+#include "connstate.h"
+
+#define SERVERS_ENV "SCSERVERS"       // Same syntax as the configuration dialog field
+#define HE_ATTEMPT_DELAY 250          // ms before the next staggered attempt (RFC 8305)
+#define HE_RESOLUTION_DELAY 50        // ms an unresolved server holds the later ones back
+#define HE_TIMEOUT 10000              // ms for the whole race
+#define HE_CANCEL_POLL 50             // ms between checks of a cancel flag
+
+namespace sslconn {
+
+struct Endpoint {
+    std::string     host,
+                    port;
+};
+
+// Comma separated host[:port] entries, in order of preference. IPv6
+// literals go in brackets when they carry a port: [2001:db8::1]:8866.
+// An empty default port leaves the port of such entries empty.
+bool  parseServers(const std::string& spec, const std::string& dfltPort,
+                   std::vector<Endpoint>& servers, std::string& err)        noexcept;
+
+bool  setBlocking(int fd, bool blocking)                                    noexcept;
+
+// Happy Eyeballs: every server is resolved in the background, its
+// addresses alternate between families, and attempts start in preference
+// order every HE_ATTEMPT_DELAY ms, or as soon as one fails. The first
+// attempt to complete the TLS handshake wins, the others are dropped.
+// Returns the winner, blocking again, with its socket owned by the SSL.
+// A state in resolving follows the race: connecting, then handshaking.
+// Setting cancel ends the race, without a winner, within HE_CANCEL_POLL ms.
+SSL*  raceConnect(SSL_CTX* ctx, const std::vector<Endpoint>& servers,
+                  const socktune::SockOpts& opts, std::string& summary,
+                  std::string& err, ConnState* state=nullptr,
+                  const std::atomic<bool>* cancel=nullptr)                  noexcept;
+
+} // End namespace sslconn
@@ -0,0 +1,139 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "connstate.h"
+
+#include <string>
+
+#include "eventlog.h"
+
+namespace sslconn {
+
+    using std::string;
+    using std::lock_guard;
+    using std::mutex;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+    using std::memory_order_relaxed;
+    using std::memory_order_acq_rel;
+
+    // Bit n set: the transition to state n is allowed.
+    static const unsigned int EDGES[] {
+        /* closed      */ 1U << resolving | 1U << listening | 1U << error,
+        /* resolving   */ 1U << connecting | 1U << closed | 1U << error,
+        /* connecting  */ 1U << handshaking | 1U << closed | 1U << error,
+        /* handshaking */ 1U << connected | 1U << listening | 1U << closed | 1U << error,
+        /* connected   */ 1U << draining | 1U << closed | 1U << error,
+        /* listening   */ 1U << handshaking | 1U << closed | 1U << error,
+        /* draining    */ 1U << closed | 1U << error,
+        /* error       */ 1U << resolving | 1U << listening | 1U << closed
+    };
+
+    ConnState::ConnState(void)
+        : state{closed},
+          transitions{0},
+          listeners{},
+          listenerCount{0}
+    {}
+
+    Status ConnState::get(void) const noexcept{
+        return state.load(memory_order_acquire);
+    }
+
+    bool ConnState::moveTo(Status next) noexcept{
+        Status  current { state.load(memory_order_acquire) };
+
+        do{
+            if(current == next)
+                return true;
+            if(!allowed(current, next)){
+                eventlog::warn("state", string("Refused transition: ").append(name(current))
+                                                                      .append(" -> ").append(name(next)));
+                return false;
+            }
+        }while(!state.compare_exchange_weak(current, next, memory_order_acq_rel, memory_order_acquire));
+
+        transitions.fetch_add(1, memory_order_relaxed);
+        notify(current, next);
+        return true;
+    }
+
+    // Applies the transition only from the expected state: for events that are stale otherwise.
+    bool ConnState::moveFrom(Status from, Status next) noexcept{
+        if(from == next || !allowed(from, next) ||
+           !state.compare_exchange_strong(from, next, memory_order_acq_rel, memory_order_acquire))
+            return false;
+
+        transitions.fetch_add(1, memory_order_relaxed);
+        notify(from, next);
+        return true;
+    }
+
+    unsigned long long ConnState::getTransitions(void) const noexcept{
+        return transitions.load(memory_order_relaxed);
+    }
+
+    bool ConnState::subscribe(const StateListener& listener) noexcept{
+        lock_guard<mutex>  lock(subscribeMtx);
+        unsigned int       count { listenerCount.load(memory_order_relaxed) };
+
+        if(count == STATE_LISTENERS)
+            return false;
+
+        try{
+            listeners[count] = listener;
+        }catch(...){
+            return false;
+        }
+
+        listenerCount.store(count + 1, memory_order_release);
+        return true;
+    }
+
+    void ConnState::notify(Status from, Status to) noexcept{
+        unsigned int  count { listenerCount.load(memory_order_acquire) };
+
+        for(unsigned int i = 0; i < count; i++){
+            try{
+                listeners[i](from, to);
+            }catch(...){}
+        }
+    }
+
+    const char* ConnState::name(Status status) noexcept{
+        switch(status){
+            case closed:      return "Disconnected";
+            case resolving:   return "Resolving";
+            case connecting:  return "Connecting";
+            case handshaking: return "Handshaking";
+            case connected:   return "Connected";
+            case listening:   return "Listening";
+            case draining:    return "Disconnecting";
+            default:          return "Error";
+        }
+    }
+
+    bool ConnState::allowed(Status from, Status to) noexcept{
+        return (EDGES[from] & (1U << to)) != 0;
+    }
+
+    bool ConnState::isActive(Status status) noexcept{
+        return status != closed && status != error;
+    }
+
+} // End namespace sslconn
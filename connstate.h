@@ -0,0 +1,70 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+#define STATE_LISTENERS 8             // Transition subscribers per connection
+
+namespace sslconn {
+
+enum Status { closed, resolving, connecting, handshaking, connected, listening, draining, error };
+
+using StateListener = std::function<void(Status from, Status to)>;
+
+// The connection state, shared by the threads that drive the connection
+// and the ones that only look at it. Reads are a single atomic load;
+// transitions are checked against the allowed edges and applied with a
+// compare and swap, so a late writer can't resurrect a closed connection.
+// Listeners run on the thread that made the transition, right after it:
+// they must be quick, e.g. post to an event loop. They are added before
+// the connection starts and live as long as it.
+
+class ConnState {
+    public:
+        ConnState(void);
+
+        ConnState(const ConnState&)                                          = delete;
+        ConnState& operator=(const ConnState&)                               = delete;
+
+        Status              get(void)                            const       noexcept;
+        bool                moveTo(Status next)                              noexcept;
+        bool                moveFrom(Status from, Status next)               noexcept;
+        unsigned long long  getTransitions(void)                 const       noexcept;
+        bool                subscribe(const StateListener& listener)         noexcept;
+
+        static const char*  name(Status status)                              noexcept;
+        static bool         allowed(Status from, Status to)                  noexcept;
+        static bool         isActive(Status status)                          noexcept;
+
+    private:
+        std::atomic<Status>                 state;
+        std::atomic<unsigned long long>     transitions;
+        std::array<StateListener, STATE_LISTENERS>
+                                            listeners;
+        std::atomic<unsigned int>           listenerCount;
+        std::mutex                          subscribeMtx;
+
+        void                notify(Status from, Status to)                   noexcept;
+};
+
+} // End namespace sslconn
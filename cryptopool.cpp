@@ -0,0 +1,149 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "cryptopool.h"
+
+namespace relay {
+
+    using std::string;
+    using std::to_string;
+    using std::function;
+    using std::lock_guard;
+    using std::unique_lock;
+    using std::mutex;
+    using std::thread;
+
+    using stats::nowUs;
+
+    CryptoPool::CryptoPool(void)
+        : queueLimit{CRYPTO_QUEUE_LIMIT},
+          maxDepth{0},
+          running{false},
+          executed{0},
+          rejected{0}
+    {}
+
+    CryptoPool::~CryptoPool(void){
+        stop();
+    }
+
+    bool CryptoPool::start(unsigned int count, size_t limit) noexcept{
+        if(count == 0)
+            return true;
+
+        running    = true;
+        queueLimit = limit == 0 ? CRYPTO_QUEUE_LIMIT : limit;
+
+        try{
+            for(unsigned int i = 0; i < count; i++)
+                threads.emplace_back(&CryptoPool::run, this);
+        }catch(...){
+            stop();
+            return false;
+        }
+
+        return true;
+    }
+
+    void CryptoPool::stop(void) noexcept{
+        {
+            lock_guard<mutex> lock(queueMtx);
+            running = false;
+        }
+        queueCond.notify_all();
+
+        for(auto& thr : threads)
+            if(thr.joinable())
+                thr.join();
+        threads.clear();
+    }
+
+    bool CryptoPool::isActive(void) const noexcept{
+        return !threads.empty();
+    }
+
+    bool CryptoPool::submit(function<void(void)> job) noexcept{
+        {
+            lock_guard<mutex> lock(queueMtx);
+
+            if(!running || queue.size() >= queueLimit){
+                rejected++;
+                return false;
+            }
+
+            try{
+                queue.push_back(Job{std::move(job), nowUs()});
+            }catch(...){
+                rejected++;
+                return false;
+            }
+
+            if(queue.size() > maxDepth)
+                maxDepth = queue.size();
+        }
+
+        queueCond.notify_one();
+        return true;
+    }
+
+    void CryptoPool::run(void) noexcept{
+        for(;;){
+            Job  job;
+            {
+                unique_lock<mutex> lock(queueMtx);
+                queueCond.wait(lock, [this]{ return !running || !queue.empty(); });
+
+                // Drain what's queued even when stopping: submitters wait for the answer.
+                if(queue.empty())
+                    return;
+
+                job = std::move(queue.front());
+                queue.pop_front();
+                waitTime.record(nowUs() - job.enqueued);
+            }
+
+            long long  begin { nowUs() };
+            job.work();
+
+            lock_guard<mutex> lock(queueMtx);
+            runTime.record(nowUs() - begin);
+            executed++;
+        }
+    }
+
+    string CryptoPool::getStats(void) const noexcept{
+        string res;
+
+        try{
+            lock_guard<mutex> lock(queueMtx);
+
+            res.append("Crypto pool - threads: ").append(to_string(threads.size()))
+               .append(" queue depth: ").append(to_string(queue.size()))
+               .append(" max depth: ").append(to_string(maxDepth))
+               .append(" executed: ").append(to_string(executed))
+               .append(" rejected: ").append(to_string(rejected))
+               .append(" - wait: ").append(waitTime.summary())
+               .append(" - run: ").append(runTime.summary());
+        }catch(...){
+            res = "getStats error.";
+        }
+
+        return res;
+    }
+
+} // End namespace relay
@@ -0,0 +1,73 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include "stats.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CRYPTO_QUEUE_LIMIT 1024       // Pending handshake steps before new ones are refused
+
+namespace relay {
+
+// Bounded worker pool for handshake steps: private key operations run here,
+// never on the event loops that move data for established sessions.
+
+class CryptoPool {
+    public:
+        CryptoPool(void);
+        ~CryptoPool(void);
+
+        CryptoPool(const CryptoPool&)                                        = delete;
+        CryptoPool& operator=(const CryptoPool&)                             = delete;
+
+        bool                start(unsigned int threads, size_t limit)        noexcept;
+        void                stop(void)                                       noexcept;
+        bool                submit(std::function<void(void)> job)            noexcept;
+        bool                isActive(void)                       const       noexcept;
+        std::string         getStats(void)                       const       noexcept;
+
+    private:
+        struct Job {
+            std::function<void(void)>  work;
+            long long                  enqueued;
+        };
+
+        std::vector<std::thread>   threads;
+        std::deque<Job>            queue;
+        mutable std::mutex         queueMtx;
+        std::condition_variable    queueCond;
+        size_t                     queueLimit,
+                                   maxDepth;
+        bool                       running;
+        unsigned long long         executed,
+                                   rejected;
+        stats::LatencyHistogram    waitTime,
+                                   runTime;
+
+        void                run(void)                                        noexcept;
+};
+
+} // End namespace relay
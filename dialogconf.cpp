@@ -22,8 +22,6 @@
 #include <QMessageBox>
 #include <QNetworkInterface>
 
-#include <iostream>
-
 using std::string;
 
 DialogConf::DialogConf(QWidget *parent) :
@@ -35,11 +33,26 @@ DialogConf::DialogConf(QWidget *parent) :
     ipAddressOct3{"0"},
     ipAddressOct4{"1"},
     port{8866},
-    serverMode{false}
+    serverMode{false},
+    sockOpts{},
+    servers{}
 
 {
     ui->setupUi(this);
 
+    const char  *sockconf { getenv(SOCK_ENV) };
+    string      sockErr;
+    if(sockconf != nullptr && socktune::parseOpts(sockconf, sockOpts, sockErr))
+        ui->lineEditSockOpts->setText(QString::fromStdString(socktune::formatOpts(sockOpts)));
+
+    // Clients race these, in order, instead of the address above.
+    const char  *serversconf { getenv(SERVERS_ENV) };
+    string      serversErr;
+    if(serversconf != nullptr && sslconn::parseServers(serversconf, "", servers, serversErr)){
+        serverList = serversconf;
+        ui->lineEditServers->setText(serverList);
+    }
+
     ui->lineEditIp1->setValidator( new QIntValidator(0, 255, ui->lineEditIp1));
     ui->lineEditIp2->setValidator( new QIntValidator(0, 255, ui->lineEditIp2));
     ui->lineEditIp3->setValidator( new QIntValidator(0, 255, ui->lineEditIp3));
@@ -60,6 +73,8 @@ DialogConf::DialogConf(QWidget *parent) :
          ui->lineEditPort->setText(QString::number(port));
          ui->lineEditPwdConf->setText(password);
          ui->lineEditPwd->setText(password);
+         ui->lineEditSockOpts->setText(QString::fromStdString(socktune::formatOpts(sockOpts)));
+         ui->lineEditServers->setText(serverList);
          serverMode ? ui->radioServer->setChecked(true) : ui->radioServer->setChecked(false);
          ui->lineEditIp1->setStyleSheet("QLineEdit {color: green;}");
          ui->lineEditIp2->setStyleSheet("QLineEdit {color: green;}");
@@ -153,6 +168,14 @@ bool  DialogConf::getServerMode(void) const{
     return serverMode;
 }
 
+const socktune::SockOpts&  DialogConf::getSockOpts(void) const{
+    return sockOpts;
+}
+
+const std::vector<sslconn::Endpoint>&  DialogConf::getServers(void) const{
+    return servers;
+}
+
 void DialogConf::done(int r){
     if(!ui->lineEditPort->hasAcceptableInput() ||
        !ui->lineEditIp1->hasAcceptableInput()  ||
@@ -170,35 +193,35 @@ void DialogConf::done(int r){
 bool  DialogConf::setConfig(void){
 
     if(!ui->lineEditPort->hasAcceptableInput()){
-        std::cerr << "Invalid port\n";
+        eventlog::warn("config", "Invalid port");
         QMessageBox::warning(this, tr("Configuration"), tr("Invalid Port."),
                              QMessageBox::Ok);
         return false;
      }
 
     if(!ui->lineEditIp1->hasAcceptableInput() ){
-        std::cerr << "Invalid Ip Address\n";
+        eventlog::warn("config", "Invalid Ip Address");
         QMessageBox::warning(this, tr("Configuration"), tr("Invalid Ip Format: first octet."),
                              QMessageBox::Ok);
         return false;
     }
 
     if(!ui->lineEditIp2->hasAcceptableInput() ){
-        std::cerr << "Invalid Ip Address\n";
+        eventlog::warn("config", "Invalid Ip Address");
         QMessageBox::warning(this, tr("Configuration"), tr("Invalid Ip Format: second octet."),
                              QMessageBox::Ok);
         return false;
     }
 
     if( !ui->lineEditIp3->hasAcceptableInput() ){
-        std::cerr << "Invalid Ip Address\n";
+        eventlog::warn("config", "Invalid Ip Address");
         QMessageBox::warning(this, tr("Configuration"), tr("Invalid Ip Format: third octet."),
                              QMessageBox::Ok);
         return false;
     }
 
     if( !ui->lineEditIp4->hasAcceptableInput() ){
-        std::cerr << "Invalid Ip Address\n";
+        eventlog::warn("config", "Invalid Ip Address");
         QMessageBox::warning(this, tr("Configuration"), tr("Invalid Ip Format: fourth octet."),
                              QMessageBox::Ok);
         return false;
@@ -219,6 +242,26 @@ bool  DialogConf::setConfig(void){
         password   =  ui->lineEditPwd->text();
     }
 
+    socktune::SockOpts  sockOptsTst;
+    string              sockErr;
+    if(!socktune::parseOpts(ui->lineEditSockOpts->text().toStdString(), sockOptsTst, sockErr)){
+        ui->lineEditSockOpts->setStyleSheet("QLineEdit {color: red;}");
+        QMessageBox::warning(this, tr("Configuration"), QString::fromStdString(sockErr),
+                             QMessageBox::Ok);
+        return false;
+    }
+    ui->lineEditSockOpts->setStyleSheet("QLineEdit {color: green;}");
+
+    std::vector<sslconn::Endpoint>  serversTst;
+    string                          serversErr;
+    if(!sslconn::parseServers(ui->lineEditServers->text().toStdString(), "", serversTst, serversErr)){
+        ui->lineEditServers->setStyleSheet("QLineEdit {color: red;}");
+        QMessageBox::warning(this, tr("Configuration"), QString::fromStdString(serversErr),
+                             QMessageBox::Ok);
+        return false;
+    }
+    ui->lineEditServers->setStyleSheet("QLineEdit {color: green;}");
+
     QString ipAddressTst   =   ui->lineEditIp1->text() + "." + ui->lineEditIp2->text() + "." + ui->lineEditIp3->text() + "." + ui->lineEditIp4->text();
     bool    serverModeTst  =   ui->radioServer->isChecked();
 
@@ -264,6 +307,9 @@ bool  DialogConf::setConfig(void){
     ipAddressOct4   =   ui->lineEditIp4->text();
     ipAddress       =   ipAddressTst;
     serverMode      =   serverModeTst;
+    sockOpts        =   sockOptsTst;
+    servers         =   serversTst;
+    serverList      =   ui->lineEditServers->text();
 
     return true;
 }
@@ -43,6 +43,10 @@ public:
     std::string    getPassword(void)      const;
     uint16_t       getPort(void)          const;
     bool           getServerMode(void)    const;
+    const socktune::SockOpts&
+                   getSockOpts(void)      const;
+    const std::vector<sslconn::Endpoint>&
+                   getServers(void)       const;
 
 private:
     Ui::DialogConf *ui;
@@ -51,9 +55,14 @@ private:
                    ipAddressOct2,
                    ipAddressOct3,
                    ipAddressOct4,
-                   password;
+                   password,
+                   serverList;
     uint16_t       port;
     bool           serverMode;
+    socktune::SockOpts
+                   sockOpts;
+    std::vector<sslconn::Endpoint>
+                   servers;
 
     bool           setConfig(void);
     void           done(int r);
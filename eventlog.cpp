@@ -0,0 +1,304 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "eventlog.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace eventlog {
+
+    using std::string;
+    using std::to_string;
+    using std::vector;
+    using std::mutex;
+    using std::lock_guard;
+    using std::unique_lock;
+    using std::thread;
+    using std::memory_order_relaxed;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+    using std::atomic_thread_fence;
+    using std::strncpy;
+    using std::memcpy;
+    using std::strlen;
+    using std::fopen;
+    using std::fclose;
+    using std::fputs;
+    using std::fflush;
+
+    static const unsigned long long  SLOT_MASK { EVENTLOG_SLOTS - 1 };
+
+    const char* levelName(Level level) noexcept{
+        switch(level){
+            case LOG_DEBUG: return "DEBUG";
+            case LOG_INFO:  return "INFO ";
+            case LOG_WARN:  return "WARN ";
+            default:        return "ERROR";
+        }
+    }
+
+    string format(const Entry& entry) noexcept{
+        string  res;
+
+        try{
+            time_t     secs  { static_cast<time_t>(entry.time / 1000000) };
+            struct tm  local {};
+            char       stamp[32] { "" };
+
+            #ifndef WINDOWS_OPENSSL
+                static_cast<void>(localtime_r(&secs, &local));
+            #else
+                static_cast<void>(localtime_s(&local, &secs));
+            #endif
+            static_cast<void>(strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local));
+
+            string  millis { to_string(entry.time / 1000 % 1000) };
+            res.append(stamp).append(".").append(3 - millis.size(), '0').append(millis)
+               .append(" ").append(levelName(entry.level))
+               .append(" ").append(entry.source).append(": ").append(entry.text);
+        }catch(...){
+            res.clear();
+        }
+
+        return res;
+    }
+
+    EventLog::EventLog(void)
+        : ring(EVENTLOG_SLOTS),
+          next{0},
+          dropped{0},
+          lost{0},
+          sinkCursor{0},
+          sink{stderr},
+          ownSink{false},
+          stopping{false}
+    {
+        for(auto& slot : ring)
+            slot.stamp.store(0, memory_order_relaxed);
+
+        const char  *envconf { getenv(EVENTLOG_ENV) };
+        if(envconf != nullptr && !setSink(envconf))
+            write(LOG_WARN, "eventlog", string("Cannot open ").append(envconf).append(": logging to stderr."));
+
+        try{
+            sinkThread = thread([this](){
+                unique_lock<mutex>  lock(sinkMtx);
+                while(!stopping){
+                    sinkCv.wait_for(lock, std::chrono::milliseconds(EVENTLOG_FLUSH_MS));
+                    lock.unlock();
+                    drain();
+                    lock.lock();
+                }
+            });
+        }catch(...){}
+    }
+
+    EventLog::~EventLog(void){
+        {
+            lock_guard<mutex>  lock(sinkMtx);
+            stopping = true;
+        }
+        sinkCv.notify_one();
+        if(sinkThread.joinable())
+            sinkThread.join();
+
+        drain();
+        if(ownSink && sink != nullptr)
+            static_cast<void>(fclose(sink));
+    }
+
+    void EventLog::write(Level level, const char* source, const char* text) noexcept{
+        unsigned long long  seq      { next.fetch_add(1, memory_order_relaxed) },
+                            writing  { 2 * seq + 1 };
+        Slot&               slot     { ring[seq & SLOT_MASK] };
+        unsigned long long  expected { slot.stamp.load(memory_order_relaxed) };
+
+        // Odd: a writer one lap ahead is still filling it. Newer: it already lapped this one.
+        if((expected & 1) != 0 || expected > writing ||
+           !slot.stamp.compare_exchange_strong(expected, writing, memory_order_acquire)){
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+
+        Entry&  entry { slot.entry };
+        size_t  len   { strlen(text) };
+
+        if(len >= EVENTLOG_TEXT)
+            len = EVENTLOG_TEXT - 1;
+        // Texts end with a newline in many call sites: the sink adds its own.
+        while(len > 0 && text[len - 1] == '\n')
+            len--;
+
+        entry.seq   = seq;
+        entry.time  = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count();
+        entry.level = level;
+        strncpy(entry.source, source, EVENTLOG_SOURCE - 1);
+        entry.source[EVENTLOG_SOURCE - 1] = 0;
+        memcpy(entry.text, text, len);
+        entry.text[len] = 0;
+
+        slot.stamp.store(writing + 1, memory_order_release);
+    }
+
+    void EventLog::write(Level level, const char* source, const string& text) noexcept{
+        write(level, source, text.c_str());
+    }
+
+    unsigned long long EventLog::head(void) const noexcept{
+        return next.load(memory_order_acquire);
+    }
+
+    size_t EventLog::readSince(unsigned long long& cursor, vector<Entry>& out, size_t max,
+                               Level minLevel, unsigned long long* skipped) const noexcept{
+        unsigned long long  end    { next.load(memory_order_acquire) },
+                            missed { 0 };
+        size_t              count  { 0 };
+
+        if(end - cursor > EVENTLOG_SLOTS){
+            missed = end - EVENTLOG_SLOTS - cursor;
+            cursor = end - EVENTLOG_SLOTS;
+        }
+
+        while(cursor < end && count < max){
+            const Slot&         slot      { ring[cursor & SLOT_MASK] };
+            unsigned long long  published { 2 * cursor + 2 },
+                                before    { slot.stamp.load(memory_order_acquire) };
+
+            if(before < published){
+                // Still being written: wait, unless its writer dropped it long ago.
+                if(end - cursor <= EVENTLOG_SLOTS / 2)
+                    break;
+                missed++;
+                cursor++;
+                continue;
+            }
+
+            if(before == published){
+                Entry  copy;
+                memcpy(&copy, &slot.entry, sizeof(copy));
+                atomic_thread_fence(memory_order_acquire);
+
+                if(slot.stamp.load(memory_order_relaxed) == before){
+                    if(copy.level >= minLevel){
+                        try{
+                            out.push_back(copy);
+                            count++;
+                        }catch(...){
+                            break;
+                        }
+                    }
+                    cursor++;
+                    continue;
+                }
+            }
+
+            missed++;
+            cursor++;
+        }
+
+        if(skipped != nullptr)
+            *skipped += missed;
+        return count;
+    }
+
+    bool EventLog::setSink(const string& path) noexcept{
+        FILE  *target { nullptr };
+        bool  own     { false };
+
+        if(path == "-"){
+            target = stderr;
+        }else if(path != "off"){
+            target = fopen(path.c_str(), "a");
+            own    = true;
+            if(target == nullptr)
+                return false;
+        }
+
+        lock_guard<mutex>  lock(sinkMtx);
+        if(ownSink && sink != nullptr)
+            static_cast<void>(fclose(sink));
+        sink    = target;
+        ownSink = own;
+        return true;
+    }
+
+    // Only the sink thread, or the destructor once it's gone, moves sinkCursor.
+    void EventLog::drain(void) noexcept{
+        vector<Entry>  batch;
+
+        try{
+            batch.reserve(EVENTLOG_SLOTS / 4);
+        }catch(...){
+            return;
+        }
+
+        unsigned long long  skipped { 0 };
+
+        while(readSince(sinkCursor, batch, EVENTLOG_SLOTS / 4, LOG_DEBUG, &skipped) != 0){
+            lock_guard<mutex>  lock(sinkMtx);
+            if(sink != nullptr){
+                for(const auto& entry : batch)
+                    static_cast<void>(fputs(format(entry).append("\n").c_str(), sink));
+                static_cast<void>(fflush(sink));
+            }
+            batch.clear();
+        }
+
+        lost.fetch_add(skipped, memory_order_relaxed);
+    }
+
+    string EventLog::getStats(void) const noexcept{
+        string  res;
+
+        try{
+            res.append("Event log - written: ").append(to_string(head()))
+               .append(" dropped: ").append(to_string(dropped.load()))
+               .append(" lost by the sink: ").append(to_string(lost.load()));
+        }catch(...){
+            res = "getStats error.";
+        }
+
+        return res;
+    }
+
+    EventLog& shared(void) noexcept{
+        static EventLog  log;
+        return log;
+    }
+
+    void debug(const char* source, const string& text) noexcept{
+        shared().write(LOG_DEBUG, source, text);
+    }
+
+    void info(const char* source, const string& text) noexcept{
+        shared().write(LOG_INFO, source, text);
+    }
+
+    void warn(const char* source, const string& text) noexcept{
+        shared().write(LOG_WARN, source, text);
+    }
+
+    void error(const char* source, const string& text) noexcept{
+        shared().write(LOG_ERROR, source, text);
+    }
+
+} // End namespace eventlog
@@ -0,0 +1,105 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define EVENTLOG_ENV      "SCLOG"       // Sink: a file path, "-" for stderr (the default), "off".
+#define EVENTLOG_SLOTS    1024          // Ring entries, a power of two
+#define EVENTLOG_TEXT     480           // Bytes of text per entry, longer texts are cut
+#define EVENTLOG_SOURCE   16
+#define EVENTLOG_FLUSH_MS 100           // Sink thread period
+
+namespace eventlog {
+
+enum Level { LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR };   // Prefixed: windows.h defines ERROR
+
+struct Entry {
+    unsigned long long  seq;
+    long long           time;           // us since the epoch
+    Level               level;
+    char                source[EVENTLOG_SOURCE],
+                        text[EVENTLOG_TEXT];
+};
+
+const char*  levelName(Level level)                                          noexcept;
+std::string  format(const Entry& entry)                                      noexcept;
+
+// Fixed ring of entries, overwritten in order. A writer claims a sequence
+// number with one atomic add and publishes the slot seqlock style: it
+// never waits, and a write that finds its slot still being filled by a
+// writer one lap ahead is dropped and counted. Readers keep their own
+// cursor: the sink thread drains to file, the GUI shows only what's new,
+// and an overrun reader skips ahead to the oldest entry still there.
+
+class EventLog {
+    public:
+        EventLog(void);
+        ~EventLog(void);
+
+        EventLog(const EventLog&)                                            = delete;
+        EventLog& operator=(const EventLog&)                                 = delete;
+
+        void                write(Level level, const char* source,
+                                  const char* text)                          noexcept;
+        void                write(Level level, const char* source,
+                                  const std::string& text)                   noexcept;
+        unsigned long long  head(void)                           const       noexcept;
+        size_t              readSince(unsigned long long& cursor,
+                                      std::vector<Entry>& out, size_t max,
+                                      Level minLevel=LOG_DEBUG,
+                                      unsigned long long* skipped=nullptr) const noexcept;
+        bool                setSink(const std::string& path)                 noexcept;
+        std::string         getStats(void)                       const       noexcept;
+
+    private:
+        struct Slot {
+            std::atomic<unsigned long long>  stamp;    // 2 * seq + 2 when published, odd while written.
+            Entry                            entry;
+        };
+
+        std::vector<Slot>                   ring;
+        std::atomic<unsigned long long>     next,
+                                            dropped,
+                                            lost;           // Overwritten before the sink got them.
+        unsigned long long                  sinkCursor;
+        std::FILE                           *sink;
+        bool                                ownSink;
+        std::mutex                          sinkMtx;
+        std::condition_variable             sinkCv;
+        bool                                stopping;
+        std::thread                         sinkThread;
+
+        void                drain(void)                                      noexcept;
+};
+
+EventLog&    shared(void)                                                    noexcept;
+
+void         debug(const char* source, const std::string& text)              noexcept;
+void         info(const char* source, const std::string& text)               noexcept;
+void         warn(const char* source, const std::string& text)               noexcept;
+void         error(const char* source, const std::string& text)              noexcept;
+
+} // End namespace eventlog
@@ -19,253 +19,131 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
-#include <unistd.h>
-
-#include <string>
 #include <iostream>
 
-#include <QScrollBar>
 #include <QPushButton>
-
-using std::to_string;
-using std::string;
-using sslconn::ChatContext;
-
-Reader::Reader(MainWindow* manWind)
-    : mainWindow{manWind},
-      running{true},
-      context{manWind->getCtx()}
-{}
-
-Reader::~Reader(void){}
-
-void Reader::endLoops(void) noexcept{
-    running = false;
-}
-
-void Reader::run(void) {
-    while(running){
-         static_cast<void>(usleep(POLLING_INTERVAL));
-         if(context.getStatus() == sslconn::connected)
-              mainWindow->receiverWrapper();
-    }
-}
-
-Listener::Listener(MainWindow* manWind)
-    : mainWindow{manWind},
-      running{true},
-      context{manWind->getCtx()}
-{}
-
-Listener::~Listener(void){}
-
-void Listener::endLoops(void) noexcept{
-    running = false;
-}
-
-void Listener::run(void) {
-    while(running){
-         static_cast<void>(usleep(POLLING_INTERVAL));
-
-         if(context.getStatus() == sslconn::listening){
-             if(!mainWindow->listenerWrapper())
-                 break;
-         }
-    }
-}
-
-ReturnPress::ReturnPress(QObject *parent)
-    : QObject(parent)
-{}
-
-bool ReturnPress::eventFilter(QObject *obj, QEvent *event){
-    if (event->type() == QEvent::KeyPress) {
-        QKeyEvent *key = static_cast<QKeyEvent *>(event);
-        if((key->key()==Qt::Key_Enter) || (key->key()==Qt::Key_Return) ) {
-             emit returnKeyPressed();
-             return true;
-        }
-    }
-    return QObject::eventFilter(obj, event);
-}
+#include <QScrollBar>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
-    returnPress{nullptr},
-    connectionStatus{false},
     statusLabel{nullptr},
-    connection{context},
-    reader{this},
-    listener{this}
+    diagHelp{nullptr},
+    replayTab{nullptr},
+    logCursor{0}
 {
+    logBatch.reserve(LOG_BATCH);
 
     ui->setupUi(this);
     ui->menuBar->setNativeMenuBar(false);
-    diagConf  = new DialogConf(this);
+    ui->logView->setMaximumBlockCount(LOG_LINES);
     diagHelp  = new DialogHelp(this);
 
-    connect(ui->quitButton, &QPushButton::clicked,   this, &MainWindow::quitApp);
-    connect(ui->clearButton, &QPushButton::clicked,  this, &MainWindow::clearHistory);
-    connect(ui->configButton, &QPushButton::clicked, this, &MainWindow::editConfig);
-
-    qRegisterMetaType<std::string>();
-
-    connect(this, &MainWindow::updateMsgSnd,         this, &MainWindow::appendMsgSnd);
-    connect(this, &MainWindow::updateMsgRec,         this, &MainWindow::appendMsgRec);
-    connect(this, &MainWindow::updateMsgStat,        this, &MainWindow::appendMsgStat);
-    connect(this, &MainWindow::updateMsgErr,         this, &MainWindow::appendMsgErr);
-
-    ui->received->setReadOnly(true);
-
-    returnPress=new ReturnPress(this);
-    ui->sent->installEventFilter(returnPress);
-    connect(returnPress, &ReturnPress::returnKeyPressed, this, &MainWindow::transmit);
-
-    connect(ui->connectButton, &QPushButton::clicked,    this, [&](){ if(connectionStatus)
-                                                                         this->disconnectChat();
-                                                                      else
-                                                                         this->connectChat();
-    });
+    if(!reactor.start())
+        eventlog::error("gui", "I/O thread not started.");
 
     statusLabel = new QLabel("Disconnected", this);
     statusBar()->addPermanentWidget(statusLabel, 3);
 
-    connect(ui->actionAbout, &QAction::triggered,        this, [&](){diagHelp->exec();});
-}
+    connect(ui->quitButton, &QPushButton::clicked,   this, &MainWindow::quitApp);
+    connect(ui->newTabButton, &QPushButton::clicked, this, [&](){ ui->tabs->setCurrentWidget(newTab()); });
+    connect(ui->clearButton, &QPushButton::clicked,  this, [&](){ currentTab()->clearHistory(); });
+    connect(ui->configButton, &QPushButton::clicked, this, [&](){ ChatTab  *tab { currentTab() };
+                                                                  tab->editConfig();
+                                                                  ui->tabs->setTabText(ui->tabs->currentIndex(), tab->getTitle());
+    });
 
-sslconn::ChatContext& MainWindow::getCtx(void){
-    return context;
-}
+    connect(ui->connectButton, &QPushButton::clicked, this, [&](){ ChatTab  *tab { currentTab() };
+                                                                   if(tab->isActive())
+                                                                       tab->disconnectChat();
+                                                                   else
+                                                                       tab->connectChat();
+    });
 
-void MainWindow::quitApp(void){
-    reader.endLoops();
-    listener.endLoops();
-    static_cast<void>(usleep(POLLING_INTERVAL * 10));
-    if(reader.isRunning()) reader.terminate();
-    if(listener.isRunning()) listener.terminate();
-    this->close();
-    std::cerr << "Exit!\n";
-}
+    connect(ui->tabs, &QTabWidget::tabCloseRequested, this, &MainWindow::closeTab);
+    connect(ui->tabs, &QTabWidget::currentChanged,    this, [&](int){ showStatus(currentTab()); });
 
-void MainWindow::clearHistory(void){
-    ui->received->clear();
-    std::cerr << "Deleted: History!\n";
-}
+    replayTab = newTab();
 
-void  MainWindow::editConfig(void){
-    diagConf->exec();
+    connect(ui->actionAbout, &QAction::triggered,        this, [&](){diagHelp->exec();});
 }
 
-void  MainWindow::appendMsgSnd(const string& prompt){
-        screenMtx.lock();
-        ui->received->appendPlainText(prompt.c_str());
-        ui->received->appendPlainText(ui->sent->toPlainText());
-        ui->received->appendPlainText(" ");
-        ui->received->verticalScrollBar()->setValue(ui->received->verticalScrollBar()->maximum());
-        screenMtx.unlock();
+ChatTab* MainWindow::currentTab(void) const noexcept{
+    return static_cast<ChatTab*>(ui->tabs->currentWidget());
 }
 
-void  MainWindow::appendMsgRec(const string& prompt, const string& msg){
-        screenMtx.lock();
-        ui->received->appendPlainText(prompt.c_str());
-        ui->received->appendPlainText(msg.c_str());
-        ui->received->appendPlainText(" ");
-        ui->received->verticalScrollBar()->setValue(ui->received->verticalScrollBar()->maximum());
-        screenMtx.unlock();
-}
+ChatTab* MainWindow::newTab(void){
+    ChatTab  *tab { new ChatTab(reactor, ui->tabs) };
 
-void  MainWindow::appendMsgStat(void){
-    if(context.getInfoMsg().size() != 0){
-        screenMtx.lock();
-        ui->received->appendPlainText(INFO_PROMPT);
-        ui->received->appendPlainText(context.getInfoMsg().c_str());
-        ui->received->appendPlainText(" ");
-        ui->received->verticalScrollBar()->setValue(ui->received->verticalScrollBar()->maximum());
-        screenMtx.unlock();
-    }
-}
+    connect(tab, &ChatTab::updateMsgStat,  this, &MainWindow::appendMsgStat);
+    connect(tab, &ChatTab::statusChanged,  this, &MainWindow::showStatus);
+    static_cast<void>(ui->tabs->addTab(tab, tab->getTitle()));
 
-void  MainWindow::appendMsgErr(const string& err){
-        screenMtx.lock();
-        statusLabel->setText(err.c_str());
-        ui->received->appendPlainText(context.getErrMsg().c_str());
-        ui->received->verticalScrollBar()->setValue(ui->received->verticalScrollBar()->maximum());
-        screenMtx.unlock();
+    return tab;
 }
 
-bool  MainWindow::connectChat(void){
-    context.setPwd(diagConf->getPassword());
-    context.setPort(to_string(diagConf->getPort()));
-    context.setIp(diagConf->getIpAddress());
-    context.setServer(diagConf->getServerMode() ? sslconn::SERVER : sslconn::CLIENT);
+// The session ends before the widget: the reactor is done with it once shutdown returns.
+void MainWindow::closeTab(int index){
+    ChatTab  *tab { static_cast<ChatTab*>(ui->tabs->widget(index)) };
 
-    connectionStatus = true;
+    tab->shutdown();
+    ui->tabs->removeTab(index);
+    if(tab == replayTab)
+        replayTab = nullptr;
+    tab->deleteLater();
 
-    if(connection.configure()){
-        ui->connectButton->setText("Disconnect");
-        statusLabel->setText("Connected");
-    } else {
-        updateMsgErr("Connect Error");
-    }
-
-    reader.start();
-
-    if(diagConf->getServerMode()){
-         std::cerr << "Starting Listener!\n";
-         listener.start();
-    }
-
-    updateMsgStat();
-
-    return true;
+    if(ui->tabs->count() == 0)
+        static_cast<void>(newTab());
 }
 
-void MainWindow::disconnectChat(void){
-    ui->connectButton->setText("Connect");
-    statusLabel->setText("Disconnected");
-    connectionStatus = false;
-}
+void MainWindow::quitApp(void){
+    for(int idx = 0; idx < ui->tabs->count(); idx++)
+        static_cast<ChatTab*>(ui->tabs->widget(idx))->shutdown();
+    reactor.stop();
+    this->close();
 
-void MainWindow::transmit(void){
-    updateMsgSnd("me:");
-    if(connection.sendMessage(ui->sent->toPlainText().toStdString()))
-       ui->sent->clear();
-    else
-       updateMsgErr("Error Sending Msg");
+    for(int idx = 0; idx < ui->tabs->count(); idx++)
+        std::cerr << static_cast<ChatTab*>(ui->tabs->widget(idx))->getStats() << "\n";
+    std::cerr << truststore::shared().getStats() << "\n"
+              << eventlog::shared().getStats() << "\nExit!\n";
 }
 
-void  MainWindow::receiverWrapper(void){
-    receive(context.getResponse());
-}
+// Shows only the log entries added since the last call, whichever tab asked.
+void  MainWindow::appendMsgStat(void){
+    logBatch.clear();
+    if(eventlog::shared().readSince(logCursor, logBatch, LOG_BATCH, eventlog::LOG_INFO) == 0)
+        return;
 
-bool  MainWindow::listenerWrapper(void){
-    bool  ret  {  connection.listenIncoming() };
+    for(const auto& entry : logBatch)
+        ui->logView->appendPlainText(QString("%1 %2: %3").arg(eventlog::levelName(entry.level))
+                                                         .arg(entry.source).arg(entry.text));
+    ui->logView->verticalScrollBar()->setValue(ui->logView->verticalScrollBar()->maximum());
+}
 
-    if(!ret)
-        updateMsgErr("Listener Error.");
+void  MainWindow::showStatus(ChatTab* tab){
+    if(tab == nullptr || tab != currentTab())
+        return;
 
-    return ret;
+    statusLabel->setText(tab->getStatusText());
+    ui->connectButton->setText(tab->isActive() ? "Disconnect" : "Connect");
 }
 
-void MainWindow::receive(const QString msg){
-    bool res  { connection.readIncoming() };
-    if(res)
-       updateMsgRec("peer: ", msg.toStdString());
-    else
-       updateMsgErr("Error Reading Msg");
-
+bool MainWindow::replayMessage(const char* msg, int len) noexcept{
+    return replayTab != nullptr && replayTab->replayMessage(msg, len);
 }
 
-void MainWindow::receive(const char* msg){
-    bool res { connection.readIncoming() };
-    if(res)
-        updateMsgRec("peer: ", msg);
-    else
-        updateMsgErr("Error Reading Msg");
+unsigned long long MainWindow::getRendered(void) const noexcept{
+    return replayTab != nullptr ? replayTab->getRendered() : 0;
 }
 
+// Tabs go first: they detach from the reactor, a member destroyed before the widgets.
 MainWindow::~MainWindow(){
+    while(ui->tabs->count() > 0){
+        QWidget  *tab { ui->tabs->widget(0) };
+        ui->tabs->removeTab(0);
+        delete tab;
+    }
+    reactor.stop();
 
     delete ui;
 }
@@ -18,69 +18,29 @@
 
 #pragma once
 
-#include "dialogconf.h"
 #include "dialoghelp.h"
+#include "chattab.h"
 
-#include "sslconn.h"
+#include "reactor.h"
+#include "eventlog.h"
+#include "truststore.h"
 
-#include <QThread>
-#include <QMutex>
 #include <QMainWindow>
 
 #include <QString>
 #include <QLabel>
-#include <QMetaType>
 
-Q_DECLARE_METATYPE(std::string)
+#include <vector>
+
+#define LOG_BATCH 64                  // Log entries shown per status update
+#define LOG_LINES 1000                // Lines the log pane keeps
 
 namespace Ui {
 class MainWindow;
 }
 
-class ReturnPress : public QObject {
-    Q_OBJECT
-
-protected:
-    bool eventFilter(QObject *obj, QEvent *event);
-
-public:
-    explicit ReturnPress(QObject *parent=nullptr);
-
-    signals:
-        void returnKeyPressed(void);
-};
-
-class MainWindow;
-
-class Reader : public QThread  {
-
-public:
-    explicit                      Reader(MainWindow* manWind);
-    virtual                       ~Reader(void)             override;
-    void                          endLoops(void)            noexcept;
-
-private:
-    MainWindow*                   mainWindow;
-    bool                          running;
-    sslconn::ChatContext&         context;
-
-    void                          run(void)                 override;
-};
-
-class Listener : public QThread {
-
-public:
-    explicit                      Listener(MainWindow* manWind);
-    virtual                       ~Listener(void)           override;
-    void                          endLoops(void)            noexcept;
-
-private:
-    MainWindow*                   mainWindow;
-    bool                          running;
-    sslconn::ChatContext&         context;
-
-    void                          run(void)                 override;
-};
+// Every tab is a session; a single Reactor thread serves all their sockets.
+// The event log is process wide, so it has its own pane under the tabs.
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -90,50 +50,26 @@ public:
     explicit MainWindow(QWidget *parent=nullptr);
     ~MainWindow();
 
-    DialogConf  *diagConf;
+    // First tab, for tools/guibench.
+    bool                replayMessage(const char* msg, int len)  noexcept;
+    unsigned long long  getRendered(void)                 const  noexcept;
 
 private:
-    friend Reader;
-    friend Listener;
-
     Ui::MainWindow             *ui;
-    ReturnPress                *returnPress;
-    QMutex                     screenMtx;
-    bool                       connectionStatus;
     QLabel                     *statusLabel;
     DialogHelp                 *diagHelp;
-    sslconn::ChatContext       context;
-    sslconn::SslConn           connection;
-    Reader                     reader;
-    Listener                   listener;
-
-    void quitApp(void);
-    void clearHistory(void);
-    void editConfig(void);
-
-    void receive(const QString msg);
-    void receive(const char* msg);
-    void receiverWrapper(void);
-    bool listenerWrapper(void);
-
-    bool connectChat(void);
-    void disconnectChat(void);
-    sslconn::ChatContext& getCtx(void);
+    sslconn::Reactor           reactor;
+    ChatTab                    *replayTab;
+    unsigned long long         logCursor;     // Next event log entry to show.
+    std::vector<eventlog::Entry>
+                               logBatch;
 
+    ChatTab* currentTab(void)                                  const  noexcept;
+    ChatTab* newTab(void);
+    void     closeTab(int index);
+    void     quitApp(void);
 
 private slots:
-    void transmit(void);
-
-    void appendMsgSnd(const std::string& prompt);
-    void appendMsgRec(const std::string& prompt,  const std::string& msg);
     void appendMsgStat(void);
-    void appendMsgErr(const std::string& err);
-
-signals:
-
-    void updateMsgSnd(const std::string& prompt);
-    void updateMsgRec(const std::string& prompt,  const std::string& msg);
-    void updateMsgStat(void);
-    void updateMsgErr(const std::string& err);
-
+    void showStatus(ChatTab* tab);
 };
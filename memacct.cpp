@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "memacct.h"
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+
+#include <openssl/crypto.h>
+
+namespace memacct {
+
+    using std::atomic;
+    using std::malloc;
+    using std::realloc;
+    using std::free;
+    using std::memcpy;
+
+    // The header keeps the payload aligned like malloc() does.
+    static const size_t          HEADER      { alignof(std::max_align_t) > sizeof(size_t) ?
+                                               alignof(std::max_align_t) : sizeof(size_t) };
+
+    static atomic<long long>     live        { 0 };
+    static atomic<bool>          installed   { false };
+    static thread_local long long
+                                 threadLive  { 0 };
+    static thread_local Scope    *innermost  { nullptr };
+
+    static void track(long long bytes) noexcept{
+        live       += bytes;
+        threadLive += bytes;
+    }
+
+    static void* allocate(size_t num, const char* file, int line) noexcept{
+        static_cast<void>(file); static_cast<void>(line);
+
+        char  *block { static_cast<char*>(malloc(num + HEADER)) };
+        if(block == nullptr)
+            return nullptr;
+
+        memcpy(block, &num, sizeof(num));
+        track(static_cast<long long>(num));
+        return block + HEADER;
+    }
+
+    static void* reallocate(void* addr, size_t num, const char* file, int line) noexcept{
+        if(addr == nullptr)
+            return allocate(num, file, line);
+
+        char    *block { static_cast<char*>(addr) - HEADER };
+        size_t  old    { 0 };
+        memcpy(&old, block, sizeof(old));
+
+        char    *moved { static_cast<char*>(realloc(block, num + HEADER)) };
+        if(moved == nullptr)
+            return nullptr;
+
+        memcpy(moved, &num, sizeof(num));
+        track(static_cast<long long>(num) - static_cast<long long>(old));
+        return moved + HEADER;
+    }
+
+    static void release(void* addr, const char* file, int line) noexcept{
+        static_cast<void>(file); static_cast<void>(line);
+
+        if(addr == nullptr)
+            return;
+
+        char    *block { static_cast<char*>(addr) - HEADER };
+        size_t  num    { 0 };
+        memcpy(&num, block, sizeof(num));
+
+        track(-static_cast<long long>(num));
+        free(block);
+    }
+
+    // Must run before OpenSSL allocates anything: later calls are refused.
+    bool install(void) noexcept{
+        if(!installed && CRYPTO_set_mem_functions(allocate, reallocate, release) == 1)
+            installed = true;
+
+        return installed;
+    }
+
+    bool isInstalled(void) noexcept{
+        return installed;
+    }
+
+    long long totalBytes(void) noexcept{
+        return live;
+    }
+
+    long long threadBytes(void) noexcept{
+        return threadLive;
+    }
+
+    // The outer scope is charged up to here, and restarts from where the inner one ends.
+    Scope::Scope(long long& target) noexcept
+        : account{target},
+          start{threadLive},
+          outer{innermost}
+    {
+        if(outer != nullptr)
+            outer->account += start - outer->start;
+        innermost = this;
+    }
+
+    Scope::~Scope(void){
+        account   += threadLive - start;
+        innermost  = outer;
+        if(outer != nullptr)
+            outer->start = threadLive;
+    }
+
+} // End namespace memacct
@@ -0,0 +1,50 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+
+// Heap accounting for OpenSSL: every allocation carries a small header with
+// its size, so the library's live bytes are known globally and, through a
+// per thread counter, can be attributed to the session a call was made for.
+
+namespace memacct {
+
+bool        install(void)                                                    noexcept;
+bool        isInstalled(void)                                                noexcept;
+long long   totalBytes(void)                                                 noexcept;
+long long   threadBytes(void)                                                noexcept;
+
+// Adds to target the bytes OpenSSL kept, net of frees, while in scope.
+// Scopes nest: while an inner one is open the bytes go to its target only.
+class Scope {
+    public:
+        explicit Scope(long long& target)                                    noexcept;
+        ~Scope(void);
+
+        Scope(const Scope&)                                                  = delete;
+        Scope& operator=(const Scope&)                                       = delete;
+
+    private:
+        long long&          account;
+        long long           start;
+        Scope               *outer;
+};
+
+} // End namespace memacct
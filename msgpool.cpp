@@ -0,0 +1,142 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "msgpool.h"
+
+#include <new>
+
+namespace msgpool {
+
+    using std::string;
+    using std::to_string;
+    using std::lock_guard;
+    using std::mutex;
+    using std::nothrow;
+
+    MsgPool::MsgPool(void)
+        : slab(MSGPOOL_SLOTS),
+          freeList{nullptr},
+          readyHead{nullptr},
+          readyTail{nullptr},
+          messages{0},
+          heapFallbacks{0},
+          notifies{0}
+    {
+        for(auto& slot : slab){
+            slot.len  = 0;
+            slot.next = freeList;
+            freeList  = &slot;
+        }
+    }
+
+    MsgPool::~MsgPool(void){
+        MsgBuffer  *buf { takeAll() };
+
+        while(buf != nullptr){
+            MsgBuffer  *next { buf->next };
+            release(buf);
+            buf = next;
+        }
+    }
+
+    bool MsgPool::owned(const MsgBuffer* buf) const noexcept{
+        return !slab.empty() && buf >= &slab.front() && buf <= &slab.back();
+    }
+
+    MsgBuffer* MsgPool::acquire(void) noexcept{
+        MsgBuffer  *buf { nullptr };
+        {
+            lock_guard<mutex> lock(mtx);
+            if(freeList != nullptr){
+                buf      = freeList;
+                freeList = buf->next;
+            }
+        }
+
+        if(buf == nullptr){
+            heapFallbacks++;
+            buf = new (nothrow) MsgBuffer;
+        }
+
+        if(buf != nullptr){
+            buf->len  = 0;
+            buf->next = nullptr;
+        }
+
+        return buf;
+    }
+
+    void MsgPool::release(MsgBuffer* buf) noexcept{
+        if(buf == nullptr)
+            return;
+
+        if(!owned(buf)){
+            delete buf;
+            return;
+        }
+
+        lock_guard<mutex> lock(mtx);
+        buf->next = freeList;
+        freeList  = buf;
+    }
+
+    // Returns true when the queue was empty: only then the consumer needs a wakeup.
+    bool MsgPool::push(MsgBuffer* buf) noexcept{
+        lock_guard<mutex> lock(mtx);
+
+        messages++;
+        buf->next = nullptr;
+        if(readyTail == nullptr){
+            readyHead = readyTail = buf;
+            notifies++;
+            return true;
+        }
+
+        readyTail->next = buf;
+        readyTail       = buf;
+        return false;
+    }
+
+    MsgBuffer* MsgPool::takeAll(void) noexcept{
+        lock_guard<mutex> lock(mtx);
+
+        MsgBuffer  *head { readyHead };
+        readyHead = readyTail = nullptr;
+        return head;
+    }
+
+    unsigned long long MsgPool::getHeapFallbacks(void) const noexcept{
+        return heapFallbacks;
+    }
+
+    string MsgPool::getStats(void) const noexcept{
+        string  res;
+
+        try{
+            res.append("Message pool - slots: ").append(to_string(slab.size()))
+               .append(" messages: ").append(to_string(messages))
+               .append(" GUI notifications: ").append(to_string(notifies))
+               .append(" heap fallbacks: ").append(to_string(heapFallbacks));
+        }catch(...){
+            res = "getStats error.";
+        }
+
+        return res;
+    }
+
+} // End namespace msgpool
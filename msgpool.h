@@ -0,0 +1,70 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define MSGPOOL_SLOTS      64         // Preallocated receive buffers
+#define MSGPOOL_SLOT_SIZE  2048       // Bytes per buffer, terminator included
+
+namespace msgpool {
+
+struct MsgBuffer {
+    int          len;
+    bool         last;                // Last piece of its message
+    MsgBuffer    *next;
+    char         data[MSGPOOL_SLOT_SIZE];
+};
+
+// Fixed slab of receive buffers: the reader fills one, queues it for the
+// GUI, and the GUI gives it back after rendering. The heap is touched only
+// when every slot is in flight, and that is counted.
+
+class MsgPool {
+    public:
+        MsgPool(void);
+        ~MsgPool(void);
+
+        MsgPool(const MsgPool&)                                              = delete;
+        MsgPool& operator=(const MsgPool&)                                   = delete;
+
+        MsgBuffer*           acquire(void)                                   noexcept;
+        void                 release(MsgBuffer* buf)                         noexcept;
+        bool                 push(MsgBuffer* buf)                            noexcept;
+        MsgBuffer*           takeAll(void)                                   noexcept;
+        unsigned long long   getHeapFallbacks(void)              const       noexcept;
+        std::string          getStats(void)                      const       noexcept;
+
+    private:
+        std::vector<MsgBuffer>          slab;
+        MsgBuffer                       *freeList,
+                                        *readyHead,
+                                        *readyTail;
+        mutable std::mutex              mtx;
+        std::atomic<unsigned long long> messages,
+                                        heapFallbacks,
+                                        notifies;
+
+        bool                 owned(const MsgBuffer* buf)         const       noexcept;
+};
+
+} // End namespace msgpool
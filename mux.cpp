@@ -0,0 +1,392 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "mux.h"
+
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+namespace sslconn {
+
+    using std::string;
+    using std::thread;
+    using std::mutex;
+    using std::lock_guard;
+    using std::unique_lock;
+    using std::memcpy;
+    using std::min;
+    using std::max;
+    using std::chrono::milliseconds;
+
+    static void putHeader(char* frame, unsigned int channel, FrameType type, size_t len, bool end=false) noexcept{
+        frame[0] = MUX_MARK;
+        frame[1] = static_cast<char>(channel);
+        frame[2] = static_cast<char>(end ? type | MUX_END : type);
+        frame[3] = static_cast<char>((len >> 8) & 0xFF);
+        frame[4] = static_cast<char>(len & 0xFF);
+    }
+
+    Mux::Mux(SslConn& connection)
+        : conn{connection},
+          channels{},
+          running{false},
+          lastServed{0},
+          zipInput{2 * MUX_FRAME_PAYLOAD}
+    {
+        for(auto& chan : channels)
+            chan = { false, 0, false, {}, 0, 0, MUX_WINDOW, 0, false, string(), false };
+
+        // The dictionary id is announced on connect, see SslConn::announceMux().
+        if(conn.context.zipEnabled && codec.setDictionary(zipcodec::loadDictionary(getenv("SCZDICT")))){
+            unzipBuf.resize(MUX_ZIP_INPUT);
+            conn.context.zipDictId = codec.getDictId();
+        }
+    }
+
+    Mux::~Mux(void){
+        stop();
+    }
+
+    bool Mux::start(void) noexcept{
+        lock_guard<mutex> lock(mtx);
+
+        if(running)
+            return true;
+
+        try{
+            running = true;
+            writer  = thread(&Mux::run, this);
+        }catch(...){
+            running = false;
+        }
+
+        return running;
+    }
+
+    void Mux::stop(void) noexcept{
+        {
+            lock_guard<mutex> lock(mtx);
+            running = false;
+        }
+
+        ready.notify_all();
+        space.notify_all();
+        if(writer.joinable())
+            writer.join();
+    }
+
+    void Mux::openChannel(unsigned int channel, unsigned int priority, bool bulk) noexcept{
+        lock_guard<mutex> lock(mtx);
+
+        if(channel >= MUX_CHANNELS)
+            return;
+
+        channels[channel].open     = true;
+        channels[channel].priority = priority;
+        channels[channel].bulk     = bulk;
+    }
+
+    void Mux::setSink(const MuxSink& sink) noexcept{
+        lock_guard<mutex> lock(mtx);
+        sinkFn = sink;
+    }
+
+    // Until the peer announces framing, data goes out directly as plain messages.
+    bool Mux::send(unsigned int channel, const char* data, size_t len) noexcept{
+        if(!conn.context.isMuxActive()){
+            try{
+                return conn.sendMessage(string(data, len));
+            }catch(...){
+                return false;
+            }
+        }
+
+        if(len > MESSAGE_MAX || !start())
+            return false;
+
+        lock_guard<mutex> lock(mtx);
+
+        if(channel >= MUX_CHANNELS || !channels[channel].open)
+            return false;
+
+        Channel&  chan { channels[channel] };
+        if(!running || chan.queued >= MUX_QUEUE_LIMIT)
+            return false;
+
+        try{
+            chan.queue.emplace_back(data, len);
+        }catch(...){
+            return false;
+        }
+        chan.queued += len;
+
+        ready.notify_one();
+        return true;
+    }
+
+    // False on timeout, or when the mux stops.
+    bool Mux::waitSpace(unsigned int channel, unsigned int timeoutMs) noexcept{
+        unique_lock<mutex> lock(mtx);
+
+        if(channel >= MUX_CHANNELS)
+            return false;
+
+        const Channel&  chan { channels[channel] };
+        return space.wait_for(lock, milliseconds(timeoutMs),
+                              [&](){ return !running || chan.queued < MUX_QUEUE_LIMIT; }) && running;
+    }
+
+    // A new session: the peer's window is whole again, nothing is owed or half received.
+    void Mux::reset(void) noexcept{
+        {
+            lock_guard<mutex> lock(mtx);
+
+            for(auto& chan : channels){
+                chan.queue.clear();
+                chan.head      = 0;
+                chan.queued    = 0;
+                chan.credit    = MUX_WINDOW;
+                chan.consumed  = 0;
+                chan.updateDue = false;
+                chan.partial.clear();
+                chan.discard   = false;
+            }
+            lastServed = 0;
+            zipInput   = 2 * MUX_FRAME_PAYLOAD;
+        }
+
+        space.notify_all();
+    }
+
+    bool Mux::isFrame(const char* buf, int len) const noexcept{
+        return len >= MUX_HEADER && buf[0] == MUX_MARK;
+    }
+
+    bool Mux::zipActive(void) const noexcept{
+        return conn.context.isMuxActive() && conn.context.zipDictId != 0 &&
+               conn.context.zipPeerId == conn.context.zipDictId;
+    }
+
+    string Mux::getZipStats(void) const noexcept{
+        return codec.getStats();
+    }
+
+    // Runs on the reader: data frames go to the sink once their message is
+    // complete, window updates give credit back. Until both peers announced
+    // framing every record is a plain message, even one that looks like a frame.
+    bool Mux::handleRecord(const char* buf, int len) noexcept{
+        if(!conn.context.isMuxActive() || !isFrame(buf, len))
+            return false;
+
+        unsigned int  channel { static_cast<unsigned char>(buf[1]) },
+                      type    { static_cast<unsigned char>(buf[2]) & ~static_cast<unsigned int>(MUX_END) },
+                      plen    { static_cast<unsigned int>(static_cast<unsigned char>(buf[3])) << 8 |
+                                static_cast<unsigned char>(buf[4]) };
+        bool          end     { (static_cast<unsigned char>(buf[2]) & MUX_END) != 0 };
+
+        if(channel >= MUX_CHANNELS || plen != static_cast<unsigned int>(len - MUX_HEADER))
+            return true;
+
+        // Window updates for what arrives go out through the writer.
+        static_cast<void>(start());
+
+        const char  *payload { buf + MUX_HEADER };
+        size_t       size    { plen };
+        string       msg;
+        MuxSink      sink;
+        {
+            lock_guard<mutex> lock(mtx);
+            Channel&  chan { channels[channel] };
+
+            if(type == MUX_WINDOW_UPDATE && plen == 4){
+                long long  inc { 0 };
+                for(unsigned int i = 0; i < 4; i++)
+                    inc = (inc << 8) | static_cast<unsigned char>(payload[i]);
+                chan.credit += inc;
+                ready.notify_one();
+                return true;
+            }
+
+            if(type != MUX_DATA && type != MUX_DATA_ZIP)
+                return true;
+
+            // Credit counts frame bytes: what crossed the link, not what they expand to.
+            chan.consumed += plen;
+            if(chan.consumed >= MUX_WINDOW / 2){
+                chan.updateDue = true;
+                ready.notify_one();
+            }
+
+            // Compressed frames are only valid once both peers announced the same dictionary.
+            if(type == MUX_DATA_ZIP){
+                size = unzipBuf.size();
+                if(!zipActive() || unzipBuf.empty() || !codec.decompress(payload, plen, unzipBuf.data(), size)){
+                    chan.discard = !end;
+                    chan.partial.clear();
+                    return true;
+                }
+                payload = unzipBuf.data();
+            }
+
+            // A message in several frames is put back together; a single frame goes as it is.
+            if(chan.discard || chan.partial.size() + size > MESSAGE_MAX){
+                chan.discard = !end;
+                chan.partial.clear();
+                return true;
+            }
+            if(!end || !chan.partial.empty()){
+                try{
+                    chan.partial.append(payload, size);
+                }catch(...){
+                    chan.discard = !end;
+                    chan.partial.clear();
+                    return true;
+                }
+                if(!end)
+                    return true;
+                msg.swap(chan.partial);
+                payload = msg.data();
+                size    = msg.size();
+            }
+            sink = sinkFn;
+        }
+
+        if(sink)
+            sink(channel, payload, static_cast<int>(size));
+
+        return true;
+    }
+
+    bool Mux::pendingUpdate(unsigned int& channel) const noexcept{
+        for(unsigned int i = 0; i < MUX_CHANNELS; i++)
+            if(channels[i].updateDue){
+                channel = i;
+                return true;
+            }
+
+        return false;
+    }
+
+    // Most urgent channel with data and credit, round robin among equals.
+    int Mux::pick(void) const noexcept{
+        int  best { -1 };
+
+        for(unsigned int i = 1; i <= MUX_CHANNELS; i++){
+            unsigned int    idx  { (lastServed + i) % MUX_CHANNELS };
+            const Channel&  chan { channels[idx] };
+
+            if(!chan.open || chan.queue.empty() || chan.credit <= 0)
+                continue;
+            if(best < 0 || chan.priority < channels[static_cast<unsigned int>(best)].priority)
+                best = static_cast<int>(idx);
+        }
+
+        return best;
+    }
+
+    void Mux::run(void) noexcept{
+        unique_lock<mutex>  lock(mtx);
+        char                frame[MUX_HEADER + MUX_FRAME_PAYLOAD];
+
+        while(running){
+            unsigned int  channel { 0 };
+            size_t        len     { 0 };
+
+            if(pendingUpdate(channel)){
+                Channel&    chan { channels[channel] };
+                long long   inc  { chan.consumed };
+
+                chan.consumed  = 0;
+                chan.updateDue = false;
+                putHeader(frame, channel, MUX_WINDOW_UPDATE, 4);
+                for(unsigned int i = 0; i < 4; i++)
+                    frame[MUX_HEADER + i] = static_cast<char>((inc >> (8 * (3 - i))) & 0xFF);
+                len = MUX_HEADER + 4;
+            }else{
+                int  next { pick() };
+                if(next < 0){
+                    ready.wait(lock);
+                    continue;
+                }
+
+                channel = static_cast<unsigned int>(next);
+                Channel&        chan    { channels[channel] };
+                const string&   msg     { chan.queue.front() };
+                size_t          left    { msg.size() - chan.head },
+                                room    { min(static_cast<size_t>(MUX_FRAME_PAYLOAD), static_cast<size_t>(chan.credit)) },
+                                payload { room },
+                                taken   { 0 };
+                FrameType       type    { MUX_DATA };
+                bool            zip     { zipActive() };
+
+                // Deflate as much of this message as still fits one frame; the input size
+                // follows the recent ratio. Other messages never share the deflate state.
+                if(zip && (chan.bulk || msg.size() >= conn.context.zipMin)){
+                    size_t  input { min(left, zipInput) };
+
+                    if(codec.compress(msg.data() + chan.head, input, frame + MUX_HEADER, payload)){
+                        type  = MUX_DATA_ZIP;
+                        taken = input;
+                        if(input == zipInput && payload < room / 2 && zipInput < MUX_ZIP_INPUT)
+                            zipInput = min(2 * zipInput, static_cast<size_t>(MUX_ZIP_INPUT));
+                    }else if(input == zipInput){
+                        zipInput = max(zipInput / 2, static_cast<size_t>(MUX_FRAME_PAYLOAD));
+                    }
+                }
+
+                if(type == MUX_DATA){
+                    payload = min(left, room);
+                    taken   = payload;
+                    memcpy(frame + MUX_HEADER, msg.data() + chan.head, payload);
+                    if(zip)
+                        codec.countRaw(payload);
+                }
+
+                bool  end { taken == left };
+                putHeader(frame, channel, type, payload, end);
+                chan.head   += taken;
+                chan.queued -= taken;
+                chan.credit -= static_cast<long long>(payload);
+                len          = MUX_HEADER + payload;
+                lastServed   = channel;
+
+                if(end){
+                    chan.queue.pop_front();
+                    chan.head = 0;
+                }
+                space.notify_all();
+            }
+
+            lock.unlock();
+            bool  sent { conn.writeRecord(frame, static_cast<int>(len)) };
+            lock.lock();
+
+            // A broken session drops what's queued: the frames can't be delivered.
+            if(!sent){
+                for(auto& chan : channels){
+                    chan.queue.clear();
+                    chan.head   = 0;
+                    chan.queued = 0;
+                }
+                space.notify_all();
+            }
+        }
+    }
+
+} // End namespace sslconn
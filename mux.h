@@ -0,0 +1,128 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include "sslconn.h"
+#include "zipcodec.h"
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MUX_MARK '\x02'               // First byte of a frame record
+#define MUX_HEADER 5                  // Mark, channel, type, 16 bit big endian length
+#define MUX_END 0x80                  // Type bit: the frame ends its message
+#define MUX_FRAME_PAYLOAD (RECORD_SMALL - MUX_HEADER)
+#define MUX_CHANNELS 8
+#define MUX_WINDOW 262144             // Per channel flow control window, bytes
+#define MUX_QUEUE_LIMIT 1048576       // Bytes a channel may queue: send() fails beyond
+#define MUX_CHAT 0                    // Channel of the chat lines
+#define MUX_ZIP_INPUT 16384           // Most payload bytes a compressed frame may carry
+
+namespace sslconn {
+
+enum FrameType { MUX_DATA = 0, MUX_WINDOW_UPDATE = 1, MUX_DATA_ZIP = 2 };
+
+using MuxSink = std::function<void(unsigned int channel, const char* data, int len)>;
+
+// Logical channels over one SslConn session. Every frame is one TLS record,
+// small enough to fit a segment, so a chat line waits at most one frame
+// behind a bulk transfer. A writer thread serves the most urgent channel
+// with data and credit; equal priorities share the link round robin.
+// A frame never spans two messages: the last one of a message carries
+// MUX_END, and the sink gets each message whole, as it was sent.
+// send() never waits: when the peer's credit is gone and the channel
+// queue is full it fails, a bulk sender can pace itself with waitSpace().
+// Every session starts from reset(): credit and queues of the previous
+// one don't carry over.
+// Framing starts only when both peers announced it (SCMUX=1): otherwise
+// send() writes plain messages, which any peer understands. The writer
+// starts with the first frame sent or received, so a session that never
+// frames costs no thread.
+// With SCZIP=1 on both sides and the same dictionary, frames of bulk
+// channels, and those of large messages on the others, are deflated one
+// by one against the dictionary alone. A frame holds part of a single
+// message and never shares compression state with another, so a secret
+// can't be probed through attacker text sent in a different message;
+// text and secret in the same message compress together, as anywhere.
+
+class Mux {
+    public:
+        explicit Mux(SslConn& conn);
+        ~Mux(void);
+
+        Mux(const Mux&)                                                      = delete;
+        Mux& operator=(const Mux&)                                           = delete;
+
+        bool            start(void)                                          noexcept;
+        void            stop(void)                                           noexcept;
+        void            openChannel(unsigned int channel,
+                                    unsigned int priority,
+                                    bool bulk=false)                         noexcept;
+        bool            send(unsigned int channel, const char* data,
+                             size_t len)                                     noexcept;
+        bool            waitSpace(unsigned int channel,
+                                  unsigned int timeoutMs)                    noexcept;
+        void            reset(void)                                          noexcept;
+        void            setSink(const MuxSink& sink)                         noexcept;
+        bool            handleRecord(const char* buf, int len)               noexcept;
+        bool            isFrame(const char* buf, int len)        const       noexcept;
+        std::string     getZipStats(void)                        const       noexcept;
+
+    private:
+        struct Channel {
+            bool            open;
+            unsigned int    priority;           // 0 is the most urgent
+            bool            bulk;               // Always a compression candidate
+            std::deque<std::string>
+                            queue;              // Messages to send, the first one from head on
+            size_t          head,
+                            queued;             // Bytes still to send
+            long long       credit,             // Bytes the peer can still take
+                            consumed;           // Bytes received since the last window update
+            bool            updateDue;
+            std::string     partial;            // Reader side: the message being received
+            bool            discard;            // It went over MESSAGE_MAX: dropped up to its end
+        };
+
+        SslConn&                                conn;
+        std::array<Channel, MUX_CHANNELS>       channels;
+        std::mutex                              mtx;
+        std::condition_variable                 ready,
+                                                space;
+        std::thread                             writer;
+        bool                                    running;
+        unsigned int                            lastServed;
+        MuxSink                                 sinkFn;
+        zipcodec::Codec                         codec;
+        size_t                                  zipInput;           // Adapts to what fits a frame
+        std::vector<char>                       unzipBuf;           // Reader side
+
+        void            run(void)                                            noexcept;
+        int             pick(void)                               const       noexcept;
+        bool            pendingUpdate(unsigned int& channel)     const       noexcept;
+        bool            zipActive(void)                          const       noexcept;
+};
+
+} // End namespace sslconn
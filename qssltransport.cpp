@@ -0,0 +1,310 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "qssltransport.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <QDir>
+#include <QFile>
+#include <QHostAddress>
+#include <QSslCertificate>
+#include <QSslCipher>
+#include <QSslConfiguration>
+#include <QSslKey>
+
+#include "truststore.h"
+#include "eventlog.h"
+
+namespace sslconn {
+
+    using std::string;
+
+    void QSslTransport::Server::incomingConnection(qintptr fd){
+        if(incoming)
+            incoming(fd);
+    }
+
+    QSslTransport::QSslTransport(ChatContext& ctx, const TransportEvents& ev, QObject *parent)
+        : QObject(parent),
+          context{ctx},
+          events{ev},
+          socket{nullptr},
+          status{closed},
+          sent{0},
+          received{0}
+    {
+        #ifndef WINDOWS_OPENSSL
+            const char  *home { getenv("HOME") };
+            baseDir.assign(home != nullptr ? home : ".").append("/.securechat/");
+        #else
+            baseDir.assign("C:\\securechat\\");
+        #endif
+
+        server.incoming = [this](qintptr fd){ accept(fd); };
+    }
+
+    QSslTransport::~QSslTransport(void){
+        server.close();
+        if(socket != nullptr)
+            socket->abort();
+    }
+
+    void QSslTransport::moveTo(Status next) noexcept{
+        Status  from { status.exchange(next) };
+
+        if(from != next && events.state)
+            events.state(from, next);
+    }
+
+    void QSslTransport::fail(const string& stat, const string& detail) noexcept{
+        errMsg = detail;
+        eventlog::error("qssl", detail);
+        if(events.error)
+            events.error(stat);
+    }
+
+    // The server takes the first connection only, as SslConn does.
+    bool QSslTransport::open(void) noexcept{
+        if(ConnState::isActive(status))
+            return false;
+
+        errMsg.clear();
+        if(!QSslSocket::supportsSsl()){
+            fail("Connect Error", "QSslSocket: no TLS support in this Qt build.");
+            return false;
+        }
+
+        quint16  port { static_cast<quint16>(strtoul(context.getPort().c_str(), nullptr, 10)) };
+
+        if(context.getMode() == SERVER){
+            QHostAddress  addr;
+            if(context.getIp().empty() || !addr.setAddress(QString::fromStdString(context.getIp())))
+                addr = QHostAddress::Any;
+
+            if(!server.listen(addr, port)){
+                fail("Listener Error.", "Listen: " + server.errorString().toStdString());
+                return false;
+            }
+            moveTo(listening);
+            eventlog::info("qssl", "Listening on " + context.getIp() + ":" + context.getPort());
+            return true;
+        }
+
+        // TRUST_DIR holds hashed links next to the certificates: only real files are read.
+        QList<QSslCertificate>  trusted { QSslCertificate::fromPath(QString::fromStdString(baseDir + TRUST_FILE)) };
+        const char              *envdir { getenv(TRUST_DIR_ENV) };
+        QDir                    dir(QString::fromStdString(envdir != nullptr ? string(envdir) : baseDir + TRUST_DIR));
+        for(const auto& entry : dir.entryInfoList(QDir::Files | QDir::NoSymLinks))
+            trusted.append(QSslCertificate::fromPath(entry.filePath()));
+
+        if(trusted.isEmpty()){
+            fail("Connect Error", "No trusted certificates in " + baseDir);
+            return false;
+        }
+
+        socket = new QSslSocket(this);
+        QSslConfiguration  conf { socket->sslConfiguration() };
+        conf.setCaCertificates(trusted);
+        conf.setPeerVerifyMode(QSslSocket::VerifyPeer);
+        socket->setSslConfiguration(conf);
+        wire();
+
+        moveTo(connecting);
+        socket->connectToHostEncrypted(QString::fromStdString(context.getIp()), port);
+        return true;
+    }
+
+    void QSslTransport::wire(void) noexcept{
+        connect(socket, &QSslSocket::connected,    this, [this](){ moveTo(handshaking); });
+        connect(socket, &QSslSocket::encrypted,    this, [this](){
+            QSslCipher  cipher { socket->sessionCipher() };
+            eventlog::info("qssl", "SSL negotiation finished successfully - Algorithms: " + cipher.name().toStdString() +
+                                   " - Algorithm bits: " + std::to_string(cipher.usedBits()) +
+                                   " - Connection Protocol Version: " + cipher.protocolString().toStdString());
+            moveTo(connected);
+        });
+        connect(socket, &QSslSocket::readyRead,    this, [this](){ readAll(); });
+        connect(socket, &QSslSocket::disconnected, this, [this](){
+            moveTo(closed);
+            dropSocket();
+        });
+        connect(socket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors),
+                this, [this](const QList<QSslError>& errors){ checkErrors(errors); });
+        // error() is deprecated from Qt 5.15, which renamed it.
+        #if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+            auto  socketError { &QAbstractSocket::errorOccurred };
+        #else
+            auto  socketError { QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error) };
+        #endif
+        connect(socket, socketError,
+                this, [this](QAbstractSocket::SocketError err){
+                    // The peer closing is reported by disconnected().
+                    if(err == QAbstractSocket::RemoteHostClosedError)
+                        return;
+                    fail(status == connected ? "Error Reading Msg" : "Connect Error",
+                         "QSslSocket: " + socket->errorString().toStdString());
+                    moveTo(closed);
+                    dropSocket();
+                });
+    }
+
+    void QSslTransport::accept(qintptr fd) noexcept{
+        server.close();
+        if(socket != nullptr){
+            QTcpSocket  extra;
+            static_cast<void>(extra.setSocketDescriptor(fd));
+            extra.abort();
+            return;
+        }
+
+        QFile  keyFile(QString::fromStdString(baseDir + "server.key"));
+        if(!keyFile.open(QIODevice::ReadOnly)){
+            fail("Listener Error.", "Can't read " + baseDir + "server.key");
+            moveTo(closed);
+            return;
+        }
+
+        QByteArray  pem        { keyFile.readAll() },
+                    passphrase { context.getPwd().data() };
+        QSslKey     key(pem, QSsl::Rsa, QSsl::Pem, QSsl::PrivateKey, passphrase);
+        if(key.isNull())
+            key = QSslKey(pem, QSsl::Ec, QSsl::Pem, QSsl::PrivateKey, passphrase);
+
+        QList<QSslCertificate>  chain { QSslCertificate::fromPath(QString::fromStdString(baseDir + "server.pem")) };
+        if(key.isNull() || chain.isEmpty()){
+            fail("Listener Error.", "Server certificate or key not loaded from " + baseDir);
+            moveTo(closed);
+            return;
+        }
+
+        socket = new QSslSocket(this);
+        if(!socket->setSocketDescriptor(fd)){
+            fail("Listener Error.", "Accept: " + socket->errorString().toStdString());
+            dropSocket();
+            moveTo(closed);
+            return;
+        }
+
+        QSslConfiguration  conf { socket->sslConfiguration() };
+        conf.setLocalCertificateChain(chain);
+        conf.setPrivateKey(key);
+        conf.setPeerVerifyMode(QSslSocket::VerifyNone);
+        socket->setSslConfiguration(conf);
+        wire();
+
+        moveTo(handshaking);
+        socket->startServerEncryption();
+    }
+
+    // SslConn checks the chain, not the name: a host name mismatch alone is accepted.
+    void QSslTransport::checkErrors(const QList<QSslError>& errors) noexcept{
+        for(const auto& err : errors)
+            if(err.error() != QSslError::HostNameMismatch)
+                return;
+
+        socket->ignoreSslErrors();
+    }
+
+    // Every read is a message, see qssltransport.h. A control record read
+    // alone is the heartbeat's: a ping gets its pong, the rest is dropped.
+    void QSslTransport::readAll(void) noexcept{
+        char  buf[RECORD_FULL];
+
+        while(socket != nullptr && socket->bytesAvailable() > 0){
+            qint64       len  { socket->read(buf, sizeof(buf)) };
+            if(len <= 0)
+                break;
+
+            ControlKind  kind { controlKind(buf, static_cast<int>(len)) };
+            const char  *text { buf };
+            if(kind == CTRL_PING){
+                const size_t  hlen { sizeof(HB_PING) - 1 };
+                string        pong { HB_PONG };
+                pong.append(buf + hlen, static_cast<size_t>(len) - hlen);
+                static_cast<void>(socket->write(pong.data(), static_cast<qint64>(pong.size())));
+                static_cast<void>(socket->flush());
+                continue;
+            }else if(kind == CTRL_ESCAPED){
+                text++;
+                len--;
+            }else if(kind != CTRL_NONE){
+                continue;
+            }
+
+            received++;
+            if(events.received)
+                events.received(text, static_cast<int>(len));
+        }
+    }
+
+    // flush() hands the message to TLS at once: one record up to RECORD_FULL, more past it, unmarked.
+    bool QSslTransport::send(const char* data, int len) noexcept{
+        if(socket == nullptr || status != connected || len < 0)
+            return false;
+
+        // Text that looks like control goes out with the mark doubled, as SslConn::sendMessage() does.
+        if(len > 0 && data[0] == CONTROL_MARK && socket->write(data, 1) != 1)
+            return false;
+        if(socket->write(data, len) != len)
+            return false;
+        static_cast<void>(socket->flush());
+        sent++;
+
+        return true;
+    }
+
+    // disconnectFromHost() sends close_notify once the writes are out.
+    void QSslTransport::close(void) noexcept{
+        server.close();
+        if(socket == nullptr){
+            moveTo(closed);
+            return;
+        }
+
+        moveTo(draining);
+        socket->disconnectFromHost();
+    }
+
+    void QSslTransport::dropSocket(void) noexcept{
+        if(socket == nullptr)
+            return;
+
+        socket->disconnect(this);
+        socket->deleteLater();
+        socket = nullptr;
+    }
+
+    Status QSslTransport::getStatus(void) const noexcept{
+        return status;
+    }
+
+    string QSslTransport::getErrMsg(void) const noexcept{
+        return errMsg;
+    }
+
+    string QSslTransport::getStats(void) const noexcept{
+        return "QSslSocket transport - messages sent: " + std::to_string(sent) + " received: " + std::to_string(received);
+    }
+
+    const char* QSslTransport::name(void) const noexcept{
+        return TRANSPORT_QT;
+    }
+
+} // End namespace sslconn
@@ -0,0 +1,95 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include <QObject>
+#include <QTcpServer>
+#include <QSslSocket>
+#include <QSslError>
+#include <QList>
+
+#include "transport.h"
+
+namespace sslconn {
+
+// QSslSocket, event driven: open() returns at once and the events come
+// from the event loop of the thread that owns the transport. Certificates
+// and trust store are the same files SslConn reads.
+//
+// QSslSocket reads a byte stream: the record boundaries the protocol
+// relies on are lost. What a readyRead() brings is delivered as one
+// message, so a burst may show as one and a long message as several, and
+// a control record is only recognized when a read brings it alone. A
+// message goes out as one write, cut into records by Qt and never marked
+// as continued (MSG_CONTINUED), so a peer shows one longer than a record
+// in pieces. Talk to an OpenSSL peer with its heartbeat (SCHBINTERVAL),
+// SCMUX and SCZIP off: pings that arrive alone are answered, the others
+// are shown as text. SCMUX, SCZIP, SCMSG, SCSOCKOPTS, SCSERVERS and
+// SCADMIT are not supported.
+
+class QSslTransport : public QObject, public Transport {
+    public:
+        QSslTransport(ChatContext& ctx, const TransportEvents& ev, QObject *parent=nullptr);
+        ~QSslTransport(void)                                                 override;
+
+        QSslTransport(const QSslTransport&)                                  = delete;
+        QSslTransport& operator=(const QSslTransport&)                       = delete;
+
+        bool            open(void)                                           noexcept override;
+        bool            send(const char* data, int len)                      noexcept override;
+        void            close(void)                                          noexcept override;
+        Status          getStatus(void)                          const       noexcept override;
+        std::string     getErrMsg(void)                          const       noexcept override;
+        std::string     getStats(void)                           const       noexcept override;
+        const char*     name(void)                               const       noexcept override;
+
+    private:
+        class Server : public QTcpServer {
+            public:
+                std::function<void(qintptr)>  incoming;
+
+            protected:
+                void  incomingConnection(qintptr fd)                         override;
+        };
+
+        ChatContext                 &context;
+        TransportEvents             events;
+        Server                      server;
+        QSslSocket                  *socket;
+        std::atomic<Status>         status;
+        std::string                 errMsg,
+                                    baseDir;
+        unsigned long long          sent,
+                                    received;
+
+        void            moveTo(Status next)                                  noexcept;
+        void            fail(const std::string& status,
+                             const std::string& detail)                      noexcept;
+        void            wire(void)                                           noexcept;
+        void            accept(qintptr fd)                                   noexcept;
+        void            readAll(void)                                        noexcept;
+        void            checkErrors(const QList<QSslError>& errors)          noexcept;
+        void            dropSocket(void)                                     noexcept;
+};
+
+} // End namespace sslconn
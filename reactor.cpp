@@ -0,0 +1,278 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+
+#include "reactor.h"
+
+#ifndef WINDOWS_OPENSSL
+    #include <poll.h>
+    #include <errno.h>
+#else
+    #include <winsock2.h>
+    #define poll WSAPoll
+#endif
+
+#include "stats.h"
+#include "eventlog.h"
+
+namespace sslconn {
+
+    using std::vector;
+    using std::mutex;
+    using std::lock_guard;
+    using std::thread;
+
+    using stats::nowUs;
+
+    #ifndef WINDOWS_OPENSSL
+        using PollFd = struct pollfd;
+    #else
+        using PollFd = WSAPOLLFD;
+    #endif
+
+    Reactor::Reactor(void)
+        : handlers{},
+          running{false},
+          wakeFds{-1, -1}
+    {
+        // Without the pipe (Windows) changes are seen at the next tick.
+        #ifndef WINDOWS_OPENSSL
+            if(pipe(wakeFds) != 0){
+                wakeFds[0] = -1;
+                wakeFds[1] = -1;
+            }else{
+                static_cast<void>(setBlocking(wakeFds[0], false));
+                static_cast<void>(setBlocking(wakeFds[1], false));
+            }
+        #endif
+    }
+
+    Reactor::~Reactor(void){
+        stop();
+        #ifndef WINDOWS_OPENSSL
+            if(wakeFds[0] >= 0) close(wakeFds[0]);
+            if(wakeFds[1] >= 0) close(wakeFds[1]);
+        #endif
+    }
+
+    bool Reactor::start(void) noexcept{
+        if(running)
+            return true;
+
+        try{
+            running = true;
+            loop    = thread(&Reactor::run, this);
+        }catch(...){
+            running = false;
+            eventlog::error("reactor", "Can't start the I/O thread.");
+            return false;
+        }
+
+        return true;
+    }
+
+    void Reactor::stop(void) noexcept{
+        if(!running)
+            return;
+
+        running = false;
+        wake();
+        if(loop.joinable())
+            loop.join();
+    }
+
+    // A session established before it was attached goes non-blocking here.
+    bool Reactor::attach(SslConn& conn, const ReactorHandler& handler) noexcept{
+        {
+            lock_guard<mutex> lock(mtx);
+
+            for(const auto& slot : handlers)
+                if(slot.conn == &conn)
+                    return false;
+
+            try{
+                handlers.push_back({ &conn, handler });
+            }catch(...){
+                return false;
+            }
+
+            conn.setNonBlocking(true);
+            if(conn.pollFd() >= 0)
+                static_cast<void>(setBlocking(conn.pollFd(), false));
+        }
+
+        wake();
+        return true;
+    }
+
+    // Returns once the session's handler has finished, if it was running.
+    void Reactor::detach(SslConn& conn) noexcept{
+        lock_guard<mutex> lock(mtx);
+
+        for(auto slot = handlers.begin(); slot != handlers.end(); ++slot){
+            if(slot->conn == &conn){
+                handlers.erase(slot);
+                break;
+            }
+        }
+    }
+
+    void Reactor::wake(void) noexcept{
+        #ifndef WINDOWS_OPENSSL
+            const char  byte { 0 };
+            if(wakeFds[1] >= 0)
+                static_cast<void>(write(wakeFds[1], &byte, 1));
+        #endif
+    }
+
+    // Wakes the reactor only for the first task queued since its last pass.
+    bool Reactor::post(ReactorTask&& task) noexcept{
+        bool  first { false };
+
+        try{
+            lock_guard<mutex> lock(taskMtx);
+            first = tasks.empty();
+            tasks.push_back(std::move(task));
+        }catch(...){
+            return false;
+        }
+
+        if(first)
+            wake();
+        return true;
+    }
+
+    void Reactor::runTasks(void) noexcept{
+        {
+            lock_guard<mutex> lock(taskMtx);
+            due.swap(tasks);
+        }
+
+        for(auto& task : due){
+            try{
+                task();
+            }catch(...){
+                eventlog::error("reactor", "Task failed.");
+            }
+        }
+        due.clear();
+    }
+
+    size_t Reactor::size(void) const noexcept{
+        lock_guard<mutex> lock(mtx);
+        return handlers.size();
+    }
+
+    // The poll set is rebuilt on every pass: sessions change socket as they
+    // go from listening to handshaking and connected.
+    void Reactor::run(void) noexcept{
+        vector<PollFd>     fds;
+        vector<SslConn*>   polled;
+        long long          lastTick { nowUs() };
+
+        try{
+            fds.reserve(64);
+            polled.reserve(64);
+        }catch(...){}
+
+        while(running){
+            bool  pending { false };
+
+            fds.clear();
+            polled.clear();
+            try{
+                #ifndef WINDOWS_OPENSSL
+                    fds.push_back({ wakeFds[0], POLLIN, 0 });
+                #else
+                    fds.push_back({ INVALID_SOCKET, 0, 0 });
+                #endif
+
+                lock_guard<mutex> lock(mtx);
+                for(const auto& slot : handlers){
+                    int  fd { slot.conn->pollFd() };
+                    if(fd < 0)
+                        continue;
+
+                    short  events { static_cast<short>(slot.conn->wantsWrite() ? POLLIN | POLLOUT : POLLIN) };
+                    #ifndef WINDOWS_OPENSSL
+                        fds.push_back({ fd, events, 0 });
+                    #else
+                        fds.push_back({ static_cast<SOCKET>(fd), events, 0 });
+                    #endif
+                    polled.push_back(slot.conn);
+                    pending = pending || slot.conn->hasPending();
+                }
+            }catch(...){
+                eventlog::error("reactor", "Poll set allocation failed.");
+            }
+
+            {
+                lock_guard<mutex> lock(taskMtx);
+                pending = pending || !tasks.empty();
+            }
+
+            long long  sinceTick { (nowUs() - lastTick) / 1000 },
+                       wait      { pending || sinceTick >= REACTOR_TICK ? 0 : REACTOR_TICK - sinceTick };
+
+            if(poll(fds.data(), static_cast<unsigned int>(fds.size()), static_cast<int>(wait)) < 0){
+                #ifndef WINDOWS_OPENSSL
+                    if(errno == EINTR)
+                        continue;
+                #endif
+                eventlog::error("reactor", "poll() failed.");
+                static_cast<void>(usleep(REACTOR_TICK * 1000));
+                continue;
+            }
+
+            #ifndef WINDOWS_OPENSSL
+                char  drain[SMALL_BUFFER];
+                if((fds[0].revents & POLLIN) != 0)
+                    while(read(wakeFds[0], drain, sizeof(drain)) > 0){}
+            #endif
+
+            runTasks();
+
+            for(size_t idx = 1; idx < fds.size(); idx++){
+                lock_guard<mutex> lock(mtx);
+
+                SslConn  *conn     { polled[idx - 1] };
+                bool     ready     { (fds[idx].revents & (POLLIN | POLLERR | POLLHUP)) != 0 },
+                         writable  { (fds[idx].revents & POLLOUT) != 0 };
+                for(auto& slot : handlers){
+                    if(slot.conn != conn)
+                        continue;
+                    if(writable)
+                        static_cast<void>(conn->flushQueued());
+                    if(ready || conn->hasPending())
+                        slot.handler(true);
+                    break;
+                }
+            }
+
+            if((nowUs() - lastTick) / 1000 >= REACTOR_TICK){
+                lastTick = nowUs();
+                lock_guard<mutex> lock(mtx);
+                for(auto& slot : handlers)
+                    slot.handler(false);
+            }
+        }
+
+        runTasks();
+    }
+
+} // End namespace sslconn
@@ -0,0 +1,89 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sslconn.h"
+
+#define REACTOR_TICK 100              // ms between ticks: heartbeats, handshake deadlines
+#define REACTOR_BATCH 64              // Records one session may read per event
+
+namespace sslconn {
+
+// Called on the reactor thread: ready when the session's socket can be
+// read (or accepted from), or it has records buffered; not ready once per
+// tick, for the timers.
+using ReactorHandler = std::function<void(bool ready)>;
+
+// Run once on the reactor thread, outside any handler: a task may attach
+// and detach sessions.
+using ReactorTask = std::function<void(void)>;
+
+// One thread serves any number of sessions, clients and servers alike:
+// it polls their sockets and runs the handler of each one that is ready.
+// Attached sessions are switched to non-blocking mode, so a handler only
+// consumes what has already arrived and never holds the others back;
+// control records and queued messages (SslConn::queueMessage()) the
+// socket can't take yet wait for POLLOUT.
+// Handlers must not attach or detach. Tasks posted before stop() run
+// before it returns.
+
+class Reactor {
+    public:
+        Reactor(void);
+        ~Reactor(void);
+
+        Reactor(const Reactor&)                                              = delete;
+        Reactor& operator=(const Reactor&)                                   = delete;
+
+        bool            start(void)                                          noexcept;
+        void            stop(void)                                           noexcept;
+        bool            attach(SslConn& conn, const ReactorHandler& handler) noexcept;
+        void            detach(SslConn& conn)                                noexcept;
+        void            wake(void)                                           noexcept;
+        bool            post(ReactorTask&& task)                             noexcept;
+        size_t          size(void)                               const       noexcept;
+
+    private:
+        struct Slot {
+            SslConn         *conn;
+            ReactorHandler  handler;
+        };
+
+        std::vector<Slot>       handlers;
+        mutable std::mutex      mtx;              // Held while a handler runs: detach waits for it.
+        std::thread             loop;
+        std::atomic<bool>       running;
+        int                     wakeFds[2];
+        std::mutex              taskMtx;
+        std::vector<ReactorTask>
+                                tasks,
+                                due;              // Reactor thread only.
+
+        void            run(void)                                            noexcept;
+        void            runTasks(void)                                       noexcept;
+};
+
+} // End namespace sslconn
@@ -0,0 +1,1451 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "relay.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "types.h"
+
+namespace relay {
+
+    using std::string;
+    using std::vector;
+    using std::to_string;
+    using std::make_shared;
+    using std::unique_ptr;
+    using std::partition;
+    using std::any_of;
+    using std::lock_guard;
+    using std::mutex;
+    using std::thread;
+
+    using sslconn::ChatContext;
+    using stats::nowUs;
+    using typeutils::narrow;
+    using typeutils::clampTo;
+
+    static bool setNonBlocking(int fd) noexcept{
+        int flags { fcntl(fd, F_GETFL, 0) };
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    // Counts the read/write syscalls issued by a socket BIO.
+    static long countIo(BIO* bio, int oper, const char* argp, size_t len, int argi,
+                        long argl, int ret, size_t* processed) noexcept{
+        static_cast<void>(argp); static_cast<void>(len); static_cast<void>(argi);
+        static_cast<void>(argl); static_cast<void>(processed);
+
+        if(oper == (BIO_CB_READ | BIO_CB_RETURN) || oper == (BIO_CB_WRITE | BIO_CB_RETURN)){
+            auto *counter { reinterpret_cast<unsigned long long*>(BIO_get_callback_arg(bio)) };
+            if(counter != nullptr)
+                (*counter)++;
+        }
+
+        return ret;
+    }
+
+    WorkerStats::WorkerStats(void)
+        : sessions{0},
+          accepted{0},
+          handshakeFailures{0},
+          handshakeRejected{0},
+          messagesIn{0},
+          bytesIn{0},
+          deliveries{0},
+          drops{0},
+          evictions{0},
+          syscalls{0},
+          uringWorkers{0},
+          memoryBytes{0},
+          pausedSessions{0},
+          sheds{0},
+          controls{0}
+    {}
+
+    void WorkerStats::merge(const WorkerStats& other) noexcept{
+        sessions          += other.sessions;
+        accepted          += other.accepted;
+        handshakeFailures += other.handshakeFailures;
+        handshakeRejected += other.handshakeRejected;
+        messagesIn        += other.messagesIn;
+        bytesIn           += other.bytesIn;
+        deliveries        += other.deliveries;
+        drops             += other.drops;
+        evictions         += other.evictions;
+        syscalls          += other.syscalls;
+        uringWorkers      += other.uringWorkers;
+        memoryBytes       += other.memoryBytes;
+        pausedSessions    += other.pausedSessions;
+        sheds             += other.sheds;
+        controls          += other.controls;
+        fanoutLatency.merge(other.fanoutLatency);
+    }
+
+    Session::Session(int sock, SSL* ssl, const string& peerName) noexcept
+        : fd{sock},
+          sslp{ssl},
+          peer{peerName},
+          handshaking{true},
+          handshakeFailed{false},
+          inPool{false},
+          wantWrite{false},
+          closing{false},
+          admitted{false},
+          paused{false},
+          acceptedAt{nowUs()},
+          lastActive{acceptedAt},
+          sslBytes{0},
+          queuedBytes{0},
+          fullSince{0},
+          dropped{0},
+          ioCalls{0}
+    #ifdef SC_IOURING
+          ,
+          rbio{nullptr},
+          wbio{nullptr},
+          rbuf{nullptr},
+          wbuf{nullptr},
+          rslot{-1},
+          wslot{-1},
+          wlen{0},
+          woff{0},
+          readSize{RELAY_URING_SLOT_SIZE},
+          inflight{0},
+          reading{false},
+          writing{false},
+          shut{false}
+    #endif
+    {}
+
+    Session::~Session(void){
+        if(sslp != nullptr)
+            SSL_free(sslp);
+        if(fd >= 0)
+            static_cast<void>(close(fd));
+    }
+
+    // What the session pins: itself, its queue, its own I/O buffers and OpenSSL's share.
+    size_t Session::memoryUsage(void) const noexcept{
+        size_t  total { sizeof(Session) + peer.capacity() + queuedBytes +
+                        queue.size() * sizeof(Outgoing) +
+                        static_cast<size_t>(sslBytes > 0 ? sslBytes : 0) };
+
+        #ifdef SC_IOURING
+            total += ownRead.capacity() + ownWrite.capacity();
+        #endif
+
+        return total;
+    }
+
+    Worker::Worker(Relay& relay, unsigned int num)
+        : owner{relay},
+          id{num},
+          listenFd{-1},
+          wakeFds{-1, -1},
+          ownListener{false},
+          readBuffer(HUGE_BUFFER, 0),
+          errMessage{"None"},
+          dirty{false},
+          uringActive{false},
+          lastHousekeeping{0},
+          memoryInUse{0},
+          pausedCount{0}
+    #ifdef SC_IOURING
+          ,
+          ring{nullptr},
+          acceptAddr{},
+          acceptLen{0},
+          tick{0, POLLING_INTERVAL * 1000LL}
+    #endif
+    {}
+
+    Worker::~Worker(void){
+        join();
+        sessions.clear();
+        if(ownListener && listenFd >= 0)
+            static_cast<void>(close(listenFd));
+        if(wakeFds[0] >= 0) static_cast<void>(close(wakeFds[0]));
+        if(wakeFds[1] >= 0) static_cast<void>(close(wakeFds[1]));
+    }
+
+    const string& Worker::getErrMsg(void) const noexcept{
+        return errMessage;
+    }
+
+    bool Worker::usesUring(void) const noexcept{
+        return uringActive;
+    }
+
+    int Worker::getListenFd(void) const noexcept{
+        return listenFd;
+    }
+
+    bool Worker::openListener(int sharedFd) noexcept{
+        if(pipe(wakeFds) != 0 || !setNonBlocking(wakeFds[0]) || !setNonBlocking(wakeFds[1])){
+            errMessage = string("Worker ").append(to_string(id)).append(": wakeup pipe failed: ").append(strerror(errno));
+            return false;
+        }
+
+        // Without SO_REUSEPORT every worker polls the same listening socket.
+        if(sharedFd >= 0){
+            listenFd = sharedFd;
+            return true;
+        }
+
+        struct addrinfo  hints,
+                         *res   { nullptr };
+        int              optval { 1 };
+
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags    = AI_PASSIVE;
+
+        int rc { getaddrinfo(owner.context.getIp().empty() ? nullptr : owner.context.getIp().c_str(),
+                             owner.context.getPort().c_str(), &hints, &res) };
+        if(rc != 0){
+            errMessage = string("getaddrinfo: ").append(gai_strerror(rc));
+            return false;
+        }
+
+        listenFd    = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        ownListener = true;
+        if(listenFd < 0                                                                       ||
+           setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) != 0       ||
+        #ifdef SO_REUSEPORT
+           setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) != 0       ||
+        #endif
+           bind(listenFd, res->ai_addr, res->ai_addrlen) != 0                                  ||
+           listen(listenFd, SOMAXCONN) != 0                                                    ||
+           !setNonBlocking(listenFd)){
+            errMessage = string("Worker ").append(to_string(id)).append(": listener setup failed: ").append(strerror(errno));
+            freeaddrinfo(res);
+            return false;
+        }
+
+        freeaddrinfo(res);
+        return true;
+    }
+
+    void Worker::start(void){
+        loop = thread(&Worker::run, this);
+    }
+
+    void Worker::join(void) noexcept{
+        if(loop.joinable())
+            loop.join();
+    }
+
+    void Worker::wakeup(void) noexcept{
+        char  byte { 0 };
+        static_cast<void>(write(wakeFds[1], &byte, 1));
+    }
+
+    void Worker::post(const Outgoing& msg) noexcept{
+        bool  wake  { false };
+        {
+            lock_guard<mutex> lock(inboxMtx);
+            wake = inbox.empty() && returned.empty();
+            inbox.push_back(msg);
+        }
+
+        if(wake)
+            wakeup();
+    }
+
+    void Worker::handshakeDone(Session* sess) noexcept{
+        bool  wake  { false };
+        {
+            lock_guard<mutex> lock(inboxMtx);
+            wake = inbox.empty() && returned.empty();
+            returned.push_back(sess);
+        }
+
+        if(wake)
+            wakeup();
+    }
+
+    void Worker::snapshot(WorkerStats& out) const noexcept{
+        lock_guard<mutex> lock(statsMtx);
+        out.merge(published);
+    }
+
+    void Worker::publishStats(void) noexcept{
+        lock_guard<mutex> lock(statsMtx);
+
+        for(auto& sess : sessions){
+            if(sess->inPool)
+                continue;
+            local.syscalls += sess->ioCalls;
+            sess->ioCalls   = 0;
+        }
+
+        published.merge(local);
+        published.sessions       = sessions.size();
+        published.uringWorkers   = uringActive ? 1 : 0;
+        published.memoryBytes    = memoryInUse;
+        published.pausedSessions = pausedCount;
+
+        local = WorkerStats();
+        dirty = false;
+    }
+
+    void Worker::acceptIncoming(void) noexcept{
+        for(;;){
+            struct sockaddr_storage  addr;
+            socklen_t                alen  { sizeof(addr) };
+            int                      fd    { accept(listenFd, reinterpret_cast<struct sockaddr*>(&addr), &alen) };
+
+            local.syscalls++;
+            if(fd < 0)
+                return;
+            if(!admit(fd, reinterpret_cast<struct sockaddr*>(&addr), alen))
+                continue;
+
+            char  host[NI_MAXHOST] { "?" },
+                  port[NI_MAXSERV] { "?" };
+            static_cast<void>(getnameinfo(reinterpret_cast<struct sockaddr*>(&addr), alen,
+                                          host, sizeof(host), port, sizeof(port),
+                                          NI_NUMERICHOST | NI_NUMERICSERV));
+
+            SSL        *ssl  { nullptr };
+            long long  held  { 0 };
+            bool       ready { false };
+            {
+                memacct::Scope  scope(held);
+                ssl   = SSL_new(owner.context.getSslCtx());
+                ready = ssl != nullptr && setNonBlocking(fd) && SSL_set_fd(ssl, fd) == 1;
+            }
+
+            if(!ready){
+                if(ssl != nullptr) SSL_free(ssl);
+                static_cast<void>(close(fd));
+                owner.admission.release();
+                local.handshakeFailures++;
+                continue;
+            }
+
+            // The handshake starts when the ClientHello makes the socket readable.
+            local.accepted++;
+            dirty = true;
+            try{
+                sessions.emplace_back(new Session(fd, ssl, string(host).append(":").append(port)));
+            }catch(...){
+                SSL_free(ssl);
+                static_cast<void>(close(fd));
+                owner.admission.release();
+                continue;
+            }
+            sessions.back()->admitted = true;
+            sessions.back()->sslBytes = held;
+
+            BIO  *sock { SSL_get_rbio(ssl) };
+            BIO_set_callback_ex(sock, countIo);
+            BIO_set_callback_arg(sock, reinterpret_cast<char*>(&sessions.back()->ioCalls));
+        }
+    }
+
+    // Runs before any TLS state exists: a refused connection costs one close().
+    bool Worker::admit(int fd, const struct sockaddr* addr, socklen_t len) noexcept{
+        if(owner.admission.admit(addr, len) == admission::ADMITTED)
+            return true;
+
+        static_cast<void>(close(fd));
+        local.syscalls++;
+        return false;
+    }
+
+    void Worker::releaseAdmission(Session& sess) noexcept{
+        if(!sess.admitted)
+            return;
+
+        sess.admitted = false;
+        owner.admission.release();
+    }
+
+    void Worker::housekeeping(void) noexcept{
+        long long  now  { nowUs() };
+
+        if(now - lastHousekeeping < RELAY_HOUSEKEEPING)
+            return;
+
+        lastHousekeeping = now;
+        expireHandshakes(now);
+
+        #ifdef SC_IOURING
+            if(ring != nullptr)
+                for(auto& sess : sessions)
+                    if(now - sess->lastActive > RELAY_IDLE_TIME)
+                        uringTrim(*sess);
+        #endif
+
+        enforceBudget();
+        dirty = true;
+    }
+
+    // Slow or silent clients must not keep their admission slot forever.
+    void Worker::expireHandshakes(long long now) noexcept{
+        for(auto& sess : sessions)
+            if(sess->handshaking && !sess->inPool && !sess->closing &&
+               now - sess->acceptedAt > static_cast<long long>(owner.admission.getTimeout()) * 1000000){
+                sess->closing = true;
+                local.handshakeFailures++;
+                dirty = true;
+            }
+    }
+
+    // Over its share of the budget, the worker drops the queues of its heaviest
+    // sessions and pauses them until usage falls back under RELAY_BUDGET_LOW, or
+    // until no queue is left to shed: the fixed cost of a session can't be paused away.
+    // Sessions still far above the average, e.g. with encrypted backlog, are evicted.
+    void Worker::enforceBudget(void) noexcept{
+        size_t  queued { 0 };
+
+        // A pool thread may be charging an in-pool session's sslBytes: it's counted once it's back.
+        memoryInUse = 0;
+        for(auto& sess : sessions){
+            if(sess->inPool)
+                continue;
+            memoryInUse += sess->memoryUsage();
+            queued      += sess->queuedBytes;
+        }
+
+        size_t  share  { static_cast<size_t>(owner.memoryBudget / (owner.workers.empty() ? 1 : owner.workers.size())) },
+                target { share / 100 * RELAY_BUDGET_LOW };
+
+        if(pausedCount != 0 && (share == 0 || memoryInUse <= target || queued == 0)){
+            for(auto& sess : sessions){
+                if(!sess->paused)
+                    continue;
+                sess->paused = false;
+                #ifdef SC_IOURING
+                    if(ring != nullptr)
+                        uringRead(*sess);
+                #endif
+            }
+            pausedCount = 0;
+        }
+
+        if(share == 0 || memoryInUse <= share)
+            return;
+
+        vector<Session*>  heavy;
+        try{
+            heavy.reserve(sessions.size());
+            for(auto& sess : sessions)
+                if(!sess->inPool && !sess->handshaking && !sess->closing)
+                    heavy.push_back(sess.get());
+        }catch(...){
+            return;
+        }
+
+        std::sort(heavy.begin(), heavy.end(),
+                  [](const Session* lhs, const Session* rhs){ return lhs->memoryUsage() > rhs->memoryUsage(); });
+
+        for(auto sess : heavy){
+            if(memoryInUse <= target)
+                break;
+
+            // A write retried after WANT_WRITE must find the same record at the head.
+            size_t  keep  { sess->wantWrite && !sess->queue.empty() ? 1U : 0U },
+                    freed { 0 };
+            if(sess->queue.size() <= keep)
+                continue;
+
+            while(sess->queue.size() > keep){
+                freed += sess->queue.back().payload->size();
+                sess->queuedBytes -= sess->queue.back().payload->size();
+                sess->queue.pop_back();
+                sess->dropped++;
+                local.drops++;
+            }
+            sess->fullSince = 0;
+
+            if(!sess->paused){
+                sess->paused = true;
+                pausedCount++;
+            }
+            local.sheds++;
+            memoryInUse = memoryInUse > freed ? memoryInUse - freed : 0;
+        }
+
+        size_t  outlier { heavy.empty() ? 0 : memoryInUse / heavy.size() * 2 };
+        for(auto sess : heavy){
+            if(memoryInUse <= share)
+                break;
+
+            size_t  usage { sess->memoryUsage() };
+            if(usage <= outlier)
+                break;
+
+            sess->closing = true;
+            local.evictions++;
+            memoryInUse = memoryInUse > usage ? memoryInUse - usage : 0;
+        }
+    }
+
+    void Worker::handshake(Session& sess) noexcept{
+        if(!owner.cryptoPool.isActive()){
+            stepHandshake(sess);
+            finishHandshake(sess);
+            return;
+        }
+
+        Session  *target { &sess };
+
+        sess.inPool = true;
+        if(!owner.cryptoPool.submit([this, target](){ stepHandshake(*target);
+                                                       handshakeDone(target); })){
+            sess.inPool  = false;
+            sess.closing = true;
+            local.handshakeRejected++;
+            dirty = true;
+        }
+    }
+
+    // May run on a crypto pool thread: it touches only the session.
+    void Worker::stepHandshake(Session& sess) noexcept{
+        memacct::Scope  scope(sess.sslBytes);
+        ERR_clear_error();
+        int rc { SSL_accept(sess.sslp) };
+
+        if(rc == 1){
+            sess.handshaking = false;
+            sess.wantWrite   = false;
+            return;
+        }
+
+        switch(SSL_get_error(sess.sslp, rc)){
+            case SSL_ERROR_WANT_READ:
+                sess.wantWrite = false;
+            break;
+            case SSL_ERROR_WANT_WRITE:
+                sess.wantWrite = true;
+            break;
+            default:
+                sess.handshakeFailed = true;
+        }
+    }
+
+    void Worker::finishHandshake(Session& sess) noexcept{
+        sess.inPool = false;
+
+        if(sess.handshakeFailed){
+            local.handshakeFailures++;
+            dirty = true;
+            sess.closing = true;
+        }
+        if(!sess.handshaking || sess.closing)
+            releaseAdmission(sess);
+    }
+
+    void Worker::readSession(Session& sess) noexcept{
+        memacct::Scope  scope(sess.sslBytes);
+
+        for(int i = 0; i < RELAY_READ_BUDGET && !sess.closing; i++){
+            // The error queue is per thread: a failure on another session must not leak here.
+            ERR_clear_error();
+            int rc { SSL_read(sess.sslp, readBuffer.data(), clampTo<int>(readBuffer.size())) };
+
+            if(rc > 0 && controlRecord(sess, rc))
+                continue;
+
+            if(rc > 0){
+                Outgoing  msg { make_shared<const string>(readBuffer.data(), static_cast<size_t>(rc)), nowUs() };
+
+                local.messagesIn++;
+                local.bytesIn += static_cast<unsigned long long>(rc);
+                dirty = true;
+                sess.lastActive = msg.enqueued;
+
+                fanout(&sess, msg);
+                owner.broadcast(*this, msg);
+                continue;
+            }
+
+            switch(SSL_get_error(sess.sslp, rc)){
+                case SSL_ERROR_WANT_READ:
+                return;
+                case SSL_ERROR_WANT_WRITE:
+                    sess.wantWrite = true;
+                return;
+                default:
+                    sess.closing = true;
+            }
+        }
+    }
+
+    // Control records are between a client and the relay, never forwarded:
+    // the relay answers pings itself, so RTT and liveness measure the link
+    // to the relay. MUX and ZIP hellos stay unanswered, every member keeps
+    // plain messages. Escaped text (CTRL_ESCAPED) is forwarded as it is.
+    bool Worker::controlRecord(Session& sess, int len) noexcept{
+        sslconn::ControlKind  kind { sslconn::controlKind(readBuffer.data(), len) };
+
+        if(kind == sslconn::CTRL_NONE || kind == sslconn::CTRL_ESCAPED)
+            return false;
+
+        local.controls++;
+        sess.lastActive = nowUs();
+        if(kind != sslconn::CTRL_PING || sess.queuedBytes + static_cast<size_t>(len) > RELAY_QUEUE_LIMIT)
+            return true;
+
+        try{
+            string  pong { HB_PONG };
+            pong.append(readBuffer.data() + sizeof(HB_PING) - 1, static_cast<size_t>(len) - (sizeof(HB_PING) - 1));
+            sess.queue.push_back(Outgoing{ make_shared<const string>(std::move(pong)), sess.lastActive });
+            sess.queuedBytes += sess.queue.back().payload->size();
+        }catch(...){
+            return true;
+        }
+        flushSession(sess);
+
+        return true;
+    }
+
+    void Worker::fanout(const Session* sender, const Outgoing& msg) noexcept{
+        long long  now  { nowUs() };
+
+        for(auto& sess : sessions){
+            if(sess.get() == sender || sess->inPool || sess->handshaking || sess->closing)
+                continue;
+            if(sess->paused){
+                sess->dropped++;
+                local.drops++;
+                continue;
+            }
+
+            // Backpressure is per subscriber: a full queue drops for that session only.
+            if(sess->queuedBytes + msg.payload->size() > RELAY_QUEUE_LIMIT){
+                sess->dropped++;
+                local.drops++;
+                dirty = true;
+                if(sess->fullSince == 0)
+                    sess->fullSince = now;
+                else if(now - sess->fullSince > RELAY_STALL_LIMIT){
+                    local.evictions++;
+                    sess->closing = true;
+                }
+                continue;
+            }
+
+            sess->fullSince = 0;
+            sess->queue.push_back(msg);
+            sess->queuedBytes += msg.payload->size();
+            flushSession(*sess);
+        }
+    }
+
+    void Worker::drainInbox(void) noexcept{
+        char  sink[SMALL_BUFFER];
+        do{
+            local.syscalls++;
+        }while(read(wakeFds[0], sink, sizeof(sink)) > 0);
+
+        {
+            lock_guard<mutex> lock(inboxMtx);
+            pending.swap(inbox);
+            adopted.swap(returned);
+        }
+
+        for(auto sess : adopted){
+            finishHandshake(*sess);
+            #ifdef SC_IOURING
+                if(ring != nullptr)
+                    uringResume(*sess);
+            #endif
+        }
+        adopted.clear();
+
+        for(const auto& msg : pending)
+            fanout(nullptr, msg);
+        pending.clear();
+    }
+
+    void Worker::flushSession(Session& sess) noexcept{
+        memacct::Scope  scope(sess.sslBytes);
+
+        while(!sess.queue.empty() && !sess.closing){
+            #ifdef SC_IOURING
+                // Memory BIOs never block: the backlog limit applies to encrypted bytes instead.
+                if(ring != nullptr && BIO_ctrl_pending(sess.wbio) >= RELAY_QUEUE_LIMIT)
+                    break;
+            #endif
+
+            const Outgoing&  out  { sess.queue.front() };
+            int              len  { 0 };
+            if(!narrow(out.payload->size(), len)){
+                sess.closing = true;
+                break;
+            }
+
+            ERR_clear_error();
+            int              rc   { SSL_write(sess.sslp, out.payload->data(), len) };
+
+            if(rc > 0){
+                sess.lastActive = nowUs();
+                local.fanoutLatency.record(sess.lastActive - out.enqueued);
+                local.deliveries++;
+                dirty = true;
+                sess.queuedBytes -= out.payload->size();
+                sess.queue.pop_front();
+                continue;
+            }
+
+            switch(SSL_get_error(sess.sslp, rc)){
+                case SSL_ERROR_WANT_WRITE:
+                case SSL_ERROR_WANT_READ:
+                    sess.wantWrite = true;
+                return;
+                default:
+                    sess.closing = true;
+            }
+        }
+
+        sess.wantWrite = false;
+
+        #ifdef SC_IOURING
+            if(ring != nullptr)
+                uringFlush(sess);
+        #endif
+    }
+
+    void Worker::reapSessions(void) noexcept{
+        housekeeping();
+
+        #ifdef SC_IOURING
+            // Outstanding operations reference the session: shutdown() completes them.
+            if(ring != nullptr)
+                for(auto& sess : sessions)
+                    if(sess->closing && sess->inflight != 0 && !sess->shut){
+                        sess->shut = true;
+                        local.syscalls++;
+                        static_cast<void>(shutdown(sess->fd, SHUT_RDWR));
+                    }
+        #endif
+
+        auto    dead   { partition(sessions.begin(), sessions.end(),
+                                   [](const unique_ptr<Session>& sess){
+                                       #ifdef SC_IOURING
+                                           if(sess->inflight != 0) return true;
+                                       #endif
+                                       return !sess->closing || sess->inPool; }) };
+
+        if(dead == sessions.end())
+            return;
+
+        for(auto it = dead; it != sessions.end(); ++it){
+            local.syscalls += (*it)->ioCalls;
+            releaseAdmission(**it);
+            #ifdef SC_IOURING
+                uringRelease(**it);
+            #endif
+        }
+
+        sessions.erase(dead, sessions.end());
+        dirty = true;
+    }
+
+    void Worker::run(void) noexcept{
+        #ifdef SC_IOURING
+            if(owner.ioUring && runUring())
+                return;
+        #endif
+
+        vector<struct pollfd>  fds;
+
+        while(owner.running){
+            fds.clear();
+            fds.push_back({listenFd, POLLIN, 0});
+            fds.push_back({wakeFds[0], POLLIN, 0});
+            for(auto& sess : sessions){
+                if(sess->inPool){
+                    fds.push_back({-1, 0, 0});
+                    continue;
+                }
+
+                short events { static_cast<short>(sess->paused ? 0 : POLLIN) };
+                if(sess->wantWrite) events |= POLLOUT;
+                fds.push_back({sess->fd, events, 0});
+            }
+
+            int rc { poll(fds.data(), fds.size(), POLLING_INTERVAL / 1000) };
+            local.syscalls++;
+            if(rc < 0 && errno != EINTR){
+                errMessage = string("poll: ").append(strerror(errno));
+                owner.stop();
+                break;
+            }
+
+            // New sessions are appended: indexes of the existing ones stay valid.
+            size_t  known { sessions.size() };
+
+            if(rc > 0){
+                for(size_t i = 0; i < known; i++){
+                    Session&  sess    { *sessions[i] };
+                    short     revents { fds[i + 2].revents };
+
+                    if(sess.inPool || revents == 0 || sess.closing)
+                        continue;
+                    if(revents & (POLLERR | POLLNVAL)){
+                        sess.closing = true;
+                        continue;
+                    }
+
+                    if(sess.handshaking){
+                        handshake(sess);
+                        continue;
+                    }
+                    if(revents & POLLOUT)
+                        flushSession(sess);
+                    if(revents & (POLLIN | POLLHUP))
+                        readSession(sess);
+                }
+
+                if(fds[1].revents & POLLIN)
+                    drainInbox();
+                if(fds[0].revents & POLLIN)
+                    acceptIncoming();
+            }
+
+            reapSessions();
+
+            if(dirty)
+                publishStats();
+        }
+    }
+
+    #ifdef SC_IOURING
+
+    // user_data: the session pointer with the operation in the low bits.
+    enum UringOp : unsigned long long { URING_ACCEPT = 1, URING_WAKE = 2, URING_TICK = 3,
+                                        URING_READ   = 4, URING_WRITE = 5, URING_OP_MASK = 7 };
+
+    static unsigned long long uringTag(const Session* sess, UringOp op) noexcept{
+        return reinterpret_cast<unsigned long long>(sess) | op;
+    }
+
+    bool Worker::runUring(void) noexcept{
+        Uring  uring;
+
+        if(!uring.setup(RELAY_URING_ENTRIES)){
+            errMessage = string("Worker ").append(to_string(id)).append(": io_uring unavailable, using poll.");
+            eventlog::warn("relay", errMessage);
+            return false;
+        }
+
+        for(unsigned char op : { IORING_OP_ACCEPT, IORING_OP_POLL_ADD, IORING_OP_TIMEOUT,
+                                 IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED }){
+            if(!uring.supports(op)){
+                errMessage = string("Worker ").append(to_string(id)).append(": io_uring lacks required operations, using poll.");
+                eventlog::warn("relay", errMessage);
+                return false;
+            }
+        }
+
+        // Registered buffers need locked memory: without them sessions use plain READ/WRITE.
+        try{
+            vector<struct iovec>  iov(RELAY_URING_SLOTS);
+
+            slotArena.assign(static_cast<size_t>(RELAY_URING_SLOTS) * RELAY_URING_SLOT_SIZE, 0);
+            for(int i = 0; i < RELAY_URING_SLOTS; i++)
+                iov[static_cast<size_t>(i)] = { &slotArena[static_cast<size_t>(i) * RELAY_URING_SLOT_SIZE], RELAY_URING_SLOT_SIZE };
+
+            if(uring.registerBuffers(iov.data(), RELAY_URING_SLOTS))
+                for(int i = RELAY_URING_SLOTS - 1; i >= 0; i--)
+                    freeSlots.push_back(i);
+            else
+                slotArena.clear();
+        }catch(...){
+            slotArena.clear();
+            freeSlots.clear();
+        }
+
+        // Ring accepts park in the kernel: the listener must block.
+        int  flags { fcntl(listenFd, F_GETFL, 0) };
+        if(flags >= 0)
+            static_cast<void>(fcntl(listenFd, F_SETFL, flags & ~O_NONBLOCK));
+
+        ring        = &uring;
+        uringActive = true;
+        dirty       = true;
+
+        // A zero result arms the first wake poll and tick timeout without side effects.
+        uringAccept();
+        for(UringOp op : { URING_WAKE, URING_TICK })
+            uringComplete({ uringTag(nullptr, op), 0, 0 });
+
+        struct io_uring_cqe  cqes[RELAY_URING_ENTRIES];
+        unsigned long long   entered { 0 };
+
+        while(owner.running){
+            int rc { uring.submitAndWait(1) };
+            if(rc < 0 && rc != -EINTR && rc != -EBUSY){
+                errMessage = string("io_uring_enter: ").append(strerror(-rc));
+                owner.stop();
+                break;
+            }
+
+            local.syscalls += uring.getEnterCalls() - entered;
+            entered         = uring.getEnterCalls();
+
+            unsigned int  count { uring.reap(cqes, RELAY_URING_ENTRIES) };
+            for(unsigned int i = 0; i < count; i++)
+                uringComplete(cqes[i]);
+
+            reapSessions();
+
+            if(dirty)
+                publishStats();
+        }
+
+        // Operations still in flight reference session buffers: complete them before leaving.
+        for(auto& sess : sessions)
+            sess->closing = true;
+        reapSessions();
+
+        for(int rounds = 0; rounds < 100 && any_of(sessions.begin(), sessions.end(),
+                                                   [](const unique_ptr<Session>& sess){ return sess->inflight != 0; }); rounds++){
+            if(uring.submitAndWait(1) < 0)
+                break;
+
+            unsigned int  count { uring.reap(cqes, RELAY_URING_ENTRIES) };
+            for(unsigned int i = 0; i < count; i++)
+                uringComplete(cqes[i]);
+            reapSessions();
+        }
+
+        ring        = nullptr;
+        uringActive = false;
+        return true;
+    }
+
+    struct io_uring_sqe* Worker::uringSqe(void) noexcept{
+        struct io_uring_sqe  *sqe { ring->getSqe() };
+
+        // A full submission queue is flushed without waiting.
+        if(sqe == nullptr && ring->submitAndWait(0) >= 0)
+            sqe = ring->getSqe();
+
+        return sqe;
+    }
+
+    void Worker::uringAccept(void) noexcept{
+        struct io_uring_sqe  *sqe { uringSqe() };
+        if(sqe == nullptr)
+            return;
+
+        acceptLen      = sizeof(acceptAddr);
+        sqe->opcode    = IORING_OP_ACCEPT;
+        sqe->fd        = listenFd;
+        sqe->addr      = reinterpret_cast<unsigned long long>(&acceptAddr);
+        sqe->addr2     = reinterpret_cast<unsigned long long>(&acceptLen);
+        sqe->user_data = uringTag(nullptr, URING_ACCEPT);
+    }
+
+    void Worker::uringComplete(const struct io_uring_cqe& cqe) noexcept{
+        Session  *sess { reinterpret_cast<Session*>(cqe.user_data & ~static_cast<unsigned long long>(URING_OP_MASK)) };
+
+        switch(cqe.user_data & URING_OP_MASK){
+            case URING_ACCEPT:
+                if(cqe.res >= 0){
+                    if(owner.running)
+                        uringAdopt(cqe.res);
+                    else
+                        static_cast<void>(close(cqe.res));
+                }
+                if(owner.running)
+                    uringAccept();
+            break;
+            case URING_WAKE:
+                if(cqe.res > 0)
+                    drainInbox();
+                if(owner.running){
+                    struct io_uring_sqe  *sqe { uringSqe() };
+                    if(sqe != nullptr){
+                        sqe->opcode      = IORING_OP_POLL_ADD;
+                        sqe->fd          = wakeFds[0];
+                        sqe->poll_events = POLLIN;
+                        sqe->user_data   = uringTag(nullptr, URING_WAKE);
+                    }
+                }
+            break;
+            case URING_TICK:
+                // Bounds the wait so a stop request is noticed.
+                if(owner.running){
+                    struct io_uring_sqe  *sqe { uringSqe() };
+                    if(sqe != nullptr){
+                        sqe->opcode    = IORING_OP_TIMEOUT;
+                        sqe->addr      = reinterpret_cast<unsigned long long>(&tick);
+                        sqe->len       = 1;
+                        sqe->user_data = uringTag(nullptr, URING_TICK);
+                    }
+                }
+            break;
+            case URING_READ:
+                sess->inflight--;
+                sess->reading = false;
+                if(cqe.res <= 0 || sess->closing){
+                    sess->closing = true;
+                    break;
+                }
+
+                {
+                    memacct::Scope  scope(sess->sslBytes);
+                    static_cast<void>(BIO_write(sess->rbio, sess->rbuf, cqe.res));
+                }
+
+                // Without a registered slot the read buffer follows the traffic.
+                if(sess->rslot < 0)
+                    uringSizeRead(*sess, cqe.res);
+                if(sess->handshaking){
+                    handshake(*sess);
+                    if(sess->inPool)
+                        break;
+                }
+                uringResume(*sess);
+            break;
+            case URING_WRITE:
+                sess->inflight--;
+                sess->writing = false;
+                if(cqe.res < 0 || sess->closing){
+                    sess->closing = true;
+                    break;
+                }
+
+                sess->woff += cqe.res;
+                // The crypto pool owns the BIOs until the handshake step returns.
+                if(sess->inPool)
+                    break;
+                if(!sess->queue.empty())
+                    flushSession(*sess);
+                else
+                    uringFlush(*sess);
+            break;
+            default:
+            break;
+        }
+    }
+
+    void Worker::uringAdopt(int fd) noexcept{
+        if(!admit(fd, reinterpret_cast<struct sockaddr*>(&acceptAddr), acceptLen))
+            return;
+
+        char  host[NI_MAXHOST] { "?" },
+              port[NI_MAXSERV] { "?" };
+        static_cast<void>(getnameinfo(reinterpret_cast<struct sockaddr*>(&acceptAddr), acceptLen,
+                                      host, sizeof(host), port, sizeof(port),
+                                      NI_NUMERICHOST | NI_NUMERICSERV));
+
+        long long  held { 0 };
+        SSL        *ssl { nullptr };
+        BIO        *rbio { nullptr },
+                   *wbio { nullptr };
+        {
+            memacct::Scope  scope(held);
+            ssl  = SSL_new(owner.context.getSslCtx());
+            rbio = BIO_new(BIO_s_mem());
+            wbio = BIO_new(BIO_s_mem());
+        }
+
+        if(ssl == nullptr || rbio == nullptr || wbio == nullptr){
+            if(ssl != nullptr)  SSL_free(ssl);
+            if(rbio != nullptr) BIO_free(rbio);
+            if(wbio != nullptr) BIO_free(wbio);
+            static_cast<void>(close(fd));
+            owner.admission.release();
+            local.handshakeFailures++;
+            dirty = true;
+            return;
+        }
+
+        // An empty read BIO means "retry later", not end of stream.
+        #pragma clang diagnostic push
+        #pragma clang diagnostic ignored "-Wold-style-cast"
+
+        static_cast<void>(BIO_set_mem_eof_return(rbio, -1));
+
+        #pragma clang diagnostic pop
+
+        SSL_set_bio(ssl, rbio, wbio);
+
+        Session  *sess { nullptr };
+        try{
+            sessions.emplace_back(new Session(fd, ssl, string(host).append(":").append(port)));
+            sess = sessions.back().get();
+            sess->admitted = true;
+            sess->sslBytes = held;
+
+            if(freeSlots.size() >= 2){
+                sess->rslot = freeSlots.back(); freeSlots.pop_back();
+                sess->wslot = freeSlots.back(); freeSlots.pop_back();
+                sess->rbuf  = &slotArena[static_cast<size_t>(sess->rslot) * RELAY_URING_SLOT_SIZE];
+                sess->wbuf  = &slotArena[static_cast<size_t>(sess->wslot) * RELAY_URING_SLOT_SIZE];
+            }else{
+                // The write buffer is allocated when there is something to send.
+                sess->ownRead.resize(RELAY_URING_IDLE_READ);
+                sess->rbuf     = sess->ownRead.data();
+                sess->readSize = RELAY_URING_IDLE_READ;
+            }
+        }catch(...){
+            if(sess != nullptr){
+                sess->closing = true;
+            }else{
+                SSL_free(ssl);
+                static_cast<void>(close(fd));
+                owner.admission.release();
+            }
+            local.handshakeFailures++;
+            dirty = true;
+            return;
+        }
+
+        sess->rbio = rbio;
+        sess->wbio = wbio;
+
+        local.accepted++;
+        dirty = true;
+        uringRead(*sess);
+    }
+
+    void Worker::uringRead(Session& sess) noexcept{
+        if(sess.reading || sess.closing || sess.inPool || sess.paused)
+            return;
+
+        struct io_uring_sqe  *sqe { uringSqe() };
+        if(sqe == nullptr){
+            sess.closing = true;
+            return;
+        }
+
+        sqe->opcode    = sess.rslot >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd        = sess.fd;
+        sqe->addr      = reinterpret_cast<unsigned long long>(sess.rbuf);
+        sqe->len       = static_cast<unsigned int>(sess.readSize);
+        sqe->buf_index = static_cast<unsigned short>(sess.rslot >= 0 ? sess.rslot : 0);
+        sqe->user_data = uringTag(&sess, URING_READ);
+
+        sess.reading = true;
+        sess.inflight++;
+    }
+
+    void Worker::uringFlush(Session& sess) noexcept{
+        if(sess.writing || sess.closing)
+            return;
+
+        if(sess.woff >= sess.wlen){
+            if(sess.wbuf == nullptr){
+                if(BIO_ctrl_pending(sess.wbio) == 0)
+                    return;
+                try{
+                    sess.ownWrite.resize(RELAY_URING_SLOT_SIZE);
+                }catch(...){
+                    sess.closing = true;
+                    return;
+                }
+                sess.wbuf = sess.ownWrite.data();
+            }
+
+            memacct::Scope  scope(sess.sslBytes);
+            int             rc    { BIO_read(sess.wbio, sess.wbuf, RELAY_URING_SLOT_SIZE) };
+
+            sess.woff = 0;
+            sess.wlen = rc > 0 ? rc : 0;
+            if(sess.wlen == 0)
+                return;
+        }
+
+        struct io_uring_sqe  *sqe { uringSqe() };
+        if(sqe == nullptr){
+            sess.closing = true;
+            return;
+        }
+
+        sqe->opcode    = sess.wslot >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd        = sess.fd;
+        sqe->addr      = reinterpret_cast<unsigned long long>(sess.wbuf + sess.woff);
+        sqe->len       = static_cast<unsigned int>(sess.wlen - sess.woff);
+        sqe->buf_index = static_cast<unsigned short>(sess.wslot >= 0 ? sess.wslot : 0);
+        sqe->user_data = uringTag(&sess, URING_WRITE);
+
+        sess.writing = true;
+        sess.inflight++;
+    }
+
+    // Runs on the worker once the session's BIOs are its own again.
+    void Worker::uringResume(Session& sess) noexcept{
+        if(sess.closing)
+            return;
+
+        if(!sess.handshaking){
+            // readSession() stops at its budget: records left in the BIO are consumed here.
+            size_t  before { 0 };
+            do{
+                before = BIO_ctrl_pending(sess.rbio);
+                readSession(sess);
+            }while(!sess.closing && BIO_ctrl_pending(sess.rbio) != 0 && BIO_ctrl_pending(sess.rbio) != before);
+        }
+
+        uringFlush(sess);
+        uringRead(sess);
+    }
+
+    // Called between reads: the kernel holds no reference to the buffer.
+    void Worker::uringSizeRead(Session& sess, int got) noexcept{
+        int  wanted { got >= sess.readSize ? RELAY_URING_SLOT_SIZE :
+                      got <= RELAY_URING_IDLE_READ ? RELAY_URING_IDLE_READ : sess.readSize };
+
+        if(wanted == sess.readSize)
+            return;
+
+        try{
+            std::vector<char>(static_cast<size_t>(wanted)).swap(sess.ownRead);
+        }catch(...){
+            return;
+        }
+
+        sess.rbuf     = sess.ownRead.data();
+        sess.readSize = wanted;
+    }
+
+    // Idle sessions give back their write buffer and whatever their memory BIOs grew to.
+    void Worker::uringTrim(Session& sess) noexcept{
+        if(sess.closing || sess.inPool || sess.writing || sess.woff < sess.wlen)
+            return;
+
+        if(sess.wslot < 0 && sess.wbuf != nullptr){
+            std::vector<char>().swap(sess.ownWrite);
+            sess.wbuf = nullptr;
+            sess.woff = sess.wlen = 0;
+        }
+
+        memacct::Scope  scope(sess.sslBytes);
+        BUF_MEM         *mem  { nullptr };
+
+        #pragma clang diagnostic push
+        #pragma clang diagnostic ignored "-Wold-style-cast"
+
+        if(BIO_ctrl_pending(sess.rbio) == 0 && BIO_get_mem_ptr(sess.rbio, &mem) > 0 &&
+           mem != nullptr && mem->max > RELAY_URING_IDLE_READ){
+            BIO  *fresh { BIO_new(BIO_s_mem()) };
+            if(fresh != nullptr){
+                static_cast<void>(BIO_set_mem_eof_return(fresh, -1));
+                SSL_set0_rbio(sess.sslp, fresh);
+                sess.rbio = fresh;
+            }
+        }
+
+        mem = nullptr;
+        if(BIO_ctrl_pending(sess.wbio) == 0 && BIO_get_mem_ptr(sess.wbio, &mem) > 0 &&
+           mem != nullptr && mem->max > RELAY_URING_IDLE_READ){
+            BIO  *fresh { BIO_new(BIO_s_mem()) };
+            if(fresh != nullptr){
+                SSL_set0_wbio(sess.sslp, fresh);
+                sess.wbio = fresh;
+            }
+        }
+
+        #pragma clang diagnostic pop
+    }
+
+    void Worker::uringRelease(Session& sess) noexcept{
+        if(sess.rslot >= 0) freeSlots.push_back(sess.rslot);
+        if(sess.wslot >= 0) freeSlots.push_back(sess.wslot);
+        sess.rslot = sess.wslot = -1;
+    }
+
+    #endif
+
+    Relay::Relay(ChatContext& ctx)
+        : context{ctx},
+          connection{ctx},
+          running{false},
+          statsInterval{0},
+          ioUring{false},
+          memoryBudget{0},
+          errMessage{"None"}
+    {}
+
+    Relay::~Relay(void){
+        running = false;
+        cryptoPool.stop();
+        workers.clear();
+        connection.cleanContext();
+    }
+
+    const string& Relay::getErrMsg(void) const noexcept{
+        return errMessage;
+    }
+
+    void Relay::setStatsInterval(unsigned int secs) noexcept{
+        statsInterval = secs;
+    }
+
+    bool Relay::setIoUring(bool enable) noexcept{
+        #ifdef SC_IOURING
+            ioUring = enable;
+            return true;
+        #else
+            ioUring = false;
+            return !enable;
+        #endif
+    }
+
+    void Relay::setMemoryBudget(unsigned long long bytes) noexcept{
+        memoryBudget = bytes;
+    }
+
+    void Relay::stop(void) noexcept{
+        running = false;
+    }
+
+    bool Relay::start(unsigned int count, unsigned int cryptoThreads) noexcept{
+        context.setServer(sslconn::SERVER);
+
+        if(!connection.createContext()){
+            errMessage = context.getErrMsg();
+            return false;
+        }
+
+        // A write retried after WANT_WRITE always restarts from the queue head.
+        #pragma clang diagnostic push
+        #pragma clang diagnostic ignored "-Wold-style-cast"
+
+        // Idle sessions hand their record buffers back to the heap.
+        static_cast<void>(SSL_CTX_set_mode(context.getSslCtx(), SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                                                                SSL_MODE_RELEASE_BUFFERS));
+        static_cast<void>(SSL_CTX_set_session_cache_mode(context.getSslCtx(), SSL_SESS_CACHE_OFF));
+
+        #pragma clang diagnostic pop
+
+        // Records go to every member as they came: none is told to expect MSG_CONTINUED pieces.
+        SSL_CTX_set_alpn_select_cb(context.getSslCtx(), nullptr, nullptr);
+
+        if(count == 0)
+            count = 1;
+
+        try{
+            for(unsigned int i = 0; i < count; i++){
+                #ifdef SO_REUSEPORT
+                    int  shared { -1 };
+                #else
+                    int  shared { i == 0 ? -1 : workers.front()->getListenFd() };
+                #endif
+
+                workers.emplace_back(new Worker(*this, i));
+                if(!workers.back()->openListener(shared)){
+                    errMessage = workers.back()->getErrMsg();
+                    workers.clear();
+                    return false;
+                }
+            }
+        }catch(...){
+            errMessage = "Worker allocation failed.";
+            workers.clear();
+            return false;
+        }
+
+        if(!cryptoPool.start(cryptoThreads, CRYPTO_QUEUE_LIMIT)){
+            errMessage = "Crypto pool start failed.";
+            workers.clear();
+            return false;
+        }
+
+        running = true;
+        return true;
+    }
+
+    void Relay::broadcast(const Worker& from, const Outgoing& msg) noexcept{
+        for(auto& worker : workers)
+            if(worker.get() != &from)
+                worker->post(msg);
+    }
+
+    void Relay::run(void) noexcept{
+        long long  lastStats  { nowUs() };
+
+        try{
+            for(auto& worker : workers)
+                worker->start();
+        }catch(...){
+            errMessage = "Worker start failed.";
+            running    = false;
+        }
+
+        while(running){
+            static_cast<void>(usleep(POLLING_INTERVAL));
+
+            if(statsInterval != 0 && nowUs() - lastStats >= static_cast<long long>(statsInterval) * 1000000){
+                lastStats = nowUs();
+                std::cerr << getStats() << "\n";
+            }
+        }
+
+        // Pending handshake steps are drained before their workers go away.
+        cryptoPool.stop();
+        for(auto& worker : workers)
+            worker->join();
+    }
+
+    string Relay::getStats(void) const noexcept{
+        string       res;
+        WorkerStats  total;
+
+        for(auto& worker : workers)
+            worker->snapshot(total);
+
+        try{
+            res.append("Relay - workers: ").append(to_string(workers.size()))
+               .append(" sessions: ").append(to_string(total.sessions))
+               .append(" accepted: ").append(to_string(total.accepted))
+               .append(" handshake failures: ").append(to_string(total.handshakeFailures))
+               .append(" handshake rejected: ").append(to_string(total.handshakeRejected))
+               .append(" messages in: ").append(to_string(total.messagesIn))
+               .append(" bytes in: ").append(to_string(total.bytesIn))
+               .append(" deliveries: ").append(to_string(total.deliveries))
+               .append(" drops: ").append(to_string(total.drops))
+               .append(" evictions: ").append(to_string(total.evictions))
+               .append(" syscalls: ").append(to_string(total.syscalls))
+               .append(" io_uring workers: ").append(to_string(total.uringWorkers))
+               .append(" memory: ").append(to_string(total.memoryBytes))
+               .append(" per session: ").append(to_string(total.sessions == 0 ? 0 : total.memoryBytes / total.sessions))
+               .append(" paused: ").append(to_string(total.pausedSessions))
+               .append(" sheds: ").append(to_string(total.sheds))
+               .append(" control records: ").append(to_string(total.controls))
+               .append(" - fan-out latency: ").append(total.fanoutLatency.summary());
+
+            res.append("\n").append(admission.getStats());
+            if(cryptoPool.isActive())
+                res.append("\n").append(cryptoPool.getStats());
+        }catch(...){
+            res = "getStats error.";
+        }
+
+        return res;
+    }
+
+} // End namespace relay
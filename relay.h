@@ -0,0 +1,262 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include "sslconn.h"
+#include "stats.h"
+#include "cryptopool.h"
+#include "admission.h"
+#include "memacct.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define RELAY_QUEUE_LIMIT  262144     // Max bytes queued for a single subscriber
+#define RELAY_STALL_LIMIT  10000000   // us a subscriber may stay saturated before eviction
+#define RELAY_READ_BUDGET  16         // Records read from one session per loop iteration
+#define RELAY_HOUSEKEEPING 1000000    // us between handshake expiry and memory scans
+#define RELAY_IDLE_TIME    5000000    // us without traffic before a session's buffers are trimmed
+#define RELAY_BUDGET_LOW   75         // % of the memory budget below which paused sessions resume
+
+#ifdef SC_IOURING
+    #include "uring.h"
+    #include <sys/socket.h>
+
+    #define RELAY_URING_ENTRIES   1024    // Submission queue depth per worker
+    #define RELAY_URING_SLOTS     256     // Registered buffers per worker, two per session
+    #define RELAY_URING_SLOT_SIZE 16384   // Bytes per registered buffer
+    #define RELAY_URING_IDLE_READ 2048    // Read size for sessions without a slot, grown on demand
+#endif
+
+namespace relay {
+
+// A received message is stored once and shared by every recipient queue.
+using SharedPayload = std::shared_ptr<const std::string>;
+
+struct Outgoing {
+    SharedPayload      payload;
+    long long          enqueued;
+};
+
+struct WorkerStats {
+    unsigned long long      sessions,
+                            accepted,
+                            handshakeFailures,
+                            handshakeRejected,
+                            messagesIn,
+                            bytesIn,
+                            deliveries,
+                            drops,
+                            evictions,
+                            syscalls,
+                            uringWorkers,
+                            memoryBytes,        // Gauges, refreshed by the housekeeping scan.
+                            pausedSessions,
+                            sheds,
+                            controls;           // Control records kept by the relay
+    stats::LatencyHistogram fanoutLatency;
+
+    WorkerStats(void);
+    void                    merge(const WorkerStats& other)                  noexcept;
+};
+
+class Session {
+    friend class Worker;
+
+    public:
+        Session(int sock, SSL* ssl, const std::string& peerName)            noexcept;
+        ~Session(void);
+
+        Session(const Session&)                                              = delete;
+        Session& operator=(const Session&)                                   = delete;
+
+        size_t               memoryUsage(void)                   const       noexcept;
+
+    private:
+        int                  fd;
+        SSL                  *sslp;
+        std::string          peer;
+        bool                 handshaking,
+                             handshakeFailed,
+                             inPool,            // Owned by the crypto pool: not polled.
+                             wantWrite,
+                             closing,
+                             admitted,          // Holds an admission slot until the handshake ends.
+                             paused;            // Over the memory budget: no reads, no new deliveries.
+        long long            acceptedAt,
+                             lastActive,
+                             sslBytes;          // Heap held by OpenSSL for this session (memacct).
+        std::deque<Outgoing> queue;
+        size_t               queuedBytes;
+        long long            fullSince;
+        unsigned long long   dropped,
+                             ioCalls;           // Socket BIO syscalls (poll backend).
+    #ifdef SC_IOURING
+        BIO                  *rbio,             // Memory BIOs, owned by sslp (io_uring backend).
+                             *wbio;
+        char                 *rbuf,
+                             *wbuf;
+        int                  rslot,             // Registered buffer index, -1: plain READ/WRITE.
+                             wslot,
+                             wlen,
+                             woff,
+                             readSize;
+        unsigned int         inflight;
+        bool                 reading,
+                             writing,
+                             shut;
+        std::vector<char>    ownRead,           // Used without a registered slot, trimmed when idle.
+                             ownWrite;
+    #endif
+};
+
+class Relay;
+
+// One event loop per core: its own listening socket, sessions and buffers.
+// Workers share only the immutable SSL_CTX; room messages cross workers
+// through a locked inbox plus a wakeup pipe.
+
+class Worker {
+    public:
+        Worker(Relay& relay, unsigned int num);
+        ~Worker(void);
+
+        Worker(const Worker&)                                                = delete;
+        Worker& operator=(const Worker&)                                     = delete;
+
+        bool                openListener(int sharedFd)                       noexcept;
+        int                 getListenFd(void)                    const       noexcept;
+        void                start(void);
+        void                join(void)                                       noexcept;
+        void                post(const Outgoing& msg)                        noexcept;
+        void                snapshot(WorkerStats& out)           const       noexcept;
+        bool                usesUring(void)                      const       noexcept;
+        const std::string&  getErrMsg(void)                      const       noexcept;
+
+    private:
+        Relay&                  owner;
+        unsigned int            id;
+        int                     listenFd,
+                                wakeFds[2];
+        bool                    ownListener;
+        std::thread             loop;
+        std::vector<std::unique_ptr<Session>>
+                                sessions;
+        std::vector<char>       readBuffer;
+        std::string             errMessage;
+
+        mutable std::mutex      inboxMtx,
+                                statsMtx;
+        std::vector<Outgoing>   inbox,
+                                pending;
+        std::vector<Session*>   returned,
+                                adopted;
+        WorkerStats             local,
+                                published;
+        bool                    dirty;
+        std::atomic<bool>       uringActive;
+        long long               lastHousekeeping;
+        size_t                  memoryInUse,
+                                pausedCount;
+
+    #ifdef SC_IOURING
+        Uring                   *ring;
+        std::vector<char>       slotArena;
+        std::vector<int>        freeSlots;
+        struct sockaddr_storage acceptAddr;
+        socklen_t               acceptLen;
+        struct __kernel_timespec
+                                tick;
+
+        bool                runUring(void)                                   noexcept;
+        struct io_uring_sqe* uringSqe(void)                                  noexcept;
+        void                uringComplete(const struct io_uring_cqe& cqe)    noexcept;
+        void                uringAccept(void)                                noexcept;
+        void                uringAdopt(int fd)                               noexcept;
+        void                uringRead(Session& sess)                         noexcept;
+        void                uringFlush(Session& sess)                        noexcept;
+        void                uringResume(Session& sess)                       noexcept;
+        void                uringRelease(Session& sess)                      noexcept;
+        void                uringSizeRead(Session& sess, int got)            noexcept;
+        void                uringTrim(Session& sess)                         noexcept;
+    #endif
+
+        void                run(void)                                        noexcept;
+        void                acceptIncoming(void)                             noexcept;
+        bool                admit(int fd, const struct sockaddr* addr,
+                                  socklen_t len)                             noexcept;
+        void                releaseAdmission(Session& sess)                  noexcept;
+        void                housekeeping(void)                               noexcept;
+        void                expireHandshakes(long long now)                  noexcept;
+        void                enforceBudget(void)                              noexcept;
+        void                handshake(Session& sess)                         noexcept;
+        void                stepHandshake(Session& sess)                     noexcept;
+        void                finishHandshake(Session& sess)                   noexcept;
+        void                handshakeDone(Session* sess)                     noexcept;
+        void                wakeup(void)                                     noexcept;
+        void                readSession(Session& sess)                       noexcept;
+        bool                controlRecord(Session& sess, int len)            noexcept;
+        void                flushSession(Session& sess)                      noexcept;
+        void                fanout(const Session* sender,
+                                   const Outgoing& msg)                      noexcept;
+        void                drainInbox(void)                                 noexcept;
+        void                reapSessions(void)                               noexcept;
+        void                publishStats(void)                               noexcept;
+};
+
+class Relay {
+    friend class Worker;
+
+    public:
+        explicit Relay(sslconn::ChatContext& ctx);
+        ~Relay(void);
+
+        bool                start(unsigned int workers,
+                                  unsigned int cryptoThreads)                noexcept;
+        void                run(void)                                        noexcept;
+        void                stop(void)                                       noexcept;
+        void                setStatsInterval(unsigned int secs)              noexcept;
+        bool                setIoUring(bool enable)                          noexcept;
+        void                setMemoryBudget(unsigned long long bytes)        noexcept;
+        std::string         getStats(void)                       const       noexcept;
+        const std::string&  getErrMsg(void)                      const       noexcept;
+
+    private:
+        sslconn::ChatContext&   context;
+        sslconn::SslConn        connection;
+        std::atomic<bool>       running;
+        unsigned int            statsInterval;
+        bool                    ioUring;
+        unsigned long long      memoryBudget;       // Bytes for all sessions, 0: unlimited.
+        CryptoPool              cryptoPool;
+        admission::Admission    admission;
+        std::vector<std::unique_ptr<Worker>>
+                                workers;
+        std::string             errMessage;
+
+        void                broadcast(const Worker& from,
+                                      const Outgoing& msg)                   noexcept;
+};
+
+} // End namespace relay
@@ -0,0 +1,233 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "socktune.h"
+
+#include <cstring>
+#include <cstdlib>
+
+#ifndef WINDOWS_OPENSSL
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <netdb.h>
+    #include <unistd.h>
+#else
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#endif
+
+namespace socktune {
+
+    using std::string;
+    using std::to_string;
+    using std::strtol;
+
+    static bool setInt(int fd, int level, int name, int value) noexcept{
+        return setsockopt(fd, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+    }
+
+    static int getInt(int fd, int level, int name) noexcept{
+        int        value { -1 };
+        socklen_t  len   { sizeof(value) };
+
+        return getsockopt(fd, level, name, reinterpret_cast<char*>(&value), &len) == 0 ? value : -1;
+    }
+
+    static bool parseInt(const string& text, int& value) noexcept{
+        char  *end { nullptr };
+        long   val { strtol(text.c_str(), &end, 10) };
+
+        if(text.empty() || *end != 0 || val < 0 || val > 0x7FFFFFFF)
+            return false;
+
+        value = static_cast<int>(val);
+        return true;
+    }
+
+    bool parseOpts(const string& spec, SockOpts& opts, string& err) noexcept{
+        SockOpts  res {};
+
+        try{
+            size_t  pos { 0 };
+            while(pos <= spec.size()){
+                size_t  next  { spec.find(',', pos) };
+                if(next == string::npos)
+                    next = spec.size();
+
+                string  item  { spec.substr(pos, next - pos) },
+                        key   { item.substr(0, item.find('=')) },
+                        value { item.find('=') == string::npos ? string() : item.substr(item.find('=') + 1) };
+                bool    ok    { true };
+                pos = next + 1;
+
+                if(item.empty())                continue;
+                else if(key == "tfo")           res.fastOpen = value.empty();
+                else if(key == "nodelay")       res.noDelay  = value.empty();
+                else if(key == "sndbuf")        ok = parseInt(value, res.sndBuf);
+                else if(key == "rcvbuf")        ok = parseInt(value, res.rcvBuf);
+                else if(key == "busypoll")      ok = parseInt(value, res.busyPoll);
+                else if(key == "backlog")       ok = parseInt(value, res.backlog);
+                else if(key == "keepalive"){
+                    size_t  first  { value.find('/') },
+                            second { first == string::npos ? string::npos : value.find('/', first + 1) };
+                    ok = second != string::npos &&
+                         parseInt(value.substr(0, first), res.keepIdle) &&
+                         parseInt(value.substr(first + 1, second - first - 1), res.keepIntvl) &&
+                         parseInt(value.substr(second + 1), res.keepCnt);
+                }else{
+                    ok = false;
+                }
+
+                if(!ok || ((key == "tfo" || key == "nodelay") && !value.empty())){
+                    err = string("Invalid socket option: ").append(item);
+                    return false;
+                }
+            }
+        }catch(...){
+            err = "Socket options parse error.";
+            return false;
+        }
+
+        opts = res;
+        return true;
+    }
+
+    string formatOpts(const SockOpts& opts) noexcept{
+        string  res;
+
+        try{
+            if(opts.fastOpen)           res.append("tfo,");
+            if(opts.noDelay)            res.append("nodelay,");
+            if(opts.sndBuf > 0)         res.append("sndbuf=").append(to_string(opts.sndBuf)).append(",");
+            if(opts.rcvBuf > 0)         res.append("rcvbuf=").append(to_string(opts.rcvBuf)).append(",");
+            if(opts.keepIdle > 0)       res.append("keepalive=").append(to_string(opts.keepIdle)).append("/")
+                                           .append(to_string(opts.keepIntvl)).append("/").append(to_string(opts.keepCnt)).append(",");
+            if(opts.busyPoll > 0)       res.append("busypoll=").append(to_string(opts.busyPoll)).append(",");
+            if(opts.backlog > 0)        res.append("backlog=").append(to_string(opts.backlog)).append(",");
+            if(!res.empty())
+                res.pop_back();
+        }catch(...){
+            res.clear();
+        }
+
+        return res;
+    }
+
+    // Buffers: the kernel doubles what it is asked for, the summary shows what it granted.
+    static void tuneBuffers(int fd, const SockOpts& opts, string& summary){
+        if(opts.sndBuf > 0){
+            summary.append(" sndbuf: ");
+            summary.append(setInt(fd, SOL_SOCKET, SO_SNDBUF, opts.sndBuf) ? to_string(getInt(fd, SOL_SOCKET, SO_SNDBUF)) : string("failed"));
+        }
+        if(opts.rcvBuf > 0){
+            summary.append(" rcvbuf: ");
+            summary.append(setInt(fd, SOL_SOCKET, SO_RCVBUF, opts.rcvBuf) ? to_string(getInt(fd, SOL_SOCKET, SO_RCVBUF)) : string("failed"));
+        }
+    }
+
+    static void tuneStream(int fd, const SockOpts& opts, string& summary){
+        if(opts.noDelay)
+            summary.append(" nodelay: ").append(setInt(fd, IPPROTO_TCP, TCP_NODELAY, 1) ? "on" : "failed");
+
+        if(opts.keepIdle > 0){
+            bool  ok { setInt(fd, SOL_SOCKET, SO_KEEPALIVE, 1) };
+            #if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+                ok = ok && setInt(fd, IPPROTO_TCP, TCP_KEEPIDLE,  opts.keepIdle)
+                        && setInt(fd, IPPROTO_TCP, TCP_KEEPINTVL, opts.keepIntvl)
+                        && setInt(fd, IPPROTO_TCP, TCP_KEEPCNT,   opts.keepCnt);
+            #endif
+            summary.append(" keepalive: ");
+            summary.append(ok ? to_string(opts.keepIdle).append("/").append(to_string(opts.keepIntvl))
+                                                        .append("/").append(to_string(opts.keepCnt))
+                              : string("failed"));
+        }
+
+        if(opts.busyPoll > 0){
+            #ifdef SO_BUSY_POLL
+                summary.append(" busypoll: ").append(setInt(fd, SOL_SOCKET, SO_BUSY_POLL, opts.busyPoll) ?
+                                                     to_string(opts.busyPoll).append(" us") : string("failed"));
+            #else
+                summary.append(" busypoll: unsupported");
+            #endif
+        }
+    }
+
+    // The buffers are reported by tuneConnected(), once the kernel settled them.
+    void tuneBeforeConnect(int fd, const SockOpts& opts, string& applied) noexcept{
+        try{
+            string  buffers;
+            tuneBuffers(fd, opts, buffers);
+            if(opts.fastOpen){
+                #ifdef TCP_FASTOPEN_CONNECT
+                    applied.append(" fastopen: ").append(setInt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1) ? "on" : "failed");
+                #else
+                    applied.append(" fastopen: unsupported");
+                #endif
+            }
+        }catch(...){
+            applied.clear();
+        }
+    }
+
+    // Accepted sockets inherit the buffers; a second listen() only resizes the backlog.
+    void tuneListener(int fd, const SockOpts& opts, string& summary) noexcept{
+        try{
+            string  applied { "Listener -" };
+
+            tuneBuffers(fd, opts, applied);
+            if(opts.fastOpen){
+                #ifdef TCP_FASTOPEN
+                    applied.append(" fastopen: ").append(setInt(fd, IPPROTO_TCP, TCP_FASTOPEN, SOCK_FASTOPEN_QLEN) ? "on" : "failed");
+                #else
+                    applied.append(" fastopen: unsupported");
+                #endif
+            }
+            if(opts.backlog > 0)
+                applied.append(" backlog: ").append(listen(fd, opts.backlog) == 0 ? to_string(opts.backlog) : string("failed"));
+
+            summary = applied.size() > sizeof("Listener -") - 1 ? applied : string("Listener - system defaults");
+        }catch(...){
+            summary.clear();
+        }
+    }
+
+    void tuneConnected(int fd, const SockOpts& opts, string& summary) noexcept{
+        try{
+            string  applied { "Socket -" };
+
+            tuneStream(fd, opts, applied);
+            if(opts.sndBuf > 0)     applied.append(" sndbuf: ").append(to_string(getInt(fd, SOL_SOCKET, SO_SNDBUF)));
+            if(opts.rcvBuf > 0)     applied.append(" rcvbuf: ").append(to_string(getInt(fd, SOL_SOCKET, SO_RCVBUF)));
+
+            summary = applied.size() > sizeof("Socket -") - 1 ? applied : string("Socket - system defaults");
+        }catch(...){
+            summary.clear();
+        }
+    }
+
+    void closeSocket(int fd) noexcept{
+        #ifndef WINDOWS_OPENSSL
+            static_cast<void>(close(fd));
+        #else
+            static_cast<void>(closesocket(static_cast<SOCKET>(fd)));
+        #endif
+    }
+
+} // End namespace socktune
@@ -0,0 +1,60 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <string>
+
+#define SOCK_ENV "SCSOCKOPTS"         // Same syntax as the configuration dialog field
+#define SOCK_FASTOPEN_QLEN 256        // Pending Fast Open requests on a listener
+
+namespace socktune {
+
+// Socket options BIO_new_ssl_connect() and BIO_new_accept() don't expose.
+// Zero, or false, leaves the system default. Spec syntax, comma separated:
+// tfo, nodelay, sndbuf=<bytes>, rcvbuf=<bytes>, keepalive=<idle>/<intvl>/<cnt>
+// (seconds, probes), busypoll=<us>, backlog=<n>.
+
+struct SockOpts {
+    bool    fastOpen,
+            noDelay;
+    int     sndBuf,
+            rcvBuf,
+            keepIdle,
+            keepIntvl,
+            keepCnt,
+            busyPoll,
+            backlog;
+};
+
+bool         parseOpts(const std::string& spec, SockOpts& opts,
+                       std::string& err)                                     noexcept;
+std::string  formatOpts(const SockOpts& opts)                                noexcept;
+
+// Options that must precede connect(): buffers size the window scale,
+// Fast Open sends the ClientHello with the SYN. tuneConnected() does the
+// rest, and reports the buffers the kernel granted.
+void         tuneBeforeConnect(int fd, const SockOpts& opts,
+                               std::string& applied)                         noexcept;
+void         tuneListener(int fd, const SockOpts& opts,
+                          std::string& summary)                              noexcept;
+void         tuneConnected(int fd, const SockOpts& opts,
+                           std::string& summary)                             noexcept;
+void         closeSocket(int fd)                                             noexcept;
+
+} // End namespace socktune
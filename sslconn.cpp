@@ -21,23 +21,78 @@
 #include <algorithm>
 #include <iostream>
 #include <cstring>
+#include <cstdio>
+
+#ifndef WINDOWS_OPENSSL
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <poll.h>
+#else
+    #include <winsock2.h>
+    #define poll WSAPoll
+#endif
 
 #include "types.h"
+#include "stats.h"
+#include "truststore.h"
 
 namespace  sslconn {
 
     using std::string;
     using std::vector;
+    using std::deque;
     using std::string;
     using std::to_string;
     using std::fill;
     using std::strlen;
     using std::strcpy;
+    using std::strncmp;
+    using std::memcmp;
+    using std::memmove;
+    using std::snprintf;
+    using std::strtoll;
+    using std::lock_guard;
+    using std::mutex;
+    using std::adopt_lock;
+
+    using typeutils::narrow;
+    using typeutils::clampTo;
+    using stats::nowUs;
+
+    // One SSL_CTX per role for the whole process: every session of that role takes a reference.
+    static mutex    sharedCtxMtx;
+    static SSL_CTX  *sharedCtx[2] { nullptr, nullptr };
+
+    static unsigned int envUInt(const char* name, unsigned int dflt) noexcept{
+        const char   *envconf  {getenv(name)};
+        if(envconf == nullptr)
+            return dflt;
+
+        char         *end      {nullptr};
+        unsigned long val      {strtoul(envconf, &end, 10)};
+        return (end == envconf || *end != 0) ? dflt : static_cast<unsigned int>(val);
+    }
+
+    // Servers take MSG_ALPN when a client offers it, and nothing else.
+    static int selectMsgAlpn(SSL* ssl, const unsigned char** out, unsigned char* outlen,
+                             const unsigned char* in, unsigned int inlen, void* arg) noexcept{
+        unsigned char  *selected { nullptr };
+
+        static_cast<void>(ssl);
+        static_cast<void>(arg);
 
-    using typeutils::safeInt;
+        if(SSL_select_next_proto(&selected, outlen, reinterpret_cast<const unsigned char*>(MSG_ALPN),
+                                 sizeof(MSG_ALPN) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED)
+            return SSL_TLSEXT_ERR_NOACK;
+
+        *out = selected;
+        return SSL_TLSEXT_ERR_OK;
+    }
 
     ChatContext::ChatContext(void)
        :    connectionMode{UNDEFINED},
+            ctxMode{UNDEFINED},
             biop{nullptr},
             abiop{nullptr},
             mbiop{nullptr},
@@ -46,19 +101,54 @@ namespace  sslconn {
             configIP{""},
             sConfigPort{""},
             errMessage{"None"},
-            infoMessage{""},
             baseDir{""},
             handShakeSummary{""},
+            sockSummary{""},
             blackList{"!aNULL:!eNULL:!3DES:!SHA1:!EXPORT:!EXPORT56:MEDIUM"},
             incomingBufferp(MEDIUM_BUFFER, 0),
             errBuffer(MEDIUM_BUFFER, 0),
             password(MEDIUM_BUFFER, 0),
-            status{inactive}
+            sockOpts{},
+            servers{},
+            status{},
+            controlMsg{false},
+            partialMsg{false},
+            hbInterval{envUInt("SCHBINTERVAL", 0)},
+            hbMissed{envUInt("SCHBMISSED", HB_MISSED)},
+            msgEnabled{envUInt("SCMSG", 1) != 0},
+            msgPeer{false},
+            muxEnabled{envUInt("SCMUX", 0) != 0},
+            muxPeer{false},
+            zipEnabled{envUInt("SCZIP", 0) != 0},
+            zipMin{envUInt("SCZMIN", ZIP_MIN)},
+            zipDictId{0},
+            zipPeerId{0},
+            lastRx{0},
+            srtt{0},
+            rttVar{0}
     {
         const string envvar    {"SCBLACKLIST"};
         const char   *envconf  {getenv(envvar.c_str())};
         if(envconf != nullptr)
             blackList  = envconf;
+
+        if(hbMissed == 0)
+            hbMissed = HB_MISSED;
+
+        const char   *sockconf {getenv(SOCK_ENV)};
+        string       sockErr;
+        if(sockconf != nullptr && !socktune::parseOpts(sockconf, sockOpts, sockErr))
+            eventlog::warn("sslconn", sockErr.append(": using the system defaults."));
+
+        const char   *serversconf {getenv(SERVERS_ENV)};
+        string       serversErr;
+        if(serversconf != nullptr && !parseServers(serversconf, "", servers, serversErr))
+            eventlog::warn("sslconn", serversErr.append(": using the configured address."));
+
+        // The last error is rebuilt in place: keep its capacity.
+        try{
+            errMessage.reserve(BIG_BUFFER);
+        }catch(...){}
     }
 
     PasswdVect ChatContext::getPwd(void) const noexcept{
@@ -70,15 +160,85 @@ namespace  sslconn {
     }
 
     Status   ChatContext::getStatus(void) const noexcept{
-        return status;
+        return status.get();
+    }
+
+    bool  ChatContext::subscribe(const StateListener& listener) noexcept{
+        return status.subscribe(listener);
     }
 
     const string&  ChatContext::getErrMsg(void)  const noexcept{
         return errMessage;
     }
 
-    const string&  ChatContext::getInfoMsg(void)  const noexcept{
-        return infoMessage;
+    ControlKind  controlKind(const char* buf, int len) noexcept{
+        auto  starts { [&](const char* prefix, size_t plen){
+                           return static_cast<size_t>(len) >= plen && memcmp(buf, prefix, plen) == 0; } };
+
+        if(len < 2 || buf[0] != CONTROL_MARK)
+            return CTRL_NONE;
+        if(buf[1] == CONTROL_MARK)
+            return CTRL_ESCAPED;
+        if(starts(HB_PING, sizeof(HB_PING) - 1))
+            return CTRL_PING;
+        if(starts(HB_PONG, sizeof(HB_PONG) - 1))
+            return CTRL_PONG;
+        if(len == sizeof(MUX_HELLO) - 1 && starts(MUX_HELLO, sizeof(MUX_HELLO) - 1))
+            return CTRL_MUX;
+        if(starts(ZIP_HELLO, sizeof(ZIP_HELLO) - 1))
+            return CTRL_ZIP;
+        if(starts(MSG_CONTINUED, sizeof(MSG_CONTINUED) - 1))
+            return CTRL_MORE;
+
+        return CTRL_NONE;
+    }
+
+    bool  ChatContext::isControlMsg(void)  const noexcept{
+        return controlMsg;
+    }
+
+    bool  ChatContext::isMuxActive(void)  const noexcept{
+        return muxEnabled && muxPeer;
+    }
+
+    bool  ChatContext::isPartialMsg(void)  const noexcept{
+        return partialMsg;
+    }
+
+    unsigned int  ChatContext::getHbInterval(void)  const noexcept{
+        return hbInterval;
+    }
+
+    double  ChatContext::getRtt(void)  const noexcept{
+        return static_cast<double>(srtt.load()) / 1000.0;
+    }
+
+    double  ChatContext::getJitter(void)  const noexcept{
+        return static_cast<double>(rttVar.load()) / 1000.0;
+    }
+
+    const socktune::SockOpts&  ChatContext::getSockOpts(void)  const noexcept{
+        return sockOpts;
+    }
+
+    const vector<Endpoint>&  ChatContext::getServers(void)  const noexcept{
+        return servers;
+    }
+
+    SSL_CTX*  ChatContext::getSslCtx(void)  const noexcept{
+        return ctxp;
+    }
+
+    const string&  ChatContext::getIp(void)  const noexcept{
+        return configIP;
+    }
+
+    const string&  ChatContext::getPort(void)  const noexcept{
+        return sConfigPort;
+    }
+
+    Conntype  ChatContext::getMode(void)  const noexcept{
+        return connectionMode;
     }
 
     void ChatContext::setIp(const string& par) noexcept{
@@ -98,17 +258,64 @@ namespace  sslconn {
         connectionMode = mod;
     }
 
+    void ChatContext::setSockOpts(const socktune::SockOpts& opts) noexcept{
+        sockOpts = opts;
+    }
+
+    void ChatContext::setServers(const vector<Endpoint>& list) noexcept{
+        try{
+            servers = list;
+        }catch(...){
+            servers.clear();
+        }
+    }
+
     void  ChatContext::appendInfo(const char* const msg) noexcept{
-        infoMessage.append(msg);
+        eventlog::info("sslconn", msg);
     }
 
     void  ChatContext::appendInfo(const string&  msg) noexcept{
-        infoMessage.append(msg);
+        eventlog::info("sslconn", msg);
+    }
+
+    RecordSizer::RecordSizer(unsigned int fixedSize)
+        : fixed{fixedSize > RECORD_FULL ? RECORD_FULL : fixedSize},
+          burstBytes{0},
+          lastSend{0}
+    {}
+
+    int  RecordSizer::next(long long now) noexcept{
+        if(fixed != 0)
+            return static_cast<int>(fixed);
+
+        if(now - lastSend > RECORD_IDLE_US)
+            burstBytes = 0;
+
+        return burstBytes < RECORD_RAMP_BYTES ? RECORD_SMALL : RECORD_FULL;
+    }
+
+    void  RecordSizer::account(int bytes, long long now) noexcept{
+        if(now - lastSend > RECORD_IDLE_US)
+            burstBytes = 0;
+
+        burstBytes += static_cast<unsigned long long>(bytes);
+        lastSend    = now;
     }
 
     SslConn::SslConn(ChatContext& ctx)
         : context{ctx},
-          errStatus{false}
+          errStatus{false},
+          linkFd{-1},
+          listenFd{-1},
+          nonBlocking{false},
+          handshakeDeadline{0},
+          cancelFlag{nullptr},
+          closing{false},
+          admitted{false},
+          recordSizer{envUInt("SCRECORDSIZE", 0)},
+          dataBytes{0},
+          dataRetry{false},
+          writeBacklog{false}
     {
         SSL_load_error_strings();
         ERR_load_BIO_strings();
@@ -157,44 +364,159 @@ namespace  sslconn {
     }
 
     void  SslConn::cleanContext(void) noexcept{
+        releaseLink();
+        if(context.ctxp!=nullptr){
+            SSL_CTX_free(context.ctxp);
+            context.ctxp=nullptr;
+        }
+        context.ctxMode = UNDEFINED;
+
+        static_cast<void>(context.status.moveTo(closed));
+    }
+
+    // Frees the session BIOs and clears the per-session state; the SSL_CTX stays.
+    // The accept BIO owns mbiop since BIO_set_accept_bios(): it frees both.
+    void  SslConn::releaseLink(void) noexcept{
+        lock_guard<mutex> lock(writeMtx);
+
+        // A handshake dropped half way, or never continued, gives its slot back here.
+        releaseAdmission();
+
+        controlOut.clear();
+        dataOut.clear();
+        dataBytes    = 0;
+        dataRetry    = false;
+        writeBacklog = false;
+
         if(context.biop!=nullptr){
             BIO_free_all(context.biop);
             context.biop=nullptr;
         }
+        if(context.abiop!=nullptr){
+            BIO_free_all(context.abiop);
+            context.abiop=nullptr;
+            context.mbiop=nullptr;
+        }
         if(context.mbiop!=nullptr){
             BIO_free_all(context.mbiop);
             context.mbiop=nullptr;
         }
-        if(context.abiop!=nullptr){
-            free(context.abiop);
-            context.abiop=nullptr;
+
+        linkFd                   = -1;
+        listenFd                 = -1;
+        context.sslp             = nullptr;
+        context.controlMsg       = false;
+        context.partialMsg       = false;
+        context.msgPeer          = false;
+        context.muxPeer          = false;
+        context.zipPeerId        = 0;
+        context.lastRx           = 0;
+        context.srtt             = 0;
+        context.rttVar           = 0;
+        context.handShakeSummary.clear();
+        context.sockSummary.clear();
+    }
+
+    // Sends close_notify and tears the session down: the peer sees an orderly
+    // close and the Reader or the Listener blocked on the socket are woken.
+    // Only the close_notify write may wait, DISCONNECT_LINGER seconds at most:
+    // close() doesn't linger, the kernel flushes what is left in background.
+    // The SSL_CTX is kept, so the next configure() only pays the handshake.
+    void  SslConn::disconnect(void) noexcept{
+        Status  current { context.status.get() };
+        int     fd      { linkFd.load() },
+                lfd     { current == listening ? listenFd.load() : -1 };
+
+        closing = true;
+
+        if(current == connected && context.status.moveFrom(connected, draining)){
+            #ifndef WINDOWS_OPENSSL
+                struct timeval  tv { DISCONNECT_LINGER, 0 };
+            #else
+                DWORD           tv { DISCONNECT_LINGER * 1000 };
+            #endif
+
+            if(fd >= 0)
+                static_cast<void>(setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv)));
+
+            lock_guard<mutex> lock(writeMtx);
+            SSL    *ssl { nullptr };
+
+            #pragma clang diagnostic push
+            #pragma clang diagnostic ignored "-Wold-style-cast"
+
+            if(context.biop != nullptr)
+                static_cast<void>(BIO_get_ssl(context.biop, &ssl));
+
+            #pragma clang diagnostic pop
+
+            ERR_clear_error();
+            if(ssl != nullptr && SSL_shutdown(ssl) < 0)
+                eventlog::warn("sslconn", "close_notify not sent.");
         }
-        if(context.ctxp!=nullptr){
-            SSL_CTX_free(context.ctxp);
-            context.ctxp=nullptr;
+
+        #ifndef WINDOWS_OPENSSL
+            if(fd >= 0)  static_cast<void>(shutdown(fd, SHUT_RDWR));
+            if(lfd >= 0) static_cast<void>(shutdown(lfd, SHUT_RDWR));
+        #else
+            if(fd >= 0)  static_cast<void>(shutdown(fd, SD_BOTH));
+            if(lfd >= 0) static_cast<void>(shutdown(lfd, SD_BOTH));
+        #endif
+
+        // A handshake may have started meanwhile on a new socket: shut that one too.
+        while(!readMtx.try_lock()){
+            int  next { linkFd.load() };
+            if(next >= 0 && next != fd){
+                fd = next;
+                #ifndef WINDOWS_OPENSSL
+                    static_cast<void>(shutdown(fd, SHUT_RDWR));
+                #else
+                    static_cast<void>(shutdown(fd, SD_BOTH));
+                #endif
+            }
+            static_cast<void>(usleep(1000));
+        }
+
+        {
+            lock_guard<mutex> lock(readMtx, adopt_lock);
+            releaseLink();
         }
 
-        context.status  =  inactive;
+        if(context.status.get() != closed)
+            static_cast<void>(context.status.moveTo(closed));
+        closing = false;
+
+        eventlog::info("sslconn", "Disconnected.");
     }
 
+    // errMessage holds the latest error only, within its reserved capacity; the log keeps the history.
     void   SslConn::setErrMsg(const char* const msg, bool clearBuff )  noexcept{
-         if(clearBuff) context.errMessage.clear();
-         context.errMessage.append(ERROR_PROMPT).append(msg);
+         eventlog::error("sslconn", msg);
+
+         size_t  prompt { strlen(ERROR_PROMPT) },
+                 len    { strlen(msg) },
+                 room   { context.errMessage.capacity() > prompt ? context.errMessage.capacity() - prompt : 0 };
+         if(clearBuff || context.errMessage.size() + prompt + len > context.errMessage.capacity())
+             context.errMessage.clear();
+         context.errMessage.append(ERROR_PROMPT).append(msg, len < room ? len : room);
     }
 
     void   SslConn::setErrMsg(const string& msg, bool clearBuff )  noexcept{
-         if(clearBuff) context.errMessage.clear();
-         context.errMessage.append(ERROR_PROMPT).append(msg);
+         setErrMsg(msg.c_str(), clearBuff);
     }
 
     bool SslConn::configure(void) noexcept{
-        bool ret  { true };
-        if(context.status==inactive && context.connectionMode == CLIENT){
+        bool   ret    { true };
+        Status current { context.status.get() };
+        if(!ConnState::isActive(current))
+               releaseLink();
+
+        if(!ConnState::isActive(current) && context.connectionMode == CLIENT){
                if(!setClientMode()){
                     setErrMsg("Error setting client mode", false);
                     ret  =  false;
                }
-        }else if(context.status==inactive && context.connectionMode == SERVER){
+        }else if(!ConnState::isActive(current) && context.connectionMode == SERVER){
                if(!setServerMode()){
                     setErrMsg("Error setting server mode", false);
                     ret  =  false;
@@ -207,6 +529,15 @@ namespace  sslconn {
         return true;
     }
 
+    bool SslConn::createContext(void) noexcept{
+        if(context.ctxp != nullptr){
+            setErrMsg("Context already created.");
+            return false;
+        }
+
+        return setContext();
+    }
+
     string  SslConn::getSslError(unsigned long errCode) const noexcept{
         try{
            string errMsg(ERR_error_string(errCode, nullptr));
@@ -216,18 +547,243 @@ namespace  sslconn {
         }
     }
 
+    // Control records are small and don't count as traffic: only sized writes
+    // go through the record sizer, one BIO_write (so one record) per chunk.
+    // Each record of a message is text on its own for the peer: one starting
+    // with CONTROL_MARK goes with the mark doubled, one the next continues
+    // starts with MSG_CONTINUED once the peer reassembles (msgPeer).
+    bool  SslConn::writeRecord(const char* buf, int len, bool sized) noexcept{
+        lock_guard<mutex> lock(writeMtx);
+
+        if(context.status.get() != connected || context.biop == nullptr)
+            return false;
+
+        // SSL_write() retries must repeat the record left half written: queued records go first.
+        if(writeBacklog && !drainQueued(true))
+            return false;
+
+        int res { 0 };
+        if(!sized){
+            res = writeBio(buf, len);
+        }else{
+            char  rec[RECORD_FULL];
+
+            while(res < len){
+                long long    now   { nowUs() };
+                const char   *out  { nullptr };
+                int          size  { 0 },
+                             taken { cutRecord(buf + res, len - res, recordSizer.next(now), rec, out, size) },
+                             rc    { writeBio(out, size) };
+
+                if(rc != size)
+                    break;
+
+                recordSizer.account(rc, now);
+                res += taken;
+            }
+        }
+
+        #pragma clang diagnostic push
+        #pragma clang diagnostic ignored "-Wold-style-cast"
+
+        static_cast<void>(BIO_flush(context.biop));
+
+        #pragma clang diagnostic pop
+
+        return res == len;
+    }
+
+    // The next record of a message, at most chunk bytes, from buf with left
+    // bytes to go: out is rec when the record needs a prefix, else buf; size
+    // is its length, the return value the message bytes it takes.
+    int  SslConn::cutRecord(const char* buf, int left, int chunk, char* rec, const char*& out, int& size) noexcept{
+        int  room   { std::max(chunk, static_cast<int>(sizeof(MSG_CONTINUED))) },
+             prefix { buf[0] == CONTROL_MARK ? 1 : 0 },
+             taken  { std::min(left, room - prefix) };
+
+        if(context.msgPeer && taken < left){
+            prefix = sizeof(MSG_CONTINUED) - 1;
+            taken  = room - prefix;
+        }
+
+        // MSG_CONTINUED starts with CONTROL_MARK: its first byte alone is the escape.
+        out  = buf;
+        size = prefix + taken;
+        if(prefix != 0){
+            memcpy(rec, MSG_CONTINUED, static_cast<size_t>(prefix));
+            memcpy(rec + prefix, buf, static_cast<size_t>(taken));
+            out = rec;
+        }
+
+        return taken;
+    }
+
+    // A non-blocking session waits for the socket here, the same call repeated as SSL_write() wants.
+    int  SslConn::writeBio(const char* buf, int len) noexcept{
+        for(;;){
+            int  rc { BIO_write(context.biop, buf, len) };
+            if(rc > 0 || !BIO_should_retry(context.biop))
+                return rc;
+
+            #ifndef WINDOWS_OPENSSL
+                struct pollfd  pfd { linkFd.load(), static_cast<short>(BIO_should_read(context.biop) ? POLLIN : POLLOUT), 0 };
+            #else
+                WSAPOLLFD      pfd { static_cast<SOCKET>(linkFd.load()), static_cast<short>(BIO_should_read(context.biop) ? POLLIN : POLLOUT), 0 };
+            #endif
+            if(pfd.fd < 0 || closing || poll(&pfd, 1, WRITE_WAIT_MS) <= 0)
+                return rc;
+        }
+    }
+
+    // Control records from the Reactor thread never wait: what the socket
+    // doesn't take now stays queued, and goes out when the Reactor sees
+    // POLLOUT (flushQueued()) or before the next record written.
+    bool  SslConn::writeControl(const char* buf, int len) noexcept{
+        if(!nonBlocking)
+            return writeRecord(buf, len);
+
+        lock_guard<mutex> lock(writeMtx);
+
+        if(context.status.get() != connected || context.biop == nullptr || controlOut.size() >= CONTROL_BACKLOG)
+            return false;
+
+        // Written from the queue: a retry must find the record at the same address.
+        try{
+            controlOut.emplace_back(buf, static_cast<size_t>(len));
+        }catch(...){
+            return false;
+        }
+
+        return drainQueued(false);
+    }
+
+    // sendMessage() for the Reactor thread, which must not wait: the records
+    // are cut as writeRecord() does and queued, what the socket doesn't take
+    // now goes out on POLLOUT. False when SEND_BACKLOG bytes already wait.
+    bool  SslConn::queueMessage(const string& msg) noexcept{
+        int  len { 0 };
+
+        if(msg.size() > MESSAGE_MAX || !narrow(msg.size(), len)){
+             errStatus   =  true;
+             setErrMsg("Message too long.");
+
+             return false;
+        }
+
+        if(!nonBlocking)
+            return sendMessage(msg);
+
+        const char  *err { "Unconnected." };
+        {
+            lock_guard<mutex> lock(writeMtx);
+
+            if(context.status.get() == connected && context.biop != nullptr && dataBytes >= SEND_BACKLOG){
+                err = "Send backlog full.";
+            }else if(context.status.get() == connected && context.biop != nullptr){
+                char    rec[RECORD_FULL];
+                size_t  before { dataOut.size() },
+                        bytes  { 0 };
+
+                // All the records of the message or none: the peer would wait for the rest.
+                try{
+                    for(int res = 0; res < len; ){
+                        long long    now   { nowUs() };
+                        const char   *out  { nullptr };
+                        int          size  { 0 },
+                                     taken { cutRecord(msg.data() + res, len - res, recordSizer.next(now), rec, out, size) };
+
+                        dataOut.emplace_back(out, static_cast<size_t>(size));
+                        recordSizer.account(size, now);
+                        bytes += static_cast<size_t>(size);
+                        res   += taken;
+                    }
+                }catch(...){
+                    dataOut.resize(before);
+                    err   = "Message queue error.";
+                    bytes = 0;
+                }
+
+                if(bytes != 0 || len == 0){
+                    dataBytes += bytes;
+                    return drainQueued(false);
+                }
+            }
+        }
+
+        errStatus   =  true;
+        setErrMsg(err);
+
+        return false;
+    }
+
+    bool  SslConn::flushQueued(void) noexcept{
+        lock_guard<mutex> lock(writeMtx);
+
+        if(context.status.get() != connected || context.biop == nullptr)
+            return false;
+
+        return drainQueued(false);
+    }
+
+    bool  SslConn::wantsWrite(void) const noexcept{
+        return writeBacklog;
+    }
+
+    // writeMtx held. Control records first, unless the socket took the first
+    // queued message record in part: SSL_write() wants it again before any
+    // other. False when the session can't take them: they are dropped.
+    bool  SslConn::drainQueued(bool wait) noexcept{
+        bool  res { true };
+
+        while(!controlOut.empty() || !dataOut.empty()){
+            bool           data  { controlOut.empty() || (dataRetry && !dataOut.empty()) };
+            deque<string>  &out  { data ? dataOut : controlOut };
+            const string&  rec   { out.front() };
+            int            rc    { wait ? writeBio(rec.data(), static_cast<int>(rec.size()))
+                                        : BIO_write(context.biop, rec.data(), static_cast<int>(rec.size())) };
+            if(rc <= 0){
+                if(wait || !BIO_should_retry(context.biop)){
+                    controlOut.clear();
+                    dataOut.clear();
+                    dataBytes = 0;
+                    dataRetry = false;
+                    res       = false;
+                }else{
+                    dataRetry = data;
+                }
+                break;
+            }
+            if(data)
+                dataBytes -= rec.size();
+            out.pop_front();
+            dataRetry = false;
+        }
+
+        #pragma clang diagnostic push
+        #pragma clang diagnostic ignored "-Wold-style-cast"
+
+        static_cast<void>(BIO_flush(context.biop));
+
+        #pragma clang diagnostic pop
+
+        writeBacklog = !controlOut.empty() || !dataOut.empty();
+        return res;
+    }
+
     bool  SslConn::sendMessage(const string& msg) noexcept{
 
-        if( context.status  ==  connected) {
+        int  len { 0 };
 
-            static_cast<void>(BIO_write(context.biop, msg.c_str(), safeInt(msg.size())));
+        if(msg.size() > MESSAGE_MAX || !narrow(msg.size(), len)){
+             errStatus   =  true;
+             setErrMsg("Message too long.");
 
-            #pragma clang diagnostic push
-            #pragma clang diagnostic ignored "-Wold-style-cast"
+             return false;
+        }
 
-            static_cast<void>(BIO_flush(context.biop));
+        if( context.status.get()  ==  connected) {
 
-            #pragma clang diagnostic pop
+            static_cast<void>(writeRecord(msg.c_str(), len, true));
 
         } else {
              errStatus   =  true;
@@ -242,43 +798,64 @@ namespace  sslconn {
     bool  SslConn::setContext(void) noexcept {
         bool ret { true };
 
-        string       trustStore,
+        string       trustErr,
                      serverPem,
                      serverKey;
 
         #ifndef WINDOWS_OPENSSL
-            context.baseDir.append(getenv("HOME")).append("/.securechat/");
+            const char  *home { getenv("HOME") };
+            context.baseDir.assign(home != nullptr ? home : ".").append("/.securechat/");
         #else
-            context.baseDir.append("C:\\securechat\\");
+            context.baseDir.assign("C:\\securechat\\");
         #endif
 
+        // Certificates and trust store are loaded once per mode, later connections reuse them.
+        if(context.ctxp != nullptr && context.ctxMode != context.connectionMode){
+            SSL_CTX_free(context.ctxp);
+            context.ctxp    = nullptr;
+            context.ctxMode = UNDEFINED;
+        }
+        if(context.ctxp == nullptr && context.connectionMode != UNDEFINED){
+            lock_guard<mutex> lock(sharedCtxMtx);
+            SSL_CTX  *ctx { sharedCtx[context.connectionMode] };
+            if(ctx != nullptr && SSL_CTX_up_ref(ctx) == 1)
+                context.ctxp = ctx;
+        }
+        bool  reuse { context.ctxp != nullptr };
+
         if(context.connectionMode == CLIENT){
+            if(reuse)
+                return true;
+
             context.ctxp = SSL_CTX_new(SSLv23_client_method());
             if(context.ctxp == nullptr ){
                 setErrMsg("SSL context failure.");
                 ret  =  false;
             }
 
-            trustStore.append(context.baseDir).append("TrustStore.pem");
-
+            // Shared by every client context, see truststore.h.
             if(ret){
-                if(SSL_CTX_load_verify_locations(context.ctxp, trustStore.data(), nullptr)==0){
+                if(!truststore::shared().attach(context.ctxp, context.baseDir, trustErr)){
                     cleanContext();
-                    setErrMsg("Error loading trust store");
+                    setErrMsg(trustErr);
                     ret  =  false;
                 }
-
-                context.biop = BIO_new_ssl_connect(context.ctxp);
             }
 
+            if(ret && context.msgEnabled)
+                static_cast<void>(SSL_CTX_set_alpn_protos(context.ctxp, reinterpret_cast<const unsigned char*>(MSG_ALPN),
+                                                          sizeof(MSG_ALPN) - 1));
+
         }else{
-            context.ctxp = SSL_CTX_new(SSLv23_server_method());
-            if(context.ctxp == nullptr){
-                setErrMsg(" SSL_CTX_new failed. Aborting.");
-                ret  =  false;
+            if(!reuse){
+                context.ctxp = SSL_CTX_new(SSLv23_server_method());
+                if(context.ctxp == nullptr){
+                    setErrMsg(" SSL_CTX_new failed. Aborting.");
+                    ret  =  false;
+                }
             }
 
-            if(ret){
+            if(ret && !reuse){
                 int (*callback)(char *, int, int, void *) = [](char *buf, int size, int rwflag, void *chatContext)
                                {
                                      static_cast<void>(size);
@@ -306,7 +883,7 @@ namespace  sslconn {
                 }
             }
 
-            if(ret){
+            if(ret && !reuse){
                 serverKey.append(context.baseDir).append("server.key");
 
                 if(SSL_CTX_use_PrivateKey_file(context.ctxp, serverKey.data(), SSL_FILETYPE_PEM)!=1){
@@ -314,8 +891,18 @@ namespace  sslconn {
                     cleanContext();
                     ret  =  false;
                 }
+
+                // The key is loaded: the context may outlive this ChatContext now.
+                if(ret){
+                    SSL_CTX_set_default_passwd_cb(context.ctxp, nullptr);
+                    SSL_CTX_set_default_passwd_cb_userdata(context.ctxp, nullptr);
+                }
+
+                if(ret && context.msgEnabled)
+                    SSL_CTX_set_alpn_select_cb(context.ctxp, selectMsgAlpn, nullptr);
             }
 
+            // The accept BIO takes this one over: it's built again for every listen.
             if(ret){
                 context.mbiop = BIO_new_ssl(context.ctxp, 0);
                 if(context.mbiop == nullptr){
@@ -326,6 +913,15 @@ namespace  sslconn {
             }
         }
 
+        if(ret)
+            context.ctxMode = context.connectionMode;
+
+        if(ret && !reuse){
+            lock_guard<mutex> lock(sharedCtxMtx);
+            if(sharedCtx[context.connectionMode] == nullptr && SSL_CTX_up_ref(context.ctxp) == 1)
+                sharedCtx[context.connectionMode] = context.ctxp;
+        }
+
         return ret;
     }
 
@@ -334,20 +930,38 @@ namespace  sslconn {
         int  bits        {  0   };
 
         if(setContext()){
-            #pragma clang diagnostic push
-            #pragma clang diagnostic ignored "-Wold-style-cast"
+            vector<Endpoint>  servers { context.servers };
+            string            raceErr;
+
+            if(servers.empty())
+                servers.push_back({ context.configIP, context.sConfigPort });
+            for(auto& server : servers)
+                if(server.port.empty())
+                    server.port = context.sConfigPort;
+
+            // The servers race up to the end of the handshake; the winner goes under an SSL BIO.
+            static_cast<void>(context.status.moveTo(resolving));
+            context.sslp = raceConnect(context.ctxp, servers, context.sockOpts, context.sockSummary, raceErr,
+                                       &context.status, cancelFlag);
+            context.biop = context.sslp == nullptr ? nullptr : BIO_new(BIO_f_ssl());
+
+            if(context.biop == nullptr){
+                if(context.sslp != nullptr)
+                    SSL_free(context.sslp);
+                context.sslp = nullptr;
+                setErrMsg(string("Set Client Mode: Error attempting to connect: ").append(raceErr));
+                localStatus = false;
+            }else{
+                #pragma clang diagnostic push
+                #pragma clang diagnostic ignored "-Wold-style-cast"
 
-            static_cast<void>(BIO_get_ssl(context.biop, &(context.sslp)));
-            static_cast<void>(SSL_set_mode(context.sslp, SSL_MODE_AUTO_RETRY));
+                static_cast<void>(BIO_set_ssl(context.biop, context.sslp, BIO_CLOSE));
+                static_cast<void>(SSL_set_mode(context.sslp, SSL_MODE_AUTO_RETRY | SSL_MODE_RELEASE_BUFFERS));
 
-            static_cast<void>(BIO_set_conn_hostname(context.biop, context.configIP.c_str()));
-            static_cast<void>(BIO_set_conn_port(context.biop, context.sConfigPort.c_str()));
-            #pragma clang diagnostic pop
+                #pragma clang diagnostic pop
+
+                linkFd = SSL_get_fd(context.sslp);
 
-            if(BIO_do_connect(context.biop) <= 0){
-                setErrMsg("Set Client Mode: Error attempting to connect");
-                localStatus = false;
-            }else{
                 // Check the certificate
                 if(SSL_get_verify_result(context.sslp) != X509_V_OK){
                     setErrMsg(string("Certificate verification error: ").append(to_string( SSL_get_verify_result(context.sslp))));
@@ -363,15 +977,20 @@ namespace  sslconn {
                 context.handShakeSummary.append("Info - ").append(SSL_state_string_long((const SSL*)context.sslp))\
                                         .append(" - Algorithms: ").append(SSL_get_cipher_name((const SSL*)context.sslp))\
                                         .append(" - Algorithm bits: ").append(to_string( SSL_get_cipher_bits((const SSL*)context.sslp, &bits)))\
-                                        .append(" - Connection Protocol Version: ").append(SSL_get_version((const SSL*)context.sslp));
+                                        .append(" - Connection Protocol Version: ").append(SSL_get_version((const SSL*)context.sslp))\
+                                        .append(" - ").append(context.sockSummary);
 
                 #pragma clang diagnostic pop
 
                 context.appendInfo(context.handShakeSummary.c_str());
-                context.status = connected;
+                if(nonBlocking)
+                    static_cast<void>(setBlocking(linkFd, false));
+                markAlive();
+                static_cast<void>(context.status.moveTo(connected));
+                announce();
             }else{
                 cleanContext();
-                context.status = error;
+                static_cast<void>(context.status.moveTo(error));
             }
         }
         return localStatus;
@@ -387,27 +1006,46 @@ namespace  sslconn {
         connectionString.insert(connectionString.end(), context.sConfigPort.begin(), context.sConfigPort.end());
         connectionString.push_back(0);
 
-        context.appendInfo("Connection String: ");
-        context.appendInfo(connectionString.data());
+        context.appendInfo(string("Connection String: ").append(connectionString.data()));
 
         if(setContext()){
             #pragma clang diagnostic push
             #pragma clang diagnostic ignored "-Wold-style-cast"
 
             static_cast<void>(BIO_get_ssl(context.mbiop, &(context.sslp)));
-            static_cast<void>(SSL_set_mode(context.sslp, SSL_MODE_AUTO_RETRY));
+            static_cast<void>(SSL_set_mode(context.sslp, SSL_MODE_AUTO_RETRY | SSL_MODE_RELEASE_BUFFERS));
             context.abiop = BIO_new_accept(connectionString.data());
             static_cast<void>(BIO_set_accept_bios(context.abiop, context.mbiop));
+            // Listening again right after a disconnect: the old session may be in TIME_WAIT.
+            static_cast<void>(BIO_set_bind_mode(context.abiop, BIO_BIND_REUSEADDR));
 
             #pragma clang diagnostic pop
 
             if(BIO_do_accept(context.abiop) <= 0){
                 setErrMsg("Accept failed.");
                 status = false;
+            }else{
+                int  fd { -1 };
+
+                #pragma clang diagnostic push
+                #pragma clang diagnostic ignored "-Wold-style-cast"
+
+                static_cast<void>(BIO_get_fd(context.abiop, &fd));
+
+                #pragma clang diagnostic pop
+
+                if(fd >= 0){
+                    string  applied;
+                    socktune::tuneListener(fd, context.sockOpts, applied);
+                    context.appendInfo(applied);
+                    if(nonBlocking)
+                        static_cast<void>(setBlocking(fd, false));
+                }
+                listenFd = fd;
             }
 
             if(status)
-                context.status = listening;
+                static_cast<void>(context.status.moveTo(listening));
             else
                 cleanContext();
         }
@@ -416,13 +1054,46 @@ namespace  sslconn {
     }
 
     bool SslConn::readIncoming(void)  noexcept{
+        int  len { 0 };
+
+        return readIncoming(context.incomingBufferp.data(), clampTo<int>(context.incomingBufferp.size()), len);
+    }
+
+    // Reads one record into a caller buffer, always NUL terminated. Nothing
+    // read (len 0) isn't an error when the session is being disconnected.
+    bool SslConn::readIncoming(char* buf, int size, int& len)  noexcept{
         int  incomingSize  {  0  };
         bool  ret          {  true };
 
-        if(context.status==connected){
-            fill(context.incomingBufferp.begin(), context.incomingBufferp.end(), 0);
-
-            incomingSize  =  BIO_read(context.biop, context.incomingBufferp.data(), safeInt(context.incomingBufferp.size() - 1));
+        lock_guard<mutex> lock(readMtx);
+
+        context.controlMsg = false;
+        context.partialMsg = false;
+        len                = 0;
+        buf[0]             = 0;
+
+        if(context.status.get() == connected && context.biop != nullptr){
+            incomingSize  =  BIO_read(context.biop, buf, size - 1);
+
+            if(incomingSize <= 0 && (closing || BIO_should_retry(context.biop)))
+                return true;
+
+            if(incomingSize > 0){
+                len               = incomingSize;
+                buf[incomingSize] = 0;
+                context.lastRx    = nowUs();
+                ControlKind  kind { controlKind(buf, len) };
+                if(kind == CTRL_ESCAPED){
+                    memmove(buf, buf + 1, static_cast<size_t>(len));
+                    len--;
+                }else if(kind == CTRL_MORE){
+                    len -= static_cast<int>(sizeof(MSG_CONTINUED) - 1);
+                    memmove(buf, buf + sizeof(MSG_CONTINUED) - 1, static_cast<size_t>(len) + 1);
+                    context.partialMsg = true;
+                }else if(kind != CTRL_NONE){
+                    handleControl(kind, buf);
+                }
+            }
 
             if(incomingSize <= 0){
                 setErrMsg(string("BIO_read() error: ").append(to_string(incomingSize)).append("\n"));
@@ -442,64 +1113,311 @@ namespace  sslconn {
 
                 #pragma clang diagnostic pop
 
-                context.status=inactive;
+                static_cast<void>(context.status.moveTo(closed));
             }
         }
 
         return ret;
     }
 
+    // Blocking, the accept and the whole handshake happen here. A non-blocking
+    // session returns as soon as the socket has nothing more: the Reactor
+    // calls again on the next event, in handshaking until it completes.
     bool  SslConn::listenIncoming(void) noexcept{
-        bool         ret        {  true  };
+        lock_guard<mutex> lock(readMtx);
+
+        Status  current { context.status.get() };
+        if(current == handshaking && context.connectionMode == SERVER && context.biop != nullptr)
+            return continueHandshake();
+        if(current != listening || context.abiop == nullptr)
+            return true;
 
         if(BIO_do_accept(context.abiop) <= 0){
+            if(closing || (nonBlocking && BIO_should_retry(context.abiop)))
+                return true;
             setErrMsg(string("BIO_do_accept error:").append(getSslErrStrings()));
-            ret  =  false;
             cleanContext();
+            return false;
+        }
+
+        context.biop = BIO_pop(context.abiop);
+
+        int  fd { -1 };
+
+        #pragma clang diagnostic push
+        #pragma clang diagnostic ignored "-Wold-style-cast"
+
+        static_cast<void>(BIO_get_fd(context.biop, &fd));
+
+        #pragma clang diagnostic pop
+
+        // A refused peer is dropped before any crypto: keep listening.
+        if(!admitIncoming(fd)){
+            BIO_free_all(context.biop);
+            context.biop = nullptr;
+            return true;
+        }
+
+        linkFd = fd;
+
+        static_cast<void>(context.status.moveTo(handshaking));
+        context.sockSummary.clear();
+        if(fd >= 0)
+            socktune::tuneConnected(fd, context.sockOpts, context.sockSummary);
+
+        if(nonBlocking){
+            static_cast<void>(setBlocking(fd, false));
+            handshakeDeadline = nowUs() + static_cast<long long>(admission.getTimeout()) * 1000000;
         }else{
-            context.biop = BIO_pop(context.abiop);
+            setHandshakeTimeout(fd, admission.getTimeout());
+        }
 
-            if(BIO_do_handshake(context.biop) > 0){
-                context.status=connected;
+        return continueHandshake();
+    }
 
-                #pragma clang diagnostic push
-                #pragma clang diagnostic ignored "-Wold-style-cast"
+    bool  SslConn::continueHandshake(void) noexcept{
+        bool  handshaked { BIO_do_handshake(context.biop) > 0 };
 
-                SSL          *tempSsl  {  nullptr };
-                static_cast<void>(BIO_get_ssl(context.biop, &tempSsl));
+        if(!handshaked && nonBlocking && BIO_should_retry(context.biop) && !closing && nowUs() < handshakeDeadline)
+            return true;
 
-                #pragma clang diagnostic pop
+        if(!nonBlocking)
+            setHandshakeTimeout(linkFd, 0);
+        releaseAdmission();
 
-                SSL_CIPHER   *cipher  { const_cast<SSL_CIPHER*>(SSL_get_current_cipher(tempSsl)) };
+        if(handshaked){
+            markAlive();
+            static_cast<void>(context.status.moveTo(connected));
+            announce();
 
-                if(cipher!=nullptr){
-                    vector<char> buffer(MEDIUM_BUFFER, 0);
-                    SSL_CIPHER_description(cipher,buffer.data(), safeInt(buffer.size() - 1));
-                    context.handShakeSummary.clear();
-                    context.handShakeSummary.append("Info - ").append(SSL_state_string_long(static_cast<const SSL*>(context.sslp)))\
-                                            .append(" - Algorithms: ").append(cipher->name)\
-                                            .append(" - Algorithm bits: ").append(to_string( cipher->alg_bits))\
-                                            .append(" - Connection Protocol Version: ").append(SSL_get_version(reinterpret_cast<const SSL*>(context.sslp)));
+            #pragma clang diagnostic push
+            #pragma clang diagnostic ignored "-Wold-style-cast"
 
-                    context.appendInfo(context.handShakeSummary.c_str());
-                }else{
-                    int       bits  {  0  };
-                    string    buffer;
-                    context.appendInfo("No cipher informations.");
-                    context.appendInfo(SSL_get_cipher(static_cast<const SSL*>(context.sslp)));
-                    context.appendInfo("Bits:");
-                    SSL_CIPHER_get_bits((SSL_get_current_cipher(static_cast<const SSL*>(context.sslp))), &bits);
-                    buffer.append("#").append(to_string(bits)).append("\n");
-                    context.appendInfo(buffer);
-                }
+            SSL          *tempSsl  {  nullptr };
+            static_cast<void>(BIO_get_ssl(context.biop, &tempSsl));
+
+            #pragma clang diagnostic pop
+
+            SSL_CIPHER   *cipher  { const_cast<SSL_CIPHER*>(SSL_get_current_cipher(tempSsl)) };
+
+            if(cipher!=nullptr){
+                vector<char> buffer(MEDIUM_BUFFER, 0);
+                int          algBits  {  0  };
+                SSL_CIPHER_description(cipher,buffer.data(), clampTo<int>(buffer.size() - 1));
+                static_cast<void>(SSL_CIPHER_get_bits(cipher, &algBits));
+                context.handShakeSummary.clear();
+                context.handShakeSummary.append("Info - ").append(SSL_state_string_long(static_cast<const SSL*>(context.sslp)))\
+                                        .append(" - Algorithms: ").append(SSL_CIPHER_get_name(cipher))\
+                                        .append(" - Algorithm bits: ").append(to_string(algBits))\
+                                        .append(" - Connection Protocol Version: ").append(SSL_get_version(reinterpret_cast<const SSL*>(context.sslp)))\
+                                        .append(" - ").append(context.sockSummary);
+
+                context.appendInfo(context.handShakeSummary.c_str());
             }else{
-                cleanContext();
-                setErrMsg("Handshake failed.");
-                ret  =  false;
+                int       bits  {  0  };
+                string    buffer  { "No cipher informations: " };
+                SSL_CIPHER_get_bits((SSL_get_current_cipher(static_cast<const SSL*>(context.sslp))), &bits);
+                buffer.append(SSL_get_cipher(static_cast<const SSL*>(context.sslp)))
+                      .append(" - Bits: ").append(to_string(bits));
+                context.appendInfo(buffer);
             }
+        }else if(closing){
+            return true;
+        }else{
+            cleanContext();
+            setErrMsg("Handshake failed.");
+            return false;
         }
 
-        return ret;
+        return true;
+    }
+
+    void  SslConn::setNonBlocking(bool enable) noexcept{
+        nonBlocking = enable;
+    }
+
+    // Checked by setClientMode() while it races the servers, see raceConnect().
+    void  SslConn::setCancelFlag(const std::atomic<bool>* flag) noexcept{
+        cancelFlag = flag;
+    }
+
+    // The socket a Reactor watches for this session, -1 when there is none.
+    int  SslConn::pollFd(void) const noexcept{
+        switch(context.status.get()){
+            case listening:
+                return listenFd;
+            case handshaking:
+            case connected:
+                return linkFd;
+            default:
+                return -1;
+        }
+    }
+
+    // Records already decrypted, or received, that no poll() would report.
+    bool  SslConn::hasPending(void) noexcept{
+        if(context.status.get() != connected || !readMtx.try_lock())
+            return false;
+
+        lock_guard<mutex> lock(readMtx, adopt_lock);
+
+        return context.biop != nullptr && BIO_pending(context.biop) > 0;
+    }
+
+    bool  SslConn::admitIncoming(int fd) noexcept{
+        struct sockaddr_storage  addr;
+        socklen_t                alen  { sizeof(addr) };
+
+        if(fd < 0 || getpeername(fd, reinterpret_cast<struct sockaddr*>(&addr), &alen) != 0)
+            return false;
+
+        if(admission.admit(reinterpret_cast<struct sockaddr*>(&addr), alen) != admission::ADMITTED)
+            return false;
+
+        admitted = true;
+        return true;
+    }
+
+    void  SslConn::releaseAdmission(void) noexcept{
+        if(admitted.exchange(false))
+            admission.release();
+    }
+
+    // Bounds the blocking handshake, so a silent peer cannot hold the listener; 0 clears it.
+    void  SslConn::setHandshakeTimeout(int fd, unsigned int secs) noexcept{
+        if(fd < 0)
+            return;
+
+        #ifndef WINDOWS_OPENSSL
+            struct timeval  tv { static_cast<time_t>(secs), 0 };
+        #else
+            DWORD           tv { secs * 1000 };
+        #endif
+
+        static_cast<void>(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv)));
+        static_cast<void>(setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv)));
+    }
+
+    string  SslConn::getAdmissionStats(void) const noexcept{
+        return admission.getStats();
+    }
+
+    void  SslConn::markAlive(void) noexcept{
+        context.lastRx  =  nowUs();
+        context.srtt    =  0;
+        context.rttVar  =  0;
+    }
+
+    // Reassembly is agreed in the handshake, so even the first message after
+    // it goes marked; framing and compression are announced in band.
+    void  SslConn::announce(void) noexcept{
+        const unsigned char  *proto { nullptr };
+        unsigned int         plen   { 0 };
+        SSL                  *ssl   { nullptr };
+
+        #pragma clang diagnostic push
+        #pragma clang diagnostic ignored "-Wold-style-cast"
+
+        static_cast<void>(BIO_get_ssl(context.biop, &ssl));
+
+        #pragma clang diagnostic pop
+
+        if(ssl != nullptr)
+            SSL_get0_alpn_selected(ssl, &proto, &plen);
+        context.msgPeer   = context.msgEnabled && plen == sizeof(MSG_ALPN) - 2 &&
+                            memcmp(proto, MSG_ALPN + 1, plen) == 0;
+        context.muxPeer   = false;
+        context.zipPeerId = 0;
+        if(!context.muxEnabled)
+            return;
+
+        // Keep the kernel queue short, so the channel priorities decide what goes out next.
+        #if !defined(WINDOWS_OPENSSL) && defined(TCP_NOTSENT_LOWAT)
+            int  fd    { -1 },
+                 lowat { MUX_NOTSENT_LOWAT };
+
+            #pragma clang diagnostic push
+            #pragma clang diagnostic ignored "-Wold-style-cast"
+
+            static_cast<void>(BIO_get_fd(context.biop, &fd));
+
+            #pragma clang diagnostic pop
+
+            if(fd >= 0)
+                static_cast<void>(setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)));
+        #endif
+
+        static_cast<void>(writeControl(MUX_HELLO, sizeof(MUX_HELLO) - 1));
+
+        if(context.zipEnabled && context.zipDictId != 0){
+            char  hello[SMALL_BUFFER];
+            int   len { snprintf(hello, sizeof(hello), "%s%lu", ZIP_HELLO, context.zipDictId.load()) };
+            if(len > 0)
+                static_cast<void>(writeControl(hello, len));
+        }
+    }
+
+    bool  SslConn::sendHeartbeat(void) noexcept{
+        char  ping[SMALL_BUFFER];
+        int   len { snprintf(ping, sizeof(ping), "%s%lld", HB_PING, nowUs()) };
+
+        return len > 0 && writeControl(ping, len);
+    }
+
+    bool  SslConn::peerAlive(void) const noexcept{
+        if(context.status.get() != connected || context.hbInterval == 0)
+            return true;
+
+        long long  deadline { static_cast<long long>(context.hbInterval) * context.hbMissed * 1000 };
+
+        return nowUs() - context.lastRx.load() < deadline;
+    }
+
+    void  SslConn::abortConnection(void) noexcept{
+        int fd { linkFd.load() };
+
+        static_cast<void>(context.status.moveTo(error));
+
+        // Unblock the Reader sitting in BIO_read(): the peer can't send a FIN anymore.
+        #ifndef WINDOWS_OPENSSL
+            if(fd >= 0) static_cast<void>(shutdown(fd, SHUT_RDWR));
+        #else
+            if(fd >= 0) static_cast<void>(shutdown(fd, SD_BOTH));
+        #endif
+    }
+
+    void  SslConn::handleControl(ControlKind kind, const char* msg) noexcept{
+        const size_t hlen { sizeof(HB_PING) - 1 };
+
+        context.controlMsg = true;
+
+        if(kind == CTRL_PING){
+            char  pong[SMALL_BUFFER];
+            int   len { snprintf(pong, sizeof(pong), "%s%s", HB_PONG, msg + hlen) };
+            if(len > 0)
+                static_cast<void>(writeControl(pong, len));
+        }else if(kind == CTRL_MUX){
+            context.muxPeer = true;
+        }else if(kind == CTRL_ZIP){
+            context.zipPeerId = strtoul(msg + sizeof(ZIP_HELLO) - 1, nullptr, 10);
+        }else if(kind == CTRL_PONG){
+            long long  sent { strtoll(msg + hlen, nullptr, 10) },
+                       rtt  { nowUs() - sent };
+
+            if(sent <= 0 || rtt < 0)
+                return;
+
+            // RFC 6298 smoothing: alpha 1/8, beta 1/4.
+            long long  prevSrtt { context.srtt.load() };
+            if(prevSrtt == 0){
+                context.srtt   = rtt;
+                context.rttVar = rtt / 2;
+            }else{
+                long long delta { prevSrtt > rtt ? prevSrtt - rtt : rtt - prevSrtt };
+                context.rttVar = (3 * context.rttVar.load() + delta) / 4;
+                context.srtt   = (7 * prevSrtt + rtt) / 8;
+            }
+        }
     }
 
 } // End namespace sslconn
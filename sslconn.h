@@ -22,11 +22,20 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
+#include "socktune.h"
+#include "connstate.h"
+#include "connector.h"
+#include "admission.h"
+#include "eventlog.h"
+
 #include <unistd.h>
 #include <stdlib.h>
 
+#include <deque>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <mutex>
 
 #define SMALL_BUFFER 64
 #define MEDIUM_BUFFER 256
@@ -40,15 +49,45 @@
 
 #define POLLING_INTERVAL 100000
 
+#define CONTROL_MARK '\x01'           // First byte of an in-band control message
+#define HB_PING "\x01PING "
+#define HB_PONG "\x01PONG "
+#define HB_MISSED 3                   // Missed beats before declaring the peer dead
+#define MUX_HELLO "\x01MUX 2"          // Framing announcement, see mux.h
+#define MUX_NOTSENT_LOWAT 16384       // Unsent kernel bytes allowed while multiplexing
+#define ZIP_HELLO "\x01ZIP "           // Compression announcement, followed by the dictionary id
+#define ZIP_MIN 1024                  // Message size from which other than bulk channels are compressed
+#define MSG_ALPN "\x08sc-msg/1"        // Offered in the handshake: the peer puts long messages back together
+#define MSG_CONTINUED "\x01+"          // Starts a record the next one continues, once MSG_ALPN is agreed
+
+#define RECORD_SMALL 1369             // One TLS record per 1500 byte MTU segment
+#define RECORD_FULL 16384             // TLS maximum plaintext per record
+#define RECORD_RAMP_BYTES 1048576     // Burst bytes sent before switching to full records
+#define RECORD_IDLE_US 1000000        // Idle time that restarts with small records
+#define MESSAGE_MAX 4194304           // Largest message sent or reassembled, bytes
+
+#define DISCONNECT_LINGER 1           // Seconds a disconnect may wait to send close_notify
+#define WRITE_WAIT_MS 5000            // A sender on a non-blocking session waits this long for the socket to take a record
+#define CONTROL_BACKLOG 16            // Control records a non-blocking session holds for the socket, more are dropped
+#define SEND_BACKLOG 1048576          // Message bytes queueMessage() holds for the socket, beyond it fails
+
 namespace  sslconn {
 
-enum Status   { inactive, connected, listening, error };
 enum Conntype { CLIENT, SERVER, UNDEFINED };
 
+enum ControlKind { CTRL_NONE, CTRL_ESCAPED, CTRL_PING, CTRL_PONG, CTRL_MUX, CTRL_ZIP, CTRL_MORE };
+
+// Only the exact prefixes above are control messages. Chat text that
+// starts with CONTROL_MARK goes out with the mark doubled (CTRL_ESCAPED),
+// the receiver drops one; any other record is text. So is CTRL_MORE: a
+// piece of a message longer than a record, the next record continues it.
+ControlKind  controlKind(const char* buf, int len)                          noexcept;
+
 using PasswdVect  = const std::vector<char>&;
 
 class ChatContext{
     friend class SslConn;
+    friend class Mux;
     friend class SslConnReader;
     friend class SslConnListener;
 
@@ -59,18 +98,35 @@ public:
     const char*             getResponse(void)             const noexcept;
     Status                  getStatus(void)               const noexcept;
     const std::string&      getErrMsg(void)               const noexcept;
-    const std::string&      getInfoMsg(void)              const noexcept;
+    bool                    isControlMsg(void)            const noexcept;
+    bool                    isMuxActive(void)             const noexcept;
+    bool                    isPartialMsg(void)            const noexcept;
+    unsigned int            getHbInterval(void)           const noexcept;
+    double                  getRtt(void)                  const noexcept;
+    double                  getJitter(void)               const noexcept;
+    const socktune::SockOpts&
+                            getSockOpts(void)             const noexcept;
+    const std::vector<Endpoint>&
+                            getServers(void)              const noexcept;
+    SSL_CTX*                getSslCtx(void)               const noexcept;
+    const std::string&      getIp(void)                   const noexcept;
+    const std::string&      getPort(void)                 const noexcept;
+    Conntype                getMode(void)                 const noexcept;
 
     void        setIp(const std::string& par)                   noexcept;
     void        setPort(const std::string& par)                 noexcept;
     void        setPwd(const std::string& par)                  noexcept;
     void        setServer(Conntype mod)                         noexcept;
+    void        setSockOpts(const socktune::SockOpts& opts)     noexcept;
+    void        setServers(const std::vector<Endpoint>& list)   noexcept;
     void        appendInfo(const char* const msg)               noexcept;
     void        appendInfo(const std::string& msg)              noexcept;
+    bool        subscribe(const StateListener& listener)        noexcept;
 
 private:
 
-    Conntype           connectionMode;
+    Conntype           connectionMode,
+                       ctxMode;               // Mode ctxp was built for: reused while it matches.
 
     BIO                *biop,
                        *abiop,
@@ -79,34 +135,126 @@ private:
     SSL                *sslp;
     std::string        configIP,
                        sConfigPort,
-                       errMessage,
-                       infoMessage,
+                       errMessage,            // Latest error, the event log keeps them all.
                        baseDir,
                        handShakeSummary,
+                       sockSummary,           // Socket options in effect, for the handshake summary.
                        blackList;
     std::vector<char>  incomingBufferp,
                        errBuffer,
                        password;
-    Status             status;                // Status: Valid values:
-                                              // inactive, connected, listening.
+    socktune::SockOpts sockOpts;              // SCSOCKOPTS, or the configuration dialog.
+    std::vector<Endpoint>
+                       servers;               // SCSERVERS, or the dialog: raced instead of configIP.
+    ConnState          status;                // See connstate.h for the transitions.
+    bool               controlMsg,            // Last read was a control message, not chat text.
+                       partialMsg;            // Last read was a piece of a message, the next record continues it.
+    unsigned int       hbInterval,            // Heartbeat period in ms, 0: disabled.
+                       hbMissed;
+    bool               msgEnabled;            // SCMSG (default on): offer MSG_ALPN, see SslConn::writeRecord().
+    std::atomic<bool>  msgPeer;               // The peer agreed to it: long messages go marked.
+    bool               muxEnabled;            // SCMUX: announce channel framing on connect.
+    std::atomic<bool>  muxPeer;               // The peer announced it too.
+    bool               zipEnabled;            // SCZIP: compress frames, see zipcodec.h.
+    unsigned int       zipMin;
+    std::atomic<unsigned long>
+                       zipDictId,             // Ours, 0: no dictionary loaded.
+                       zipPeerId;             // Announced by the peer.
+    std::atomic<long long>
+                       lastRx,                // Steady clock, us: last record from the peer.
+                       srtt,                  // Smoothed RTT and its variation (RFC 6298), us.
+                       rttVar;
+};
+
+// Dynamic record sizing: after idle, records fit one segment and can be
+// decrypted as soon as it arrives; a sustained burst ramps to full records
+// to amortize header and MAC costs. A fixed size disables the ramp.
+
+class RecordSizer {
+    public:
+        explicit RecordSizer(unsigned int fixedSize=0);
+
+        int             next(long long now)                                 noexcept;
+        void            account(int bytes, long long now)                   noexcept;
+
+    private:
+        unsigned int        fixed;
+        unsigned long long  burstBytes;
+        long long           lastSend;
 };
 
+class Mux;
+
 class SslConn {
+    friend class Mux;
+
     public:
         explicit SslConn(ChatContext& ctx);
         ~SslConn(void);
 
         bool            sendMessage(const std::string& msg)                 noexcept;
+        bool            queueMessage(const std::string& msg)                noexcept;
         bool            configure(void)                                     noexcept;
+        bool            createContext(void)                                 noexcept;
         void            cleanContext(void)                                  noexcept;
         std::string     getSslError(unsigned long errCode)       const      noexcept;
         bool            listenIncoming(void)                                noexcept;
         bool            readIncoming(void)                                  noexcept;
+        bool            readIncoming(char* buf, int size, int& len)         noexcept;
+        bool            sendHeartbeat(void)                                 noexcept;
+        bool            peerAlive(void)                          const      noexcept;
+        void            abortConnection(void)                               noexcept;
+        void            disconnect(void)                                    noexcept;
+        void            setNonBlocking(bool enable)                         noexcept;
+        void            setCancelFlag(const std::atomic<bool>* flag)        noexcept;
+        int             pollFd(void)                             const      noexcept;
+        bool            hasPending(void)                                    noexcept;
+        bool            wantsWrite(void)                         const      noexcept;
+        bool            flushQueued(void)                                   noexcept;
+        std::string     getAdmissionStats(void)                  const      noexcept;
 
     private:
 
         ChatContext&    context;
         bool            errStatus;
+        std::mutex      writeMtx,
+                        readMtx;              // Held in BIO_read() and accept: teardown waits for it.
+        std::atomic<int>
+                        linkFd,               // Session socket, for a disconnect from another thread.
+                        listenFd;
+        bool            nonBlocking;          // Driven by a Reactor: reads never wait, see reactor.h.
+        long long       handshakeDeadline;    // Non-blocking server handshake, steady clock us.
+        const std::atomic<bool>
+                        *cancelFlag;          // Set by the owner to end a client's connect race.
+        std::atomic<bool>
+                        closing,              // A local disconnect is tearing the session down.
+                        admitted;             // Holds an admission slot until the handshake ends.
+        RecordSizer     recordSizer;          // SCRECORDSIZE: 0 (default) dynamic, else fixed.
+        admission::Admission
+                        admission;            // SCADMIT: checked before the server handshake.
+        std::deque<std::string>
+                        controlOut,           // Control records the socket didn't take yet, under writeMtx.
+                        dataOut;              // Records of queued messages, the same.
+        size_t          dataBytes;            // In dataOut.
+        bool            dataRetry;            // The socket took the first of dataOut in part: it goes first.
+        std::atomic<bool>
+                        writeBacklog;         // Either isn't empty: the Reactor polls for POLLOUT.
+
+        bool            writeRecord(const char* buf, int len,
+                                    bool sized=false)                       noexcept;
+        int             cutRecord(const char* buf, int left, int chunk,
+                                  char* rec, const char*& out, int& size)   noexcept;
+        int             writeBio(const char* buf, int len)                  noexcept;
+        bool            writeControl(const char* buf, int len)              noexcept;
+        bool            drainQueued(bool wait)                              noexcept;
+        bool            continueHandshake(void)                             noexcept;
+        void            handleControl(ControlKind kind, const char* msg)    noexcept;
+        void            markAlive(void)                                     noexcept;
+        void            announce(void)                                      noexcept;
+        bool            admitIncoming(int fd)                               noexcept;
+        void            releaseAdmission(void)                              noexcept;
+        void            releaseLink(void)                                   noexcept;
+        void            setHandshakeTimeout(int fd, unsigned int secs)      noexcept;
 
         bool            setClientMode(void)                                 noexcept;
         bool            setContext(void)                                    noexcept;
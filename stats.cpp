@@ -0,0 +1,122 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "stats.h"
+
+#include <chrono>
+
+namespace stats {
+
+    using std::string;
+    using std::to_string;
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    long long nowUs(void) noexcept{
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    LatencyHistogram::LatencyHistogram(void)
+        : buckets{},
+          count{0},
+          max{0}
+    {}
+
+    size_t LatencyHistogram::index(long long us) noexcept{
+        if(us < static_cast<long long>(SUB_BUCKETS))
+            return us < 0 ? 0 : static_cast<size_t>(us);
+
+        int       msb    { 63 - __builtin_clzll(static_cast<unsigned long long>(us)) };
+        int       shift  { msb - 3 };
+        long long top    { us >> shift };
+
+        return static_cast<size_t>(shift + 1) * SUB_BUCKETS + static_cast<size_t>(top - 8);
+    }
+
+    long long LatencyHistogram::upper(size_t idx) noexcept{
+        if(idx < SUB_BUCKETS)
+            return static_cast<long long>(idx);
+
+        size_t    shift  { idx / SUB_BUCKETS - 1 };
+        long long top    { static_cast<long long>(idx % SUB_BUCKETS + 8) };
+
+        return ((top + 1) << shift) - 1;
+    }
+
+    void LatencyHistogram::record(long long us) noexcept{
+        buckets[index(us)]++;
+        count++;
+        if(us > max) max = us;
+    }
+
+    void LatencyHistogram::merge(const LatencyHistogram& other) noexcept{
+        for(size_t i = 0; i < BUCKETS; i++)
+            buckets[i] += other.buckets[i];
+        count += other.count;
+        if(other.max > max) max = other.max;
+    }
+
+    void LatencyHistogram::reset(void) noexcept{
+        buckets.fill(0);
+        count = 0;
+        max   = 0;
+    }
+
+    long long LatencyHistogram::percentile(double pct) const noexcept{
+        if(count == 0)
+            return 0;
+
+        unsigned long long  rank  { static_cast<unsigned long long>(pct / 100.0 * static_cast<double>(count)) },
+                            seen  { 0 };
+        if(rank >= count) rank = count - 1;
+
+        for(size_t i = 0; i < BUCKETS; i++){
+            seen += buckets[i];
+            if(seen > rank)
+                return upper(i) < max ? upper(i) : max;
+        }
+
+        return max;
+    }
+
+    long long LatencyHistogram::getMax(void) const noexcept{
+        return max;
+    }
+
+    unsigned long long LatencyHistogram::getCount(void) const noexcept{
+        return count;
+    }
+
+    string LatencyHistogram::summary(void) const noexcept{
+        string res;
+
+        try{
+            res.append("p50=").append(to_string(percentile(50)))
+               .append(" p90=").append(to_string(percentile(90)))
+               .append(" p99=").append(to_string(percentile(99)))
+               .append(" p99.9=").append(to_string(percentile(99.9)))
+               .append(" max=").append(to_string(max)).append(" us");
+        }catch(...){
+            res = "summary error.";
+        }
+
+        return res;
+    }
+
+} // End namespace stats
@@ -0,0 +1,56 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <array>
+#include <string>
+
+namespace stats {
+
+long long   nowUs(void)                                                      noexcept;
+
+// Log-linear latency histogram: 8 linear sub-buckets per power of two,
+// so every reported percentile is within 12.5% of the true value.
+
+class LatencyHistogram {
+    public:
+        LatencyHistogram(void);
+
+        void                record(long long us)                             noexcept;
+        void                merge(const LatencyHistogram& other)             noexcept;
+        void                reset(void)                                      noexcept;
+        long long           percentile(double pct)              const        noexcept;
+        long long           getMax(void)                        const        noexcept;
+        unsigned long long  getCount(void)                      const        noexcept;
+        std::string         summary(void)                       const        noexcept;
+
+    private:
+        static const size_t SUB_BUCKETS  = 8;
+        static const size_t BUCKETS      = 64 * SUB_BUCKETS;
+
+        std::array<unsigned long long, BUCKETS>
+                            buckets;
+        unsigned long long  count;
+        long long           max;
+
+        static size_t       index(long long us)                              noexcept;
+        static long long    upper(size_t idx)                                noexcept;
+};
+
+} // End namespace stats
@@ -0,0 +1,57 @@
+#-------------------------------------------------
+#
+# securechat_asyncbench: asynchronous client API benchmark and alert sender
+#
+#-------------------------------------------------
+
+TARGET = securechat_asyncbench
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../sslconn.cpp \
+        ../../reactor.cpp \
+        ../../asyncconn.cpp \
+        ../../socktune.cpp \
+        ../../connstate.cpp \
+        ../../connector.cpp \
+        ../../admission.cpp \
+        ../../eventlog.cpp \
+        ../../truststore.cpp \
+        ../../stats.cpp \
+        ../../typesimpl.cpp
+
+HEADERS += \
+        ../../sslconn.h \
+        ../../reactor.h \
+        ../../asyncconn.h \
+        ../../socktune.h \
+        ../../connstate.h \
+        ../../connector.h \
+        ../../admission.h \
+        ../../eventlog.h \
+        ../../truststore.h \
+        ../../stats.h \
+        ../../types.h
+
+defined(OPENSSL_ALT_PATH, var) {
+    INCLUDEPATH += $$OPENSSL_ALT_PATH/include
+    LIBS +=  -L$$OPENSSL_ALT_PATH/lib/
+} else {
+  osx: {
+    INCLUDEPATH += /usr/local/ssl/include/
+    LIBS +=  -L/usr/local/ssl/lib/
+  }
+}
+
+# qmake CONFIG+=c++2a: coroutine awaitables (asyncconn.h) and the -C mode.
+c++2a {
+    CONFIG -= c++14
+}
+
+LIBS += -lssl -lcrypto -lpthread
@@ -0,0 +1,363 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_asyncbench: AsyncClient sessions, all on one AsyncEngine,
+// against in-process echo servers served by a reactor of their own. Every
+// client keeps -w messages in flight, each echo received sends the next;
+// with -C (a C++20 build) each client is a coroutine awaiting one echo per
+// send instead. With -a it's an alert sender: every line read from stdin
+// is sent to that server.
+
+#include "asyncconn.h"
+#include "stats.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <signal.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::atomic;
+using std::unique_ptr;
+using std::ifstream;
+using std::cin;
+using std::cerr;
+using std::to_string;
+
+using stats::nowUs;
+
+namespace {
+
+struct Options {
+    unsigned int        clients,
+                        port,               // First server port, one per client
+                        messages,           // Per client
+                        window;             // Sends in flight per client
+    bool                coroutines;
+    string              host;               // Alert mode
+};
+
+struct Echo {
+    sslconn::ChatContext    context;
+    sslconn::SslConn        conn;
+    vector<char>            buffer;
+
+    Echo(void)
+        : context{},
+          conn{context},
+          buffer(RECORD_FULL + 1, 0)
+    {}
+};
+
+struct Driver {
+    sslconn::AsyncClient    client;
+    unsigned int            target;
+    atomic<unsigned int>    sent,
+                            echoed;
+    atomic<bool>            connected,
+                            finished;
+
+    Driver(sslconn::AsyncEngine& engine, unsigned int messages)
+        : client{engine},
+          target{messages},
+          sent{0},
+          echoed{0},
+          connected{false},
+          finished{false}
+    {}
+};
+
+atomic<unsigned long>  failures { 0 };
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-n clients] [-p first_port] [-m messages_per_client] [-w window] [-C]\n"
+         << "       " << prog << " -a host [-p port] < alerts\n"
+         << "       -C: one coroutine per client, one echo awaited per send (C++20 builds).\n";
+}
+
+int threadCount(void){
+    ifstream  status("/proc/self/status");
+    string    line;
+
+    while(std::getline(status, line))
+        if(line.compare(0, 8, "Threads:") == 0)
+            return atoi(line.c_str() + 8);
+
+    return -1;
+}
+
+void echo(Echo& server) noexcept{
+    for(int count = 0; count < REACTOR_BATCH; count++){
+        int  len { 0 };
+        if(!server.conn.readIncoming(server.buffer.data(), static_cast<int>(server.buffer.size()), len) || len == 0)
+            break;
+        if(!server.context.isControlMsg())
+            static_cast<void>(server.conn.queueMessage(string(server.buffer.data(), static_cast<size_t>(len))));
+    }
+}
+
+// Every echo back sends the next message: the window stays full.
+void pump(Driver* drv, const string& line){
+    if(drv->sent++ >= drv->target)
+        return;
+
+    drv->client.send(line, [](bool ok){ if(!ok) failures++; });
+}
+
+void collect(Driver* drv, const string& line){
+    drv->client.onReceive([drv, &line](bool ok, const string&){
+        if(!ok){
+            if(!drv->finished)
+                failures++;
+            drv->finished = true;
+            return;
+        }
+        if(++drv->echoed < drv->target)
+            pump(drv, line);
+        else
+            drv->finished = true;
+    });
+}
+
+#ifdef SC_ASYNC_COROUTINES
+struct Detached {
+    struct promise_type {
+        Detached             get_return_object(void)     noexcept{ return {}; }
+        std::suspend_never   initial_suspend(void)       noexcept{ return {}; }
+        std::suspend_never   final_suspend(void)         noexcept{ return {}; }
+        void                 return_void(void)           noexcept{}
+        void                 unhandled_exception(void)   noexcept{ std::terminate(); }
+    };
+};
+
+Detached pingPong(Driver* drv, string host, string port, const string& line){
+    auto  res { co_await drv->client.awaitConnect(host, port) };
+    if(!res.ok){
+        cerr << "Connect to " << port << ": " << res.err << "\n";
+        failures++;
+        drv->finished = true;
+        co_return;
+    }
+    drv->connected = true;
+
+    while(drv->echoed < drv->target){
+        if(!co_await drv->client.awaitSend(line))
+            break;
+        auto  rec { co_await drv->client.awaitReceive() };
+        if(!rec.ok)
+            break;
+        drv->echoed++;
+    }
+
+    if(drv->echoed < drv->target)
+        failures++;
+    drv->finished = true;
+}
+#endif
+
+int sendAlerts(const Options& opts){
+    sslconn::AsyncEngine  engine;
+    sslconn::AsyncClient  client(engine);
+    atomic<int>           connected { 0 };
+    atomic<unsigned long> sent      { 0 },
+                          done      { 0 };
+    string                err,
+                          line;
+
+    if(!engine.start())
+        return 1;
+
+    client.connect(opts.host, to_string(opts.port), [&](bool ok, const string& msg){
+        err       = msg;
+        connected = ok ? 1 : -1;
+    });
+    while(connected == 0)
+        static_cast<void>(usleep(1000));
+    if(connected < 0){
+        cerr << "Connect to " << opts.host << ":" << opts.port << ": " << err << "\n";
+        return 1;
+    }
+
+    while(std::getline(cin, line)){
+        sent++;
+        client.send(line, [&](bool ok){ if(!ok) failures++; done++; });
+    }
+
+    while(done < sent)
+        static_cast<void>(usleep(1000));
+
+    atomic<bool>  closed { false };
+    client.close([&](){ closed = true; });
+    while(!closed)
+        static_cast<void>(usleep(1000));
+
+    cerr << "Alerts sent: " << sent - failures << "/" << sent << "\n";
+    return failures == 0 ? 0 : 1;
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { 100, 8900, 1000, 16, false, "" };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "n:p:m:w:a:Ch")) != -1){
+        switch(opt){
+            case 'n': opts.clients  = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'p': opts.port     = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'm': opts.messages = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'w': opts.window   = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'a': opts.host     = optarg;                                                   break;
+            case 'C': opts.coroutines = true;                                                   break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if(!opts.host.empty())
+        return sendAlerts(opts);
+
+    if(opts.clients == 0 || opts.messages == 0 || opts.window == 0 || opts.window > ASYNC_INBOX){
+        usage(argv[0]);
+        return 1;
+    }
+
+    #ifndef SC_ASYNC_COROUTINES
+        if(opts.coroutines){
+            cerr << "-C needs a C++20 build.\n";
+            return 1;
+        }
+    #endif
+
+    static_cast<void>(setenv(ADMIT_ENV, "ip=1000000/1000000,global=1000000/1000000", 0));
+    static_cast<void>(setenv(EVENTLOG_ENV, "off", 0));
+
+    int                         thrStart  { threadCount() };
+    sslconn::Reactor            serverLoop;
+    sslconn::AsyncEngine        engine;
+    vector<unique_ptr<Echo>>    servers;
+    vector<unique_ptr<Driver>>  drivers;
+    string                      line(64, 'a');
+
+    if(!serverLoop.start() || !engine.start())
+        return 1;
+
+    for(unsigned int idx = 0; idx < opts.clients; idx++){
+        string  port   { to_string(opts.port + idx) };
+        Echo    *server { new Echo() };
+        servers.emplace_back(server);
+
+        server->context.setIp("127.0.0.1");
+        server->context.setPort(port);
+        server->context.setServer(sslconn::SERVER);
+        static_cast<void>(serverLoop.attach(server->conn, [server](bool ready){
+            sslconn::Status  status { server->context.getStatus() };
+            if(status == sslconn::listening || status == sslconn::handshaking)
+                static_cast<void>(server->conn.listenIncoming());
+            else if(ready)
+                echo(*server);
+        }));
+        static_cast<void>(server->conn.configure());
+        if(server->context.getStatus() != sslconn::listening){
+            cerr << "Listen on " << port << ": " << server->context.getErrMsg() << "\n";
+            return 1;
+        }
+        serverLoop.wake();
+
+        Driver  *drv { new Driver(engine, opts.messages) };
+        drivers.emplace_back(drv);
+
+        #ifdef SC_ASYNC_COROUTINES
+            if(opts.coroutines){
+                static_cast<void>(pingPong(drv, "127.0.0.1", port, line));
+                continue;
+            }
+        #endif
+
+        drv->client.connect("127.0.0.1", port, [drv, port](bool ok, const string& err){
+            if(!ok){
+                cerr << "Connect to " << port << ": " << err << "\n";
+                failures++;
+                drv->finished = true;
+            }
+            drv->connected = ok;
+        });
+    }
+
+    for(auto& drv : drivers)
+        while(!drv->connected && !drv->finished)
+            static_cast<void>(usleep(1000));
+
+    int        threads  { threadCount() - thrStart };
+    long long  start    { nowUs() },
+               deadline { start + 60000000LL };
+
+    if(!opts.coroutines){
+        for(auto& drv : drivers){
+            collect(drv.get(), line);
+            for(unsigned int inFlight = 0; inFlight < opts.window; inFlight++)
+                pump(drv.get(), line);
+        }
+    }
+
+    unsigned long long  expected { static_cast<unsigned long long>(opts.clients) * opts.messages },
+                        got      { 0 };
+    bool                all      { false };
+
+    while(!all && nowUs() < deadline){
+        static_cast<void>(usleep(1000));
+        all = true;
+        got = 0;
+        for(auto& drv : drivers){
+            got += drv->echoed;
+            all  = all && drv->finished;
+        }
+    }
+
+    double              secs    { static_cast<double>(nowUs() - start) / 1000000.0 };
+    unsigned long long  dropped { 0 };
+    for(auto& drv : drivers)
+        dropped += drv->client.getDropped();
+
+    cerr << "Asyncbench - " << (opts.coroutines ? "coroutines, one echo awaited per send" : "callbacks, window " + to_string(opts.window))
+         << ", clients: " << opts.clients << "\n"
+         << "  threads: " << threads << " (engine and echo servers)\n"
+         << "  echoed: " << got << "/" << expected << " messages, " << static_cast<double>(got) / secs << " msgs/s\n"
+         << "  failures: " << failures << " dropped: " << dropped << "\n";
+
+    bool  passed { got == expected && failures == 0 };
+
+    for(auto& drv : drivers)
+        drv->client.close();
+    engine.stop();
+    for(auto& server : servers)
+        server->conn.disconnect();
+    serverLoop.stop();
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+
+// securechat_cyclebench: an SslConn server and client in one process that
+// connect, exchange one message and disconnect, over and over, with the
+// close initiated by either side in turn. It reports the cycle time and,
+// at every checkpoint, the OpenSSL heap, the RSS and the open descriptors:
+// after warm up all three must stay flat.
+
+#include "sslconn.h"
+#include "memacct.h"
+#include "truststore.h"
+#include "stats.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <cstdlib>
+
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+
+using std::string;
+using std::thread;
+using std::atomic;
+using std::ifstream;
+using std::cerr;
+using std::to_string;
+
+using stats::nowUs;
+using stats::LatencyHistogram;
+
+namespace {
+
+struct Options {
+    string              port;
+    unsigned int        cycles,
+                        every;              // Cycles between checkpoints
+};
+
+struct Footprint {
+    long long           heap,               // OpenSSL live bytes
+                        rss;                // KB
+    int                 fds;
+};
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-p port] [-n cycles] [-c checkpoint_every]\n"
+         << "       exits with 1 if a cycle fails or descriptors leak.\n";
+}
+
+long long rssKb(void){
+    ifstream   statm("/proc/self/statm");
+    long long  size  { 0 },
+               pages { 0 };
+
+    statm >> size >> pages;
+
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int openFds(void){
+    DIR  *dir   { opendir("/proc/self/fd") };
+    int  count  { 0 };
+
+    if(dir == nullptr)
+        return -1;
+    while(readdir(dir) != nullptr)
+        count++;
+    closedir(dir);
+
+    return count - 3;                       // ".", ".." and the DIR itself
+}
+
+Footprint measure(void){
+    return { memacct::totalBytes(), rssKb(), openFds() };
+}
+
+void report(unsigned int cycle, const Footprint& now, const Footprint& base){
+    cerr << "  cycle " << cycle << " - OpenSSL heap: " << now.heap << " bytes (" << now.heap - base.heap
+         << ") RSS: " << now.rss << " KB (" << now.rss - base.rss << ") fds: " << now.fds
+         << " (" << now.fds - base.fds << ")\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { "8880", 2000, 250 };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "p:n:c:h")) != -1){
+        switch(opt){
+            case 'p': opts.port   = optarg;                                                   break;
+            case 'n': opts.cycles = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'c': opts.every  = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.cycles == 0 || opts.every == 0){
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Every cycle is a new handshake from the same address: don't let admission refuse them.
+    static_cast<void>(setenv(ADMIT_ENV, "ip=1000000/1000000,global=1000000/1000000", 0));
+    static_cast<void>(setenv(EVENTLOG_ENV, "off", 0));
+    static_cast<void>(memacct::install());
+    signal(SIGPIPE, SIG_IGN);
+
+    sslconn::ChatContext  serverCtx,
+                          clientCtx;
+    sslconn::SslConn      server(serverCtx),
+                          client(clientCtx);
+
+    serverCtx.setIp("127.0.0.1");
+    serverCtx.setPort(opts.port);
+    serverCtx.setServer(sslconn::SERVER);
+    clientCtx.setIp("127.0.0.1");
+    clientCtx.setPort(opts.port);
+    clientCtx.setServer(sslconn::CLIENT);
+
+    LatencyHistogram    cycleTime,
+                        closeTime;
+    Footprint           base  { 0, 0, 0 },
+                        last  { 0, 0, 0 };
+    string              failure;
+    const char          ping[] { "ping" };
+
+    cerr << "Cyclebench - cycles: " << opts.cycles << "\n";
+
+    for(unsigned int cycle = 1; cycle <= opts.cycles && failure.empty(); cycle++){
+        long long     start    { nowUs() };
+        atomic<bool>  received { false };
+
+        static_cast<void>(server.configure());
+        if(serverCtx.getStatus() != sslconn::listening){
+            failure = "listen: " + serverCtx.getErrMsg();
+            break;
+        }
+
+        thread  acceptor([&](){
+            char  buf[SMALL_BUFFER];
+            int   len { 0 };
+
+            if(server.listenIncoming() && serverCtx.getStatus() == sslconn::connected &&
+               server.readIncoming(buf, sizeof(buf), len) && len == sizeof(ping) - 1)
+                received = true;
+        });
+
+        static_cast<void>(client.configure());
+        if(clientCtx.getStatus() != sslconn::connected || !client.sendMessage(ping)){
+            failure = "connect: " + clientCtx.getErrMsg();
+            server.disconnect();
+            acceptor.join();
+            break;
+        }
+        acceptor.join();
+        if(!received){
+            failure = "exchange: " + serverCtx.getErrMsg();
+            break;
+        }
+
+        // The closing side sends close_notify, the other one must read it as an orderly EOF.
+        sslconn::SslConn     &closer   { cycle % 2 == 0 ? server : client },
+                             &peer     { cycle % 2 == 0 ? client : server };
+        sslconn::ChatContext &peerCtx  { cycle % 2 == 0 ? clientCtx : serverCtx };
+        char                 buf[SMALL_BUFFER];
+        int                  len       { 0 };
+        long long            closing   { nowUs() };
+
+        closer.disconnect();
+        static_cast<void>(peer.readIncoming(buf, sizeof(buf), len));
+        if(peerCtx.getStatus() != sslconn::closed){
+            failure = string("no close_notify at the ") + (cycle % 2 == 0 ? "client" : "server");
+            break;
+        }
+        peer.disconnect();
+        closeTime.record(nowUs() - closing);
+        cycleTime.record(nowUs() - start);
+
+        if(cycle == opts.every){
+            base = measure();
+            report(cycle, base, base);
+        }else if(cycle % opts.every == 0){
+            last = measure();
+            report(cycle, last, base);
+        }
+    }
+
+    if(!failure.empty()){
+        cerr << "Cycle failed: " << failure << "\n";
+        return 1;
+    }
+
+    cerr << "  cycle: " << cycleTime.summary() << "\n"
+         << "  close: " << closeTime.summary() << "\n"
+         << truststore::shared().getStats() << "\n";
+
+    client.cleanContext();
+    server.cleanContext();
+
+    if(last.fds > base.fds){
+        cerr << "Descriptors leaked: " << last.fds - base.fds << "\n";
+        return 1;
+    }
+
+    return 0;
+}
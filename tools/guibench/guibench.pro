@@ -0,0 +1,79 @@
+#-------------------------------------------------
+#
+# securechat_guibench: offscreen GUI rendering benchmark
+#
+#-------------------------------------------------
+
+QT       += core gui network
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = securechat_guibench
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../mainwindow.cpp \
+        ../../chattab.cpp \
+        ../../dialogconf.cpp \
+        ../../dialoghelp.cpp \
+        ../../sslconn.cpp \
+        ../../reactor.cpp \
+        ../../transport.cpp \
+        ../../qssltransport.cpp \
+        ../../socktune.cpp \
+        ../../connstate.cpp \
+        ../../connector.cpp \
+        ../../admission.cpp \
+        ../../eventlog.cpp \
+        ../../truststore.cpp \
+        ../../mux.cpp \
+        ../../zipcodec.cpp \
+        ../../msgpool.cpp \
+        ../../utf8.cpp \
+        ../../stats.cpp \
+        ../../typesimpl.cpp
+
+HEADERS += \
+        ../../mainwindow.h \
+        ../../chattab.h \
+        ../../dialogconf.h \
+        ../../dialoghelp.h \
+        ../../sslconn.h \
+        ../../reactor.h \
+        ../../transport.h \
+        ../../qssltransport.h \
+        ../../socktune.h \
+        ../../connstate.h \
+        ../../connector.h \
+        ../../admission.h \
+        ../../eventlog.h \
+        ../../truststore.h \
+        ../../mux.h \
+        ../../zipcodec.h \
+        ../../msgpool.h \
+        ../../utf8.h \
+        ../../stats.h \
+        ../../types.h
+
+FORMS += \
+        ../../mainwindow.ui \
+        ../../dialogconf.ui \
+        ../../dialoghelp.ui
+
+defined(OPENSSL_ALT_PATH, var) {
+    INCLUDEPATH += $$OPENSSL_ALT_PATH/include
+    LIBS +=  -L$$OPENSSL_ALT_PATH/lib/
+} else {
+  osx: {
+    INCLUDEPATH += /usr/local/ssl/include/
+    LIBS +=  -L/usr/local/ssl/lib/
+  }
+}
+
+LIBS += -lssl -lcrypto -lz -lpthread
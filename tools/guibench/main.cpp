@@ -0,0 +1,213 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_guibench: runs MainWindow offscreen and replays a message
+// trace into its receive path from a thread, as the reactor would. Every
+// frame processes the queued events and repaints the window; the report
+// gives frame time, rendered messages/s, time-to-visible and RSS growth.
+
+#include "mainwindow.h"
+#include "stats.h"
+
+#include <QApplication>
+#include <QTimer>
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::thread;
+using std::atomic;
+using std::ifstream;
+using std::cerr;
+
+using stats::nowUs;
+using stats::LatencyHistogram;
+
+namespace {
+
+struct TraceMsg {
+    long long       offset;             // us from the start of the replay
+    string          text;
+};
+
+// Trace lines: "<offset_ms> <text>", offsets non decreasing.
+bool loadTrace(const char* path, vector<TraceMsg>& trace){
+    ifstream  file(path);
+    string    line;
+
+    if(!file)
+        return false;
+
+    while(getline(file, line)){
+        size_t  sep { line.find(' ') };
+        if(line.empty() || sep == string::npos)
+            continue;
+
+        long long  offset { strtoll(line.c_str(), nullptr, 10) * 1000 };
+        if(!trace.empty() && offset < trace.back().offset)
+            return false;
+        trace.push_back({ offset, line.substr(sep + 1) });
+    }
+
+    return !trace.empty();
+}
+
+void synthTrace(unsigned int count, unsigned int rate, unsigned int size, vector<TraceMsg>& trace){
+    string  text;
+
+    for(unsigned int i = 0; i < size; i++)
+        text.push_back(static_cast<char>('a' + i % 26));
+
+    for(unsigned int i = 0; i < count; i++)
+        trace.push_back({ rate == 0 ? 0 : static_cast<long long>(i) * 1000000 / rate, text });
+}
+
+long rssKb(void){
+    ifstream  status("/proc/self/status");
+    string    line;
+
+    while(getline(status, line))
+        if(line.compare(0, 6, "VmRSS:") == 0)
+            return strtol(line.c_str() + 6, nullptr, 10);
+
+    return -1;
+}
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-f trace_file | -n messages -r msgs_per_sec -s msg_size] [-F frame_ms]\n"
+         << "       trace lines: <offset_ms> <text>; -r 0 injects the whole synthetic trace at once.\n"
+         << "       QT_QPA_PLATFORM defaults to offscreen.\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    unsigned int      count    { 10000 },
+                      rate     { 1000 },
+                      size     { 80 },
+                      frameMs  { 16 };
+    const char        *path    { nullptr };
+    int               opt;
+
+    while((opt = getopt(argc, argv, "f:n:r:s:F:h")) != -1){
+        switch(opt){
+            case 'f': path    = optarg;                                                   break;
+            case 'n': count   = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'r': rate    = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 's': size    = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'F': frameMs = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    vector<TraceMsg>  trace;
+    if(path != nullptr){
+        if(!loadTrace(path, trace)){
+            cerr << "Invalid trace: " << path << "\n";
+            return 1;
+        }
+    }else{
+        synthTrace(count, rate, size, trace);
+    }
+
+    if(trace.empty()){
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication        app(argc, argv);
+    MainWindow          window;
+    window.show();
+    QApplication::processEvents();
+
+    // Injection times, indexed by sequence: written before the message is queued.
+    vector<long long>   stamps(trace.size(), 0);
+    atomic<size_t>      injected { 0 };
+    long long           start    { nowUs() };
+    long                rssStart { rssKb() },
+                        rssPeak  { rssStart };
+    LatencyHistogram    frameTime,
+                        toVisible;
+    unsigned long long  frames   { 0 },
+                        seen     { 0 };
+
+    thread  producer([&](){
+        for(size_t i = 0; i < trace.size(); i++){
+            long long  wait { start + trace[i].offset - nowUs() };
+            if(wait > 0)
+                static_cast<void>(usleep(static_cast<useconds_t>(wait)));
+
+            stamps[i] = nowUs();
+            window.replayMessage(trace[i].text.data(), static_cast<int>(trace[i].text.size()));
+            injected = i + 1;
+        }
+    });
+
+    QTimer  frameTimer;
+    QObject::connect(&frameTimer, &QTimer::timeout, [&](){
+        long long  t0 { nowUs() };
+
+        QApplication::processEvents();
+        window.repaint();
+
+        long long           t1       { nowUs() };
+        unsigned long long  rendered { window.getRendered() };
+
+        frames++;
+        frameTime.record(t1 - t0);
+        for(; seen < rendered; seen++)
+            toVisible.record(t1 - stamps[seen]);
+
+        long  rss { rssKb() };
+        if(rss > rssPeak)
+            rssPeak = rss;
+
+        if(injected == trace.size() && rendered == trace.size())
+            app.quit();
+    });
+    frameTimer.start(static_cast<int>(frameMs));
+
+    app.exec();
+    producer.join();
+
+    double  secs { static_cast<double>(nowUs() - start) / 1000000.0 };
+    long    rss  { rssKb() };
+
+    cerr << "Guibench - messages: " << trace.size() << " seconds: " << secs
+         << " frames: " << frames << " rendered msgs/s: " << static_cast<double>(seen) / secs << "\n"
+         << "  frame time: "      << frameTime.summary() << "\n"
+         << "  time to visible: " << toVisible.summary() << "\n"
+         << "  rss start: " << rssStart << " kB end: " << rss << " kB peak: " << rssPeak
+         << " kB growth: " << rss - rssStart << " kB\n";
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#-------------------------------------------------
+#
+# securechat_loadgen: multi-client load generator
+#
+#-------------------------------------------------
+
+TARGET = securechat_loadgen
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../sslconn.cpp \
+        ../../socktune.cpp \
+        ../../connstate.cpp \
+        ../../connector.cpp \
+        ../../admission.cpp \
+        ../../eventlog.cpp \
+        ../../truststore.cpp \
+        ../../stats.cpp \
+        ../../typesimpl.cpp
+
+HEADERS += \
+        ../../sslconn.h \
+        ../../socktune.h \
+        ../../connstate.h \
+        ../../connector.h \
+        ../../admission.h \
+        ../../eventlog.h \
+        ../../truststore.h \
+        ../../stats.h \
+        ../../types.h
+
+defined(OPENSSL_ALT_PATH, var) {
+    INCLUDEPATH += $$OPENSSL_ALT_PATH/include
+    LIBS +=  -L$$OPENSSL_ALT_PATH/lib/
+} else {
+  osx: {
+    INCLUDEPATH += /usr/local/ssl/include/
+    LIBS +=  -L/usr/local/ssl/lib/
+  }
+}
+
+LIBS += -lssl -lcrypto -lpthread
@@ -0,0 +1,683 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_loadgen: drives many concurrent TLS client sessions against
+// a securechat server or relay and reports aggregate rates, delivery
+// latency and, optionally, the server CPU and memory usage over time.
+
+#include "sslconn.h"
+#include "stats.h"
+#include "truststore.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+using std::string;
+using std::vector;
+using std::thread;
+using std::atomic;
+using std::unique_ptr;
+using std::cerr;
+using std::to_string;
+using std::mutex;
+using std::lock_guard;
+using std::ifstream;
+using std::istringstream;
+using std::minstd_rand;
+
+using stats::nowUs;
+
+namespace {
+
+#define STAMP_MARK 'T'                // Payloads start with "T<send time, us> "
+
+// One step of a load script: hold rate and size for a number of seconds.
+struct Phase {
+    unsigned int    seconds,
+                    rate,               // Messages per second, per connection
+                    size;               // Message size in bytes
+};
+
+struct Options {
+    string          address,
+                    port;
+    unsigned int    connections,
+                    threads,
+                    rate,               // Messages per second, per connection
+                    size,               // Message size in bytes
+                    duration,           // Seconds
+                    lifetime,           // Mean session lifetime in seconds, 0: no churn
+                    interval,           // Report period in seconds
+                    heartbeat;          // Ping period in ms, 0: no heartbeat
+    bool            handshakeOnly;
+    int             serverPid;          // Sampled from /proc, 0: not sampled
+    vector<Phase>   phases;
+};
+
+struct Totals {
+    atomic<unsigned long long>  handshakes,
+                                sent,
+                                received,
+                                bytesIn,
+                                errors,
+                                closes,
+                                pings,
+                                pongs,
+                                foreign;        // Control records not meant for this client
+    atomic<long long>           open;
+    atomic<unsigned int>        rate,
+                                size;
+};
+
+enum ClientState { CONNECTING, HANDSHAKING, OPEN, CLOSED };
+
+struct Client {
+    int             fd;
+    SSL             *sslp;
+    ClientState     state;
+    bool            wantWrite;
+    long long       nextSend,
+                    closeAt,
+                    nextPing;
+    int             pingLen;            // A ping to write again after SSL_ERROR_WANT_WRITE
+    char            ping[SMALL_BUFFER];
+
+    Client(void) : fd{-1}, sslp{nullptr}, state{CLOSED}, wantWrite{false}, nextSend{0}, closeAt{0},
+                   nextPing{0}, pingLen{0}, ping{} {}
+    ~Client(void){ reset(); }
+
+    void reset(void){
+        if(sslp != nullptr) SSL_free(sslp);
+        if(fd >= 0) static_cast<void>(close(fd));
+        sslp  = nullptr;
+        fd    = -1;
+        state = CLOSED;
+    }
+};
+
+class Runner {
+    public:
+        Runner(const Options& opts, SSL_CTX* ctx, const struct addrinfo* target,
+               unsigned int count, Totals& totals, const atomic<bool>& running);
+
+        void    run(void)                                                    noexcept;
+        void    collect(stats::LatencyHistogram& out,
+                        stats::LatencyHistogram& rtt)                        noexcept;
+
+    private:
+        const Options&           options;
+        SSL_CTX                  *ctxp;
+        const struct addrinfo    *addr;
+        Totals&                  total;
+        const atomic<bool>&      active;
+        vector<unique_ptr<Client>>
+                                 clients;
+        vector<char>             payload,
+                                 readBuffer;
+        minstd_rand              random;
+        mutex                    latencyMtx;
+        stats::LatencyHistogram  latency,
+                                 hbRtt;
+
+        void    open(Client& cli)                                            noexcept;
+        void    handshake(Client& cli)                                       noexcept;
+        void    drain(Client& cli)                                           noexcept;
+        void    send(Client& cli, long long now)                             noexcept;
+        void    heartbeat(Client& cli, long long now)                        noexcept;
+        void    churn(Client& cli, long long now)                            noexcept;
+        void    fail(Client& cli)                                            noexcept;
+};
+
+Runner::Runner(const Options& opts, SSL_CTX* ctx, const struct addrinfo* target,
+               unsigned int count, Totals& totals, const atomic<bool>& running)
+    : options{opts},
+      ctxp{ctx},
+      addr{target},
+      total{totals},
+      active{running},
+      payload(opts.size, 'x'),
+      readBuffer(HUGE_BUFFER, 0),
+      random{static_cast<unsigned int>(nowUs())}
+{
+    for(const auto& phase : opts.phases)
+        if(phase.size > payload.size())
+            payload.resize(phase.size, 'x');
+
+    for(unsigned int i = 0; i < count; i++)
+        clients.emplace_back(new Client());
+}
+
+void Runner::fail(Client& cli) noexcept{
+    if(cli.state == OPEN)
+        total.open--;
+    total.errors++;
+    cli.reset();
+}
+
+void Runner::collect(stats::LatencyHistogram& out, stats::LatencyHistogram& rtt) noexcept{
+    lock_guard<mutex> lock(latencyMtx);
+    out.merge(latency);
+    latency.reset();
+    rtt.merge(hbRtt);
+    hbRtt.reset();
+}
+
+// Churn: a session lives lifetime seconds on average, then reconnects.
+void Runner::churn(Client& cli, long long now) noexcept{
+    if(cli.closeAt == 0 || now < cli.closeAt)
+        return;
+
+    ERR_clear_error();
+    static_cast<void>(SSL_shutdown(cli.sslp));
+    total.open--;
+    total.closes++;
+    cli.reset();
+}
+
+void Runner::open(Client& cli) noexcept{
+    cli.fd = socket(addr->ai_family, SOCK_STREAM, 0);
+    if(cli.fd < 0){
+        fail(cli);
+        return;
+    }
+
+    int flags { fcntl(cli.fd, F_GETFL, 0) };
+    static_cast<void>(fcntl(cli.fd, F_SETFL, flags | O_NONBLOCK));
+
+    if(connect(cli.fd, addr->ai_addr, addr->ai_addrlen) != 0 && errno != EINPROGRESS){
+        fail(cli);
+        return;
+    }
+
+    cli.sslp = SSL_new(ctxp);
+    if(cli.sslp == nullptr || SSL_set_fd(cli.sslp, cli.fd) != 1){
+        fail(cli);
+        return;
+    }
+
+    cli.state     = CONNECTING;
+    cli.wantWrite = true;
+}
+
+void Runner::handshake(Client& cli) noexcept{
+    ERR_clear_error();
+    int rc { SSL_connect(cli.sslp) };
+
+    if(rc == 1){
+        total.handshakes++;
+        cli.wantWrite = false;
+        cli.nextSend  = nowUs();
+        cli.nextPing  = cli.nextSend;
+        cli.pingLen   = 0;
+        cli.closeAt   = 0;
+        if(options.lifetime != 0){
+            long long  mean { static_cast<long long>(options.lifetime) * 1000000 };
+            cli.closeAt = cli.nextSend + mean / 2 + static_cast<long long>(random() % static_cast<unsigned long long>(mean));
+        }
+
+        if(options.handshakeOnly){
+            cli.reset();
+        }else{
+            cli.state = OPEN;
+            total.open++;
+        }
+        return;
+    }
+
+    switch(SSL_get_error(cli.sslp, rc)){
+        case SSL_ERROR_WANT_READ:
+            cli.wantWrite = false;
+        break;
+        case SSL_ERROR_WANT_WRITE:
+            cli.wantWrite = true;
+        break;
+        default:
+            fail(cli);
+    }
+}
+
+void Runner::drain(Client& cli) noexcept{
+    for(;;){
+        ERR_clear_error();
+        int rc { SSL_read(cli.sslp, readBuffer.data(), static_cast<int>(readBuffer.size())) };
+
+        if(rc > 0 && readBuffer[0] == CONTROL_MARK){
+            sslconn::ControlKind  kind { sslconn::controlKind(readBuffer.data(), rc) };
+
+            // Pongs carry the stamp and the client of the ping: someone else's is foreign.
+            if(kind == sslconn::CTRL_PONG){
+                readBuffer[static_cast<size_t>(rc) < readBuffer.size() ? static_cast<size_t>(rc) : readBuffer.size() - 1] = 0;
+                char       *end  { nullptr };
+                long long  sent  { strtoll(readBuffer.data() + sizeof(HB_PONG) - 1, &end, 10) };
+                if(sent > 0 && reinterpret_cast<Client*>(strtoull(end, nullptr, 16)) == &cli){
+                    total.pongs++;
+                    lock_guard<mutex> lock(latencyMtx);
+                    hbRtt.record(nowUs() - sent);
+                }else{
+                    total.foreign++;
+                }
+                continue;
+            }
+            if(kind != sslconn::CTRL_NONE && kind != sslconn::CTRL_ESCAPED){
+                total.foreign++;
+                continue;
+            }
+        }
+
+        if(rc > 0){
+            total.received++;
+            total.bytesIn += static_cast<unsigned long long>(rc);
+
+            // Senders and receivers share the host clock: the stamp gives one way latency.
+            if(readBuffer[0] == STAMP_MARK){
+                long long  sent { strtoll(readBuffer.data() + 1, nullptr, 10) };
+                if(sent > 0){
+                    lock_guard<mutex> lock(latencyMtx);
+                    latency.record(nowUs() - sent);
+                }
+            }
+            continue;
+        }
+
+        int err { SSL_get_error(cli.sslp, rc) };
+        if(err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+            fail(cli);
+        return;
+    }
+}
+
+// A ping like SslConn's, plus the client it comes from, to tell its pong from a forwarded one.
+void Runner::heartbeat(Client& cli, long long now) noexcept{
+    if(options.heartbeat == 0 || (cli.pingLen == 0 && now < cli.nextPing))
+        return;
+
+    if(cli.pingLen == 0){
+        cli.pingLen = snprintf(cli.ping, sizeof(cli.ping), "%s%lld %p", HB_PING, now, static_cast<void*>(&cli));
+        if(cli.pingLen <= 0){
+            cli.pingLen = 0;
+            return;
+        }
+    }
+
+    ERR_clear_error();
+    int rc { SSL_write(cli.sslp, cli.ping, cli.pingLen) };
+    if(rc > 0){
+        total.pings++;
+        cli.pingLen   = 0;
+        cli.nextPing  = now + static_cast<long long>(options.heartbeat) * 1000;
+        return;
+    }
+
+    int err { SSL_get_error(cli.sslp, rc) };
+    if(err == SSL_ERROR_WANT_WRITE)
+        cli.wantWrite = true;
+    else if(err != SSL_ERROR_WANT_READ)
+        fail(cli);
+}
+
+void Runner::send(Client& cli, long long now) noexcept{
+    unsigned int  rate { total.rate },
+                  size { total.size };
+
+    // A ping waiting to be written again goes first: OpenSSL wants the same buffer back.
+    if(rate == 0 || now < cli.nextSend || cli.pingLen != 0)
+        return;
+
+    // The stamp is rewritten only if the payload can hold it, padding stays.
+    char  stamp[SMALL_BUFFER];
+    int   slen  { snprintf(stamp, sizeof(stamp), "%c%lld ", STAMP_MARK, now) };
+    if(slen > 0 && static_cast<unsigned int>(slen) <= size)
+        memcpy(payload.data(), stamp, static_cast<size_t>(slen));
+    else
+        payload[0] = 'x';
+
+    ERR_clear_error();
+    int rc { SSL_write(cli.sslp, payload.data(), static_cast<int>(size)) };
+    if(rc > 0){
+        total.sent++;
+        cli.nextSend += 1000000 / rate;
+        if(cli.nextSend < now - 1000000)
+            cli.nextSend = now;
+        return;
+    }
+
+    int err { SSL_get_error(cli.sslp, rc) };
+    if(err == SSL_ERROR_WANT_WRITE)
+        cli.wantWrite = true;
+    else if(err != SSL_ERROR_WANT_READ)
+        fail(cli);
+}
+
+void Runner::run(void) noexcept{
+    vector<struct pollfd>  fds;
+
+    while(active){
+        long long  now  { nowUs() };
+
+        fds.clear();
+        for(auto& cli : clients){
+            if(cli->state == OPEN)
+                churn(*cli, now);
+            if(cli->state == CLOSED)
+                open(*cli);
+            if(cli->state == OPEN)
+                heartbeat(*cli, now);
+            if(cli->state == OPEN)
+                send(*cli, now);
+
+            short events { POLLIN };
+            if(cli->wantWrite) events |= POLLOUT;
+            fds.push_back({cli->fd, events, 0});
+        }
+
+        unsigned int  rate    { total.rate };
+        int           timeout { rate == 0 ? 100 : static_cast<int>(1000 / rate) + 1 };
+        if(poll(fds.data(), fds.size(), timeout > 100 ? 100 : timeout) <= 0)
+            continue;
+
+        for(size_t i = 0; i < clients.size(); i++){
+            Client&  cli     { *clients[i] };
+            short    revents { fds[i].revents };
+
+            if(revents == 0 || cli.state == CLOSED)
+                continue;
+            if(revents & (POLLERR | POLLNVAL)){
+                fail(cli);
+                continue;
+            }
+
+            if(cli.state == CONNECTING)
+                cli.state = HANDSHAKING;
+            if(cli.state == HANDSHAKING){
+                handshake(cli);
+                continue;
+            }
+            if(revents & POLLOUT)
+                cli.wantWrite = false;
+            if(revents & (POLLIN | POLLHUP))
+                drain(cli);
+        }
+    }
+}
+
+// Server resource usage from /proc: cumulative CPU seconds and resident set.
+struct ProcSample {
+    double      cpuSecs;
+    long        rssKb;
+};
+
+bool sampleProc(int pid, ProcSample& out){
+    ifstream  statFile(string("/proc/").append(to_string(pid)).append("/stat")),
+              statusFile(string("/proc/").append(to_string(pid)).append("/status"));
+    string    line;
+
+    if(!getline(statFile, line))
+        return false;
+
+    // Fields after the command name: state is the first, utime the 12th, stime the 13th.
+    size_t    close { line.rfind(')') };
+    if(close == string::npos)
+        return false;
+
+    istringstream       fields(line.substr(close + 2));
+    string              field;
+    unsigned long long  utime { 0 },
+                        stime { 0 };
+    for(int i = 0; i < 13 && fields >> field; i++){
+        if(i == 11) utime = strtoull(field.c_str(), nullptr, 10);
+        if(i == 12) stime = strtoull(field.c_str(), nullptr, 10);
+    }
+
+    out.cpuSecs = static_cast<double>(utime + stime) / static_cast<double>(sysconf(_SC_CLK_TCK));
+    out.rssKb   = 0;
+    while(getline(statusFile, line))
+        if(line.compare(0, 6, "VmRSS:") == 0)
+            out.rssKb = strtol(line.c_str() + 6, nullptr, 10);
+
+    return true;
+}
+
+// Script lines: "<seconds> <msgs_per_sec_per_conn> <msg_size>", '#' starts a comment.
+bool loadScript(const char* path, vector<Phase>& phases){
+    ifstream  script(path);
+    string    line;
+
+    if(!script)
+        return false;
+
+    while(getline(script, line)){
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        istringstream  fields(line);
+        Phase          phase { 0, 0, 0 };
+        if(!(fields >> phase.seconds >> phase.rate >> phase.size) || phase.seconds == 0 || phase.size == 0)
+            return false;
+        phases.push_back(phase);
+    }
+
+    return !phases.empty();
+}
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-a address] [-p port] [-c connections] [-t threads]\n"
+         << "          [-r msgs_per_sec_per_conn] [-s msg_size] [-d seconds] [-H]\n"
+         << "          [-S script] [-C mean_lifetime_seconds] [-i report_seconds] [-P server_pid]\n"
+         << "          [-b heartbeat_ms]\n"
+         << "       -H: handshake mode, every session reconnects as soon as it's established.\n"
+         << "       -S: phases, one per line: <seconds> <msgs_per_sec_per_conn> <msg_size>;\n"
+         << "           it replaces -r, -s and -d.\n"
+         << "       -C: churn, sessions disconnect after a random lifetime and reconnect.\n"
+         << "       -P: report the server CPU usage and RSS, read from /proc;\n"
+         << "       -b: every session pings the server, which must answer with its own pong:\n"
+         << "           pings or pongs of other sessions are counted as foreign.\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { "127.0.0.1", "8866", 100, 1, 1, 64, 10, 0, 1, 0, false, 0, {} };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "a:p:c:t:r:s:d:HS:C:i:P:b:h")) != -1){
+        switch(opt){
+            case 'a': opts.address       = optarg;                                              break;
+            case 'p': opts.port          = optarg;                                              break;
+            case 'c': opts.connections   = static_cast<unsigned int>(strtoul(optarg, nullptr, 10)); break;
+            case 't': opts.threads       = static_cast<unsigned int>(strtoul(optarg, nullptr, 10)); break;
+            case 'r': opts.rate          = static_cast<unsigned int>(strtoul(optarg, nullptr, 10)); break;
+            case 's': opts.size          = static_cast<unsigned int>(strtoul(optarg, nullptr, 10)); break;
+            case 'd': opts.duration      = static_cast<unsigned int>(strtoul(optarg, nullptr, 10)); break;
+            case 'H': opts.handshakeOnly = true;                                                break;
+            case 'C': opts.lifetime      = static_cast<unsigned int>(strtoul(optarg, nullptr, 10)); break;
+            case 'i': opts.interval      = static_cast<unsigned int>(strtoul(optarg, nullptr, 10)); break;
+            case 'P': opts.serverPid     = static_cast<int>(strtol(optarg, nullptr, 10));          break;
+            case 'b': opts.heartbeat     = static_cast<unsigned int>(strtoul(optarg, nullptr, 10)); break;
+            case 'S':
+                if(!loadScript(optarg, opts.phases)){
+                    cerr << "Invalid script: " << optarg << "\n";
+                    return 1;
+                }
+            break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.threads == 0 || opts.connections < opts.threads || opts.size == 0 || opts.interval == 0){
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(opts.phases.empty())
+        opts.phases.push_back({ opts.duration, opts.rate, opts.size });
+
+    opts.duration = 0;
+    for(const auto& phase : opts.phases)
+        opts.duration += phase.seconds;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // The client SSL_CTX, trust store included, comes from SslConn client mode.
+    sslconn::ChatContext  context;
+    sslconn::SslConn      connection(context);
+
+    context.setServer(sslconn::CLIENT);
+    if(!connection.createContext()){
+        cerr << "Client context error: " << context.getErrMsg() << "\n";
+        return 1;
+    }
+
+    SSL_CTX_set_verify(context.getSslCtx(), SSL_VERIFY_PEER, nullptr);
+
+    struct addrinfo  hints,
+                     *target { nullptr };
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(opts.address.c_str(), opts.port.c_str(), &hints, &target) != 0){
+        cerr << "Can't resolve " << opts.address << "\n";
+        return 1;
+    }
+
+    Totals             totals {};
+    atomic<bool>       running { true };
+
+    totals.rate = opts.phases.front().rate;
+    totals.size = opts.phases.front().size;
+    vector<unique_ptr<Runner>>
+                       runners;
+    vector<thread>     threads;
+
+    for(unsigned int i = 0; i < opts.threads; i++){
+        unsigned int  count { opts.connections / opts.threads + (i < opts.connections % opts.threads ? 1 : 0) };
+        runners.emplace_back(new Runner(opts, context.getSslCtx(), target, count, totals, running));
+    }
+    for(auto& runner : runners)
+        threads.emplace_back(&Runner::run, runner.get());
+
+    long long                start      { nowUs() },
+                             lastReport { start };
+    unsigned long long       lastSent   { 0 },
+                             lastRecv   { 0 },
+                             lastHs     { 0 };
+    stats::LatencyHistogram  overall,
+                             window,
+                             rtt;
+    ProcSample               procStart  { 0, 0 },
+                             procLast   { 0, 0 },
+                             proc       { 0, 0 };
+    bool                     haveProc   { opts.serverPid != 0 && sampleProc(opts.serverPid, procStart) };
+    unsigned int             elapsed    { 0 };
+    long                     peakRss    { procStart.rssKb };
+
+    procLast = procStart;
+    for(const auto& phase : opts.phases){
+        totals.rate = phase.rate;
+        totals.size = phase.size;
+
+        for(unsigned int s = 0; s < phase.seconds; s++){
+            static_cast<void>(sleep(1));
+            if(++elapsed % opts.interval != 0)
+                continue;
+
+            long long  now { nowUs() };
+            double     dt  { static_cast<double>(now - lastReport) / 1000000.0 };
+
+            for(auto& runner : runners)
+                runner->collect(window, rtt);
+
+            unsigned long long  sent { totals.sent },
+                                recv { totals.received },
+                                hs   { totals.handshakes };
+
+            cerr << "t=" << elapsed << "s open: " << totals.open
+                 << " handshakes/s: " << static_cast<double>(hs - lastHs) / dt
+                 << " sent/s: " << static_cast<double>(sent - lastSent) / dt
+                 << " received/s: " << static_cast<double>(recv - lastRecv) / dt
+                 << " errors: " << totals.errors
+                 << " latency: " << window.summary();
+
+            if(haveProc && sampleProc(opts.serverPid, proc)){
+                if(proc.rssKb > peakRss) peakRss = proc.rssKb;
+                cerr << " server cpu: " << 100.0 * (proc.cpuSecs - procLast.cpuSecs) / dt << "%"
+                     << " rss: " << proc.rssKb / 1024 << " MB";
+                procLast = proc;
+            }
+            cerr << "\n";
+
+            overall.merge(window);
+            window.reset();
+            lastReport = now;
+            lastSent   = sent;
+            lastRecv   = recv;
+            lastHs     = hs;
+        }
+    }
+
+    running = false;
+    for(auto& thr : threads)
+        thr.join();
+
+    double  secs { static_cast<double>(nowUs() - start) / 1000000.0 };
+
+    for(auto& runner : runners)
+        runner->collect(overall, rtt);
+
+    cerr << "Loadgen - connections: " << opts.connections << " threads: " << opts.threads
+         << " seconds: " << secs << "\n"
+         << "  handshakes/s: " << static_cast<double>(totals.handshakes) / secs
+         << "  sent msgs/s: " << static_cast<double>(totals.sent) / secs
+         << "  received msgs/s: " << static_cast<double>(totals.received) / secs
+         << "  errors: " << totals.errors
+         << "  churn closes: " << totals.closes << "\n"
+         << "  latency: " << overall.summary() << "\n";
+    if(opts.heartbeat != 0)
+        cerr << "  heartbeat pings: " << totals.pings << " own pongs: " << totals.pongs
+             << " foreign control records: " << totals.foreign << "\n"
+             << "  heartbeat rtt: " << rtt.summary() << "\n";
+
+    if(haveProc)
+        cerr << "  server cpu: " << 100.0 * (procLast.cpuSecs - procStart.cpuSecs) / secs << "%"
+             << " peak rss: " << peakRss / 1024 << " MB\n";
+    cerr << truststore::shared().getStats() << "\n";
+
+    freeaddrinfo(target);
+    connection.cleanContext();
+
+    return 0;
+}
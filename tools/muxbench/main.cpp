@@ -0,0 +1,266 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_muxbench: an SslConn server and client in one process. The
+// client streams a bulk transfer on one channel while it sends stamped
+// chat lines on another; the server measures how long each line took.
+// Run it with and without -m, possibly through securechat_netproxy, to
+// compare channel framing with plain messages queued behind the bulk.
+// The bulk is a synthetic JSON log, to see what -z compression saves.
+
+#include "sslconn.h"
+#include "mux.h"
+#include "stats.h"
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <random>
+
+#include <signal.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::thread;
+using std::atomic;
+using std::cerr;
+using std::to_string;
+
+using stats::nowUs;
+using stats::LatencyHistogram;
+
+namespace {
+
+#define BULK_CHANNEL 1
+#define BULK_CHUNK 65536
+#define BULK_WAIT_MS 10000            // A stalled channel fails the run
+
+struct Options {
+    string              address,            // Where the client connects: the server or a proxy
+                        clientPort,
+                        serverPort;
+    unsigned int        lines,
+                        intervalMs,
+                        lineBytes;
+    unsigned long long  bulk;
+    bool                mux,
+                        zip;
+};
+
+// Log lines with varying numbers; never a '#', which marks the chat lines.
+string logChunk(size_t size){
+    static const char  *levels[] { "info", "debug", "warn", "error" };
+    std::mt19937       rng { 2019 };
+    string             chunk;
+    char               line[256];
+    auto               draw { [&](unsigned int range){ return static_cast<unsigned int>(rng() % range); } };
+
+    while(chunk.size() < size){
+        int  len { snprintf(line, sizeof(line),
+                            "{\"timestamp\": \"2019-10-%02uT%02u:%02u:%02u.%03uZ\", \"level\": \"%s\", "
+                            "\"msg\": \"request %u served in %u ms\", \"status\": %u}\n",
+                            draw(28) + 1, draw(24), draw(60), draw(60), draw(1000),
+                            levels[draw(4)], draw(100000), draw(500), draw(2) == 0 ? 200U : 404U) };
+        chunk.append(line, static_cast<size_t>(len));
+    }
+    chunk.resize(size);
+
+    return chunk;
+}
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-l server_port] [-a client_address] [-p client_port] [-n chat_lines]\n"
+         << "          [-i interval_ms] [-c line_bytes] [-B bulk_bytes] [-m [-z]]\n"
+         << "       the client connects to -a:-p (default the server itself, or a netproxy in front of it);\n"
+         << "       -m multiplexes chat and bulk on prioritized channels (SCMUX=1),\n"
+         << "       -z also compresses the bulk channel (SCZIP=1, dictionary from SCZDICT).\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { "127.0.0.1", "", "8872", 50, 100, 64, 64ULL * 1048576, false, false };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "l:a:p:n:i:c:B:mzh")) != -1){
+        switch(opt){
+            case 'l': opts.serverPort = optarg;                                                   break;
+            case 'a': opts.address    = optarg;                                                   break;
+            case 'p': opts.clientPort = optarg;                                                   break;
+            case 'n': opts.lines      = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'i': opts.intervalMs = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'c': opts.lineBytes  = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'B': opts.bulk       = strtoull(optarg, nullptr, 10);                            break;
+            case 'm': opts.mux        = true;                                                     break;
+            case 'z': opts.zip        = true;                                                     break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.lines == 0 || opts.lineBytes < 24 || opts.lineBytes > MUX_FRAME_PAYLOAD){
+        usage(argv[0]);
+        return 1;
+    }
+    if(opts.clientPort.empty())
+        opts.clientPort = opts.serverPort;
+
+    // Both contexts read the framing switch when they are built.
+    static_cast<void>(setenv("SCMUX", opts.mux ? "1" : "0", 1));
+    static_cast<void>(setenv("SCZIP", opts.zip ? "1" : "0", 1));
+    signal(SIGPIPE, SIG_IGN);
+
+    sslconn::ChatContext  serverCtx,
+                          clientCtx;
+    sslconn::SslConn      server(serverCtx),
+                          client(clientCtx);
+    sslconn::Mux          serverMux(server),
+                          clientMux(client);
+
+    serverCtx.setIp("127.0.0.1");
+    serverCtx.setPort(opts.serverPort);
+    serverCtx.setServer(sslconn::SERVER);
+    static_cast<void>(server.configure());
+    if(serverCtx.getStatus() != sslconn::listening){
+        cerr << "Server: " << serverCtx.getErrMsg() << "\n";
+        return 1;
+    }
+
+    LatencyHistogram            chatLatency;
+    atomic<unsigned long long>  bulkGot   { 0 };
+    atomic<unsigned int>        linesGot  { 0 };
+    atomic<long long>           bulkEnd   { 0 };
+    atomic<bool>                failed    { false };
+
+    // Runs on the server reader: both the framed and the plain path end here.
+    auto  account { [&](unsigned int channel, const char* data, int len){
+        if(channel == MUX_CHAT){
+            chatLatency.record(nowUs() - strtoll(data + 1, nullptr, 10));
+            linesGot++;
+        }else if((bulkGot += static_cast<unsigned long long>(len)) >= opts.bulk){
+            bulkEnd = nowUs();
+        }
+    } };
+
+    serverMux.setSink(account);
+    static_cast<void>(serverMux.start());
+
+    thread  receiver([&](){
+        if(!server.listenIncoming()){
+            failed = true;
+            return;
+        }
+
+        vector<char>  buffer(RECORD_FULL + 1, 0);
+        while(linesGot < opts.lines || bulkGot < opts.bulk){
+            int  len { 0 };
+            if(!server.readIncoming(buffer.data(), static_cast<int>(buffer.size()), len)){
+                failed = true;
+                return;
+            }
+            if(serverCtx.isControlMsg() || serverMux.handleRecord(buffer.data(), len))
+                continue;
+            account(buffer[0] == '#' ? MUX_CHAT : BULK_CHANNEL, buffer.data(), len);
+        }
+    });
+
+    clientCtx.setIp(opts.address);
+    clientCtx.setPort(opts.clientPort);
+    clientCtx.setServer(sslconn::CLIENT);
+    static_cast<void>(client.configure());
+    if(clientCtx.getStatus() != sslconn::connected){
+        cerr << "Client: " << clientCtx.getErrMsg() << "\n";
+        server.abortConnection();
+        receiver.detach();
+        return 1;
+    }
+
+    // The client reads only the announcement and the window updates.
+    thread  clientReader([&](){
+        vector<char>  buffer(RECORD_FULL + 1, 0);
+        int           len { 0 };
+
+        while(client.readIncoming(buffer.data(), static_cast<int>(buffer.size()), len))
+            static_cast<void>(clientMux.handleRecord(buffer.data(), len));
+    });
+
+    clientMux.openChannel(MUX_CHAT, 0);
+    clientMux.openChannel(BULK_CHANNEL, 1, true);
+    static_cast<void>(clientMux.start());
+    for(unsigned int wait = 0; opts.mux && !clientCtx.isMuxActive() && wait < 2000; wait++)
+        static_cast<void>(usleep(1000));
+    if(opts.mux && !clientCtx.isMuxActive())
+        cerr << "The server did not announce framing: sending plain messages.\n";
+
+    long long  bulkStart { nowUs() };
+    thread     bulkSender([&](){
+        string              chunk { logChunk(BULK_CHUNK) };
+        unsigned long long  left { opts.bulk };
+
+        while(left > 0 && !failed){
+            size_t  len { left < chunk.size() ? static_cast<size_t>(left) : chunk.size() };
+            if(!clientMux.waitSpace(BULK_CHANNEL, BULK_WAIT_MS) || !clientMux.send(BULK_CHANNEL, chunk.data(), len))
+                failed = true;
+            left -= len;
+        }
+    });
+
+    for(unsigned int line = 0; line < opts.lines && !failed; line++){
+        static_cast<void>(usleep(opts.intervalMs * 1000));
+
+        string  msg { string("#").append(to_string(nowUs())).append(" ") };
+        msg.resize(opts.lineBytes, 'c');
+        if(!clientMux.send(MUX_CHAT, msg.data(), msg.size()))
+            failed = true;
+    }
+
+    bulkSender.join();
+    receiver.join();
+
+    clientMux.stop();
+    serverMux.stop();
+    client.abortConnection();
+    server.abortConnection();
+    clientReader.join();
+
+    if(failed){
+        cerr << "Transfer failed: " << serverCtx.getErrMsg() << " " << clientCtx.getErrMsg() << "\n";
+        return 1;
+    }
+
+    double  bulkSecs { static_cast<double>(bulkEnd - bulkStart) / 1000000.0 };
+
+    cerr << "Muxbench - " << (clientCtx.isMuxActive() ? "channels" : "plain messages")
+         << " lines: " << opts.lines << " every " << opts.intervalMs << " ms, bulk: " << opts.bulk << " bytes\n"
+         << "  chat latency: " << chatLatency.summary() << "\n"
+         << "  bulk: " << static_cast<double>(opts.bulk) / 1048576.0 / bulkSecs << " MB/s\n";
+    if(opts.zip)
+        cerr << "  client " << clientMux.getZipStats() << "\n"
+             << "  server " << serverMux.getZipStats() << "\n";
+
+    client.cleanContext();
+    server.cleanContext();
+
+    return 0;
+}
@@ -0,0 +1,221 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_narrowbench: the checked conversions of types.h against raw
+// casts. The limits are checked first, most of them at compile time;
+// then the same conversion loop, over lengths like the ones sendMessage()
+// and readIncoming() convert, runs with static_cast, widen(), clampTo(),
+// narrow() and the throwing safeInt(). Exits 1 on a wrong result.
+
+#include "types.h"
+#include "stats.h"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <random>
+
+#include <unistd.h>
+
+using std::vector;
+using std::cerr;
+using std::numeric_limits;
+
+using stats::nowUs;
+using typeutils::Holds;
+using typeutils::inRange;
+using typeutils::narrow;
+using typeutils::clampTo;
+using typeutils::widen;
+
+namespace {
+
+// Proven at compile time: these cost nothing at run time.
+static_assert(Holds<size_t, uint32_t>::value,                        "uint32_t to size_t");
+static_assert(Holds<long long, int>::value,                          "int to long long");
+static_assert(Holds<int, unsigned short>::value,                     "unsigned short to int");
+static_assert(!Holds<int, unsigned int>::value,                      "unsigned int to int");
+static_assert(!Holds<size_t, int>::value,                            "int to size_t");
+static_assert(!Holds<uint32_t, size_t>::value,                       "size_t to uint32_t");
+static_assert(inRange<int>(size_t{ 2147483647 }),                    "INT_MAX as size_t");
+static_assert(!inRange<int>(size_t{ 2147483648U }),                  "INT_MAX + 1 as size_t");
+static_assert(!inRange<size_t>(-1),                                  "-1 to size_t");
+static_assert(inRange<signed char>(-128) && !inRange<signed char>(-129), "signed char bounds");
+static_assert(clampTo<int>(size_t{ 1 } << 40) == numeric_limits<int>::max(), "clamp high");
+static_assert(clampTo<unsigned int>(-5) == 0,                        "clamp negative");
+static_assert(clampTo<short>(-100000L) == numeric_limits<short>::min(),  "clamp low");
+static_assert(widen<size_t>(uint32_t{ 7 }) == 7,                     "widen");
+
+constexpr int narrowed(long long value){
+    int  out { -1 };
+    return narrow(value, out) ? out : -1;
+}
+static_assert(narrowed(42) == 42 && narrowed(1LL << 33) == -1,       "narrow in a constant expression");
+
+// The same checks at run time, on values the compiler can't see.
+bool limits(void){
+    volatile long long  big     { 1LL << 40 },
+                        neg     { -1 },
+                        fits    { 123456 };
+    volatile size_t     huge    { numeric_limits<size_t>::max() },
+                        edge    { static_cast<size_t>(numeric_limits<int>::max()) };
+    int                 out     { 7 };
+    bool                passed  { true };
+
+    passed = passed && !narrow(static_cast<long long>(big), out) && out == 7;
+    passed = passed && narrow(static_cast<long long>(fits), out) && out == 123456;
+    passed = passed && narrow(static_cast<long long>(neg), out) && out == -1;
+    passed = passed && !inRange<size_t>(static_cast<long long>(neg));
+    passed = passed && !inRange<int>(static_cast<size_t>(huge));
+    passed = passed && inRange<int>(static_cast<size_t>(edge)) && !inRange<int>(static_cast<size_t>(edge) + 1);
+    passed = passed && clampTo<int>(static_cast<size_t>(huge)) == numeric_limits<int>::max();
+    passed = passed && clampTo<uint32_t>(static_cast<long long>(neg)) == 0;
+
+    bool  thrown { false };
+    try{
+        static_cast<void>(typeutils::safeInt(static_cast<size_t>(huge)));
+    }catch(const typeutils::TypesUtilsException&){
+        thrown = true;
+    }
+
+    return passed && thrown;
+}
+
+template<typename Fn>
+long long timeBest(Fn fn){
+    long long  best { -1 };
+    for(int round = 0; round < 5; round++){
+        long long  start { nowUs() };
+        fn();
+        long long  took { nowUs() - start };
+        if(best < 0 || took < best)
+            best = took;
+    }
+    return best;
+}
+
+void report(const char* label, long long us, long long rawUs, size_t ops){
+    printf("%-22s %7.3f ns/conversion  %+6.1f%% vs static_cast\n", label,
+           static_cast<double>(us) * 1000.0 / static_cast<double>(ops),
+           rawUs > 0 ? 100.0 * static_cast<double>(us - rawUs) / static_cast<double>(rawUs) : 0.0);
+}
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-n conversions_M]\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    size_t  millions { 64 };
+    int     opt;
+
+    while((opt = getopt(argc, argv, "n:h")) != -1){
+        switch(opt){
+            case 'n': millions = strtoul(optarg, nullptr, 10);  break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(millions == 0 || millions > 4096){
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!limits()){
+        cerr << "Wrong result at run time.\n";
+        return 1;
+    }
+
+    // Message and buffer lengths, all in range as on the real paths.
+    std::mt19937        rng { 2019 };
+    vector<size_t>      lengths(65536);
+    vector<uint32_t>    counts(65536);
+    for(size_t idx = 0; idx < lengths.size(); idx++){
+        lengths[idx] = 1 + rng() % 16384;
+        counts[idx]  = static_cast<uint32_t>(lengths[idx]);
+    }
+
+    size_t              passes  { millions * 1048576 / lengths.size() },
+                        ops     { passes * lengths.size() };
+    long long           sum     { 0 },
+                        check   { 0 };
+    unsigned long long  wide    { 0 };
+    bool                failed  { false };
+
+    long long  rawUs    { timeBest([&](){ sum = 0;
+                                           for(size_t pass = 0; pass < passes; pass++)
+                                               for(size_t len : lengths)
+                                                   sum += static_cast<int>(len); }) };
+    check = sum;
+
+    long long  widenRawUs { timeBest([&](){ wide = 0;
+                                             for(size_t pass = 0; pass < passes; pass++)
+                                                 for(uint32_t count : counts)
+                                                     wide += static_cast<size_t>(count); }) };
+    unsigned long long  wideCheck { wide };
+    long long  widenUs  { timeBest([&](){ wide = 0;
+                                           for(size_t pass = 0; pass < passes; pass++)
+                                               for(uint32_t count : counts)
+                                                   wide += widen<size_t>(count); }) };
+    failed = failed || wide != wideCheck;
+
+    long long  clampUs  { timeBest([&](){ sum = 0;
+                                           for(size_t pass = 0; pass < passes; pass++)
+                                               for(size_t len : lengths)
+                                                   sum += clampTo<int>(len); }) };
+    failed = failed || sum != check;
+
+    long long  narrowUs { timeBest([&](){ sum = 0;
+                                           for(size_t pass = 0; pass < passes; pass++)
+                                               for(size_t len : lengths){
+                                                   int  out { 0 };
+                                                   if(!narrow(len, out))
+                                                       failed = true;
+                                                   sum += out;
+                                               } }) };
+    failed = failed || sum != check;
+
+    long long  throwUs  { timeBest([&](){ sum = 0;
+                                           try{
+                                               for(size_t pass = 0; pass < passes; pass++)
+                                                   for(size_t len : lengths)
+                                                       sum += typeutils::safeInt(len);
+                                           }catch(const typeutils::TypesUtilsException&){
+                                               failed = true;
+                                           } }) };
+    failed = failed || sum != check;
+
+    printf("%zu M conversions, best of 5\n", millions);
+    report("static_cast<int>", rawUs, rawUs, ops);
+    report("clampTo<int>", clampUs, rawUs, ops);
+    report("narrow<int>", narrowUs, rawUs, ops);
+    report("safeInt (throws)", throwUs, rawUs, ops);
+    report("static_cast<size_t>", widenRawUs, widenRawUs, ops);
+    report("widen<size_t>", widenUs, widenRawUs, ops);
+
+    if(failed){
+        cerr << "Wrong result in the conversion loops.\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# securechat_narrowbench: checked numeric conversions against raw casts
+#
+#-------------------------------------------------
+
+TARGET = securechat_narrowbench
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../typesimpl.cpp \
+        ../../stats.cpp
+
+HEADERS += \
+        ../../types.h \
+        ../../stats.h
@@ -0,0 +1,480 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_netproxy: a TCP proxy that makes loopback behave like a WAN
+// link. Each direction gets a one way delay with jitter, a bandwidth cap,
+// loss modelled as a retransmission stall and, optionally, connection
+// resets. Bytes are never reordered, as on a real TCP stream.
+
+#include "stats.h"
+
+#include <atomic>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+using std::string;
+using std::vector;
+using std::deque;
+using std::unique_ptr;
+using std::atomic;
+using std::cerr;
+using std::minstd_rand;
+using std::uniform_real_distribution;
+using std::exponential_distribution;
+
+using stats::nowUs;
+
+#define PROXY_CHUNK        16384      // Bytes read at once
+#define PROXY_QUEUE_LIMIT  1048576    // Bytes in flight per direction before reads stop
+#define PROXY_SEGMENT      1448       // Emulated MSS: the unit of serialisation, delay and loss
+
+namespace {
+
+struct Options {
+    string          listenAddress,
+                    listenPort,
+                    targetAddress,
+                    targetPort;
+    long long       delay,              // One way, us
+                    jitter,             // +/- us, never reorders
+                    stall;              // Retransmission stall for a "lost" chunk, us
+    double          bandwidth,          // Bytes per us, 0: unlimited
+                    loss,               // Probability a chunk is "lost"
+                    resetAfter;         // Mean connection lifetime before a RST, s, 0: never
+};
+
+struct Chunk {
+    vector<char>    data;
+    size_t          offset;
+    long long       due;
+};
+
+// One direction of a proxied connection.
+struct Pipe {
+    deque<Chunk>    queue;
+    size_t          queuedBytes;
+    long long       linkFree,           // When the emulated link finishes serialising
+                    lastDue;
+    bool            eof,
+                    shutDone;
+
+    Pipe(void) : queuedBytes{0}, linkFree{0}, lastDue{0}, eof{false}, shutDone{false} {}
+};
+
+struct Connection {
+    int             client,
+                    server;
+    Pipe            up,                 // client -> server
+                    down;               // server -> client
+    long long       resetAt;
+    bool            closing;
+
+    Connection(int cli, int srv) : client{cli}, server{srv}, resetAt{0}, closing{false} {}
+    ~Connection(void){
+        if(client >= 0) static_cast<void>(close(client));
+        if(server >= 0) static_cast<void>(close(server));
+    }
+};
+
+struct Counters {
+    unsigned long long  accepted,
+                        bytes,
+                        stalls,
+                        resets;
+};
+
+atomic<bool>  running { true };
+
+bool setNonBlocking(int fd){
+    int flags { fcntl(fd, F_GETFL, 0) };
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+int openListener(const Options& opts){
+    struct addrinfo  hints,
+                     *res    { nullptr };
+    int              optval  { 1 },
+                     fd      { -1 };
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    if(getaddrinfo(opts.listenAddress.c_str(), opts.listenPort.c_str(), &hints, &res) != 0)
+        return -1;
+
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if(fd < 0                                                                  ||
+       setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) != 0  ||
+       bind(fd, res->ai_addr, res->ai_addrlen) != 0                            ||
+       listen(fd, SOMAXCONN) != 0                                              ||
+       !setNonBlocking(fd)){
+        if(fd >= 0) static_cast<void>(close(fd));
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+int connectTarget(const Options& opts){
+    struct addrinfo  hints,
+                     *res    { nullptr };
+    int              fd      { -1 };
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(opts.targetAddress.c_str(), opts.targetPort.c_str(), &hints, &res) != 0)
+        return -1;
+
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if(fd >= 0 && (connect(fd, res->ai_addr, res->ai_addrlen) != 0 || !setNonBlocking(fd))){
+        static_cast<void>(close(fd));
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+class Proxy {
+    public:
+        Proxy(const Options& opts, int listener);
+
+        void    run(void);
+
+    private:
+        const Options&            options;
+        int                       listenFd;
+        vector<unique_ptr<Connection>>
+                                  conns;
+        vector<char>              buffer;
+        minstd_rand               random;
+        uniform_real_distribution<double>
+                                  unit;
+        Counters                  counters;
+
+        void        acceptIncoming(long long now);
+        void        receive(int from, Pipe& pipe, Connection& conn, long long now);
+        void        deliver(int to, Pipe& pipe, Connection& conn, long long now);
+        void        reset(Connection& conn);
+        long long   nextDue(void)                                 const;
+        void        printStats(void)                              const;
+};
+
+Proxy::Proxy(const Options& opts, int listener)
+    : options{opts},
+      listenFd{listener},
+      buffer(PROXY_CHUNK, 0),
+      random{static_cast<unsigned int>(nowUs())},
+      unit{0.0, 1.0},
+      counters{0, 0, 0, 0}
+{}
+
+void Proxy::acceptIncoming(long long now){
+    for(;;){
+        int  cli { accept(listenFd, nullptr, nullptr) };
+        if(cli < 0)
+            return;
+
+        int  srv { connectTarget(options) };
+        if(srv < 0 || !setNonBlocking(cli)){
+            cerr << "Target " << options.targetAddress << ":" << options.targetPort << " unreachable.\n";
+            static_cast<void>(close(cli));
+            if(srv >= 0) static_cast<void>(close(srv));
+            continue;
+        }
+
+        conns.emplace_back(new Connection(cli, srv));
+        counters.accepted++;
+
+        if(options.resetAfter > 0){
+            exponential_distribution<double>  life(1.0 / options.resetAfter);
+            conns.back()->resetAt = now + static_cast<long long>(life(random) * 1000000.0);
+        }
+    }
+}
+
+// Timestamps the data as it would leave the far end of the emulated link.
+void Proxy::receive(int from, Pipe& pipe, Connection& conn, long long now){
+    ssize_t  got { read(from, buffer.data(), buffer.size()) };
+
+    if(got == 0){
+        pipe.eof = true;
+        return;
+    }
+    if(got < 0){
+        if(errno != EAGAIN && errno != EINTR)
+            conn.closing = true;
+        return;
+    }
+
+    // Segments arrive one after the other, as they would on the wire.
+    for(ssize_t pos = 0; pos < got; pos += PROXY_SEGMENT){
+        ssize_t    len       { got - pos < PROXY_SEGMENT ? got - pos : PROXY_SEGMENT };
+        long long  serialise { options.bandwidth > 0 ? static_cast<long long>(static_cast<double>(len) / options.bandwidth) : 0 },
+                   start     { pipe.linkFree > now ? pipe.linkFree : now },
+                   due       { start + serialise + options.delay };
+
+        pipe.linkFree = start + serialise;
+
+        if(options.jitter > 0)
+            due += static_cast<long long>((unit(random) * 2.0 - 1.0) * static_cast<double>(options.jitter));
+
+        // A lost segment holds back everything behind it until it's retransmitted.
+        if(options.loss > 0 && unit(random) < options.loss){
+            due += options.stall;
+            counters.stalls++;
+        }
+
+        if(due < pipe.lastDue)
+            due = pipe.lastDue;
+        pipe.lastDue = due;
+
+        pipe.queue.push_back({ vector<char>(buffer.data() + pos, buffer.data() + pos + len), 0, due });
+        pipe.queuedBytes += static_cast<size_t>(len);
+    }
+}
+
+void Proxy::deliver(int to, Pipe& pipe, Connection& conn, long long now){
+    while(!pipe.queue.empty() && pipe.queue.front().due <= now){
+        Chunk&   chunk { pipe.queue.front() };
+        ssize_t  sent  { write(to, chunk.data.data() + chunk.offset, chunk.data.size() - chunk.offset) };
+
+        if(sent < 0){
+            if(errno != EAGAIN && errno != EINTR)
+                conn.closing = true;
+            return;
+        }
+
+        chunk.offset     += static_cast<size_t>(sent);
+        pipe.queuedBytes -= static_cast<size_t>(sent);
+        counters.bytes   += static_cast<unsigned long long>(sent);
+        if(chunk.offset < chunk.data.size())
+            return;
+        pipe.queue.pop_front();
+    }
+
+    // The half close travels after the data, like a FIN.
+    if(pipe.eof && pipe.queue.empty() && !pipe.shutDone){
+        static_cast<void>(shutdown(to, SHUT_WR));
+        pipe.shutDone = true;
+    }
+}
+
+// SO_LINGER with a zero timeout turns close() into a RST on both sides.
+void Proxy::reset(Connection& conn){
+    struct linger  hard { 1, 0 };
+
+    static_cast<void>(setsockopt(conn.client, SOL_SOCKET, SO_LINGER, &hard, sizeof(hard)));
+    static_cast<void>(setsockopt(conn.server, SOL_SOCKET, SO_LINGER, &hard, sizeof(hard)));
+    counters.resets++;
+    conn.closing = true;
+}
+
+long long Proxy::nextDue(void) const{
+    long long  next { -1 };
+
+    for(const auto& conn : conns){
+        for(const Pipe* pipe : { &conn->up, &conn->down })
+            if(!pipe->queue.empty() && (next < 0 || pipe->queue.front().due < next))
+                next = pipe->queue.front().due;
+        if(conn->resetAt != 0 && (next < 0 || conn->resetAt < next))
+            next = conn->resetAt;
+    }
+
+    return next;
+}
+
+void Proxy::run(void){
+    vector<struct pollfd>  fds;
+    long long              lastStats { nowUs() };
+
+    while(running){
+        long long  now  { nowUs() },
+                   due  { nextDue() };
+        int        wait { 100 };
+
+        if(due >= 0)
+            wait = due <= now ? 0 : static_cast<int>((due - now) / 1000) + 1;
+        if(wait > 100)
+            wait = 100;
+
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        for(auto& conn : conns){
+            // A full direction stops reading: the sender sees the backpressure.
+            short  cliEv { static_cast<short>(conn->up.eof || conn->up.queuedBytes > PROXY_QUEUE_LIMIT ? 0 : POLLIN) },
+                   srvEv { static_cast<short>(conn->down.eof || conn->down.queuedBytes > PROXY_QUEUE_LIMIT ? 0 : POLLIN) };
+
+            if(!conn->down.queue.empty() && conn->down.queue.front().due <= now) cliEv |= POLLOUT;
+            if(!conn->up.queue.empty()   && conn->up.queue.front().due <= now)   srvEv |= POLLOUT;
+
+            // Nothing to wait for on a side: a hung up socket would wake poll continuously.
+            fds.push_back({cliEv != 0 ? conn->client : -1, cliEv, 0});
+            fds.push_back({srvEv != 0 ? conn->server : -1, srvEv, 0});
+        }
+
+        if(poll(fds.data(), fds.size(), wait) < 0 && errno != EINTR)
+            break;
+
+        now = nowUs();
+        size_t  known { conns.size() };
+
+        for(size_t i = 0; i < known; i++){
+            Connection&  conn   { *conns[i] };
+            short        cliRev { fds[1 + i * 2].revents },
+                         srvRev { fds[2 + i * 2].revents };
+
+            if(conn.resetAt != 0 && now >= conn.resetAt){
+                reset(conn);
+                continue;
+            }
+
+            if(cliRev & (POLLIN | POLLHUP | POLLERR)) receive(conn.client, conn.up,   conn, now);
+            if(srvRev & (POLLIN | POLLHUP | POLLERR)) receive(conn.server, conn.down, conn, now);
+
+            deliver(conn.server, conn.up,   conn, now);
+            deliver(conn.client, conn.down, conn, now);
+
+            if(conn.up.shutDone && conn.down.shutDone)
+                conn.closing = true;
+        }
+
+        if(fds[0].revents & POLLIN)
+            acceptIncoming(now);
+
+        for(size_t i = 0; i < conns.size();){
+            if(conns[i]->closing){
+                conns[i].swap(conns.back());
+                conns.pop_back();
+                continue;
+            }
+            i++;
+        }
+
+        if(now - lastStats >= 10000000){
+            lastStats = now;
+            printStats();
+        }
+    }
+
+    printStats();
+}
+
+void Proxy::printStats(void) const{
+    cerr << "Netproxy - connections: " << conns.size() << " accepted: " << counters.accepted
+         << " bytes: " << counters.bytes << " stalls: " << counters.stalls
+         << " resets: " << counters.resets << "\n";
+}
+
+bool splitHostPort(const char* arg, string& host, string& port){
+    string  val  { arg };
+    size_t  sep  { val.rfind(':') };
+
+    if(sep == string::npos || sep + 1 == val.size())
+        return false;
+
+    host = val.substr(0, sep);
+    port = val.substr(sep + 1);
+    if(host.size() > 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+    return !host.empty();
+}
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " -l listen_host:port -t target_host:port [-d delay_ms] [-j jitter_ms]\n"
+         << "          [-b kbit_per_sec] [-L loss_pct] [-s stall_ms] [-R mean_seconds_to_reset]\n"
+         << "       delay and jitter are one way, applied to both directions;\n"
+         << "       a lost chunk stalls its direction for stall_ms (default 200), data is never reordered;\n"
+         << "       -R resets every connection after a random, exponentially distributed, lifetime.\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { "127.0.0.1", "", "", "", 0, 0, 200000, 0.0, 0.0, 0.0 };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "l:t:d:j:b:L:s:R:h")) != -1){
+        switch(opt){
+            case 'l':
+                if(!splitHostPort(optarg, opts.listenAddress, opts.listenPort)){
+                    usage(argv[0]);
+                    return 1;
+                }
+            break;
+            case 't':
+                if(!splitHostPort(optarg, opts.targetAddress, opts.targetPort)){
+                    usage(argv[0]);
+                    return 1;
+                }
+            break;
+            case 'd': opts.delay      = strtoll(optarg, nullptr, 10) * 1000;                     break;
+            case 'j': opts.jitter     = strtoll(optarg, nullptr, 10) * 1000;                     break;
+            case 's': opts.stall      = strtoll(optarg, nullptr, 10) * 1000;                     break;
+            case 'b': opts.bandwidth  = strtod(optarg, nullptr) * 1000.0 / 8.0 / 1000000.0;      break;
+            case 'L': opts.loss       = strtod(optarg, nullptr) / 100.0;                         break;
+            case 'R': opts.resetAfter = strtod(optarg, nullptr);                                 break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.listenPort.empty() || opts.targetPort.empty()){
+        usage(argv[0]);
+        return 1;
+    }
+
+    int  listener { openListener(opts) };
+    if(listener < 0){
+        cerr << "Can't listen on " << opts.listenAddress << ":" << opts.listenPort << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT,  [](int){ running = false; });
+    signal(SIGTERM, [](int){ running = false; });
+
+    cerr << "Netproxy " << opts.listenAddress << ":" << opts.listenPort << " -> "
+         << opts.targetAddress << ":" << opts.targetPort << " - delay: " << opts.delay / 1000
+         << " ms jitter: " << opts.jitter / 1000 << " ms loss: " << opts.loss * 100.0 << "%\n";
+
+    Proxy  proxy(opts, listener);
+    proxy.run();
+
+    static_cast<void>(close(listener));
+    cerr << "Exit!\n";
+
+    return 0;
+}
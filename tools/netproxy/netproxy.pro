@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# securechat_netproxy: TCP impairment proxy
+#
+#-------------------------------------------------
+
+TARGET = securechat_netproxy
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../stats.cpp
+
+HEADERS += \
+        ../../stats.h
+
+LIBS += -lpthread
@@ -0,0 +1,201 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_recbench: an SslConn server and client in one process. The
+// client sends bursts after an idle pause, then one bulk transfer; the
+// server timestamps what it reads. Run it once with dynamic record sizing
+// and once with a fixed size, possibly through securechat_netproxy.
+
+#include "sslconn.h"
+#include "stats.h"
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+#include <signal.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::thread;
+using std::atomic;
+using std::cerr;
+using std::to_string;
+
+using stats::nowUs;
+using stats::LatencyHistogram;
+
+namespace {
+
+struct Options {
+    string              address,            // Where the client connects: the server or a proxy
+                        clientPort,
+                        serverPort;
+    unsigned int        rounds,
+                        burst,              // Bytes per burst
+                        idleMs,
+                        fixed;              // Record size, 0: dynamic
+    unsigned long long  bulk;               // Bytes of the final transfer
+};
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-l server_port] [-a client_address] [-p client_port] [-n rounds]\n"
+         << "          [-b burst_bytes] [-i idle_ms] [-B bulk_bytes] [-f fixed_record_size]\n"
+         << "       the client connects to -a:-p (default the server itself, or a netproxy in front of it);\n"
+         << "       -f 0 (default) uses dynamic record sizing.\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { "127.0.0.1", "", "8870", 10, 262144, 1100, 0, 64ULL * 1048576 };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "l:a:p:n:b:i:B:f:h")) != -1){
+        switch(opt){
+            case 'l': opts.serverPort = optarg;                                                   break;
+            case 'a': opts.address    = optarg;                                                   break;
+            case 'p': opts.clientPort = optarg;                                                   break;
+            case 'n': opts.rounds     = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'b': opts.burst      = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'i': opts.idleMs     = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'B': opts.bulk       = strtoull(optarg, nullptr, 10);                            break;
+            case 'f': opts.fixed      = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.rounds == 0 || opts.burst == 0){
+        usage(argv[0]);
+        return 1;
+    }
+    if(opts.clientPort.empty())
+        opts.clientPort = opts.serverPort;
+
+    // The sizer mode is read when the connection is built.
+    static_cast<void>(setenv("SCRECORDSIZE", to_string(opts.fixed).c_str(), 1));
+    signal(SIGPIPE, SIG_IGN);
+
+    sslconn::ChatContext  serverCtx,
+                          clientCtx;
+    sslconn::SslConn      server(serverCtx),
+                          client(clientCtx);
+
+    serverCtx.setIp("127.0.0.1");
+    serverCtx.setPort(opts.serverPort);
+    serverCtx.setServer(sslconn::SERVER);
+    static_cast<void>(server.configure());
+    if(serverCtx.getStatus() != sslconn::listening){
+        cerr << "Server: " << serverCtx.getErrMsg() << "\n";
+        return 1;
+    }
+
+    vector<long long>   sentAt(opts.rounds + 1, 0),
+                        firstAt(opts.rounds + 1, 0),
+                        lastAt(opts.rounds + 1, 0);
+    atomic<bool>        failed { false };
+
+    // Server side: one byte count per round, then the bulk transfer.
+    thread  receiver([&](){
+        if(!server.listenIncoming()){
+            failed = true;
+            return;
+        }
+
+        vector<char>  buffer(RECORD_FULL + 1, 0);
+        for(unsigned int round = 0; round <= opts.rounds; round++){
+            unsigned long long  expected { round < opts.rounds ? opts.burst : opts.bulk },
+                                got      { 0 };
+
+            while(got < expected){
+                int  len { 0 };
+                if(!server.readIncoming(buffer.data(), static_cast<int>(buffer.size()), len)){
+                    failed = true;
+                    return;
+                }
+                if(got == 0)
+                    firstAt[round] = nowUs();
+                got += static_cast<unsigned long long>(len);
+            }
+            lastAt[round] = nowUs();
+        }
+    });
+
+    clientCtx.setIp(opts.address);
+    clientCtx.setPort(opts.clientPort);
+    clientCtx.setServer(sslconn::CLIENT);
+    static_cast<void>(client.configure());
+    if(clientCtx.getStatus() != sslconn::connected){
+        cerr << "Client: " << clientCtx.getErrMsg() << "\n";
+        server.abortConnection();
+        receiver.detach();
+        return 1;
+    }
+
+    string  burst(opts.burst, 'b');
+    for(unsigned int round = 0; round < opts.rounds && !failed; round++){
+        static_cast<void>(usleep(opts.idleMs * 1000));
+        sentAt[round] = nowUs();
+        if(!client.sendMessage(burst))
+            failed = true;
+        while(lastAt[round] == 0 && !failed)
+            static_cast<void>(usleep(1000));
+    }
+
+    // Bulk: written in bursts back to back, so the sizer ramps to full records.
+    unsigned long long  left { opts.bulk };
+    sentAt[opts.rounds] = nowUs();
+    while(left > 0 && !failed){
+        size_t  chunk { left < burst.size() ? static_cast<size_t>(left) : burst.size() };
+        if(!client.sendMessage(burst.substr(0, chunk)))
+            failed = true;
+        left -= chunk;
+    }
+
+    receiver.join();
+    if(failed){
+        cerr << "Transfer failed: " << serverCtx.getErrMsg() << " " << clientCtx.getErrMsg() << "\n";
+        return 1;
+    }
+
+    LatencyHistogram  firstByte,
+                      burstTime;
+    for(unsigned int round = 0; round < opts.rounds; round++){
+        firstByte.record(firstAt[round] - sentAt[round]);
+        burstTime.record(lastAt[round]  - sentAt[round]);
+    }
+
+    double  bulkSecs { static_cast<double>(lastAt[opts.rounds] - sentAt[opts.rounds]) / 1000000.0 };
+
+    cerr << "Recbench - records: " << (opts.fixed == 0 ? string("dynamic") : to_string(opts.fixed))
+         << " rounds: " << opts.rounds << " burst: " << opts.burst << " bytes\n"
+         << "  first byte: " << firstByte.summary() << "\n"
+         << "  burst complete: " << burstTime.summary() << "\n"
+         << "  bulk: " << static_cast<double>(opts.bulk) / 1048576.0 / bulkSecs << " MB/s\n";
+
+    client.cleanContext();
+    server.cleanContext();
+
+    return 0;
+}
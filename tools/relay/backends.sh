@@ -0,0 +1,33 @@
+#!/bin/sh
+# Relay backend comparison: poll vs io_uring, syscalls per record and throughput.
+# Usage: backends.sh [connections] [rate_per_conn] [msg_size] [seconds]
+# Expects securechat_relay built with CONFIG+=iouring and securechat_loadgen.
+
+RELAY=${RELAY:-./securechat_relay}
+LOADGEN=${LOADGEN:-../loadgen/securechat_loadgen}
+PORT=${PORT:-8878}
+CONNS=${1:-50}
+RATE=${2:-50}
+SIZE=${3:-128}
+SECS=${4:-10}
+
+echo "backend delivered_msgs/s syscalls/record"
+for backend in poll io_uring; do
+    flag=""
+    [ "$backend" = io_uring ] && flag="-u"
+
+    log=$(mktemp)
+    "$RELAY" -a 127.0.0.1 -p "$PORT" -w 1 -k 0 -s 0 $flag 2>"$log" &
+    pid=$!
+    sleep 1
+
+    rate=$("$LOADGEN" -a 127.0.0.1 -p "$PORT" -c "$CONNS" -r "$RATE" -s "$SIZE" -d "$SECS" 2>&1 |
+           sed -n 's/.*received msgs\/s: \([0-9.]*\).*/\1/p')
+
+    kill -INT "$pid"; wait "$pid" 2>/dev/null
+    ratio=$(sed -n 's/.*messages in: \([0-9]*\).*deliveries: \([0-9]*\).*syscalls: \([0-9]*\).*/\1 \2 \3/p' "$log" |
+            awk '{ if ($1 + $2 > 0) printf "%.3f", $3 / ($1 + $2) }')
+    rm -f "$log"
+
+    echo "$backend $rate $ratio"
+done
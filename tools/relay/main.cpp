@@ -0,0 +1,118 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "relay.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <thread>
+
+#include <signal.h>
+#include <unistd.h>
+
+using std::string;
+using std::cerr;
+
+static relay::Relay  *activeRelay  { nullptr };
+
+static void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-a address] [-p port] [-w workers] [-k crypto_threads] [-s stats_seconds] [-m budget_mb] [-u]\n"
+         << "       -u uses the io_uring backend (Linux, built with CONFIG+=iouring),\n"
+         << "       workers and crypto threads default to the number of cores,\n"
+         << "       -k 0 runs the handshakes on the workers.\n"
+         << "       -m caps the memory of all sessions: the heaviest are shed and paused beyond it.\n"
+         << "       the key passphrase, if any, is read from SCKEYPASS.\n";
+}
+
+int main(int argc, char *argv[]){
+    string        address   { "0.0.0.0" },
+                  port      { "8866" };
+    bool          uring     { false };
+    unsigned long long
+                  budgetMb  { 0 };
+    unsigned int  statsSecs { 10 },
+                  workers   { std::thread::hardware_concurrency() },
+                  crypto    { std::thread::hardware_concurrency() };
+    int           opt;
+
+    while((opt = getopt(argc, argv, "a:p:w:k:s:m:uh")) != -1){
+        switch(opt){
+            case 'a':
+                address = optarg;
+            break;
+            case 'p':
+                port = optarg;
+            break;
+            case 'w':
+                workers = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));
+            break;
+            case 'k':
+                crypto = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));
+            break;
+            case 's':
+                statsSecs = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));
+            break;
+            case 'm':
+                budgetMb = strtoull(optarg, nullptr, 10);
+            break;
+            case 'u':
+                uring = true;
+            break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    // OpenSSL's heap is accounted per session only if hooked before its first allocation.
+    if(!memacct::install())
+        cerr << "OpenSSL memory accounting unavailable.\n";
+
+    sslconn::ChatContext  context;
+    const char            *pass  { getenv("SCKEYPASS") };
+
+    context.setIp(address);
+    context.setPort(port);
+    if(pass != nullptr)
+        context.setPwd(pass);
+
+    relay::Relay  server(context);
+    if(!server.setIoUring(uring))
+        cerr << "io_uring support not built in: using poll.\n";
+
+    if(!server.start(workers, crypto)){
+        cerr << "Relay start failed: " << server.getErrMsg() << "\n";
+        return 1;
+    }
+
+    activeRelay = &server;
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT,  [](int){ activeRelay->stop(); });
+    signal(SIGTERM, [](int){ activeRelay->stop(); });
+
+    cerr << "Relay listening on " << address << ":" << port << " - workers: " << workers
+         << " crypto threads: " << crypto << "\n";
+    server.setStatsInterval(statsSecs);
+    server.setMemoryBudget(budgetMb * 1024 * 1024);
+    server.run();
+
+    cerr << server.getStats() << "\nExit!\n";
+
+    return 0;
+}
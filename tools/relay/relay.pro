@@ -0,0 +1,61 @@
+#-------------------------------------------------
+#
+# securechat_relay: headless group chat relay
+#
+#-------------------------------------------------
+
+TARGET = securechat_relay
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../relay.cpp \
+        ../../cryptopool.cpp \
+        ../../sslconn.cpp \
+        ../../socktune.cpp \
+        ../../connstate.cpp \
+        ../../connector.cpp \
+        ../../admission.cpp \
+        ../../eventlog.cpp \
+        ../../truststore.cpp \
+        ../../memacct.cpp \
+        ../../stats.cpp \
+        ../../typesimpl.cpp
+
+HEADERS += \
+        ../../relay.h \
+        ../../cryptopool.h \
+        ../../sslconn.h \
+        ../../socktune.h \
+        ../../connstate.h \
+        ../../connector.h \
+        ../../admission.h \
+        ../../eventlog.h \
+        ../../truststore.h \
+        ../../memacct.h \
+        ../../stats.h \
+        ../../types.h
+
+defined(OPENSSL_ALT_PATH, var) {
+    INCLUDEPATH += $$OPENSSL_ALT_PATH/include
+    LIBS +=  -L$$OPENSSL_ALT_PATH/lib/
+} else {
+  osx: {
+    INCLUDEPATH += /usr/local/ssl/include/
+    LIBS +=  -L/usr/local/ssl/lib/
+  }
+}
+
+# qmake CONFIG+=iouring: optional io_uring backend (relay -u), falls back to poll at runtime.
+linux:iouring {
+    DEFINES += SC_IOURING
+    SOURCES += ../../uring.cpp
+    HEADERS += ../../uring.h
+}
+
+LIBS += -lssl -lcrypto -lpthread
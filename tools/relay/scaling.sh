@@ -0,0 +1,28 @@
+#!/bin/sh
+# Relay scaling curve: messages/s and handshakes/s for 1..N workers.
+# Usage: scaling.sh [max_workers] [connections] [seconds]
+# Expects securechat_relay and securechat_loadgen already built.
+
+RELAY=${RELAY:-./securechat_relay}
+LOADGEN=${LOADGEN:-../loadgen/securechat_loadgen}
+PORT=${PORT:-8877}
+MAX=${1:-$(getconf _NPROCESSORS_ONLN)}
+CONNS=${2:-200}
+SECS=${3:-10}
+
+echo "workers msgs_in/s handshakes/s"
+w=1
+while [ "$w" -le "$MAX" ]; do
+    "$RELAY" -a 127.0.0.1 -p "$PORT" -w "$w" -s 0 2>/dev/null &
+    pid=$!
+    sleep 1
+
+    msgs=$("$LOADGEN" -a 127.0.0.1 -p "$PORT" -c "$CONNS" -t "$w" -r 10 -s 64 -d "$SECS" 2>&1 |
+           sed -n 's/.*sent msgs\/s: \([0-9.]*\).*/\1/p')
+    hs=$("$LOADGEN" -a 127.0.0.1 -p "$PORT" -c 64 -t "$w" -r 0 -d "$SECS" -H 2>&1 |
+         sed -n 's/.*handshakes\/s: \([0-9.]*\).*/\1/p')
+
+    kill "$pid"; wait "$pid" 2>/dev/null
+    echo "$w $msgs $hs"
+    w=$((w * 2))
+done
@@ -0,0 +1,279 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+
+// securechat_sessionbench: many chat sessions in one process, as the tabs
+// of the GUI: half of them servers, each one with a client connected to
+// it. With the reactor all of them share one I/O thread; with -T each
+// session has a blocking reader thread, as the GUI had. It reports the
+// threads, the RSS and the idle CPU per session, then the throughput
+// of a burst of messages from every client.
+
+#include "sslconn.h"
+#include "reactor.h"
+#include "stats.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+using std::string;
+using std::vector;
+using std::thread;
+using std::atomic;
+using std::unique_ptr;
+using std::ifstream;
+using std::cerr;
+using std::to_string;
+
+using stats::nowUs;
+
+namespace {
+
+struct Options {
+    unsigned int        pairs,
+                        port,               // First server port, one per pair
+                        messages,           // Per client
+                        idleSecs;
+    bool                threads;            // One reader thread per session instead of the reactor
+};
+
+struct Session {
+    sslconn::ChatContext    context;
+    sslconn::SslConn        conn;
+    vector<char>            buffer;
+    atomic<unsigned long>   received;
+
+    Session(void)
+        : context{},
+          conn{context},
+          buffer(RECORD_FULL + 1, 0),
+          received{0}
+    {}
+};
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-n pairs] [-p first_port] [-m messages_per_client] [-i idle_secs] [-T]\n"
+         << "       -T: a reader thread per session, the default is one reactor for all.\n";
+}
+
+long long rssKb(void){
+    ifstream   statm("/proc/self/statm");
+    long long  size  { 0 },
+               pages { 0 };
+
+    statm >> size >> pages;
+
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int threadCount(void){
+    ifstream  status("/proc/self/status");
+    string    line;
+
+    while(std::getline(status, line))
+        if(line.compare(0, 8, "Threads:") == 0)
+            return atoi(line.c_str() + 8);
+
+    return -1;
+}
+
+double cpuSecs(void){
+    struct rusage  usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+// Everything already there, at most REACTOR_BATCH records: other sessions wait meanwhile.
+void drain(Session& session) noexcept{
+    for(int count = 0; count < REACTOR_BATCH; count++){
+        int  len { 0 };
+        if(!session.conn.readIncoming(session.buffer.data(), static_cast<int>(session.buffer.size()), len) || len == 0)
+            break;
+        if(!session.context.isControlMsg())
+            session.received++;
+    }
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { 50, 8890, 1000, 5, false };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "n:p:m:i:Th")) != -1){
+        switch(opt){
+            case 'n': opts.pairs    = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'p': opts.port     = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'm': opts.messages = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'i': opts.idleSecs = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'T': opts.threads  = true;                                                     break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.pairs == 0){
+        usage(argv[0]);
+        return 1;
+    }
+
+    static_cast<void>(setenv(ADMIT_ENV, "ip=1000000/1000000,global=1000000/1000000", 0));
+    static_cast<void>(setenv(EVENTLOG_ENV, "off", 0));
+    signal(SIGPIPE, SIG_IGN);
+
+    long long                   rssStart  { rssKb() };
+    int                         thrStart  { threadCount() };
+    vector<unique_ptr<Session>> servers,
+                                clients;
+    vector<thread>              readers;
+    atomic<bool>                running   { true };
+    sslconn::Reactor            reactor;
+
+    if(!opts.threads && !reactor.start())
+        return 1;
+
+    for(unsigned int idx = 0; idx < opts.pairs; idx++){
+        string   port { to_string(opts.port + idx) };
+        Session  *server { new Session() },
+                 *client { new Session() };
+        servers.emplace_back(server);
+        clients.emplace_back(client);
+
+        server->context.setIp("127.0.0.1");
+        server->context.setPort(port);
+        server->context.setServer(sslconn::SERVER);
+        client->context.setIp("127.0.0.1");
+        client->context.setPort(port);
+        client->context.setServer(sslconn::CLIENT);
+
+        if(!opts.threads){
+            static_cast<void>(reactor.attach(server->conn, [server](bool ready){
+                sslconn::Status  status { server->context.getStatus() };
+                if(status == sslconn::listening || status == sslconn::handshaking)
+                    static_cast<void>(server->conn.listenIncoming());
+                else if(ready)
+                    drain(*server);
+            }));
+            static_cast<void>(reactor.attach(client->conn, [client](bool ready){
+                if(ready)
+                    drain(*client);
+            }));
+        }
+
+        static_cast<void>(server->conn.configure());
+        if(server->context.getStatus() != sslconn::listening){
+            cerr << "Listen on " << port << ": " << server->context.getErrMsg() << "\n";
+            return 1;
+        }
+        reactor.wake();
+
+        if(opts.threads){
+            readers.emplace_back([server, &running](){
+                if(!server->conn.listenIncoming())
+                    return;
+                while(running && server->context.getStatus() == sslconn::connected){
+                    int  len { 0 };
+                    if(!server->conn.readIncoming(server->buffer.data(), static_cast<int>(server->buffer.size()), len))
+                        break;
+                    if(len > 0 && !server->context.isControlMsg())
+                        server->received++;
+                }
+            });
+        }
+
+        static_cast<void>(client->conn.configure());
+        if(client->context.getStatus() != sslconn::connected){
+            cerr << "Connect to " << port << ": " << client->context.getErrMsg() << "\n";
+            return 1;
+        }
+
+        if(opts.threads){
+            readers.emplace_back([client, &running](){
+                while(running && client->context.getStatus() == sslconn::connected){
+                    int  len { 0 };
+                    if(!client->conn.readIncoming(client->buffer.data(), static_cast<int>(client->buffer.size()), len))
+                        break;
+                }
+            });
+        }
+    }
+
+    // Wait for the server side of the last handshake.
+    while(servers.back()->context.getStatus() != sslconn::connected)
+        static_cast<void>(usleep(1000));
+
+    unsigned int  sessions { opts.pairs * 2 };
+    long long     rss      { rssKb() - rssStart };
+    int           thr      { threadCount() - thrStart };
+    double        cpu      { cpuSecs() };
+
+    static_cast<void>(sleep(opts.idleSecs));
+    cpu = cpuSecs() - cpu;
+
+    cerr << "Sessionbench - " << (opts.threads ? "thread per session" : "one reactor") << ", sessions: " << sessions << "\n"
+         << "  threads: " << thr << " RSS: " << rss << " KB (" << rss / sessions << " KB per session)\n"
+         << "  idle CPU: " << 100.0 * cpu / opts.idleSecs << "%\n";
+
+    string              line(64, 'm');
+    unsigned long long  expected { static_cast<unsigned long long>(opts.pairs) * opts.messages },
+                        got      { 0 };
+    long long           start    { nowUs() },
+                        deadline { start + 60000000LL };
+
+    for(unsigned int msg = 0; msg < opts.messages; msg++)
+        for(auto& client : clients)
+            if(!client->conn.sendMessage(line)){
+                cerr << "Send failed: " << client->context.getErrMsg() << "\n";
+                return 1;
+            }
+
+    while(got < expected && nowUs() < deadline){
+        got = 0;
+        for(auto& server : servers)
+            got += server->received;
+        static_cast<void>(usleep(1000));
+    }
+
+    double  secs { static_cast<double>(nowUs() - start) / 1000000.0 };
+    cerr << "  delivered: " << got << "/" << expected << " messages, " << static_cast<double>(got) / secs << " msgs/s\n";
+
+    running = false;
+    for(auto& client : clients)
+        client->conn.disconnect();
+    for(auto& server : servers)
+        server->conn.disconnect();
+    for(auto& reader : readers)
+        reader.join();
+    reactor.stop();
+
+    return got == expected ? 0 : 1;
+}
@@ -0,0 +1,311 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_transportbench: every transport backend in turn, a server and
+// a client in one process: handshake time, round trip latency of small
+// messages echoed by the server, bulk throughput and the CPU they cost.
+// Built where QtNetwork is available it includes the QSslSocket backend
+// (SC_QSSL), otherwise only the OpenSSL one.
+
+#include "transport.h"
+#include "reactor.h"
+#include "stats.h"
+
+#ifdef SC_QSSL
+    #include <QCoreApplication>
+    #include <QTimer>
+    #include "qssltransport.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+using std::string;
+using std::vector;
+using std::atomic;
+using std::unique_ptr;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::condition_variable;
+using std::function;
+using std::cerr;
+using std::to_string;
+
+using stats::nowUs;
+using stats::LatencyHistogram;
+
+namespace {
+
+struct Options {
+    unsigned int        port,               // Server port, the next one for the next backend
+                        rounds,             // Round trips measured
+                        messages,           // Bulk messages
+                        size;               // Bulk message size
+    string              only;               // One backend, empty: all
+};
+
+struct Side {
+    atomic<sslconn::Status>     state;
+    atomic<unsigned long long>  messages,
+                                bytes;
+    atomic<bool>                echo,
+                                failed;
+
+    Side(void)
+        : state{sslconn::closed},
+          messages{0},
+          bytes{0},
+          echo{false},
+          failed{false}
+    {}
+};
+
+mutex               waitMtx;
+condition_variable  waitCv;
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-p port] [-r round_trips] [-m bulk_messages] [-s bulk_size] [-t openssl|qt]\n";
+}
+
+double cpuSecs(void){
+    struct rusage  usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+void notify(void){
+    {
+        lock_guard<mutex> lock(waitMtx);
+    }
+    waitCv.notify_all();
+}
+
+// The QSslSocket backend runs on this thread: its events need the loop.
+bool waitFor(bool eventLoop, const function<bool(void)>& cond, long long timeoutMs){
+    long long           deadline { nowUs() + timeoutMs * 1000 };
+    unique_lock<mutex>  lock(waitMtx);
+
+    while(!cond()){
+        if(nowUs() >= deadline)
+            return false;
+        #ifdef SC_QSSL
+            if(eventLoop){
+                lock.unlock();
+                QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+                lock.lock();
+                continue;
+            }
+        #else
+            static_cast<void>(eventLoop);
+        #endif
+        waitCv.wait_for(lock, std::chrono::milliseconds(10));
+    }
+
+    return true;
+}
+
+sslconn::TransportEvents events(Side& side, unique_ptr<sslconn::Transport>& self){
+    sslconn::TransportEvents  ev;
+
+    ev.state    = [&side](sslconn::Status, sslconn::Status to){ side.state = to; notify(); };
+    ev.error    = [&side](const string&){ side.failed = true; notify(); };
+    ev.received = [&side, &self](const char* data, int len){
+                      side.messages++;
+                      side.bytes += static_cast<unsigned long long>(len);
+                      if(side.echo)
+                          static_cast<void>(self->send(data, len));
+                      notify();
+                  };
+
+    return ev;
+}
+
+int run(const string& kind, unsigned int port, const Options& opts, sslconn::Reactor& reactor){
+    sslconn::ChatContext            serverCtx,
+                                    clientCtx;
+    Side                            serverSide,
+                                    clientSide;
+    unique_ptr<sslconn::Transport>  server,
+                                    client;
+    bool                            loop { kind == TRANSPORT_QT };
+
+    serverCtx.setIp("127.0.0.1");
+    serverCtx.setPort(to_string(port));
+    serverCtx.setServer(sslconn::SERVER);
+    clientCtx.setIp("127.0.0.1");
+    clientCtx.setPort(to_string(port));
+    clientCtx.setServer(sslconn::CLIENT);
+
+    #ifdef SC_QSSL
+        if(loop){
+            server.reset(new sslconn::QSslTransport(serverCtx, events(serverSide, server)));
+            client.reset(new sslconn::QSslTransport(clientCtx, events(clientSide, client)));
+        }
+    #endif
+    if(!loop){
+        server.reset(new sslconn::OpenSslTransport(serverCtx, reactor, events(serverSide, server)));
+        client.reset(new sslconn::OpenSslTransport(clientCtx, reactor, events(clientSide, client)));
+    }
+
+    cerr << "Transport " << kind << "\n";
+
+    if(!server->open()){
+        cerr << "  listen: " << server->getErrMsg() << "\n";
+        return 1;
+    }
+
+    long long  start { nowUs() };
+    if(!client->open() ||
+       !waitFor(loop, [&](){ return (clientSide.state == sslconn::connected && serverSide.state == sslconn::connected) ||
+                                    clientSide.failed || serverSide.failed; }, 10000) ||
+       clientSide.failed || serverSide.failed){
+        cerr << "  connect: " << client->getErrMsg() << server->getErrMsg() << "\n";
+        return 1;
+    }
+    cerr << "  handshake: " << (nowUs() - start) / 1000.0 << " ms\n";
+
+    string            small(64, 'r');
+    LatencyHistogram  rtt;
+    double            cpu   { cpuSecs() };
+
+    serverSide.echo = true;
+    start           = nowUs();
+    for(unsigned int round = 0; round < opts.rounds; round++){
+        long long  sent { nowUs() };
+        if(!client->send(small.data(), static_cast<int>(small.size())) ||
+           !waitFor(loop, [&](){ return clientSide.bytes >= (round + 1ULL) * small.size() || clientSide.failed; }, 5000)){
+            cerr << "  round trip " << round << " failed\n";
+            return 1;
+        }
+        rtt.record(nowUs() - sent);
+    }
+
+    double  rttWall { static_cast<double>(nowUs() - start) / 1000000.0 },
+            rttCpu  { cpuSecs() - cpu };
+    cerr << "  round trip (64 B): " << rtt.summary() << "\n"
+         << "    CPU: " << 100.0 * rttCpu / rttWall << "% - " << 1000000.0 * rttCpu / opts.rounds << " us per round trip\n";
+
+    string              bulk(opts.size, 'b');
+    unsigned long long  total { static_cast<unsigned long long>(opts.messages) * opts.size },
+                        base  { serverSide.bytes };
+
+    serverSide.echo = false;
+    cpu             = cpuSecs();
+    start           = nowUs();
+    for(unsigned int msg = 0; msg < opts.messages; msg++){
+        if(!client->send(bulk.data(), static_cast<int>(bulk.size()))){
+            cerr << "  bulk send failed: " << client->getErrMsg() << "\n";
+            return 1;
+        }
+        #ifdef SC_QSSL
+            // QSslSocket only writes from the event loop once the kernel stops taking it.
+            if(loop && (msg & 63) == 63)
+                QCoreApplication::processEvents();
+        #endif
+    }
+
+    if(!waitFor(loop, [&](){ return serverSide.bytes - base >= total || serverSide.failed; }, 60000)){
+        cerr << "  bulk: " << serverSide.bytes - base << "/" << total << " bytes\n";
+        return 1;
+    }
+
+    double  secs    { static_cast<double>(nowUs() - start) / 1000000.0 },
+            bulkCpu { cpuSecs() - cpu };
+    cerr << "  throughput (" << opts.messages << " x " << opts.size << " B): "
+         << static_cast<double>(total) / secs / 1048576.0 << " MB/s, " << opts.messages / secs << " msgs/s\n"
+         << "    CPU: " << 100.0 * bulkCpu / secs << "% - " << 1000000.0 * bulkCpu / opts.messages << " us per message\n";
+
+    client->close();
+    server->close();
+    static_cast<void>(waitFor(loop, [&](){ return serverSide.state == sslconn::closed && clientSide.state == sslconn::closed; }, 2000));
+
+    return 0;
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    #ifdef SC_QSSL
+        QCoreApplication  app(argc, argv);
+        QTimer            tick;           // Bounds the event loop waits.
+        tick.start(50);
+    #endif
+
+    Options  opts { 8920, 2000, 20000, 1024, "" };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "p:r:m:s:t:h")) != -1){
+        switch(opt){
+            case 'p': opts.port     = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'r': opts.rounds   = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'm': opts.messages = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 's': opts.size     = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 't': opts.only     = optarg;                                                   break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.rounds == 0 || opts.messages == 0 || opts.size == 0 || opts.size > RECORD_FULL){
+        usage(argv[0]);
+        return 1;
+    }
+
+    static_cast<void>(setenv(ADMIT_ENV, "ip=1000000/1000000,global=1000000/1000000", 0));
+    static_cast<void>(setenv(EVENTLOG_ENV, "off", 0));
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<string>    kinds { TRANSPORT_OPENSSL };
+    #ifdef SC_QSSL
+        kinds.push_back(TRANSPORT_QT);
+    #endif
+
+    sslconn::Reactor  reactor;
+    unsigned int      port    { opts.port };
+    int               ret     { 0 };
+
+    if(!reactor.start())
+        return 1;
+
+    for(const auto& kind : kinds){
+        if(!opts.only.empty() && opts.only != kind)
+            continue;
+        if(run(kind, port++, opts, reactor) != 0)
+            ret = 1;
+    }
+
+    reactor.stop();
+
+    return ret;
+}
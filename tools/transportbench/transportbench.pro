@@ -0,0 +1,67 @@
+#-------------------------------------------------
+#
+# securechat_transportbench: transport backends compared
+#
+#-------------------------------------------------
+
+TARGET = securechat_transportbench
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../transport.cpp \
+        ../../reactor.cpp \
+        ../../sslconn.cpp \
+        ../../socktune.cpp \
+        ../../connstate.cpp \
+        ../../connector.cpp \
+        ../../admission.cpp \
+        ../../eventlog.cpp \
+        ../../truststore.cpp \
+        ../../mux.cpp \
+        ../../zipcodec.cpp \
+        ../../stats.cpp \
+        ../../typesimpl.cpp
+
+HEADERS += \
+        ../../transport.h \
+        ../../reactor.h \
+        ../../sslconn.h \
+        ../../socktune.h \
+        ../../connstate.h \
+        ../../connector.h \
+        ../../admission.h \
+        ../../eventlog.h \
+        ../../truststore.h \
+        ../../mux.h \
+        ../../zipcodec.h \
+        ../../stats.h \
+        ../../types.h
+
+# The QSslSocket backend comes with QtNetwork, without it only OpenSSL's is built.
+qtHaveModule(network) {
+    QT      += core network
+    QT      -= gui
+    DEFINES += SC_QSSL
+    SOURCES += ../../qssltransport.cpp
+    HEADERS += ../../qssltransport.h
+} else {
+    CONFIG  -= qt
+}
+
+defined(OPENSSL_ALT_PATH, var) {
+    INCLUDEPATH += $$OPENSSL_ALT_PATH/include
+    LIBS +=  -L$$OPENSSL_ALT_PATH/lib/
+} else {
+  osx: {
+    INCLUDEPATH += /usr/local/ssl/include/
+    LIBS +=  -L/usr/local/ssl/lib/
+  }
+}
+
+LIBS += -lssl -lcrypto -lz -lpthread
@@ -0,0 +1,386 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_utf8bench: the receive path text decoding, without the GUI.
+// A large paste mixing scripts and emoji is validated with the scalar and
+// the vectorized code, then decoded the way ChatTab gets it: in pieces the
+// size of a message slot. Decoding each piece on its own garbles the code
+// points cut at the boundaries; the Decoder must give the same text as
+// the whole paste decoded at once. Then the paste goes as long messages
+// through a pair of OpenSSL transports on loopback, the path chat text
+// takes: the sender cuts them into records, the receiver puts them back
+// together and decodes them in slot pieces, every message must come out
+// whole. Random mutations cross-check the validators and the Decoder on
+// malformed input. Exits 1 on a mismatch.
+
+#include "utf8.h"
+#include "stats.h"
+#include "transport.h"
+#include "reactor.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <random>
+
+#include <signal.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::atomic;
+using std::function;
+using std::cerr;
+using std::cout;
+using std::u16string;
+using std::to_string;
+
+using stats::nowUs;
+
+namespace {
+
+#define SEND_MESSAGES 64              // Messages of the paste sent through the transports
+#define SEND_WAIT_MS 30000
+
+struct Options {
+    size_t        megabytes,
+                  chunk,
+                  message;
+    unsigned int  fuzz,
+                  port;
+};
+
+// What a user pastes: prose in several scripts, some emoji, code.
+string paste(size_t size, bool asciiOnly){
+    static const char  *mixed[] {
+        "The quick brown fox jumps over the lazy dog. ",
+        "Ça va très bien, merci ; à bientôt et bon appétit ! ",
+        "Привет, как дела? Всё хорошо, спасибо. ",
+        "你好，世界。今天天气很好，我们去公园散步吧。",
+        "こんにちは、元気ですか？ ",
+        "Καλημέρα σας, τι κάνετε; ",
+        "مرحبا بالعالم ",
+        "🙂🚀🎉 👍🏽 ",
+        "for(auto& item : items){ total += item.size(); }\n"
+    },
+                       *ascii[] {
+        "The quick brown fox jumps over the lazy dog. ",
+        "for(auto& item : items){ total += item.size(); }\n",
+        "Meeting moved to 15:30, room 4B; bring the slides.\n"
+    };
+    std::mt19937       rng { 2019 };
+    string             text;
+
+    text.reserve(size + 128);
+    while(text.size() < size)
+        text.append(asciiOnly ? ascii[rng() % (sizeof(ascii) / sizeof(ascii[0]))]
+                              : mixed[rng() % (sizeof(mixed) / sizeof(mixed[0]))]);
+
+    // Never cut a code point at the end.
+    while(text.size() > size && (static_cast<unsigned char>(text[size]) & 0xC0) == 0x80)
+        size++;
+    text.resize(size);
+
+    return text;
+}
+
+double mbps(size_t bytes, long long us){
+    return us > 0 ? static_cast<double>(bytes) / static_cast<double>(us) : 0.0;
+}
+
+// Best of a few rounds: the validators read the same cached buffer.
+template<typename Fn>
+long long timeBest(Fn fn){
+    long long  best { -1 };
+    for(int round = 0; round < 5; round++){
+        long long  start { nowUs() };
+        fn();
+        long long  took { nowUs() - start };
+        if(best < 0 || took < best)
+            best = took;
+    }
+    return best;
+}
+
+bool validation(const char* label, const string& text){
+    bool       scalarOk { true },
+               simdOk   { true };
+    long long  scalarUs { timeBest([&](){ scalarOk = utf8::validateScalar(text.data(), text.size()); }) },
+               simdUs   { timeBest([&](){ simdOk   = utf8::validate(text.data(), text.size()); }) };
+
+    printf("validate %-6s  scalar %8.1f MB/s  %-6s %8.1f MB/s  x%.1f\n", label,
+           mbps(text.size(), scalarUs), utf8::implementation(), mbps(text.size(), simdUs),
+           simdUs > 0 ? static_cast<double>(scalarUs) / static_cast<double>(simdUs) : 0.0);
+    if(!scalarOk || !simdOk){
+        cerr << "Valid " << label << " text rejected: scalar " << scalarOk << " vectorized " << simdOk << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Pieces as deliver() cuts them, each decoded into a slot-sized buffer.
+size_t decodePieces(const string& text, size_t chunk, utf8::Decoder* decoder, u16string& out){
+    vector<char16_t>  buffer(chunk + UTF8_MAX_PENDING);
+    size_t            garbled { 0 };
+
+    out.clear();
+    for(size_t pos = 0; pos < text.size(); pos += chunk){
+        int  piece { static_cast<int>(text.size() - pos < chunk ? text.size() - pos : chunk) },
+             len   { decoder != nullptr ? decoder->decode(text.data() + pos, piece, buffer.data())
+                                        : utf8::toUtf16(text.data() + pos, piece, buffer.data()) };
+        for(int idx = 0; idx < len; idx++)
+            if(buffer[static_cast<size_t>(idx)] == 0xFFFD)
+                garbled++;
+        out.append(buffer.data(), static_cast<size_t>(len));
+    }
+    if(decoder != nullptr){
+        int  len { decoder->finish(buffer.data()) };
+        garbled += static_cast<size_t>(len);
+        out.append(buffer.data(), static_cast<size_t>(len));
+    }
+
+    return garbled;
+}
+
+u16string whole(const string& text){
+    u16string  ref(text.size(), u'\0');
+    ref.resize(static_cast<size_t>(utf8::toUtf16(text.data(), static_cast<int>(text.size()), &ref[0])));
+    return ref;
+}
+
+// Messages of the paste, never cutting a code point.
+vector<string> messages(const string& text, size_t size, size_t count){
+    vector<string>  msgs;
+    size_t          pos { 0 };
+
+    while(msgs.size() < count && pos < text.size()){
+        size_t  end { pos + size < text.size() ? pos + size : text.size() };
+        while(end < text.size() && (static_cast<unsigned char>(text[end]) & 0xC0) == 0x80)
+            end++;
+        msgs.emplace_back(text, pos, end - pos);
+        pos = end;
+    }
+
+    return msgs;
+}
+
+bool waitFor(const function<bool(void)>& cond, long long timeoutMs){
+    long long  deadline { nowUs() + timeoutMs * 1000 };
+
+    while(!cond()){
+        if(nowUs() >= deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    return true;
+}
+
+// Each message is received whole and decoded as ChatTab does, one Decoder
+// carried across its slot pieces and flushed at its end.
+bool transported(const string& text, const Options& opts){
+    vector<string>        msgs { messages(text, opts.message, SEND_MESSAGES) };
+    sslconn::Reactor      reactor;
+    sslconn::ChatContext  serverCtx,
+                          clientCtx;
+    sslconn::TransportEvents
+                          serverEv,
+                          clientEv;
+    utf8::Decoder         decoder;
+    u16string             decoded;
+    atomic<int>           serverState { sslconn::closed },
+                          clientState { sslconn::closed };
+    atomic<size_t>        received    { 0 },
+                          garbled     { 0 },
+                          mismatched  { 0 };
+
+    serverCtx.setIp("127.0.0.1");
+    serverCtx.setPort(to_string(opts.port));
+    serverCtx.setServer(sslconn::SERVER);
+    clientCtx.setIp("127.0.0.1");
+    clientCtx.setPort(to_string(opts.port));
+    clientCtx.setServer(sslconn::CLIENT);
+
+    serverEv.state    = [&](sslconn::Status, sslconn::Status to){ serverState = to; };
+    clientEv.state    = [&](sslconn::Status, sslconn::Status to){ clientState = to; };
+    serverEv.received = [&](const char* data, int len){
+                            size_t  idx { received };
+                            garbled += decodePieces(string(data, static_cast<size_t>(len)), opts.chunk, &decoder, decoded);
+                            if(idx >= msgs.size() || decoded != whole(msgs[idx]))
+                                mismatched++;
+                            received++;
+                        };
+
+    if(!reactor.start())
+        return false;
+
+    bool  passed { false };
+    {
+        sslconn::OpenSslTransport  server(serverCtx, reactor, serverEv),
+                                   client(clientCtx, reactor, clientEv);
+
+        if(!server.open() || !client.open() ||
+           !waitFor([&](){ return serverState == sslconn::connected && clientState == sslconn::connected; }, SEND_WAIT_MS)){
+            cerr << "Transport connect failed: " << client.getErrMsg() << server.getErrMsg() << "\n";
+        }else{
+            long long  start { nowUs() };
+            size_t     bytes { 0 };
+
+            for(const auto& msg : msgs){
+                if(!client.send(msg.data(), static_cast<int>(msg.size())))
+                    cerr << "Transport send failed: " << client.getErrMsg() << "\n";
+                bytes += msg.size();
+            }
+            bool  done { waitFor([&](){ return received >= msgs.size(); }, SEND_WAIT_MS) };
+
+            printf("transport %zu messages of %zu bytes  %8.1f MB/s  received %zu, %zu U+FFFD, %zu differ\n",
+                   msgs.size(), opts.message, mbps(bytes, nowUs() - start), received.load(), garbled.load(), mismatched.load());
+            passed = done && received == msgs.size() && garbled == 0 && mismatched == 0;
+        }
+
+        client.close();
+        server.close();
+        static_cast<void>(waitFor([&](){ return serverState == sslconn::closed && clientState == sslconn::closed; }, 2000));
+    }
+    reactor.stop();
+
+    return passed;
+}
+
+bool decoding(const string& text, size_t chunk){
+    u16string      ref { whole(text) },
+                   naive,
+                   streamed;
+    utf8::Decoder  decoder;
+    size_t         naiveBad    { 0 },
+                   streamedBad { 0 };
+    long long      naiveUs     { timeBest([&](){ naiveBad = decodePieces(text, chunk, nullptr, naive); }) },
+                   streamedUs  { timeBest([&](){ decoder.reset();
+                                                 streamedBad = decodePieces(text, chunk, &decoder, streamed); }) };
+
+    printf("decode %zu byte pieces  per piece %8.1f MB/s  %zu U+FFFD\n", chunk, mbps(text.size(), naiveUs), naiveBad);
+    printf("decode %zu byte pieces  Decoder   %8.1f MB/s  %zu U+FFFD  %s\n", chunk, mbps(text.size(), streamedUs),
+           streamedBad, streamed == ref ? "matches the whole paste" : "DIFFERS from the whole paste");
+
+    return streamed == ref && streamedBad == 0;
+}
+
+bool fuzz(const string& text, unsigned int rounds){
+    std::mt19937   rng { 8866 };
+    unsigned int   invalid { 0 };
+    utf8::Decoder  decoder;
+    vector<char16_t>
+                   buffer(512 + UTF8_MAX_PENDING);
+
+    for(unsigned int round = 0; round < rounds; round++){
+        size_t  start { rng() % (text.size() - 400) };
+        while((static_cast<unsigned char>(text[start]) & 0xC0) == 0x80)
+            start++;
+        string  sample(text, start, 1 + rng() % 400);
+
+        for(unsigned int flips = rng() % 4; flips > 0; flips--)
+            sample[rng() % sample.size()] = static_cast<char>(rng() % 4 == 0 ? 0x80 | (rng() % 0x80) : rng() % 256);
+
+        bool  scalarOk { utf8::validateScalar(sample.data(), sample.size()) };
+        if(scalarOk != utf8::validate(sample.data(), sample.size())){
+            cerr << "Validators disagree on round " << round << "\n";
+            return false;
+        }
+        if(!scalarOk)
+            invalid++;
+
+        u16string  ref { whole(sample) },
+                   streamed;
+        for(size_t pos = 0; pos < sample.size(); ){
+            size_t  piece { 1 + rng() % 64 };
+            if(piece > sample.size() - pos)
+                piece = sample.size() - pos;
+            int  len { decoder.decode(sample.data() + pos, static_cast<int>(piece), buffer.data()) };
+            streamed.append(buffer.data(), static_cast<size_t>(len));
+            pos += piece;
+        }
+        // The sample ends the message: a truncated code point still held is flushed.
+        int  len { decoder.finish(buffer.data()) };
+        streamed.append(buffer.data(), static_cast<size_t>(len));
+        if(decoder.getPending() != 0){
+            cerr << "Decoder holds bytes past the end of round " << round << "\n";
+            return false;
+        }
+
+        if(streamed != ref){
+            cerr << "Decoder differs from a whole read on round " << round << "\n";
+            return false;
+        }
+    }
+
+    printf("fuzz %u samples, %u malformed: validators and Decoder agree\n", rounds, invalid);
+    return true;
+}
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " [-s paste_MB] [-c piece_bytes] [-f fuzz_rounds] [-m message_bytes] [-p port]\n"
+         << "       -c defaults to the payload of a message slot;\n"
+         << "       -m sizes the messages sent through the transports, -p their port;\n"
+         << "       SCUTF8=scalar or SCUTF8=ssse3 steps the vectorized validator down.\n";
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { 16, 255, 65536, 200000, 8930 };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "s:c:m:f:p:h")) != -1){
+        switch(opt){
+            case 's': opts.megabytes = strtoul(optarg, nullptr, 10);                             break;
+            case 'c': opts.chunk     = strtoul(optarg, nullptr, 10);                             break;
+            case 'm': opts.message   = strtoul(optarg, nullptr, 10);                             break;
+            case 'f': opts.fuzz      = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            case 'p': opts.port      = static_cast<unsigned int>(strtoul(optarg, nullptr, 10));  break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.megabytes == 0 || opts.megabytes > 1024 || opts.chunk < UTF8_MAX_PENDING + 1 ||
+       opts.message == 0 || opts.message > MESSAGE_MAX - UTF8_MAX_PENDING){
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    string  mixed { paste(opts.megabytes * 1048576, false) },
+            ascii { paste(opts.megabytes * 1048576, true) };
+    bool    passed { true };
+
+    passed = validation("ascii", ascii) && passed;
+    passed = validation("mixed", mixed) && passed;
+    passed = decoding(mixed, opts.chunk) && passed;
+    passed = transported(mixed, opts) && passed;
+    passed = fuzz(mixed, opts.fuzz) && passed;
+
+    return passed ? 0 : 1;
+}
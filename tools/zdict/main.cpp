@@ -0,0 +1,310 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+// securechat_zdict: trains the SCZDICT dictionary on sample messages.
+// Every message is deflated on its own against the dictionary, so what
+// pays is content found in many messages, not content repeated inside a
+// few: each 8 byte string scores the number of samples holding it. The
+// samples are cut in epochs, one per dictionary segment, and each epoch
+// gives the segment whose strings score most, strings already taken
+// scoring nothing (the COVER method of zstd's trainer). The segments go
+// out best last, the closest to the data, where deflate refers to them
+// with the shortest distances. The built-in dictionary and the trained
+// one are then compared on the samples, or on held out ones (-t).
+
+#include "zipcodec.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::pair;
+using std::cerr;
+using std::ifstream;
+using std::ofstream;
+using std::istreambuf_iterator;
+using std::unordered_map;
+
+using stats::nowUs;
+
+namespace {
+
+#define DMER 8                        // Bytes of the strings counted, one uint64_t
+#define SEGMENT_DEFAULT 64            // Bytes of a dictionary segment
+
+struct Options {
+    string        output,
+                  test;
+    size_t        size,
+                  segment;
+    bool          lines;
+};
+
+struct Samples {
+    string          data;             // All the samples, one after the other
+    vector<size_t>  ends;             // Where each one ends in data
+};
+
+struct Count {
+    uint32_t        samples,          // Samples holding the string
+                    last;             // Last sample counted, + 1
+};
+
+void usage(const char* prog){
+    cerr << "Usage: " << prog << " -o dictionary [-s size] [-k segment] [-t test_file] [-l] sample_file...\n"
+         << "       every file is one sample message, with -l every line of them is;\n"
+         << "       -t compares the dictionaries on these samples instead of the training ones,\n"
+         << "       -s dictionary bytes (default and most " << ZIP_DICT_MAX << "),\n"
+         << "       -k segment bytes (default " << SEGMENT_DEFAULT << ").\n";
+}
+
+bool load(const vector<string>& files, bool lines, Samples& samples){
+    for(const auto& name : files){
+        ifstream  file(name, std::ios::binary);
+        string    text { istreambuf_iterator<char>(file), istreambuf_iterator<char>() };
+
+        if(!file.good() && !file.eof()){
+            cerr << "Can't read " << name << "\n";
+            return false;
+        }
+
+        size_t  pos { 0 };
+        while(pos < text.size()){
+            size_t  end { lines ? text.find('\n', pos) : string::npos };
+            end = end == string::npos ? text.size() : end + 1;
+            samples.data.append(text, pos, end - pos);
+            samples.ends.push_back(samples.data.size());
+            pos = end;
+        }
+    }
+
+    return !samples.ends.empty();
+}
+
+uint64_t dmerAt(const string& data, size_t pos){
+    uint64_t  key { 0 };
+    std::memcpy(&key, data.data() + pos, DMER);
+    return key;
+}
+
+// Strings that cross into the next sample are never counted.
+vector<bool> validStarts(const Samples& samples){
+    vector<bool>  valid(samples.data.size(), false);
+    size_t        begin { 0 };
+
+    for(size_t end : samples.ends){
+        for(size_t pos = begin; pos + DMER <= end; pos++)
+            valid[pos] = true;
+        begin = end;
+    }
+
+    return valid;
+}
+
+unordered_map<uint64_t, Count> countSamples(const Samples& samples, const vector<bool>& valid){
+    unordered_map<uint64_t, Count>  counts;
+    size_t                          begin { 0 };
+
+    for(uint32_t idx = 0; idx < samples.ends.size(); idx++){
+        for(size_t pos = begin; pos < samples.ends[idx]; pos++){
+            if(!valid[pos])
+                continue;
+            Count&  cnt { counts[dmerAt(samples.data, pos)] };
+            if(cnt.last != idx + 1){
+                cnt.samples++;
+                cnt.last = idx + 1;
+            }
+        }
+        begin = samples.ends[idx];
+    }
+
+    return counts;
+}
+
+// The best segment of [begin, end): a sliding window, each string scored once however often it's in it.
+pair<size_t, uint64_t> bestSegment(const Samples& samples, const vector<bool>& valid,
+                                   const unordered_map<uint64_t, Count>& counts,
+                                   size_t begin, size_t end, size_t segment){
+    unordered_map<uint64_t, uint32_t>  window;
+    size_t                             span  { segment - DMER + 1 },
+                                       best  { begin };
+    uint64_t                           score { 0 },
+                                       top   { 0 };
+    auto  weight { [&](uint64_t key){ auto it = counts.find(key); return it == counts.end() ? 0ULL : it->second.samples; } };
+
+    for(size_t pos = begin; pos + DMER <= end; pos++){
+        if(valid[pos]){
+            uint64_t  key { dmerAt(samples.data, pos) };
+            if(window[key]++ == 0)
+                score += weight(key);
+        }
+
+        // The window holds the strings starting in [pos + 1 - span, pos].
+        if(pos >= begin + span){
+            size_t  old { pos - span };
+            if(valid[old]){
+                uint64_t  key { dmerAt(samples.data, old) };
+                auto      it  { window.find(key) };
+                if(--it->second == 0){
+                    score -= weight(key);
+                    window.erase(it);
+                }
+            }
+        }
+
+        if(pos + 1 >= begin + span && score > top){
+            top  = score;
+            best = pos + 1 - span;
+        }
+    }
+
+    return { best, top };
+}
+
+string train(const Samples& samples, size_t size, size_t segment){
+    vector<bool>                    valid   { validStarts(samples) };
+    unordered_map<uint64_t, Count>  counts  { countSamples(samples, valid) };
+    size_t                          epochs  { std::max<size_t>(size / segment, 1) },
+                                    epoch   { std::max(samples.data.size() / epochs, segment) };
+    vector<pair<uint64_t, string>>  picked;
+
+    for(size_t begin = 0; begin + segment <= samples.data.size() && picked.size() < epochs; begin += epoch){
+        size_t  end        { std::min(begin + epoch, samples.data.size()) };
+        auto    best       { bestSegment(samples, valid, counts, begin, end, segment) };
+
+        if(best.second == 0)
+            continue;
+
+        // Taken: the same strings in later segments would only waste room.
+        for(size_t pos = best.first; pos + DMER <= best.first + segment; pos++)
+            if(valid[pos])
+                counts.erase(dmerAt(samples.data, pos));
+        picked.emplace_back(best.second, samples.data.substr(best.first, segment));
+    }
+
+    std::stable_sort(picked.begin(), picked.end(),
+                     [](const pair<uint64_t, string>& lhs, const pair<uint64_t, string>& rhs){ return lhs.first < rhs.first; });
+
+    string  dict;
+    for(const auto& seg : picked)
+        dict.append(seg.second);
+    if(dict.size() > size)
+        dict.erase(0, dict.size() - size);
+
+    return dict;
+}
+
+// Payload bytes after deflate with the dictionary, the raw size where it doesn't pay, as Mux sends them.
+unsigned long long compressed(const Samples& samples, const string& dict){
+    zipcodec::Codec     codec;
+    unsigned long long  total { 0 };
+    vector<char>        out;
+    size_t              begin { 0 };
+
+    if(!codec.setDictionary(dict))
+        return 0;
+
+    for(size_t end : samples.ends){
+        size_t  len  { end - begin },
+                size { len };
+        out.resize(len + 1);
+        total += codec.compress(samples.data.data() + begin, len, out.data(), size) ? size : len;
+        begin  = end;
+    }
+
+    return total;
+}
+
+} // End anonymous namespace
+
+int main(int argc, char *argv[]){
+    Options  opts { "", "", ZIP_DICT_MAX, SEGMENT_DEFAULT, false };
+    int      opt;
+
+    while((opt = getopt(argc, argv, "o:s:k:t:lh")) != -1){
+        switch(opt){
+            case 'o': opts.output  = optarg;                                break;
+            case 't': opts.test    = optarg;                                break;
+            case 's': opts.size    = strtoul(optarg, nullptr, 10);          break;
+            case 'k': opts.segment = strtoul(optarg, nullptr, 10);          break;
+            case 'l': opts.lines   = true;                                  break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(opts.output.empty() || optind >= argc || opts.size == 0 || opts.size > ZIP_DICT_MAX ||
+       opts.segment < DMER || opts.segment > opts.size){
+        usage(argv[0]);
+        return 1;
+    }
+
+    Samples  samples;
+    if(!load(vector<string>(argv + optind, argv + argc), opts.lines, samples))
+        return 1;
+
+    long long  start { nowUs() };
+    string     dict  { train(samples, opts.size, opts.segment) };
+    long long  took  { nowUs() - start };
+
+    if(dict.empty()){
+        cerr << "No string is found in more than one place: nothing to train on.\n";
+        return 1;
+    }
+
+    ofstream  file(opts.output, std::ios::binary | std::ios::trunc);
+    file.write(dict.data(), static_cast<std::streamsize>(dict.size()));
+    if(!file.good()){
+        cerr << "Can't write " << opts.output << "\n";
+        return 1;
+    }
+
+    Samples  test;
+    if(!opts.test.empty() && !load(vector<string>(1, opts.test), opts.lines, test))
+        return 1;
+    const Samples&  eval { opts.test.empty() ? samples : test };
+
+    unsigned long long  raw     { eval.data.size() },
+                        builtin { compressed(eval, zipcodec::loadDictionary(nullptr)) },
+                        trained { compressed(eval, dict) };
+
+    cerr << "Zdict - " << samples.ends.size() << " samples, " << samples.data.size() << " bytes, trained in "
+         << static_cast<double>(took) / 1000.0 << " ms: " << dict.size() << " bytes to " << opts.output << "\n"
+         << "  compared on " << (opts.test.empty() ? string("the same samples") : opts.test)
+         << ", " << eval.ends.size() << " messages\n"
+         << "  built-in dictionary: " << raw << " -> " << builtin
+         << " ratio: " << static_cast<double>(raw) / static_cast<double>(builtin) << "\n"
+         << "  trained dictionary:  " << raw << " -> " << trained
+         << " ratio: " << static_cast<double>(raw) / static_cast<double>(trained) << "\n";
+
+    return 0;
+}
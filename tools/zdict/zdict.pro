@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# securechat_zdict: trains the SCZDICT compression dictionary
+#
+#-------------------------------------------------
+
+TARGET = securechat_zdict
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../zipcodec.cpp \
+        ../../stats.cpp
+
+HEADERS += \
+        ../../zipcodec.h \
+        ../../stats.h
+
+LIBS += -lz
@@ -0,0 +1,293 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "transport.h"
+
+#include <cstdlib>
+
+#include "stats.h"
+#include "eventlog.h"
+
+namespace sslconn {
+
+    using std::string;
+    using std::thread;
+    using std::mutex;
+    using std::lock_guard;
+
+    using stats::nowUs;
+
+    string transportKind(void) noexcept{
+        const char  *env { getenv(TRANSPORT_ENV) };
+
+        if(env != nullptr && string(env) == TRANSPORT_QT)
+            return TRANSPORT_QT;
+
+        return TRANSPORT_OPENSSL;
+    }
+
+    OpenSslTransport::OpenSslTransport(ChatContext& ctx, Reactor& react, const TransportEvents& ev)
+        : context{ctx},
+          reactor{react},
+          events{ev},
+          connection{ctx},
+          mux{connection},
+          buffer(RECORD_FULL + 1, 0),
+          lastBeat{0},
+          discard{false},
+          fresh{false},
+          serverMode{false},
+          attached{false},
+          connecting{false},
+          cancelled{false}
+    {
+        connection.setCancelFlag(&cancelled);
+        mux.openChannel(MUX_CHAT, 0);
+        mux.setSink([this](unsigned int channel, const char* data, int len){
+                        if(channel == MUX_CHAT && events.received)
+                            events.received(data, len);
+                    });
+
+        // Transitions happen on the reactor thread too. A session starts with fresh channels.
+        static_cast<void>(context.subscribe([this](Status from, Status to){
+                                                if(to == connected){
+                                                    mux.reset();
+                                                    fresh = true;
+                                                }
+                                                if(events.state)
+                                                    events.state(from, to); }));
+
+        attached = reactor.attach(connection, [this](bool ready){ onReactor(ready); });
+        if(!attached)
+            eventlog::error("transport", "Session not attached to the I/O thread.");
+    }
+
+    // Once detached, the reactor doesn't call this transport anymore. A
+    // connect still racing is cancelled, then waited for.
+    OpenSslTransport::~OpenSslTransport(void){
+        {
+            lock_guard<mutex> lock(openMtx);
+            cancelled = true;
+        }
+        if(opener.joinable())
+            opener.join();
+
+        connection.disconnect();
+        if(attached)
+            reactor.detach(connection);
+        mux.stop();
+    }
+
+    bool OpenSslTransport::open(void) noexcept{
+        serverMode = context.getMode() == SERVER;
+
+        if(!serverMode){
+            lock_guard<mutex> lock(openMtx);
+
+            if(connecting){
+                if(events.error)
+                    events.error("Already connecting.");
+                return false;
+            }
+            if(opener.joinable())
+                opener.join();
+
+            try{
+                connecting = true;
+                cancelled  = false;
+                opener     = thread(&OpenSslTransport::connectClient, this);
+            }catch(...){
+                connecting = false;
+                if(events.error)
+                    events.error("Connect Error");
+                return false;
+            }
+
+            return true;
+        }
+
+        // The state follows the transitions; configure() reports failures there.
+        static_cast<void>(connection.configure());
+        reactor.wake();
+
+        if(context.getStatus() != connected && context.getStatus() != listening){
+            if(events.error)
+                events.error("Connect Error");
+            return false;
+        }
+
+        return true;
+    }
+
+    bool OpenSslTransport::send(const char* data, int len) noexcept{
+        return len >= 0 && mux.send(MUX_CHAT, data, static_cast<size_t>(len));
+    }
+
+    // Connect thread: the race and the handshake, then the session is the reactor's.
+    void OpenSslTransport::connectClient(void) noexcept{
+        static_cast<void>(connection.configure());
+
+        bool  dropped { false };
+        {
+            lock_guard<mutex> lock(openMtx);
+            connecting = false;
+            dropped    = cancelled;
+        }
+
+        if(dropped){
+            connection.disconnect();
+            return;
+        }
+
+        reactor.wake();
+        if(context.getStatus() != connected && events.error)
+            events.error("Connect Error");
+    }
+
+    // close_notify to the peer, then the session is freed: the next open starts clean.
+    // A connect in progress is cancelled instead: it drops the session when its race ends.
+    void OpenSslTransport::close(void) noexcept{
+        {
+            lock_guard<mutex> lock(openMtx);
+            if(connecting){
+                cancelled = true;
+                return;
+            }
+        }
+
+        connection.disconnect();
+    }
+
+    // Until the connect thread moves the state, the connect is already under way.
+    Status OpenSslTransport::getStatus(void) const noexcept{
+        Status  status { context.getStatus() };
+
+        return connecting && !ConnState::isActive(status) ? resolving : status;
+    }
+
+    string OpenSslTransport::getErrMsg(void) const noexcept{
+        try{
+            return context.getErrMsg();
+        }catch(...){
+            return string();
+        }
+    }
+
+    string OpenSslTransport::getStats(void) const noexcept{
+        try{
+            return mux.getZipStats() + "\n" + connection.getAdmissionStats();
+        }catch(...){
+            return string();
+        }
+    }
+
+    const char* OpenSslTransport::name(void) const noexcept{
+        return TRANSPORT_OPENSSL;
+    }
+
+    // Reactor thread: accept and handshake steps for a server, otherwise the
+    // records already arrived, at most REACTOR_BATCH; the heartbeat on ticks.
+    void OpenSslTransport::onReactor(bool ready) noexcept{
+        Status  status { context.getStatus() };
+
+        if(serverMode && (status == listening || status == handshaking)){
+            if(!connection.listenIncoming() && events.error)
+                events.error("Listener Error.");
+            return;
+        }
+
+        if(status != connected)
+            return;
+
+        if(ready){
+            for(int count = 0; count < REACTOR_BATCH && receive(); count++){}
+            return;
+        }
+
+        long long  now { nowUs() };
+        if(context.getHbInterval() != 0 && now - lastBeat >= static_cast<long long>(context.getHbInterval()) * 1000){
+            lastBeat = now;
+            heartbeat();
+        }
+    }
+
+    void OpenSslTransport::heartbeat(void) noexcept{
+        if(!connection.peerAlive()){
+            connection.abortConnection();
+            if(events.error)
+                events.error("Peer not responding.");
+            return;
+        }
+
+        if(connection.sendHeartbeat() && events.linkStat)
+            events.linkStat();
+    }
+
+    // Frames, once framing is on, go through the mux sink; plain records to the handler, the
+    // pieces of a longer message put back together first, as the mux does with frames.
+    // False when nothing was read: the socket has nothing more for now.
+    bool OpenSslTransport::receive(void) noexcept{
+        int   len { 0 };
+        bool  res { connection.readIncoming(buffer.data(), static_cast<int>(buffer.size()), len) };
+
+        if(fresh.exchange(false)){
+            partial.clear();
+            discard = false;
+        }
+
+        if(!res){
+            if(events.error)
+                events.error("Error Reading Msg");
+            return false;
+        }
+
+        if(len == 0)
+            return false;
+
+        if(context.isControlMsg() || mux.handleRecord(buffer.data(), len))
+            return true;
+
+        bool  more { context.isPartialMsg() };
+        if(discard || partial.size() + static_cast<size_t>(len) > MESSAGE_MAX){
+            discard = more;
+            partial.clear();
+            return true;
+        }
+        if(more || !partial.empty()){
+            try{
+                partial.append(buffer.data(), static_cast<size_t>(len));
+            }catch(...){
+                discard = more;
+                partial.clear();
+                return true;
+            }
+            if(more)
+                return true;
+            if(events.received)
+                events.received(partial.data(), static_cast<int>(partial.size()));
+            partial.clear();
+            return true;
+        }
+
+        if(events.received)
+            events.received(buffer.data(), len);
+
+        return true;
+    }
+
+} // End namespace sslconn
@@ -0,0 +1,116 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sslconn.h"
+#include "reactor.h"
+#include "mux.h"
+
+#define TRANSPORT_ENV "SCTRANSPORT"   // openssl (default) or qt
+#define TRANSPORT_OPENSSL "openssl"
+#define TRANSPORT_QT "qt"
+
+namespace sslconn {
+
+// What a transport reports, on the thread that drives it: the reactor
+// for the OpenSSL backend, the owner's event loop for QSslSocket.
+struct TransportEvents {
+    std::function<void(Status from, Status to)>         state;
+    std::function<void(const char* data, int len)>      received;     // One chat message, see QSslTransport
+    std::function<void(const std::string& err)>        error;
+    std::function<void(void)>                           linkStat;     // New RTT sample in the context
+};
+
+// One chat session over TLS, whatever does the I/O. The ChatContext holds
+// the configuration; open() listens or connects as it says. The OpenSSL
+// backend keeps message boundaries: a message goes in records, marked as
+// continued when the peer reassembles them (SCMSG), and arrives whole.
+// QSslSocket hides record boundaries, so its backend only interoperates
+// within the limits qssltransport.h lists.
+
+class Transport {
+    public:
+        virtual ~Transport(void)                                             = default;
+
+        virtual bool            open(void)                                   noexcept = 0;
+        virtual bool            send(const char* data, int len)              noexcept = 0;
+        virtual void            close(void)                                  noexcept = 0;
+        virtual Status          getStatus(void)                  const       noexcept = 0;
+        virtual std::string     getErrMsg(void)                  const       noexcept = 0;
+        virtual std::string     getStats(void)                   const       noexcept = 0;
+        virtual const char*     name(void)                       const       noexcept = 0;
+};
+
+// SCTRANSPORT, TRANSPORT_OPENSSL if unset or unknown.
+std::string  transportKind(void)                                             noexcept;
+
+// SslConn on BIOs, served by a Reactor, channels through a Mux. Adds the
+// heartbeat, SCMUX and SCZIP, which the QSslSocket backend lacks. A
+// client's open() returns at once: the server race, which blocks up to
+// its timeouts, runs on a thread of its own and reports through events.
+// close() cancels it.
+
+class OpenSslTransport : public Transport {
+    public:
+        OpenSslTransport(ChatContext& ctx, Reactor& react, const TransportEvents& ev);
+        ~OpenSslTransport(void)                                              override;
+
+        OpenSslTransport(const OpenSslTransport&)                            = delete;
+        OpenSslTransport& operator=(const OpenSslTransport&)                 = delete;
+
+        bool            open(void)                                           noexcept override;
+        bool            send(const char* data, int len)                      noexcept override;
+        void            close(void)                                          noexcept override;
+        Status          getStatus(void)                          const       noexcept override;
+        std::string     getErrMsg(void)                          const       noexcept override;
+        std::string     getStats(void)                           const       noexcept override;
+        const char*     name(void)                               const       noexcept override;
+
+    private:
+        ChatContext             &context;
+        Reactor                 &reactor;
+        TransportEvents         events;
+        SslConn                 connection;
+        Mux                     mux;
+        std::vector<char>       buffer;           // Reactor thread only, as lastBeat and partial.
+        long long               lastBeat;
+        std::string             partial;          // A message whose next record is still to come.
+        bool                    discard;          // Over MESSAGE_MAX: its records are dropped up to the last.
+        std::atomic<bool>       fresh;            // A session started: partial is from the one before.
+        std::atomic<bool>       serverMode;
+        bool                    attached;
+        std::thread             opener;           // The client connect in progress, or done.
+        std::mutex              openMtx;
+        std::atomic<bool>       connecting;       // Written under openMtx.
+        std::atomic<bool>       cancelled;        // close() came during the connect: the race ends.
+
+        void            connectClient(void)                                  noexcept;
+        void            onReactor(bool ready)                                noexcept;
+        bool            receive(void)                                        noexcept;
+        void            heartbeat(void)                                      noexcept;
+};
+
+} // End namespace sslconn
@@ -0,0 +1,249 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+
+#include "truststore.h"
+
+#include <sys/stat.h>
+
+#include <cstdlib>
+
+#include "eventlog.h"
+
+namespace truststore {
+
+    using std::string;
+    using std::to_string;
+    using std::lock_guard;
+    using std::mutex;
+    using std::getenv;
+
+    using stats::nowUs;
+
+    static bool exists(const string& path, bool dir) noexcept{
+        struct stat  info;
+
+        if(path.empty() || stat(path.c_str(), &info) != 0)
+            return false;
+
+        return dir ? (info.st_mode & S_IFMT) == S_IFDIR : (info.st_mode & S_IFMT) == S_IFREG;
+    }
+
+    TrustStore::TrustStore(void)
+        : store{nullptr},
+          source{""},
+          loadTime{0},
+          verified{},
+          chainTime{},
+          hitTime{},
+          hits{0},
+          misses{0},
+          failures{0}
+    {}
+
+    TrustStore::~TrustStore(void){
+        if(store != nullptr)
+            X509_STORE_free(store);
+    }
+
+    // Either location may be empty, not both. Contexts already attached keep
+    // their reference to the previous store.
+    bool TrustStore::load(const string& file, const string& dir, string& err) noexcept{
+        long long    start { nowUs() };
+        X509_STORE   *next { X509_STORE_new() };
+
+        if(next == nullptr){
+            err = "Trust store allocation failed.";
+            return false;
+        }
+
+        if(X509_STORE_load_locations(next, file.empty() ? nullptr : file.c_str(),
+                                     dir.empty() ? nullptr : dir.c_str()) != 1){
+            X509_STORE_free(next);
+            err = string("Error loading trust store: ").append(file).append(file.empty() || dir.empty() ? "" : " ").append(dir);
+            return false;
+        }
+
+        lock_guard<mutex> lock(mtx);
+
+        if(store != nullptr)
+            X509_STORE_free(store);
+        store    = next;
+        loadTime = nowUs() - start;
+        verified.clear();
+        try{
+            source.assign(file).append(file.empty() || dir.empty() ? "" : " + ").append(dir);
+        }catch(...){}
+
+        return true;
+    }
+
+    // Loads the store on first use: the directory from TRUST_DIR_ENV, else
+    // TRUST_DIR if present, plus TRUST_FILE if present.
+    bool TrustStore::attach(SSL_CTX* ctx, const string& baseDir, string& err) noexcept{
+        bool  ready { false };
+        {
+            lock_guard<mutex> lock(mtx);
+            ready = store != nullptr;
+        }
+
+        if(!ready){
+            try{
+                const char  *envdir { getenv(TRUST_DIR_ENV) };
+                string      file    { baseDir + TRUST_FILE },
+                            dir     { envdir != nullptr ? string(envdir) : baseDir + TRUST_DIR };
+
+                if(!exists(dir, true)){
+                    if(envdir != nullptr)
+                        eventlog::warn("trust", string("Not a directory: ").append(dir));
+                    dir.clear();
+                }
+                if(!dir.empty() && !exists(file, false))
+                    file.clear();
+
+                if(!load(file, dir, err))
+                    return false;
+            }catch(...){
+                err = "Trust store configuration error.";
+                return false;
+            }
+        }
+
+        lock_guard<mutex> lock(mtx);
+
+        if(X509_STORE_up_ref(store) != 1){
+            err = "Trust store reference error.";
+            return false;
+        }
+        SSL_CTX_set_cert_store(ctx, store);
+        SSL_CTX_set_cert_verify_callback(ctx, verify, this);
+
+        return true;
+    }
+
+    void TrustStore::flush(void) noexcept{
+        lock_guard<mutex> lock(mtx);
+        verified.clear();
+    }
+
+    // Runs in place of X509_verify_cert() for every handshake of an attached context.
+    int TrustStore::verify(X509_STORE_CTX* sctx, void* arg){
+        TrustStore     *self  { static_cast<TrustStore*>(arg) };
+        X509           *leaf  { X509_STORE_CTX_get0_cert(sctx) };
+        unsigned char  digest[EVP_MAX_MD_SIZE];
+        unsigned int   len    { 0 };
+        long long      start  { nowUs() };
+        string         print;
+
+        if(leaf != nullptr && X509_digest(leaf, EVP_sha256(), digest, &len) == 1){
+            try{
+                print.assign(reinterpret_cast<const char*>(digest), len);
+            }catch(...){
+                print.clear();
+            }
+        }
+
+        if(!print.empty() && self->cached(print, start / 1000000)){
+            self->hits++;
+            lock_guard<mutex> lock(self->mtx);
+            self->hitTime.record(nowUs() - start);
+            return 1;
+        }
+
+        int  ret { X509_verify_cert(sctx) };
+
+        self->misses++;
+        if(ret > 0 && X509_STORE_CTX_get_error(sctx) == X509_V_OK){
+            if(!print.empty())
+                self->remember(print, leaf, start / 1000000);
+        }else{
+            self->failures++;
+        }
+
+        lock_guard<mutex> lock(self->mtx);
+        self->chainTime.record(nowUs() - start);
+
+        return ret;
+    }
+
+    bool TrustStore::cached(const string& print, long long now) noexcept{
+        lock_guard<mutex> lock(mtx);
+
+        auto  entry { verified.find(print) };
+        if(entry == verified.end())
+            return false;
+        if(entry->second > now)
+            return true;
+
+        verified.erase(entry);
+        return false;
+    }
+
+    // Valid until the cache TTL or the certificate expiry, whichever comes first.
+    void TrustStore::remember(const string& print, X509* leaf, long long now) noexcept{
+        int        days  { 0 },
+                   secs  { 0 };
+        if(ASN1_TIME_diff(&days, &secs, nullptr, X509_get0_notAfter(leaf)) != 1)
+            return;
+
+        long long  left  { static_cast<long long>(days) * 86400 + secs };
+        if(left <= 0)
+            return;
+
+        lock_guard<mutex> lock(mtx);
+
+        try{
+            if(verified.size() >= TRUST_CACHE_SIZE){
+                for(auto entry = verified.begin(); entry != verified.end();)
+                    entry = entry->second <= now ? verified.erase(entry) : ++entry;
+                if(verified.size() >= TRUST_CACHE_SIZE)
+                    verified.erase(verified.begin());
+            }
+            verified[print] = now + (left < TRUST_CACHE_TTL ? left : TRUST_CACHE_TTL);
+        }catch(...){}
+    }
+
+    string TrustStore::getStats(void) const noexcept{
+        string  res;
+
+        try{
+            lock_guard<mutex> lock(mtx);
+
+            res.append("Trust store - ").append(source.empty() ? string("not loaded") : source)
+               .append(" certificates in memory: ").append(to_string(store == nullptr ? 0 :
+                                                           sk_X509_OBJECT_num(X509_STORE_get0_objects(store))))
+               .append(" load: ").append(to_string(loadTime)).append(" us\n")
+               .append("  verify cache - hits: ").append(to_string(hits))
+               .append(" misses: ").append(to_string(misses))
+               .append(" failures: ").append(to_string(failures))
+               .append(" entries: ").append(to_string(verified.size())).append("\n")
+               .append("  chain verification: ").append(chainTime.summary()).append("\n")
+               .append("  cache hit: ").append(hitTime.summary());
+        }catch(...){
+            res = "getStats error.";
+        }
+
+        return res;
+    }
+
+    TrustStore& shared(void) noexcept{
+        static TrustStore  trust;
+        return trust;
+    }
+
+} // End namespace truststore
@@ -0,0 +1,88 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+
+#pragma once
+
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "stats.h"
+
+#define TRUST_DIR_ENV "SCTRUSTDIR"    // Hashed certificate directory (openssl rehash)
+#define TRUST_FILE "TrustStore.pem"   // In the securechat directory, optional with a directory
+#define TRUST_DIR "TrustStore.d"      // Default hashed directory, used if present
+#define TRUST_CACHE_SIZE 1024         // Verified leaf certificates remembered
+#define TRUST_CACHE_TTL 300           // Seconds a verification result is reused
+
+namespace truststore {
+
+// One X509_STORE for every client context of the process, built on first
+// use: the PEM file is parsed once, a hashed directory is indexed by
+// subject and read on demand, so hundreds of pinned servers cost neither
+// load time nor a linear chain lookup.
+//
+// Chain verification results are cached by the SHA-256 fingerprint of the
+// peer leaf certificate: a repeat connection to a server already verified
+// skips chain building. The handshake still proves the peer owns the key,
+// the cache only remembers that this exact certificate chains to a trusted
+// root. Entries expire after TRUST_CACHE_TTL seconds or with the
+// certificate, and a reload of the store drops them all.
+
+class TrustStore {
+    public:
+        TrustStore(void);
+        ~TrustStore(void);
+
+        TrustStore(const TrustStore&)                                        = delete;
+        TrustStore& operator=(const TrustStore&)                             = delete;
+
+        bool                load(const std::string& file, const std::string& dir,
+                                 std::string& err)                           noexcept;
+        bool                attach(SSL_CTX* ctx, const std::string& baseDir,
+                                   std::string& err)                         noexcept;
+        void                flush(void)                                      noexcept;
+        std::string         getStats(void)                       const       noexcept;
+
+    private:
+        X509_STORE                      *store;
+        std::string                     source;
+        long long                       loadTime;
+        mutable std::mutex              mtx;
+        std::unordered_map<std::string, long long>
+                                        verified;     // Fingerprint -> expiry, epoch seconds
+        stats::LatencyHistogram         chainTime,
+                                        hitTime;
+        std::atomic<unsigned long long> hits,
+                                        misses,
+                                        failures;
+
+        static int          verify(X509_STORE_CTX* sctx, void* arg);
+        bool                cached(const std::string& print, long long now)  noexcept;
+        void                remember(const std::string& print, X509* leaf,
+                                     long long now)                          noexcept;
+};
+
+TrustStore&  shared(void)                                                    noexcept;
+
+} // End namespace truststore
@@ -20,7 +20,9 @@
 
 #include <limits>
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <type_traits>
 
 #include <sys/types.h>
 #include <stdint.h>
@@ -38,6 +40,59 @@ namespace typeutils{
                    int errorCode;
    };
 
+   // Checked narrowing without exceptions, header only and constexpr so it
+   // inlines on the hot paths. When every value of From fits in To, the
+   // range is proven at compile time and no check is emitted at all.
+
+   // True if To can hold every value of From.
+   template<class To, class From>
+   struct Holds : std::integral_constant<bool,
+                      std::is_integral<To>::value && std::is_integral<From>::value &&
+                      (std::is_signed<From>::value ? std::is_signed<To>::value : true) &&
+                      std::numeric_limits<From>::digits <= std::numeric_limits<To>::digits> {};
+
+   template<class T>
+   constexpr bool isNegative(T value, std::true_type)                         noexcept{ return value < 0; }
+
+   template<class T>
+   constexpr bool isNegative(T, std::false_type)                              noexcept{ return false; }
+
+   template<class To, class From>
+   constexpr bool inRange(From value)                                         noexcept{
+      static_assert(std::is_integral<To>::value && std::is_integral<From>::value, "inRange: integral types only.");
+      return Holds<To, From>::value ||
+             (isNegative(value, std::is_signed<From>{})
+                 ? std::is_signed<To>::value &&
+                   static_cast<intmax_t>(value) >= static_cast<intmax_t>(std::numeric_limits<To>::min())
+                 : static_cast<uintmax_t>(value) <= static_cast<uintmax_t>(std::numeric_limits<To>::max()));
+   }
+
+   // Returns false, leaving out untouched, if value doesn't fit in To.
+   template<class To, class From>
+   constexpr bool narrow(From value, To& out)                                 noexcept{
+      if(!inRange<To>(value))
+         return false;
+      out = static_cast<To>(value);
+      return true;
+   }
+
+   // Out of range values become the nearest limit of To: for lengths where less is fine, like a read.
+   template<class To, class From>
+   constexpr To clampTo(From value)                                           noexcept{
+      return inRange<To>(value) ? static_cast<To>(value)
+                                : isNegative(value, std::is_signed<From>{}) ? std::numeric_limits<To>::min()
+                                                                           : std::numeric_limits<To>::max();
+   }
+
+   // Only compiles when the conversion can't lose anything.
+   template<class To, class From>
+   constexpr To widen(From value)                                             noexcept{
+      static_assert(Holds<To, From>::value, "widen: To can't hold every value of From, use narrow().");
+      return static_cast<To>(value);
+   }
+
+   // The throwing versions, for code that may throw. Not from noexcept functions.
+
    #ifdef __clang__
    #pragma clang diagnostic push
    #pragma clang diagnostic ignored "-Wsign-compare"
@@ -110,22 +165,6 @@ namespace typeutils{
    #pragma clang diagnostic pop
    #endif
 
-   extern template ptrdiff_t       safePtrdiff<size_t>(size_t)                noexcept(false);
-   extern template ssize_t         safeSsizeT<size_t>(size_t)                 noexcept(false);
-   extern template int             safeInt<unsigned int>(unsigned int)        noexcept(false);
-   extern template int             safeInt<size_t>(size_t)                    noexcept(false);
-   #ifndef WINDOWS_OPENSSL
-      extern template size_t          safeSizeT<ssize_t>(ssize_t)                noexcept(false);
-   #endif
-   extern template size_t          safeSizeT<int>(int)                        noexcept(false);
-   extern template size_t          safeSizeT<uint32_t>(uint32_t)              noexcept(false);
-   extern template size_t          safeSizeT<long long int>(long long int)    noexcept(false);
-   extern template uint32_t        safeUint32<int>(int)                       noexcept(false);
-   extern template uint32_t        safeUint32<unsigned long>(unsigned long)   noexcept(false);
-   extern template unsigned int    safeUInt<size_t>(size_t)                   noexcept(false);
-   extern template unsigned long   safeULong<int>(int)                        noexcept(false);
-   extern template unsigned long   safeULong<long int>(long int)              noexcept(false);
-
    #ifdef __GNUC__
    #pragma GCC diagnostic pop
    #endif
@@ -18,17 +18,6 @@
 
 #include "types.h"
 
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wsign-compare"
-#pragma GCC diagnostic ignored "-Wtype-limits"
-#endif
-
-#if defined  __clang_major__ && __clang_major__ >= 4 && !defined __APPLE__ && __clang_major__ >= 4
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wundefined-func-template"
-#endif
-
 namespace typeutils{
 
   TypesUtilsException::TypesUtilsException(int errNum) :
@@ -43,28 +32,4 @@ namespace typeutils{
   std::string TypesUtilsException::what() const noexcept(true){
           return errorMessage;
   }
-
-  template ptrdiff_t       safePtrdiff(size_t size)            noexcept(false);
-  template ssize_t         safeSsizeT(size_t size)             noexcept(false);
-  template int             safeInt(unsigned int size)          noexcept(false);
-  template int             safeInt(size_t size)                noexcept(false);
-  template size_t          safeSizeT(ssize_t size)             noexcept(false);
-  template size_t          safeSizeT(int size)                 noexcept(false);
-  template size_t          safeSizeT(uint32_t size)            noexcept(false);
-#ifndef WINDOWS_OPENSSL
-  template size_t          safeSizeT(long long int size)       noexcept(false);
-#endif
-  template uint32_t        safeUint32(int size)                noexcept(false);
-  template uint32_t        safeUint32(unsigned long size)      noexcept(false);
-  template unsigned int    safeUInt(size_t size)               noexcept(false);
-  template unsigned long   safeULong(int size)                 noexcept(false);
-  template unsigned long   safeULong(long int size)            noexcept(false);
 }
-
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
-
-#if defined  __clang_major__ && __clang_major__ >= 4 && !defined __APPLE__ && __clang_major__ >= 4
-#pragma clang diagnostic pop
-#endif
@@ -0,0 +1,197 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "uring.h"
+
+#ifdef SC_IOURING
+
+#include <cstring>
+#include <cerrno>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace relay {
+
+    using std::vector;
+
+    static int sysSetup(unsigned int entries, struct io_uring_params* params) noexcept{
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    static int sysEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) noexcept{
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+    }
+
+    static int sysRegister(int fd, unsigned int opcode, const void* arg, unsigned int nrArgs) noexcept{
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+    }
+
+    template<class T>
+    static T* ringPtr(void* base, unsigned int offset) noexcept{
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+
+    Uring::Uring(void)
+        : ringFd{-1},
+          sqRing{MAP_FAILED},
+          cqRing{MAP_FAILED},
+          sqRingSize{0},
+          cqRingSize{0},
+          sqesSize{0},
+          sqes{nullptr},
+          cqes{nullptr},
+          sqHead{nullptr},
+          sqTail{nullptr},
+          sqArray{nullptr},
+          cqHead{nullptr},
+          cqTail{nullptr},
+          sqMask{0},
+          cqMask{0},
+          sqEntries{0},
+          localTail{0},
+          flushedTail{0},
+          supported{},
+          enterCalls{0}
+    {}
+
+    Uring::~Uring(void){
+        if(sqes != nullptr)
+            static_cast<void>(munmap(sqes, sqesSize));
+        if(cqRing != MAP_FAILED && cqRing != sqRing)
+            static_cast<void>(munmap(cqRing, cqRingSize));
+        if(sqRing != MAP_FAILED)
+            static_cast<void>(munmap(sqRing, sqRingSize));
+        if(ringFd >= 0)
+            static_cast<void>(close(ringFd));
+    }
+
+    bool Uring::setup(unsigned int entries) noexcept{
+        struct io_uring_params  params;
+        memset(&params, 0, sizeof(params));
+
+        ringFd = sysSetup(entries, &params);
+        if(ringFd < 0)
+            return false;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cqRingSize = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+        if(params.features & IORING_FEAT_SINGLE_MMAP){
+            if(cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+            cqRingSize = sqRingSize;
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if(sqRing == MAP_FAILED)
+            return false;
+
+        cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing :
+                 mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if(cqRing == MAP_FAILED)
+            return false;
+
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void *sqeMap { mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES) };
+        if(sqeMap == MAP_FAILED)
+            return false;
+        sqes = static_cast<struct io_uring_sqe*>(sqeMap);
+
+        sqHead    = ringPtr<unsigned int>(sqRing, params.sq_off.head);
+        sqTail    = ringPtr<unsigned int>(sqRing, params.sq_off.tail);
+        sqArray   = ringPtr<unsigned int>(sqRing, params.sq_off.array);
+        sqMask    = *ringPtr<unsigned int>(sqRing, params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        cqHead    = ringPtr<unsigned int>(cqRing, params.cq_off.head);
+        cqTail    = ringPtr<unsigned int>(cqRing, params.cq_off.tail);
+        cqMask    = *ringPtr<unsigned int>(cqRing, params.cq_off.ring_mask);
+        cqes      = ringPtr<struct io_uring_cqe>(cqRing, params.cq_off.cqes);
+        localTail = flushedTail = *sqTail;
+
+        // Kernels without the probe interface (< 5.6) lack some opcodes we need anyway.
+        vector<char>  probeBuf(sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op), 0);
+        auto          *probe  { reinterpret_cast<struct io_uring_probe*>(probeBuf.data()) };
+
+        if(sysRegister(ringFd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+            return false;
+
+        for(unsigned int op = 0; op < IORING_OP_LAST && op <= probe->last_op; op++)
+            supported[op] = (probe->ops[op].flags & IO_URING_OP_SUPPORTED) ? 1 : 0;
+
+        return true;
+    }
+
+    bool Uring::supports(unsigned char opcode) const noexcept{
+        return opcode < IORING_OP_LAST && supported[opcode] != 0;
+    }
+
+    bool Uring::registerBuffers(const struct iovec* iov, unsigned int count) noexcept{
+        return sysRegister(ringFd, IORING_REGISTER_BUFFERS, iov, count) == 0;
+    }
+
+    struct io_uring_sqe* Uring::getSqe(void) noexcept{
+        unsigned int  head { __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) };
+
+        if(localTail - head >= sqEntries)
+            return nullptr;
+
+        struct io_uring_sqe  *sqe { &sqes[localTail & sqMask] };
+        sqArray[localTail & sqMask] = localTail & sqMask;
+        localTail++;
+
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    int Uring::submitAndWait(unsigned int waitNr) noexcept{
+        unsigned int  toSubmit { localTail - flushedTail };
+
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        flushedTail = localTail;
+
+        if(toSubmit == 0 && waitNr == 0)
+            return 0;
+
+        enterCalls++;
+        int  rc { sysEnter(ringFd, toSubmit, waitNr, waitNr != 0 ? IORING_ENTER_GETEVENTS : 0) };
+
+        return rc < 0 ? -errno : rc;
+    }
+
+    unsigned int Uring::reap(struct io_uring_cqe* out, unsigned int max) noexcept{
+        unsigned int  head  { *cqHead },
+                      tail  { __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) },
+                      count { 0 };
+
+        while(head != tail && count < max){
+            out[count++] = cqes[head & cqMask];
+            head++;
+        }
+
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    unsigned long long Uring::getEnterCalls(void) const noexcept{
+        return enterCalls;
+    }
+
+} // End namespace relay
+
+#endif
@@ -0,0 +1,75 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#ifdef SC_IOURING
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+namespace relay {
+
+// Minimal io_uring ring on raw syscalls: no liburing dependency.
+// Submissions are batched until submitAndWait(), completions are
+// reaped in bulk without entering the kernel.
+
+class Uring {
+    public:
+        Uring(void);
+        ~Uring(void);
+
+        Uring(const Uring&)                                                  = delete;
+        Uring& operator=(const Uring&)                                       = delete;
+
+        bool                  setup(unsigned int entries)                    noexcept;
+        bool                  supports(unsigned char opcode)     const       noexcept;
+        bool                  registerBuffers(const struct iovec* iov,
+                                              unsigned int count)            noexcept;
+        struct io_uring_sqe*  getSqe(void)                                   noexcept;
+        int                   submitAndWait(unsigned int waitNr)             noexcept;
+        unsigned int          reap(struct io_uring_cqe* out,
+                                   unsigned int max)                         noexcept;
+        unsigned long long    getEnterCalls(void)                const       noexcept;
+
+    private:
+        int                   ringFd;
+        void                  *sqRing,
+                              *cqRing;
+        size_t                sqRingSize,
+                              cqRingSize,
+                              sqesSize;
+        struct io_uring_sqe   *sqes;
+        struct io_uring_cqe   *cqes;
+        unsigned int          *sqHead,
+                              *sqTail,
+                              *sqArray,
+                              *cqHead,
+                              *cqTail,
+                              sqMask,
+                              cqMask,
+                              sqEntries,
+                              localTail,
+                              flushedTail;
+        unsigned char         supported[IORING_OP_LAST];
+        unsigned long long    enterCalls;
+};
+
+} // End namespace relay
+
+#endif
@@ -0,0 +1,523 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "utf8.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define UTF8_X86
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define UTF8_NEON
+#endif
+
+namespace utf8 {
+
+    using std::uint64_t;
+    using std::string;
+
+    namespace {
+
+        // The lookup validator (Keiser and Lemire, "Validating UTF-8 in less
+        // than one instruction per byte"): every error shows as a bit set in
+        // all three tables, indexed by the high and low nibble of the previous
+        // byte and the high nibble of the current one. Sequences longer than
+        // two bytes are checked apart, against the lead two and three bytes back.
+        const unsigned char  TOO_SHORT      { 1 << 0 },   // Lead or ASCII, then a lead
+                             TOO_LONG       { 1 << 1 },   // ASCII, then a continuation
+                             OVERLONG_3     { 1 << 2 },
+                             TOO_LARGE      { 1 << 3 },   // Beyond U+10FFFF
+                             SURROGATE      { 1 << 4 },
+                             OVERLONG_2     { 1 << 5 },
+                             TOO_LARGE_1000 { 1 << 6 },
+                             OVERLONG_4     { 1 << 6 },
+                             TWO_CONTS      { 1 << 7 },   // Unless a 3 or 4 byte lead expects it
+                             CARRY          { TOO_SHORT | TOO_LONG | TWO_CONTS };
+
+        const unsigned char  BYTE_1_HIGH[16] {
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            TOO_SHORT | OVERLONG_2,
+            TOO_SHORT,
+            TOO_SHORT | OVERLONG_3 | SURROGATE,
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+        };
+
+        const unsigned char  BYTE_1_LOW[16] {
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+            CARRY | OVERLONG_2,
+            CARRY,
+            CARRY,
+            CARRY | TOO_LARGE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000
+        };
+
+        const unsigned char  BYTE_2_HIGH[16] {
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+        };
+
+        // Above these, the last three bytes of a block lead a sequence the block doesn't finish.
+        const unsigned char  INCOMPLETE[32] {
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF
+        };
+
+        // The length a lead announces, valid or not, as toUtf16() reads it.
+        int seqLen(unsigned char lead) noexcept{
+            if((lead & 0xE0) == 0xC0) return 2;
+            if((lead & 0xF0) == 0xE0) return 3;
+            if((lead & 0xF8) == 0xF0) return 4;
+            return 1;
+        }
+
+        bool scalar(const unsigned char* in, size_t len) noexcept{
+            size_t  pos { 0 };
+
+            while(pos < len){
+                if(len - pos >= 8){
+                    uint64_t  word;
+                    std::memcpy(&word, in + pos, sizeof(word));
+                    if((word & 0x8080808080808080ULL) == 0){
+                        pos += 8;
+                        continue;
+                    }
+                }
+
+                unsigned char  lead { in[pos] },
+                               low  { 0x80 },
+                               high { 0xBF };
+                if(lead < 0x80){
+                    pos++;
+                    continue;
+                }
+
+                if(lead < 0xC2 || lead > 0xF4)
+                    return false;
+
+                size_t  need { static_cast<size_t>(seqLen(lead)) - 1 };
+                if(lead == 0xE0) low  = 0xA0;
+                if(lead == 0xED) high = 0x9F;
+                if(lead == 0xF0) low  = 0x90;
+                if(lead == 0xF4) high = 0x8F;
+
+                if(len - pos <= need || in[pos + 1] < low || in[pos + 1] > high)
+                    return false;
+                for(size_t idx = 2; idx <= need; idx++)
+                    if((in[pos + idx] & 0xC0) != 0x80)
+                        return false;
+
+                pos += need + 1;
+            }
+
+            return true;
+        }
+
+#ifdef UTF8_X86
+        __attribute__((target("ssse3")))
+        bool ssse3(const unsigned char* in, size_t len) noexcept{
+            const __m128i  byte1High  { _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH)) },
+                           byte1Low   { _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW)) },
+                           byte2High  { _mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH)) },
+                           incomplete { _mm_loadu_si128(reinterpret_cast<const __m128i*>(INCOMPLETE + 16)) },
+                           nibble     { _mm_set1_epi8(0x0F) },
+                           zero       { _mm_setzero_si128() };
+            __m128i        error      { zero },
+                           prev       { zero },
+                           prevIncomplete { zero };
+            unsigned char  tail[16];
+
+            for(size_t pos = 0; pos < len; pos += 16){
+                __m128i  input;
+                if(len - pos >= 16){
+                    input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos));
+                }else{
+                    std::memset(tail, 0, sizeof(tail));
+                    std::memcpy(tail, in + pos, len - pos);
+                    input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+                }
+
+                if(_mm_movemask_epi8(input) == 0){
+                    error          = _mm_or_si128(error, prevIncomplete);
+                    prevIncomplete = zero;
+                    prev           = input;
+                    continue;
+                }
+
+                __m128i  prev1 { _mm_alignr_epi8(input, prev, 15) },
+                         prev2 { _mm_alignr_epi8(input, prev, 14) },
+                         prev3 { _mm_alignr_epi8(input, prev, 13) },
+                         special { _mm_and_si128(_mm_and_si128(
+                                       _mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                                       _mm_shuffle_epi8(byte1Low,  _mm_and_si128(prev1, nibble))),
+                                       _mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble))) },
+                         must23  { _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+                                                _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)))) };
+
+                must23         = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+                error          = _mm_or_si128(error, _mm_xor_si128(must23, special));
+                prevIncomplete = _mm_subs_epu8(input, incomplete);
+                prev           = input;
+            }
+
+            error = _mm_or_si128(error, prevIncomplete);
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) == 0xFFFF;
+        }
+
+        __attribute__((target("avx2")))
+        bool avx2(const unsigned char* in, size_t len) noexcept{
+            const __m256i  byte1High  { _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_HIGH))) },
+                           byte1Low   { _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_1_LOW))) },
+                           byte2High  { _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(BYTE_2_HIGH))) },
+                           incomplete { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(INCOMPLETE)) },
+                           nibble     { _mm256_set1_epi8(0x0F) },
+                           zero       { _mm256_setzero_si256() };
+            __m256i        error      { zero },
+                           prev       { zero },
+                           prevIncomplete { zero };
+            unsigned char  tail[32];
+
+            for(size_t pos = 0; pos < len; pos += 32){
+                __m256i  input;
+                if(len - pos >= 32){
+                    input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + pos));
+                }else{
+                    std::memset(tail, 0, sizeof(tail));
+                    std::memcpy(tail, in + pos, len - pos);
+                    input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail));
+                }
+
+                if(_mm256_movemask_epi8(input) == 0){
+                    error          = _mm256_or_si256(error, prevIncomplete);
+                    prevIncomplete = zero;
+                    prev           = input;
+                    continue;
+                }
+
+                // The previous bytes cross the lane boundary: the upper half of prev joins the lower of input.
+                __m256i  shifted { _mm256_permute2x128_si256(prev, input, 0x21) },
+                         prev1   { _mm256_alignr_epi8(input, shifted, 15) },
+                         prev2   { _mm256_alignr_epi8(input, shifted, 14) },
+                         prev3   { _mm256_alignr_epi8(input, shifted, 13) },
+                         special { _mm256_and_si256(_mm256_and_si256(
+                                       _mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                                       _mm256_shuffle_epi8(byte1Low,  _mm256_and_si256(prev1, nibble))),
+                                       _mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble))) },
+                         must23  { _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+                                                   _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)))) };
+
+                must23         = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+                error          = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+                prevIncomplete = _mm256_subs_epu8(input, incomplete);
+                prev           = input;
+            }
+
+            error = _mm256_or_si256(error, prevIncomplete);
+            return _mm256_testz_si256(error, error) != 0;
+        }
+#endif
+
+#ifdef UTF8_NEON
+        bool neon(const unsigned char* in, size_t len) noexcept{
+            const uint8x16_t  byte1High  { vld1q_u8(BYTE_1_HIGH) },
+                              byte1Low   { vld1q_u8(BYTE_1_LOW) },
+                              byte2High  { vld1q_u8(BYTE_2_HIGH) },
+                              incomplete { vld1q_u8(INCOMPLETE + 16) },
+                              nibble     { vdupq_n_u8(0x0F) },
+                              zero       { vdupq_n_u8(0) };
+            uint8x16_t        error      { zero },
+                              prev       { zero },
+                              prevIncomplete { zero };
+            unsigned char     tail[16];
+
+            for(size_t pos = 0; pos < len; pos += 16){
+                uint8x16_t  input;
+                if(len - pos >= 16){
+                    input = vld1q_u8(in + pos);
+                }else{
+                    std::memset(tail, 0, sizeof(tail));
+                    std::memcpy(tail, in + pos, len - pos);
+                    input = vld1q_u8(tail);
+                }
+
+                if(vmaxvq_u8(input) < 0x80){
+                    error          = vorrq_u8(error, prevIncomplete);
+                    prevIncomplete = zero;
+                    prev           = input;
+                    continue;
+                }
+
+                uint8x16_t  prev1   { vextq_u8(prev, input, 15) },
+                            prev2   { vextq_u8(prev, input, 14) },
+                            prev3   { vextq_u8(prev, input, 13) },
+                            special { vandq_u8(vandq_u8(
+                                          vqtbl1q_u8(byte1High, vshrq_n_u8(prev1, 4)),
+                                          vqtbl1q_u8(byte1Low,  vandq_u8(prev1, nibble))),
+                                          vqtbl1q_u8(byte2High, vshrq_n_u8(input, 4))) },
+                            must23  { vorrq_u8(vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80)),
+                                               vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80))) };
+
+                must23         = vandq_u8(must23, vdupq_n_u8(0x80));
+                error          = vorrq_u8(error, veorq_u8(must23, special));
+                prevIncomplete = vqsubq_u8(input, incomplete);
+                prev           = input;
+            }
+
+            error = vorrq_u8(error, prevIncomplete);
+            return vmaxvq_u8(error) == 0;
+        }
+#endif
+
+        using Validator = bool (*)(const unsigned char*, size_t);
+
+        struct Choice {
+            Validator       fn;
+            const char      *name;
+        };
+
+        // UTF8_ENV can only step down, to compare the implementations on one CPU.
+        Choice pick(void) noexcept{
+            const char  *env  { getenv(UTF8_ENV) };
+            string       force { env != nullptr ? env : "" };
+
+            if(force == "scalar")
+                return { scalar, "scalar" };
+
+            #ifdef UTF8_X86
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2") && force != "ssse3")
+                    return { avx2, "avx2" };
+                if(__builtin_cpu_supports("ssse3"))
+                    return { ssse3, "ssse3" };
+            #endif
+            #ifdef UTF8_NEON
+                return { neon, "neon" };
+            #endif
+            return { scalar, "scalar" };
+        }
+
+        const Choice& chosen(void) noexcept{
+            static const Choice  choice { pick() };
+            return choice;
+        }
+
+        // Input already validated: no checks, ASCII runs widened 16 bytes at a time.
+        int transcode(const unsigned char* in, size_t len, char16_t* dst) noexcept{
+            size_t  pos { 0 };
+            int     out { 0 };
+
+            while(pos < len){
+                #if defined(__SSE2__)
+                    if(len - pos >= 16){
+                        __m128i  block { _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + pos)) };
+                        if(_mm_movemask_epi8(block) == 0){
+                            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + out),     _mm_unpacklo_epi8(block, _mm_setzero_si128()));
+                            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + out + 8), _mm_unpackhi_epi8(block, _mm_setzero_si128()));
+                            pos += 16;
+                            out += 16;
+                            continue;
+                        }
+                    }
+                #elif defined(UTF8_NEON)
+                    if(len - pos >= 16){
+                        uint8x16_t  block { vld1q_u8(in + pos) };
+                        if(vmaxvq_u8(block) < 0x80){
+                            vst1q_u16(reinterpret_cast<uint16_t*>(dst + out),     vmovl_u8(vget_low_u8(block)));
+                            vst1q_u16(reinterpret_cast<uint16_t*>(dst + out + 8), vmovl_high_u8(block));
+                            pos += 16;
+                            out += 16;
+                            continue;
+                        }
+                    }
+                #endif
+
+                unsigned int  lead { in[pos] },
+                              cp;
+                if(lead < 0x80){
+                    dst[out++] = static_cast<char16_t>(lead);
+                    pos++;
+                    continue;
+                }
+
+                if(lead < 0xE0){
+                    cp   = ((lead & 0x1F) << 6) | (in[pos + 1] & 0x3Fu);
+                    pos += 2;
+                }else if(lead < 0xF0){
+                    cp   = ((lead & 0x0F) << 12) | ((in[pos + 1] & 0x3Fu) << 6) | (in[pos + 2] & 0x3Fu);
+                    pos += 3;
+                }else{
+                    cp   = ((lead & 0x07) << 18) | ((in[pos + 1] & 0x3Fu) << 12) |
+                           ((in[pos + 2] & 0x3Fu) << 6) | (in[pos + 3] & 0x3Fu);
+                    pos += 4;
+                }
+
+                if(cp >= 0x10000){
+                    cp -= 0x10000;
+                    dst[out++] = static_cast<char16_t>(0xD800 + (cp >> 10));
+                    dst[out++] = static_cast<char16_t>(0xDC00 + (cp & 0x3FF));
+                }else{
+                    dst[out++] = static_cast<char16_t>(cp);
+                }
+            }
+
+            return out;
+        }
+
+    } // End anonymous namespace
+
+    bool validate(const char* src, size_t len) noexcept{
+        return chosen().fn(reinterpret_cast<const unsigned char*>(src), len);
+    }
+
+    bool validateScalar(const char* src, size_t len) noexcept{
+        return scalar(reinterpret_cast<const unsigned char*>(src), len);
+    }
+
+    const char* implementation(void) noexcept{
+        return chosen().name;
+    }
+
+    int toUtf16(const char* src, int len, char16_t* dst) noexcept{
+        const unsigned char  *in  { reinterpret_cast<const unsigned char*>(src) };
+        int                   pos { 0 },
+                              out { 0 };
+
+        while(pos < len){
+            unsigned int  lead { in[pos] },
+                          cp   { 0xFFFD },
+                          need { 0 },
+                          min  { 0 };
+
+            if(lead < 0x80){
+                dst[out++] = static_cast<char16_t>(lead);
+                pos++;
+                continue;
+            }
+
+            if((lead & 0xE0) == 0xC0)      { need = 1; min = 0x80;    cp = lead & 0x1F; }
+            else if((lead & 0xF0) == 0xE0) { need = 2; min = 0x800;   cp = lead & 0x0F; }
+            else if((lead & 0xF8) == 0xF0) { need = 3; min = 0x10000; cp = lead & 0x07; }
+
+            pos++;
+            unsigned int  got { 0 };
+            while(got < need && pos < len && (in[pos] & 0xC0) == 0x80){
+                cp = (cp << 6) | (in[pos] & 0x3F);
+                pos++;
+                got++;
+            }
+
+            if(need == 0 || got != need || cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+                cp = 0xFFFD;
+
+            if(cp >= 0x10000){
+                cp -= 0x10000;
+                dst[out++] = static_cast<char16_t>(0xD800 + (cp >> 10));
+                dst[out++] = static_cast<char16_t>(0xDC00 + (cp & 0x3FF));
+            }else{
+                dst[out++] = static_cast<char16_t>(cp);
+            }
+        }
+
+        return out;
+    }
+
+    Decoder::Decoder(void)
+        : pending{0, 0, 0, 0},
+          pendingLen{0}
+    {}
+
+    // A sequence left open by the last read is completed first; one this
+    // read leaves open waits for the next. The rest goes through at once.
+    int Decoder::decode(const char* src, int len, char16_t* dst) noexcept{
+        const unsigned char  *in  { reinterpret_cast<const unsigned char*>(src) };
+        int                   pos { 0 },
+                              out { 0 };
+
+        if(len <= 0)
+            return 0;
+
+        if(pendingLen > 0){
+            int  need { seqLen(pending[0]) };
+            while(pendingLen < need && pos < len && (in[pos] & 0xC0) == 0x80)
+                pending[pendingLen++] = in[pos++];
+            if(pendingLen < need && pos == len)
+                return 0;
+
+            // Broken by a byte that doesn't continue it: U+FFFD, as a whole read would give.
+            out        += toUtf16(reinterpret_cast<const char*>(pending), pendingLen, dst);
+            pendingLen  = 0;
+        }
+
+        int  end { len };
+        for(int back = 1; back <= UTF8_MAX_PENDING && len - back >= pos; back++){
+            unsigned char  byte { in[len - back] };
+            if((byte & 0xC0) == 0x80)
+                continue;
+            if(seqLen(byte) > back)
+                end = len - back;
+            break;
+        }
+
+        pendingLen = len - end;
+        std::memcpy(pending, in + end, static_cast<size_t>(pendingLen));
+
+        size_t  size { static_cast<size_t>(end - pos) };
+        if(validate(src + pos, size))
+            out += transcode(in + pos, size, dst + out);
+        else
+            out += toUtf16(src + pos, end - pos, dst + out);
+
+        return out;
+    }
+
+    // What is still held is a truncated code point: U+FFFD, as a whole read would give.
+    int Decoder::finish(char16_t* dst) noexcept{
+        int  out { toUtf16(reinterpret_cast<const char*>(pending), pendingLen, dst) };
+
+        pendingLen = 0;
+        return out;
+    }
+
+    void Decoder::reset(void) noexcept{
+        pendingLen = 0;
+    }
+
+    int Decoder::getPending(void) const noexcept{
+        return pendingLen;
+    }
+
+} // End namespace utf8
@@ -0,0 +1,61 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+
+#define UTF8_MAX_PENDING 3            // Bytes of an incomplete code point carried to the next read
+#define UTF8_ENV "SCUTF8"             // scalar or ssse3: overrides the validator the CPU allows
+
+namespace utf8 {
+
+// Well formed UTF-8: no overlong forms, surrogates or code points beyond
+// U+10FFFF, nothing truncated at the end. validate() is vectorized where
+// the CPU allows it, AVX2 or SSSE3 chosen at run time on x86, NEON on
+// AArch64; implementation() tells which one runs.
+bool         validate(const char* src, size_t len)                           noexcept;
+bool         validateScalar(const char* src, size_t len)                     noexcept;
+const char*  implementation(void)                                            noexcept;
+
+// UTF-8 to UTF-16 without allocating: dst needs room for len code units.
+// Malformed sequences become U+FFFD. Returns the code units written.
+int          toUtf16(const char* src, int len, char16_t* dst)                noexcept;
+
+// Decodes a byte stream read in pieces: a code point split between two
+// reads is held back and completed by the next one, instead of turning
+// into two U+FFFD. Valid input takes the vectorized path. finish() ends
+// a message, so a code point it leaves open isn't carried into the next.
+
+class Decoder {
+    public:
+        Decoder(void);
+
+        // dst needs room for len + UTF8_MAX_PENDING code units.
+        int             decode(const char* src, int len, char16_t* dst)      noexcept;
+        // dst needs room for UTF8_MAX_PENDING code units.
+        int             finish(char16_t* dst)                                noexcept;
+        void            reset(void)                                          noexcept;
+        int             getPending(void)                         const       noexcept;
+
+    private:
+        unsigned char   pending[UTF8_MAX_PENDING + 1];
+        int             pendingLen;
+};
+
+} // End namespace utf8
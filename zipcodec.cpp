@@ -0,0 +1,209 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#include "zipcodec.h"
+
+#include <fstream>
+#include <iterator>
+
+#include "stats.h"
+
+namespace zipcodec {
+
+    using std::string;
+    using std::to_string;
+    using std::ifstream;
+    using std::istreambuf_iterator;
+
+    using stats::nowUs;
+
+    // Recurring tokens of chat pastes: JSON keys, log levels and timestamps.
+    static const char builtinDict[] {
+        "Traceback (most recent call last):\n  File \"\", line , in \n"
+        "Exception in thread \"main\" java.lang.NullPointerException\n\tat "
+        "<html><head></head><body><div class=\"\"></div></body></html>"
+        "SELECT * FROM  WHERE  ORDER BY  LIMIT ;"
+        "\"id\": , \"name\": \"\", \"type\": \"\", \"status\": \"\", \"value\": , "
+        "\"enabled\": true, \"count\": , \"error\": null, \"data\": [], \"items\": [{"
+        "\"created_at\": \"2019-\", \"updated_at\": \"2019-\", \"message\": \""
+        "{\"timestamp\": \"2019-T:.000Z\", \"level\": \"info\", \"msg\": \""
+        " DEBUG  [main] \n2019- INFO  [main] \n2019- WARN  [main] \n2019- ERROR [main] \n"
+        "Oct  localhost kernel: [ ] \nOct  localhost systemd[1]: Started \n"
+        "http://https://www..com/api/v1/ HTTP/1.1\" 200 GET /POST /"
+    };
+
+    Codec::Codec(void)
+        : deflater{},
+          inflater{},
+          ready{false},
+          dictId{0},
+          zipIn{0},
+          zipOut{0},
+          rawOut{0},
+          fallbacks{0},
+          deflateUs{0},
+          inflateUs{0},
+          unzipIn{0},
+          unzipOut{0},
+          errors{0}
+    {}
+
+    Codec::~Codec(void){
+        if(ready){
+            static_cast<void>(deflateEnd(&deflater));
+            static_cast<void>(inflateEnd(&inflater));
+        }
+    }
+
+    // Raw deflate streams: no header or checksum, the peers agree on the dictionary id.
+    bool Codec::setDictionary(const string& dict) noexcept{
+        if(ready || dict.empty())
+            return false;
+
+        try{
+            dictionary = dict.size() > ZIP_DICT_MAX ? dict.substr(dict.size() - ZIP_DICT_MAX) : dict;
+        }catch(...){
+            return false;
+        }
+
+        if(deflateInit2(&deflater, ZIP_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        if(inflateInit2(&inflater, -MAX_WBITS) != Z_OK){
+            static_cast<void>(deflateEnd(&deflater));
+            return false;
+        }
+
+        dictId = adler32(adler32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(dictionary.data()),
+                         static_cast<uInt>(dictionary.size()));
+        ready  = true;
+
+        return true;
+    }
+
+    unsigned long Codec::getDictId(void) const noexcept{
+        return dictId;
+    }
+
+    // False when the output doesn't fit outLen or isn't smaller than the input.
+    bool Codec::compress(const char* in, size_t inLen, char* out, size_t& outLen) noexcept{
+        if(!ready)
+            return false;
+
+        long long  start { nowUs() };
+        bool       ok    { false };
+
+        if(deflateReset(&deflater) == Z_OK &&
+           deflateSetDictionary(&deflater, reinterpret_cast<const Bytef*>(dictionary.data()),
+                                static_cast<uInt>(dictionary.size())) == Z_OK){
+            deflater.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+            deflater.avail_in  = static_cast<uInt>(inLen);
+            deflater.next_out  = reinterpret_cast<Bytef*>(out);
+            deflater.avail_out = static_cast<uInt>(outLen);
+
+            ok = deflate(&deflater, Z_FINISH) == Z_STREAM_END && deflater.total_out < inLen;
+        }
+
+        deflateUs += static_cast<unsigned long long>(nowUs() - start);
+        if(!ok){
+            fallbacks++;
+            return false;
+        }
+
+        outLen  = deflater.total_out;
+        zipIn  += inLen;
+        zipOut += outLen;
+
+        return true;
+    }
+
+    bool Codec::decompress(const char* in, size_t inLen, char* out, size_t& outLen) noexcept{
+        if(!ready)
+            return false;
+
+        long long  start { nowUs() };
+        bool       ok    { false };
+
+        if(inflateReset(&inflater) == Z_OK &&
+           inflateSetDictionary(&inflater, reinterpret_cast<const Bytef*>(dictionary.data()),
+                                static_cast<uInt>(dictionary.size())) == Z_OK){
+            inflater.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+            inflater.avail_in  = static_cast<uInt>(inLen);
+            inflater.next_out  = reinterpret_cast<Bytef*>(out);
+            inflater.avail_out = static_cast<uInt>(outLen);
+
+            ok = inflate(&inflater, Z_FINISH) == Z_STREAM_END;
+        }
+
+        inflateUs += static_cast<unsigned long long>(nowUs() - start);
+        if(!ok){
+            errors++;
+            return false;
+        }
+
+        outLen    = inflater.total_out;
+        unzipIn  += inLen;
+        unzipOut += outLen;
+
+        return true;
+    }
+
+    void Codec::countRaw(size_t len) noexcept{
+        rawOut += len;
+    }
+
+    string Codec::getStats(void) const noexcept{
+        string  res;
+
+        try{
+            unsigned long long  payload { zipIn + rawOut },
+                                wire    { zipOut + rawOut };
+            double              ratio   { wire == 0 ? 1.0 : static_cast<double>(payload) / static_cast<double>(wire) };
+
+            res.append("Compression - dictionary: ").append(to_string(dictionary.size()))
+               .append(" bytes, sent: ").append(to_string(payload)).append(" -> ").append(to_string(wire))
+               .append(" ratio: ").append(to_string(ratio))
+               .append(" fallbacks: ").append(to_string(fallbacks))
+               .append(" deflate: ").append(to_string(deflateUs)).append(" us")
+               .append(" received: ").append(to_string(unzipIn)).append(" -> ").append(to_string(unzipOut))
+               .append(" inflate: ").append(to_string(inflateUs)).append(" us")
+               .append(" errors: ").append(to_string(errors));
+        }catch(...){
+            res = "getStats error.";
+        }
+
+        return res;
+    }
+
+    string loadDictionary(const char* path) noexcept{
+        string  dict;
+
+        try{
+            if(path != nullptr && *path != 0){
+                ifstream  file(path, std::ios::binary);
+                dict.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+            }
+            if(dict.empty())
+                dict.assign(builtinDict, sizeof(builtinDict) - 1);
+        }catch(...){
+            dict.clear();
+        }
+
+        return dict;
+    }
+
+} // End namespace zipcodec
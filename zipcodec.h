@@ -0,0 +1,74 @@
+// -----------------------------------------------------------------
+// securechat_qt - an encrypted chat using OpenSSL, with a QT interface
+// Copyright (C) 2019  Gabriele Bonacini
+//
+// This program is free software for no profit use; you can redistribute
+// it and/or modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2 of
+// the License, or (at your option) any later version.
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// A commercial license is also available for a lucrative use.
+// -----------------------------------------------------------------
+
+#pragma once
+
+#include <zlib.h>
+
+#include <atomic>
+#include <string>
+
+#define ZIP_DICT_MAX 32768            // Deflate window: older dictionary bytes are never referenced
+#define ZIP_LEVEL 6
+
+namespace zipcodec {
+
+// Stateless per-message deflate with a preset dictionary shared by both
+// peers: every message is compressed on its own, so it can only refer to
+// itself and to the dictionary, never to earlier traffic. The dictionary is
+// a sample of typical payloads (log lines, JSON), most frequent content last:
+// tools/zdict trains one on real messages, the built-in one is only generic.
+
+class Codec {
+    public:
+        Codec(void);
+        ~Codec(void);
+
+        Codec(const Codec&)                                                  = delete;
+        Codec& operator=(const Codec&)                                       = delete;
+
+        bool                setDictionary(const std::string& dict)           noexcept;
+        unsigned long       getDictId(void)                      const       noexcept;
+        bool                compress(const char* in, size_t inLen,
+                                     char* out, size_t& outLen)              noexcept;
+        bool                decompress(const char* in, size_t inLen,
+                                       char* out, size_t& outLen)            noexcept;
+        void                countRaw(size_t len)                             noexcept;
+        std::string         getStats(void)                       const       noexcept;
+
+    private:
+        z_stream                        deflater,
+                                        inflater;
+        bool                            ready;
+        std::string                     dictionary;
+        unsigned long                   dictId;
+        std::atomic<unsigned long long> zipIn,              // Payload bytes sent compressed
+                                        zipOut,             // and their compressed size
+                                        rawOut,             // Payload bytes sent as they were
+                                        fallbacks,          // compress() calls that didn't pay off
+                                        deflateUs,
+                                        inflateUs,
+                                        unzipIn,
+                                        unzipOut,
+                                        errors;
+};
+
+// The SCZDICT file, or a built-in sample when it isn't set or readable.
+std::string  loadDictionary(const char* path)                                noexcept;
+
+} // End namespace zipcodec